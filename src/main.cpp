@@ -31,6 +31,7 @@ namespace nhahn
 	std::shared_ptr<IEffect> _attractorEffect;
 	std::shared_ptr<IEffect> _fountainEffect;
 	std::shared_ptr<IEffect> _burningEffect;
+	std::shared_ptr<IEffect> _verletEffect;
 
 	void splitDockspace()
 	{
@@ -88,33 +89,44 @@ int main()
 		sceneView = std::make_unique<SceneView>(displayTex);
 		propertyPanel = std::make_unique<PropertyPanel>();
 
-		// particle effects
+		// particle effects, "auto" measures the upload paths on the first start and caches the fastest
 		_tunnelEffect = EffectFactory::create("tunnel");
 		_tunnelEffect->initialize(200000);
-		_tunnelEffect->initializeRenderer("gl");
+		_tunnelEffect->initializeRenderer("auto");
 
 		_attractorEffect = EffectFactory::create("attractors");
 		_attractorEffect->initialize(100000);
-		_attractorEffect->initializeRenderer("gl");
+		_attractorEffect->initializeRenderer("auto");
 
 		_fountainEffect = EffectFactory::create("fountain");
 		_fountainEffect->initialize(IEffect::DEFAULT_PARTICLE_NUM_FLAG);
-		_fountainEffect->initializeRenderer("gl");
+		_fountainEffect->initializeRenderer("auto");
 
 		_burningEffect = EffectFactory::create("burning");
 		_burningEffect->initialize(200000);
-		_burningEffect->initializeRenderer("gl");
+		_burningEffect->initializeRenderer("auto");
+
+		_verletEffect = EffectFactory::create("verlet");
+		_verletEffect->initialize(IEffect::DEFAULT_PARTICLE_NUM_FLAG);
+		_verletEffect->initializeRenderer("gl");
 
 		sceneView->setEffect(_fountainEffect.get());
 		propertyPanel->addEffect("Fountain", _fountainEffect);
 		propertyPanel->addEffect("Attractor", _attractorEffect);
 		propertyPanel->addEffect("Tunnel", _tunnelEffect);
 		propertyPanel->addEffect("Burning", _burningEffect);
+		propertyPanel->addEffect("Verlet", _verletEffect);
 
 		// notify scene view when settings change
 		propertyPanel->setEffectSwitchedCallback([](std::shared_ptr<IEffect> eff) {
 			sceneView->setEffect(eff.get());
 		});
+		propertyPanel->setBlendModeChangedCallback([](BlendMode mode) {
+			sceneView->setBlendMode(mode);
+		});
+		propertyPanel->setOverdrawChangedCallback([](bool enabled) {
+			sceneView->setOverdrawView(enabled);
+		});
 
 		// run main loop
 		app.run();
@@ -123,6 +135,7 @@ int main()
 		_fountainEffect->clean();
 		_attractorEffect->clean();
 		_burningEffect->clean();
+		_verletEffect->clean();
 
 		propertyPanel.reset();
 		sceneView.reset();
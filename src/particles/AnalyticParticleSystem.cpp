@@ -0,0 +1,529 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "AnalyticParticleSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <string.h>
+#include <string>
+#include <immintrin.h>
+#include <GL/glew.h>
+#include "render/Shader.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+
+
+namespace nhahn
+{
+	// the age of an unused slot overflows every lifetime, see particles_analytic.inc
+	static const float DEAD_TIME = -FLT_MAX;
+	static const float ENDLESS_LIFETIME = 3.0e38f;
+	static const int MAX_BOUNCES = 4;
+	static const size_t MAX_PROBES_PER_SPAWN = 4;
+	static const float TAU = 6.28318531f;		// the same as common.inc
+
+	// the EulerUpdater scales the global acceleration by dt once more, the closed form needs a
+	// constant one and takes the value of a 60 fps step
+	static const float NOMINAL_DT = 1.0f / 60.0f;
+
+	// the random numbers are drawn in the same order and with the same hash as in particles_analytic.inc
+	static inline uint32_t hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	static inline uint32_t seedOf(size_t slot, float spawnTime)
+	{
+		uint32_t bits;
+		memcpy(&bits, &spawnTime, sizeof(bits));
+		return hash((uint32_t)slot ^ hash(bits));
+	}
+
+	static inline float randFloat(uint32_t& state, float a, float b)
+	{
+		state = hash(state);
+		return a + (b - a) * ((float)(state >> 8) * (1.0f / 16777216.0f));
+	}
+
+	static inline __m128i hash4(__m128i x)
+	{
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		x = _mm_mullo_epi32(x, _mm_set1_epi32(0x7feb352d));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+		x = _mm_mullo_epi32(x, _mm_set1_epi32((int)0x846ca68bu));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		return x;
+	}
+
+	static inline __m128 rand4(__m128i& state, float a, float b)
+	{
+		state = hash4(state);
+		const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(state, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+		return _mm_add_ps(_mm_set1_ps(a), _mm_mul_ps(_mm_set1_ps(b - a), t));
+	}
+
+	static inline __m128 mix4(__m128 a, __m128 b, __m128 t)
+	{
+		return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+	}
+
+	// height above the floor after t seconds, every bounce launches with the impact speed scaled by
+	// the bounce factor like the FloorUpdater does. The particles rest after MAX_BOUNCES bounces
+	static inline __m128 bounceHeight4(__m128 h0, __m128 u, __m128 t, float g, float bounceFactor)
+	{
+		const __m128 g4 = _mm_set1_ps(g);
+		const __m128 halfG = _mm_set1_ps(0.5f * g);
+		const __m128 bounce = _mm_set1_ps(bounceFactor);
+
+		h0 = _mm_max_ps(h0, _mm_setzero_ps());
+		const __m128 impactSpeed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(_mm_set1_ps(2.0f * g), h0)));
+		const __m128 impact = _mm_div_ps(_mm_add_ps(u, impactSpeed), g4);
+
+		__m128 height = _mm_sub_ps(_mm_add_ps(h0, _mm_mul_ps(u, t)), _mm_mul_ps(halfG, _mm_mul_ps(t, t)));
+		__m128 done = _mm_cmplt_ps(t, impact);
+
+		__m128 launch = _mm_mul_ps(impactSpeed, bounce);
+		t = _mm_sub_ps(t, impact);
+		for (int b = 0; b < MAX_BOUNCES; ++b)
+		{
+			const __m128 flight = _mm_div_ps(_mm_add_ps(launch, launch), g4);
+			const __m128 inFlight = _mm_andnot_ps(done, _mm_cmplt_ps(t, flight));
+			const __m128 flightHeight = _mm_sub_ps(_mm_mul_ps(launch, t), _mm_mul_ps(halfG, _mm_mul_ps(t, t)));
+			height = _mm_blendv_ps(height, flightHeight, inFlight);
+			done = _mm_or_ps(done, inFlight);
+
+			t = _mm_sub_ps(t, flight);
+			launch = _mm_mul_ps(launch, bounce);
+		}
+
+		return _mm_and_ps(height, done);
+	}
+
+	// out of line, the header only forward declares Shader
+	AnalyticParticleSystem::AnalyticParticleSystem() { }
+	AnalyticParticleSystem::~AnalyticParticleSystem() { destroy(); }
+
+	bool AnalyticParticleSystem::generate(ParticleSystem* sys)
+	{
+		ASSERT(sys != nullptr, "AnalyticParticleSystem: particle system is null");
+
+		destroy();
+		collectStages(sys);
+		if (!m_emitter)
+		{
+			DBG("AnalyticParticleSystem", DebugLevel::WARNING, "the particle system has no emitter\n");
+			return false;
+		}
+
+		m_count = sys->numAllParticles();
+		m_records.resize((m_count + 3) & ~(size_t)3);
+
+		// particles.vert evaluates the particles when the include defines ANALYTIC_PARTICLES
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_shader = std::make_unique<Shader>();
+		ShaderObject* frag = m_shader->addObject();
+		for (const char* file : { "common.inc", "particles.frag" })
+			frag->addFile((path + file).c_str());
+		frag->compile(FRAGMENT_SHADER);
+		ShaderObject* vert = m_shader->addObject();
+		for (const char* file : { "common.inc", "particles_analytic.inc", "particles.vert" })
+			vert->addFile((path + file).c_str());
+		vert->compile(VERTEX_SHADER);
+		m_shader->link();
+
+		glGenBuffers(1, &m_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		glBufferData(GL_ARRAY_BUFFER, m_count * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+
+		// the spawn record takes the place of the position, the color is not used
+		glGenVertexArrays(1, &m_vao);
+		glBindVertexArray(m_vao);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), nullptr);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		reset();
+		return true;
+	}
+
+	void AnalyticParticleSystem::destroy()
+	{
+		if (m_buffer != 0)
+			glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+
+		if (m_vao != 0)
+			glDeleteVertexArrays(1, &m_vao);
+		m_vao = 0;
+
+		m_shader.reset();
+		m_records.clear();
+		m_batches.clear();
+		m_count = 0;
+		m_countAlive = 0;
+	}
+
+	void AnalyticParticleSystem::collectStages(ParticleSystem* sys)
+	{
+		m_emitter.reset();
+		m_boxPos.reset();
+		m_roundPos.reset();
+		m_vel.reset();
+		m_color.reset();
+		m_timeGen.reset();
+		m_timeUpdater.reset();
+		m_colorUpdater.reset();
+		m_eulerUpdater.reset();
+		m_floorUpdater.reset();
+		m_skippedStages = 0;
+
+		// one emitter, the others would need their own seeds
+		for (const auto& emitter : sys->emitters())
+		{
+			if (m_emitter)
+			{
+				m_skippedStages++;
+				continue;
+			}
+
+			m_emitter = emitter;
+			for (const auto& gen : emitter->generators())
+			{
+				if (auto box = std::dynamic_pointer_cast<BoxPosGen>(gen)) m_boxPos = box;
+				else if (auto round = std::dynamic_pointer_cast<RoundPosGen>(gen)) m_roundPos = round;
+				else if (auto vel = std::dynamic_pointer_cast<BasicVelGen>(gen)) m_vel = vel;
+				else if (auto color = std::dynamic_pointer_cast<BasicColorGen>(gen)) m_color = color;
+				else if (auto time = std::dynamic_pointer_cast<BasicTimeGen>(gen)) m_timeGen = time;
+				else
+					m_skippedStages++;
+			}
+		}
+
+		for (const auto& up : sys->updaters())
+		{
+			if (auto time = std::dynamic_pointer_cast<BasicTimeUpdater>(up)) m_timeUpdater = time;
+			else if (auto color = std::dynamic_pointer_cast<BasicColorUpdater>(up)) m_colorUpdater = color;
+			else if (auto euler = std::dynamic_pointer_cast<EulerUpdater>(up)) m_eulerUpdater = euler;
+			else if (auto floor = std::dynamic_pointer_cast<FloorUpdater>(up)) m_floorUpdater = floor;
+			else
+				m_skippedStages++;
+		}
+
+		if (m_skippedStages > 0)
+			DBG("AnalyticParticleSystem", DebugLevel::DEBUG, "%d stages have no closed form, they are skipped\n", (int)m_skippedStages);
+	}
+
+	AnalyticParticleSystem::Params AnalyticParticleSystem::currentParams() const
+	{
+		Params params;
+		if (m_roundPos)
+		{
+			params.shape = Shape::ROUND;
+			params.posExtent = glm::vec4(m_roundPos->m_radX, m_roundPos->m_radY, 0.0f, 0.0f);
+		}
+		else if (m_boxPos)
+		{
+			params.posExtent = m_boxPos->m_maxStartPosOffset;
+		}
+
+		if (m_vel)
+		{
+			params.minVel = m_vel->m_minStartVel;
+			params.maxVel = m_vel->m_maxStartVel;
+		}
+
+		if (m_color)
+		{
+			params.minStartCol = m_color->m_minStartCol;
+			params.maxStartCol = m_color->m_maxStartCol;
+			params.minEndCol = m_color->m_minEndCol;
+			params.maxEndCol = m_color->m_maxEndCol;
+		}
+		params.colorEnabled = m_color && m_colorUpdater;
+
+		if (m_timeGen)
+		{
+			params.minTime = m_timeGen->m_minTime;
+			params.maxTime = m_timeGen->m_maxTime;
+		}
+		params.timeEnabled = m_timeGen && m_timeUpdater;
+
+		if (m_eulerUpdater)
+			params.acceleration = glm::vec4(glm::vec3(m_eulerUpdater->m_globalAcceleration) * NOMINAL_DT, 0.0f);
+
+		// only a falling particle ever reaches the floor again
+		params.floorEnabled = m_floorUpdater && params.acceleration.y < 0.0f;
+		if (m_floorUpdater)
+		{
+			params.floorY = m_floorUpdater->m_floorY;
+			params.bounceFactor = std::min(std::max(m_floorUpdater->m_bounceFactor, 0.0f), 1.0f);
+		}
+
+		return params;
+	}
+
+	void AnalyticParticleSystem::reset()
+	{
+		std::fill(m_records.begin(), m_records.end(), glm::vec4(0.0f, 0.0f, 0.0f, DEAD_TIME));
+		uploadRecords(0, m_count);
+
+		m_head = 0;
+		m_time = 0.0;
+		m_batches.clear();
+		m_countAlive = 0;
+	}
+
+	bool AnalyticParticleSystem::isAlive(size_t slot, const Params& params) const
+	{
+		const float spawnTime = m_records[slot].w;
+		uint32_t state = seedOf(slot, spawnTime);
+		const float lifetime = randFloat(state, params.minTime, params.maxTime);
+		const float age = (float)m_time - spawnTime;
+		return age < (params.timeEnabled ? lifetime : ENDLESS_LIFETIME);
+	}
+
+	void AnalyticParticleSystem::update(double dt)
+	{
+		if (m_count == 0 || !m_shader)
+			return;
+
+		m_time += dt;
+		const Params params = currentParams();
+		const glm::vec4 center = m_roundPos ? m_roundPos->m_center : (m_boxPos ? m_boxPos->m_pos : glm::vec4(0.0f));
+		const glm::vec4 record{ center.x, center.y, center.z, (float)m_time };
+
+		// a slot is only reused once its particle died. The ring holds the particles roughly by age,
+		// so the few that outlive the slots ahead are stepped over. When too many of them follow
+		// each other the ring is full and the rest is dropped, like the cpu system does
+		const size_t wanted = std::min((size_t)(dt * m_emitter->m_emitRate), m_count);
+		const size_t maxProbes = std::min(MAX_PROBES_PER_SPAWN * wanted, m_count);
+		const size_t first = m_head;
+		size_t spawned = 0, probes = 0;
+		for (; spawned < wanted && probes < maxProbes; ++probes)
+		{
+			const size_t slot = (first + probes) % m_count;
+			if (isAlive(slot, params))
+				continue;
+			m_records[slot] = record;
+			spawned++;
+		}
+
+		m_head = (first + probes) % m_count;
+		uploadRecords(first, probes);
+
+		if (spawned > 0)
+			m_batches.push_back({ m_time, spawned });
+		estimateAlive();
+	}
+
+	void AnalyticParticleSystem::uploadRecords(size_t first, size_t count)
+	{
+		if (count == 0 || m_buffer == 0)
+			return;
+
+		// the range may wrap around the end of the ring
+		const size_t tail = std::min(count, m_count - first);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec4), tail * sizeof(glm::vec4), &m_records[first]);
+		if (count > tail)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, (count - tail) * sizeof(glm::vec4), &m_records[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void AnalyticParticleSystem::estimateAlive()
+	{
+		const Params params = currentParams();
+		if (!params.timeEnabled)
+		{
+			size_t spawned = 0;
+			for (const SpawnBatch& batch : m_batches)
+				spawned += batch.count;
+			m_batches.clear();
+			m_batches.push_back({ m_time, std::min(spawned, m_count) });
+			m_countAlive = m_batches.back().count;
+			return;
+		}
+
+		while (!m_batches.empty() && m_time - m_batches.front().time >= params.maxTime)
+			m_batches.pop_front();
+
+		// the lifetimes are uniform in [minTime, maxTime]
+		const double range = std::max((double)params.maxTime - (double)params.minTime, 1e-6);
+		double alive = 0.0;
+		for (const SpawnBatch& batch : m_batches)
+		{
+			const double age = m_time - batch.time;
+			alive += (double)batch.count * std::min(std::max((params.maxTime - age) / range, 0.0), 1.0);
+		}
+		m_countAlive = std::min((size_t)alive, m_count);
+	}
+
+	void AnalyticParticleSystem::setView(const ScenePass& pass)
+	{
+		m_pass = pass;
+	}
+
+	void AnalyticParticleSystem::render()
+	{
+		if (m_vao == 0)
+			return;
+
+		// the particle texture and the pass of the SceneView, the program it bound is restored after the draw
+		GLint program = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+		const Params params = currentParams();
+		m_shader->bind();
+		m_shader->setUniformI("tex", m_pass.texUnit);
+		m_shader->setUniformI("oitPass", m_pass.weightedOit ? 1 : 0);
+		m_shader->setUniformI("overdrawPass", m_pass.overdraw ? 1 : 0);
+		m_shader->setUniformMat("modelViewMat", m_pass.viewMat, false);
+		m_shader->setUniformMat("projectionMat", m_pass.projMat, false);
+		m_shader->setUniformF("time", (float)m_time);
+		m_shader->setUniformI("posShape", (int)params.shape);
+		m_shader->setUniformF("posExtent", params.posExtent);
+		m_shader->setUniformF("minVel", params.minVel);
+		m_shader->setUniformF("maxVel", params.maxVel);
+		m_shader->setUniformI("colorEnabled", params.colorEnabled ? 1 : 0);
+		m_shader->setUniformF("minStartCol", params.minStartCol);
+		m_shader->setUniformF("maxStartCol", params.maxStartCol);
+		m_shader->setUniformF("minEndCol", params.minEndCol);
+		m_shader->setUniformF("maxEndCol", params.maxEndCol);
+		m_shader->setUniformI("timeEnabled", params.timeEnabled ? 1 : 0);
+		m_shader->setUniformF("minTime", params.minTime);
+		m_shader->setUniformF("maxTime", params.maxTime);
+		m_shader->setUniformF("acceleration", params.acceleration);
+		m_shader->setUniformI("floorEnabled", params.floorEnabled ? 1 : 0);
+		m_shader->setUniformF("floorY", params.floorY);
+		m_shader->setUniformF("bounceFactor", params.bounceFactor);
+
+		glBindVertexArray(m_vao);
+		glDrawArrays(GL_POINTS, 0, (GLsizei)m_count);
+		glBindVertexArray(0);
+
+		glUseProgram(program);
+	}
+
+	size_t AnalyticParticleSystem::evaluate(std::vector<glm::vec4>& pos, std::vector<glm::vec4>& col) const
+	{
+		pos.clear();
+		col.clear();
+
+		const Params params = currentParams();
+		const float now = (float)m_time;
+		const __m128 now4 = _mm_set1_ps(now);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		alignas(16) glm::vec4 lanePos[4];
+		alignas(16) glm::vec4 laneCol[4];
+
+		// four particles per register, the records are padded with dead ones
+		for (size_t i = 0; i < m_count; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(&m_records[i].x);
+			__m128 cy = _mm_loadu_ps(&m_records[i + 1].x);
+			__m128 cz = _mm_loadu_ps(&m_records[i + 2].x);
+			__m128 spawnTime = _mm_loadu_ps(&m_records[i + 3].x);
+			_MM_TRANSPOSE4_PS(cx, cy, cz, spawnTime);
+
+			const __m128i slots = _mm_setr_epi32((int)i, (int)i + 1, (int)i + 2, (int)i + 3);
+			__m128i state = hash4(_mm_xor_si128(slots, hash4(_mm_castps_si128(spawnTime))));
+
+			const __m128 age = _mm_sub_ps(now4, spawnTime);
+			__m128 lifetime = rand4(state, params.minTime, params.maxTime);
+			if (!params.timeEnabled)
+				lifetime = _mm_set1_ps(ENDLESS_LIFETIME);
+
+			const int alive = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(age, _mm_setzero_ps()), _mm_cmplt_ps(age, lifetime)));
+			if (alive == 0)
+				continue;
+
+			// start position
+			const __m128 rx = rand4(state, 0.0f, 1.0f);
+			const __m128 ry = rand4(state, 0.0f, 1.0f);
+			const __m128 rz = rand4(state, 0.0f, 1.0f);
+			__m128 ox, oy, oz;
+			if (params.shape == Shape::BOX)
+			{
+				const glm::vec4& e = params.posExtent;
+				ox = _mm_add_ps(cx, mix4(_mm_set1_ps(-e.x), _mm_set1_ps(e.x), rx));
+				oy = _mm_add_ps(cy, mix4(_mm_set1_ps(-e.y), _mm_set1_ps(e.y), ry));
+				oz = _mm_add_ps(cz, mix4(_mm_set1_ps(-e.z), _mm_set1_ps(e.z), rz));
+			}
+			else
+			{
+				alignas(16) float angle[4], sinAngle[4], cosAngle[4];
+				_mm_store_ps(angle, _mm_mul_ps(rx, _mm_set1_ps(TAU)));
+				for (int l = 0; l < 4; ++l)
+				{
+					sinAngle[l] = sinf(angle[l]);
+					cosAngle[l] = cosf(angle[l]);
+				}
+				ox = _mm_add_ps(cx, _mm_mul_ps(_mm_set1_ps(params.posExtent.x), _mm_load_ps(sinAngle)));
+				oy = _mm_add_ps(cy, _mm_mul_ps(_mm_set1_ps(params.posExtent.y), _mm_load_ps(cosAngle)));
+				oz = cz;
+			}
+
+			// colors
+			__m128 startCol[4], endCol[4];
+			for (int c = 0; c < 4; ++c)
+				startCol[c] = rand4(state, params.minStartCol[c], params.maxStartCol[c]);
+			for (int c = 0; c < 4; ++c)
+				endCol[c] = rand4(state, params.minEndCol[c], params.maxEndCol[c]);
+
+			// ballistic flight from the start position
+			const __m128 vx = rand4(state, params.minVel.x, params.maxVel.x);
+			const __m128 vy = rand4(state, params.minVel.y, params.maxVel.y);
+			const __m128 vz = rand4(state, params.minVel.z, params.maxVel.z);
+			const __m128 halfAgeSq = _mm_mul_ps(half, _mm_mul_ps(age, age));
+			__m128 px = _mm_add_ps(ox, _mm_add_ps(_mm_mul_ps(vx, age), _mm_mul_ps(_mm_set1_ps(params.acceleration.x), halfAgeSq)));
+			__m128 py = _mm_add_ps(oy, _mm_add_ps(_mm_mul_ps(vy, age), _mm_mul_ps(_mm_set1_ps(params.acceleration.y), halfAgeSq)));
+			__m128 pz = _mm_add_ps(oz, _mm_add_ps(_mm_mul_ps(vz, age), _mm_mul_ps(_mm_set1_ps(params.acceleration.z), halfAgeSq)));
+			if (params.floorEnabled)
+			{
+				const __m128 floorY = _mm_set1_ps(params.floorY);
+				py = _mm_add_ps(floorY, bounceHeight4(_mm_sub_ps(oy, floorY), vy, age, -params.acceleration.y, params.bounceFactor));
+			}
+			__m128 pw = one;
+			_MM_TRANSPOSE4_PS(px, py, pz, pw);
+			_mm_store_ps(&lanePos[0].x, px);
+			_mm_store_ps(&lanePos[1].x, py);
+			_mm_store_ps(&lanePos[2].x, pz);
+			_mm_store_ps(&lanePos[3].x, pw);
+
+			const __m128 t = _mm_div_ps(age, lifetime);
+			__m128 cr = params.colorEnabled ? mix4(startCol[0], endCol[0], t) : startCol[0];
+			__m128 cg = params.colorEnabled ? mix4(startCol[1], endCol[1], t) : startCol[1];
+			__m128 cb = params.colorEnabled ? mix4(startCol[2], endCol[2], t) : startCol[2];
+			__m128 ca = params.colorEnabled ? mix4(startCol[3], endCol[3], t) : startCol[3];
+			_MM_TRANSPOSE4_PS(cr, cg, cb, ca);
+			_mm_store_ps(&laneCol[0].x, cr);
+			_mm_store_ps(&laneCol[1].x, cg);
+			_mm_store_ps(&laneCol[2].x, cb);
+			_mm_store_ps(&laneCol[3].x, ca);
+
+			for (int l = 0; l < 4; ++l)
+			{
+				if (alive & (1 << l))
+				{
+					pos.push_back(lanePos[l]);
+					col.push_back(laneCol[l]);
+				}
+			}
+		}
+
+		return pos.size();
+	}
+}
\ No newline at end of file
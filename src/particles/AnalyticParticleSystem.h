@@ -0,0 +1,115 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include "ParticleSystem.h"
+#include "ParticleGenerators.h"
+#include "ParticleUpdaters.h"
+#include "ScenePass.h"
+
+
+namespace nhahn
+{
+	class Shader;
+
+	/*
+	 * Stateless particles for effects whose motion has a closed form. A particle is only its spawn
+	 * record (emitter center, spawn time), velocity, color and lifetime come from a hash of the slot
+	 * and the spawn time, so position and color are evaluated in particles.vert from the age alone.
+	 * The cpu only writes the records of the new particles into a ring buffer each frame.
+	 * Supported are the box/round position, basic velocity, basic color and time generators, the
+	 * time, basic color, Euler and floor updaters. Floor bounces are solved analytically.
+	 */
+	class AnalyticParticleSystem
+	{
+	public:
+		AnalyticParticleSystem();
+		~AnalyticParticleSystem();
+
+		AnalyticParticleSystem(const AnalyticParticleSystem&) = delete;
+		AnalyticParticleSystem& operator=(const AnalyticParticleSystem&) = delete;
+
+		/* takes the emitter and updater settings of the cpu system, which keeps owning them */
+		bool generate(ParticleSystem* sys);
+		void destroy();
+
+		void reset();
+		void update(double dt);
+		void setView(const ScenePass& pass);
+		void render();
+
+		/* alive particles at the current time, evaluated on the cpu four at a time */
+		size_t evaluate(std::vector<glm::vec4>& pos, std::vector<glm::vec4>& col) const;
+
+		size_t numAllParticles() const { return m_count; }
+		/* expected count from the spawn history, evaluate() gives the exact one */
+		size_t numAliveParticles() const { return m_countAlive; }
+		double getAliveToAllRatio() const { return m_count > 0 ? (double)m_countAlive / (double)m_count : 0.0; }
+		size_t numSkippedStages() const { return m_skippedStages; }
+
+	private:
+		enum class Shape { BOX = 0, ROUND };
+
+		struct SpawnBatch
+		{
+			double time;
+			size_t count;
+		};
+
+		// the settings of the stages, the uniforms of particles_analytic.inc
+		struct Params
+		{
+			Shape shape{ Shape::BOX };
+			glm::vec4 posExtent{ 0.0f };
+			glm::vec4 minVel{ 0.0f }, maxVel{ 0.0f };
+			glm::vec4 minStartCol{ 1.0f }, maxStartCol{ 1.0f };
+			glm::vec4 minEndCol{ 1.0f }, maxEndCol{ 1.0f };
+			glm::vec4 acceleration{ 0.0f };
+			float minTime{ 1.0f }, maxTime{ 1.0f };
+			float floorY{ 0.0f }, bounceFactor{ 0.0f };
+			bool timeEnabled{ false };
+			bool colorEnabled{ false };
+			bool floorEnabled{ false };
+		};
+
+		void collectStages(ParticleSystem* sys);
+		Params currentParams() const;
+		bool isAlive(size_t slot, const Params& params) const;
+		void uploadRecords(size_t first, size_t count);
+		void estimateAlive();
+
+	private:
+		std::unique_ptr<Shader> m_shader;
+		unsigned int m_buffer{ 0 };
+		unsigned int m_vao{ 0 };
+		ScenePass m_pass;
+
+		// spawn records (emitter center, spawn time), padded to four for the evaluator
+		std::vector<glm::vec4> m_records;
+		size_t m_count{ 0 };
+		size_t m_head{ 0 };				// next slot of the ring
+		double m_time{ 0.0 };
+		std::deque<SpawnBatch> m_batches;	// the spawns that may still be alive
+		size_t m_countAlive{ 0 };
+
+		std::shared_ptr<ParticleEmitter> m_emitter;
+		std::shared_ptr<BoxPosGen> m_boxPos;
+		std::shared_ptr<RoundPosGen> m_roundPos;
+		std::shared_ptr<BasicVelGen> m_vel;
+		std::shared_ptr<BasicColorGen> m_color;
+		std::shared_ptr<BasicTimeGen> m_timeGen;
+		std::shared_ptr<BasicTimeUpdater> m_timeUpdater;
+		std::shared_ptr<BasicColorUpdater> m_colorUpdater;
+		std::shared_ptr<EulerUpdater> m_eulerUpdater;
+		std::shared_ptr<FloorUpdater> m_floorUpdater;
+		size_t m_skippedStages{ 0 };
+	};
+}
\ No newline at end of file
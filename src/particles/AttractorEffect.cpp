@@ -9,6 +9,7 @@
 
 #include <string>
 #include "imgui.h"
+#include "EffectUI.h"
 #include "utility/Debug.h"
 #include "ui/CustomWidgets.h"
 
@@ -99,9 +100,10 @@ namespace nhahn
 		m_attractors->add(glm::vec4{ 0.0, -0.75, 0.0, 1.0 });
 		m_system->addUpdater(m_attractors);
 
-		auto eulerUpdater = std::make_shared<EulerUpdater>();
-		eulerUpdater->m_globalAcceleration = glm::vec4{ 0.0, 0.0, 0.0, 0.0 };
-		m_system->addUpdater(eulerUpdater);
+		m_eulerUpdater = std::make_shared<EulerUpdater>();
+		m_eulerUpdater->m_globalAcceleration = glm::vec4{ 0.0, 0.0, 0.0, 0.0 };
+		m_eulerUpdater->addForce(m_attractors);
+		m_system->addUpdater(m_eulerUpdater);
 
 		m_zScale = 1.0f;
 
@@ -112,7 +114,11 @@ namespace nhahn
 	bool AttractorEffect::initializeRenderer(const char* name)
 	{
 		m_renderer = ParticleRendererFactory::create(name);
-		m_renderer->generate(m_system.get(), false);
+
+		if (!m_renderer)
+			return false;
+
+		m_renderer->generate(m_system.get(), m_useQuads);
 
 		return true;
 	}
@@ -120,6 +126,32 @@ namespace nhahn
 	void AttractorEffect::clean()
 	{
 		if (m_renderer) m_renderer->destroy();
+		if (m_gpuSystem) m_gpuSystem->destroy();
+	}
+
+	void AttractorEffect::setGpuBackend(bool enabled)
+	{
+		if (enabled && !m_gpuSystem)
+		{
+			m_gpuSystem = GpuParticleBackend::create(m_system.get());
+			if (!m_gpuSystem)
+				enabled = false;
+		}
+
+		// the particles are not carried over, the backend that takes over starts empty
+		m_useGpu = enabled;
+		if (m_useGpu)
+			m_gpuSystem->reset();
+		else
+			m_system->reset();
+	}
+
+	void AttractorEffect::setQuads(bool enabled)
+	{
+		// generated again with the other buffer layout, the particles are kept
+		m_renderer->destroy();
+		m_renderer->generate(m_system.get(), enabled);
+		m_useQuads = enabled;
 	}
 
 	void AttractorEffect::update(double dt)
@@ -142,17 +174,37 @@ namespace nhahn
 
 	void AttractorEffect::cpuUpdate(double dt)
 	{
-		m_system->update(dt);
+		if (!m_useGpu)
+			m_system->update(dt);
 	}
 
 	void AttractorEffect::gpuUpdate(double dt)
 	{
-		m_renderer->update();
+		if (m_useGpu)
+			m_gpuSystem->update(dt);
+		else
+			m_renderer->update();
+	}
+
+	void AttractorEffect::setView(const ScenePass& pass)
+	{
+		m_renderer->setView(pass);
+	}
+
+	bool AttractorEffect::bounds(glm::vec4& boundsMin, glm::vec4& boundsMax)
+	{
+		// the gpu backend positions stay on the gpu
+		if (!m_useGpu)
+			return systemBounds(m_system.get(), m_renderer.get(), boundsMin, boundsMax);
+		return false;
 	}
 
 	void AttractorEffect::render()
 	{
-		m_renderer->render();
+		if (m_useGpu)
+			m_gpuSystem->render();
+		else
+			m_renderer->render();
 	}
 
 	void AttractorEffect::renderUI()
@@ -166,8 +218,23 @@ namespace nhahn
 
 		ImGui::SeparatorText("Settings:");
 
+		bool useGpu = m_useGpu;
+		if (ImGui::Checkbox("gpu backend", &useGpu))
+			setGpuBackend(useGpu);
+		ImGui::SameLine(); ImGui::HelpMarker("Keeps the particles in gpu buffers, nothing is uploaded per frame. Uses compute shaders, or transform feedback with the generators on the cpu on drivers without them.\nVerlet and RK2 fall back to semi-implicit Euler, switching restarts the effect.");
+
+		bool useQuads = m_useQuads;
+		if (quadsUI(*m_renderer, useQuads))
+			setQuads(useQuads);
+
+		rendererUI(*m_renderer, m_system->numAliveParticles());
+
 		ImGui::SliderFloat("z scale", &m_zScale, 0.0f, 1.0f);
 		ImGui::SameLine(); ImGui::HelpMarker("CTRL+click to input value.");
+		int integrator = (int)m_eulerUpdater->m_integrator;
+		if (ImGui::Combo("integrator", &integrator, EulerUpdater::INTEGRATOR_NAMES, (int)EulerUpdater::Integrator::COUNT))
+			m_eulerUpdater->m_integrator = (EulerUpdater::Integrator)integrator;
+		ImGui::SameLine(); ImGui::HelpMarker("Verlet and RK2 evaluate the forces twice per step, but stay stable with larger steps.");
 
 		ImGui::SeparatorText("Colors:");
 
@@ -9,6 +9,7 @@
 
 #include <memory>
 #include "Effect.h"
+#include "GpuParticleBackend.h"
 #include "ParticleSystem.h"
 #include "ParticleGenerators.h"
 #include "ParticleRenderer.h"
@@ -25,25 +26,35 @@ namespace nhahn
 
 		bool initialize(size_t numParticles) override;
 		bool initializeRenderer(const char* name) override;
-		void reset() override { m_system->reset(); }
+		void reset() override { m_system->reset(); if (m_gpuSystem) m_gpuSystem->reset(); }
 		void clean() override;
 
 		void update(double dt) override;
 		void cpuUpdate(double dt) override;
 		void gpuUpdate(double dt) override;
+		void setView(const ScenePass& pass) override;
+		bool bounds(glm::vec4& boundsMin, glm::vec4& boundsMax) override;
 		void render() override;
 		void renderUI() override;
 
 		int numAllParticles() override { return m_system->numAllParticles(); }
-		int numAliveParticles() override { return m_system->numAliveParticles(); }
-		double aliveToAllRatio() override { return m_system->getAliveToAllRatio(); }
+		int numAliveParticles() override { return (int)(m_useGpu ? m_gpuSystem->numAliveParticles() : m_system->numAliveParticles()); }
+		double aliveToAllRatio() override { return m_useGpu ? m_gpuSystem->getAliveToAllRatio() : m_system->getAliveToAllRatio(); }
+
+	private:
+		void setGpuBackend(bool enabled);
+		void setQuads(bool enabled);
 
 	private:
 		std::shared_ptr<ParticleSystem> m_system;
+		std::unique_ptr<GpuParticleBackend> m_gpuSystem;
+		bool m_useGpu{ false };
 		std::shared_ptr<IParticleRenderer> m_renderer;
+		bool m_useQuads{ false };
 		std::shared_ptr<BoxPosGen> m_posGenerators[3];
 		std::shared_ptr<BasicColorGen> m_colGenerator;
 		std::shared_ptr<AttractorUpdater> m_attractors;
+		std::shared_ptr<EulerUpdater> m_eulerUpdater;
 		float m_zScale = 1.0f;
 	};
 }
\ No newline at end of file
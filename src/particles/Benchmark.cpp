@@ -0,0 +1,1066 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <GL/glew.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include "ComputeParticleSystem.h"
+#include "DepthSorter.h"
+#include "FeedbackParticleSystem.h"
+#include "GLParticleRenderer.h"
+#include "GpuSolver.h"
+#include "ParticleData.h"
+#include "ParticleRenderer.h"
+#include "ParticleUpdaters.h"
+#include "Solver.h"
+#include "WeightedOit.h"
+#include "render/RenderTarget.h"
+#include "render/Shader.h"
+#include "render/Texture.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+#include "utility/JobSystem.h"
+#include "utility/Timer.h"
+
+
+namespace nhahn
+{
+	std::vector<std::string> Benchmark::s_results;
+
+	void Benchmark::report(const char* format, ...)
+	{
+		char line[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(line, sizeof(line), format, args);
+		va_end(args);
+
+		s_results.push_back(line);
+		DBG("Benchmark", DebugLevel::INFO, "%s\n", line);
+	}
+
+	// particles on circular orbits around a single attractor, the force is k / r so the orbit speed is sqrt(k)
+	static void setupOrbits(ParticleData& p, float strength)
+	{
+		const float speed = sqrtf(strength);
+		for (size_t i = 0; i < p.m_count; ++i)
+		{
+			const float r = 0.2f + 0.3f * (float)i / (float)p.m_count;
+			const float angle = 6.2831853f * (float)(i * 7 % 97) / 97.0f;
+			p.m_pos[i] = glm::vec4(r * cosf(angle), r * sinf(angle), 0.0f, 1.0f);
+			p.m_vel[i] = glm::vec4(-speed * sinf(angle), speed * cosf(angle), 0.0f, 0.0f);
+			p.m_acc[i] = glm::vec4(0.0f);
+		}
+		p.m_countAlive = p.m_count;
+	}
+
+	static void step(ParticleData& p, AttractorUpdater& attractor, EulerUpdater& euler, double dt)
+	{
+		for (size_t i = 0; i < p.m_countAlive; ++i)
+			p.m_acc[i] = glm::vec4(0.0f);
+
+		attractor.update(dt, &p);
+		euler.update(dt, &p);
+	}
+
+	void Benchmark::runIntegrators()
+	{
+		const float STRENGTH = 1.0f;
+		const double SIM_TIME = 4.0;
+		const double steps[] = { 1.0 / 240.0, 1.0 / 60.0, 1.0 / 30.0, 1.0 / 15.0 };
+
+		report("--- integrators: orbit radius drift after %.0fs, cost per particle ---", SIM_TIME);
+
+		for (int it = 0; it < (int)EulerUpdater::Integrator::COUNT; ++it)
+		{
+			const auto integrator = (EulerUpdater::Integrator)it;
+
+			auto attractor = std::make_shared<AttractorUpdater>();
+			attractor->add(glm::vec4(0.0f, 0.0f, 0.0f, STRENGTH));
+
+			EulerUpdater euler;
+			euler.m_integrator = integrator;
+			euler.addForce(attractor);
+
+			// stability: relative radius error of the orbits for growing time steps
+			std::string drift;
+			ParticleData orbits(1024, 0);
+			for (double dt : steps)
+			{
+				setupOrbits(orbits, STRENGTH);
+				for (double t = 0.0; t < SIM_TIME; t += dt)
+					step(orbits, *attractor, euler, dt);
+
+				double error = 0.0;
+				for (size_t i = 0; i < orbits.m_count; ++i)
+				{
+					const float r0 = 0.2f + 0.3f * (float)i / (float)orbits.m_count;
+					const float r = sqrtf(orbits.m_pos[i].x * orbits.m_pos[i].x + orbits.m_pos[i].y * orbits.m_pos[i].y);
+					error += isfinite(r) ? fabs(r - r0) / r0 : 1.0;
+				}
+
+				char buf[48];
+				snprintf(buf, sizeof(buf), " 1/%.0fs: %6.2f%%", 1.0 / dt, 100.0 * error / (double)orbits.m_count);
+				drift += buf;
+			}
+
+			// cost: many particles, a few steps
+			const int COST_STEPS = 10;
+			ParticleData crowd(256 * 1024, 0);
+			setupOrbits(crowd, STRENGTH);
+			Timer timer;
+			for (int s = 0; s < COST_STEPS; ++s)
+				step(crowd, *attractor, euler, 1.0 / 60.0);
+			const double nsPerParticle = 1000.0 * (double)timer.getMicroseconds() / (double)(COST_STEPS * crowd.m_count);
+
+			report("%-20s %5.1f ns |%s", EulerUpdater::INTEGRATOR_NAMES[it], nsPerParticle, drift.c_str());
+		}
+	}
+
+	// objects on a jittered lattice inside of the constraint, so the first frames do not explode
+	static void setupSolver(Solver& solver, uint32_t count, float radius)
+	{
+		const float spacing = 2.2f * radius;
+		const float constraint = 1.3f * sqrtf((float)count / 3.1415926f) * spacing;
+
+		solver.setConstraint(glm::vec2(0.0f), constraint);
+		solver.setSimulationUpdateRate(1.0 / 60.0);
+		solver.setSubStepsCount(8);
+
+		const int32_t side = (int32_t)(constraint / spacing);
+		uint32_t added = 0;
+		for (int32_t y = -side; y <= side && added < count; ++y)
+		{
+			for (int32_t x = -side; x <= side && added < count; ++x)
+			{
+				const glm::vec2 pos{ x * spacing + 0.1f * radius * (float)(y & 1), y * spacing };
+				if (sqrtf(pos.x * pos.x + pos.y * pos.y) < constraint - spacing)
+				{
+					solver.addObject(pos, radius * (0.75f + 0.25f * (float)(added % 3)));
+					added++;
+				}
+			}
+		}
+	}
+
+	void Benchmark::runSolverBroadphase()
+	{
+		const int FRAMES = 10;
+		const uint32_t counts[] = { 1000, 10000, 100000, 250000 };
+
+		report("--- solver broadphase: ms per frame, 8 sub steps ---");
+
+		for (uint32_t count : counts)
+		{
+			char bruteText[32] = "skipped";
+			char gridText[32];
+			const char* valid = "-";
+
+			// brute force gets too slow to be worth waiting for
+			if (count <= 10000)
+			{
+				Solver solver;
+				solver.setBroadphase(Solver::Broadphase::BRUTE_FORCE);
+				setupSolver(solver, count, 1.0f);
+
+				Timer timer;
+				for (int f = 0; f < FRAMES; ++f)
+					solver.update(1.0 / 60.0);
+				snprintf(bruteText, sizeof(bruteText), "%8.2f", (double)timer.getMicroseconds() / (1000.0 * FRAMES));
+			}
+
+			Solver solver;
+			solver.setBroadphase(Solver::Broadphase::UNIFORM_GRID);
+			setupSolver(solver, count, 1.0f);
+
+			Timer timer;
+			for (int f = 0; f < FRAMES; ++f)
+				solver.update(1.0 / 60.0);
+			snprintf(gridText, sizeof(gridText), "%8.2f", (double)timer.getMicroseconds() / (1000.0 * FRAMES));
+
+			const char* resolved = "-";
+			if (count <= 10000)
+			{
+				valid = solver.validateBroadphase() ? "pairs match" : "PAIRS DIFFER";
+				resolved = solver.validateNarrowPhase(1e-4f) ? "positions match" : "POSITIONS DIFFER";
+			}
+
+			report("%7u objects | brute %s | grid %s | %s | %s", (uint32_t)solver.getObjectsCount(), bruteText, gridText, valid, resolved);
+		}
+	}
+
+	void Benchmark::runSolverScaling()
+	{
+		const int FRAMES = 10;
+		const uint32_t COUNT = 100000;
+
+		JobSystem& jobs = JobSystem::instance();
+		const uint32_t previousThreads = jobs.activeThreads();
+
+		report("--- solver scaling: %u objects, ms per frame, 8 sub steps ---", COUNT);
+
+		double singleThreaded = 0.0;
+		for (uint32_t threads = 1; threads <= jobs.threadCount(); ++threads)
+		{
+			jobs.setActiveThreads(threads);
+
+			Solver solver;
+			setupSolver(solver, COUNT, 1.0f);
+
+			Timer timer;
+			for (int f = 0; f < FRAMES; ++f)
+				solver.update(1.0 / 60.0);
+			const double ms = (double)timer.getMicroseconds() / (1000.0 * FRAMES);
+
+			if (threads == 1)
+				singleThreaded = ms;
+			report("%2u threads | %8.2f | speedup %5.2fx", threads, ms, singleThreaded / ms);
+		}
+
+		jobs.setActiveThreads(previousThreads);
+	}
+
+	// deepest overlap relative to the smaller radius and objects outside of the constraint, brute force
+	static void measureContacts(const float* x, const float* y, const float* r, uint32_t count, const glm::vec3& constraint,
+		float& maxPenetration, uint32_t& outside)
+	{
+		maxPenetration = 0.0f;
+		outside = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const float cx = x[i] - constraint.x;
+			const float cy = y[i] - constraint.y;
+			if (sqrtf(cx * cx + cy * cy) > constraint.z - r[i] + 0.01f)
+				outside++;
+
+			for (uint32_t k = i + 1; k < count; ++k)
+			{
+				const float dx = x[i] - x[k];
+				const float dy = y[i] - y[k];
+				const float minDist = r[i] + r[k];
+				const float dist2 = dx * dx + dy * dy;
+				if (dist2 < minDist * minDist)
+					maxPenetration = std::max(maxPenetration, (minDist - sqrtf(dist2)) / std::min(r[i], r[k]));
+			}
+		}
+	}
+
+	// rows of objects filling the bottom of the constraint up, they settle into a pile
+	static void setupPile(Solver& solver, uint32_t count, float radius, float constraint)
+	{
+		solver.setConstraint(glm::vec2(0.0f), constraint);
+		solver.setSimulationUpdateRate(1.0 / 60.0);
+		solver.setSubStepsCount(8);
+
+		const float spacing = 2.2f * radius;
+		uint32_t added = 0;
+		for (int32_t y = 0; added < count; ++y)
+		{
+			for (int32_t x = -40; x <= 40 && added < count; ++x)
+			{
+				const glm::vec2 pos{ x * spacing + 0.15f * radius * (float)(y & 1), 0.9f * constraint - y * spacing };
+				if (sqrtf(pos.x * pos.x + pos.y * pos.y) < constraint - spacing)
+				{
+					solver.addObject(pos, radius * (0.8f + 0.1f * (float)(added % 3)));
+					added++;
+				}
+			}
+		}
+	}
+
+	void Benchmark::runSolverSleeping()
+	{
+		const uint32_t COUNT = 4000;
+		const uint32_t DROPPED = 20;
+		const float RADIUS = 2.0f;
+		const float CONSTRAINT = 200.0f;
+		const int SETTLE_SECONDS = 8;
+		const int DROP_SECONDS = 3;
+
+		report("--- solver sleeping: %u object pile, ms per frame, 8 sub steps ---", COUNT);
+
+		// same pile twice, the second one may put objects to sleep
+		Solver solvers[2];
+		solvers[1].setSleeping(true);
+		for (Solver& solver : solvers)
+			setupPile(solver, COUNT, RADIUS, CONSTRAINT);
+
+		const auto run = [&solvers](int seconds, const char* phase) {
+			// only the last second is timed, the pile had time to settle by then
+			double ms[2] = { 0.0, 0.0 };
+			for (int f = 0; f < 60 * seconds; ++f)
+			{
+				for (int s = 0; s < 2; ++s)
+				{
+					Timer timer;
+					solvers[s].update(1.0 / 60.0);
+					if (f >= 60 * (seconds - 1))
+						ms[s] += (double)timer.getMicroseconds() / 1000.0;
+				}
+			}
+
+			for (int s = 0; s < 2; ++s)
+			{
+				float penetration;
+				uint32_t outside;
+				measureContacts(solvers[s].getPositionsX(), solvers[s].getPositionsY(), solvers[s].getRadii(),
+					(uint32_t)solvers[s].getObjectsCount(), solvers[s].getConstraint(), penetration, outside);
+				report("%-7s %-8s | %8.2f | asleep %5u | overlap %5.2f r | outside %u", phase, (s == 0) ? "awake" : "sleeping",
+					ms[s] / 60.0, solvers[s].getSleepingCount(), penetration, outside);
+			}
+		};
+
+		run(SETTLE_SECONDS, "settled");
+
+		// fast objects falling onto the pile have to wake it up instead of sinking into it
+		for (Solver& solver : solvers)
+		{
+			for (uint32_t i = 0; i < DROPPED; ++i)
+			{
+				VerletObject obj = solver.addObject(glm::vec2(-50.0f + 5.0f * (float)i, -0.75f * CONSTRAINT), RADIUS);
+				solver.setObjectVelocity(obj, glm::vec2(0.0f, 400.0f));
+			}
+		}
+
+		run(DROP_SECONDS, "dropped");
+
+		// where the dropped objects came to rest, sleeping should not change it much
+		float restY[2] = { 0.0f, 0.0f };
+		for (int s = 0; s < 2; ++s)
+			for (uint32_t i = 0; i < DROPPED; ++i)
+				restY[s] += solvers[s].getPositionsY()[COUNT + i] / (float)DROPPED;
+		report("dropped objects rest at y %.1f awake, %.1f sleeping", restY[0], restY[1]);
+	}
+
+	// side x side objects linked to their right and lower neighbours, every eighth object of the top row pinned
+	static void setupCloth(Solver& solver, uint32_t side, float radius)
+	{
+		const float spacing = 2.2f * radius;
+		const float width = spacing * (float)(side - 1);
+
+		solver.setConstraint(glm::vec2(0.0f), 1.2f * width);
+		solver.setSimulationUpdateRate(1.0 / 60.0);
+		solver.setSubStepsCount(8);
+		solver.setLinkIterations(8);
+
+		for (uint32_t y = 0; y < side; ++y)
+		{
+			for (uint32_t x = 0; x < side; ++x)
+			{
+				VerletObject obj = solver.addObject(glm::vec2(-0.5f * width + x * spacing, -0.8f * width + y * spacing), radius);
+				if (x > 0)
+					solver.addLink(solver.getObject(obj.getIndex() - 1), obj);
+				if (y > 0)
+					solver.addLink(solver.getObject(obj.getIndex() - side), obj);
+				if (y == 0 && x % 8 == 0)
+					solver.setPinned(obj, true);
+			}
+		}
+	}
+
+	// largest and average relative stretch of the links of setupCloth
+	static void measureStretch(const Solver& solver, uint32_t side, float spacing, float& maxStretch, float& avgStretch)
+	{
+		const float* x = solver.getPositionsX();
+		const float* y = solver.getPositionsY();
+
+		maxStretch = 0.0f;
+		double sum = 0.0;
+		uint32_t links = 0;
+		for (uint32_t i = 0; i < side * side; ++i)
+		{
+			const uint32_t neighbours[2] = { (i % side + 1 < side) ? i + 1 : UINT32_MAX, (i + side < side * side) ? i + side : UINT32_MAX };
+			for (uint32_t k : neighbours)
+			{
+				if (k == UINT32_MAX)
+					continue;
+				const float dx = x[k] - x[i];
+				const float dy = y[k] - y[i];
+				const float stretch = fabsf(sqrtf(dx * dx + dy * dy) - spacing) / spacing;
+				maxStretch = std::max(maxStretch, stretch);
+				sum += stretch;
+				links++;
+			}
+		}
+		avgStretch = (float)(sum / (double)links);
+	}
+
+	void Benchmark::runSolverCloth()
+	{
+		const int SETTLE_FRAMES = 120;
+		const int FRAMES = 30;
+		const uint32_t SIDE = 224;	// 2 * 224 * 223 = 99904 links
+		const float RADIUS = 1.0f;
+
+		JobSystem& jobs = JobSystem::instance();
+		const uint32_t previousThreads = jobs.activeThreads();
+
+		report("--- solver cloth: %u objects, %u links, ms per frame, 8 sub steps, 8 link iterations ---", SIDE * SIDE, 2 * SIDE * (SIDE - 1));
+
+		double singleThreaded = 0.0;
+		for (uint32_t threads = 1; threads <= jobs.threadCount(); threads = (threads < jobs.threadCount()) ? std::min(2 * threads, jobs.threadCount()) : threads + 1)
+		{
+			jobs.setActiveThreads(threads);
+
+			Solver solver;
+			setupCloth(solver, SIDE, RADIUS);
+
+			for (int f = 0; f < SETTLE_FRAMES; ++f)
+				solver.update(1.0 / 60.0);
+
+			Timer timer;
+			for (int f = 0; f < FRAMES; ++f)
+				solver.update(1.0 / 60.0);
+			const double ms = (double)timer.getMicroseconds() / (1000.0 * FRAMES);
+
+			float maxStretch, avgStretch;
+			measureStretch(solver, SIDE, 2.2f * RADIUS, maxStretch, avgStretch);
+
+			if (threads == 1)
+				singleThreaded = ms;
+			report("%2u threads | %8.2f | speedup %5.2fx | %u colors | stretch avg %5.2f%% max %5.2f%%", threads, ms, singleThreaded / ms,
+				solver.getLinkColorsCount(), 100.0f * avgStretch, 100.0f * maxStretch);
+		}
+
+		jobs.setActiveThreads(previousThreads);
+	}
+
+	void Benchmark::runSolverGpu()
+	{
+		report("--- gpu solver: validated against the cpu solver, 8 sub steps ---");
+
+		// free flight: without contacts both solvers have to follow the same trajectories
+		{
+			const uint32_t COUNT = 1000;
+			const int FRAMES = 60;
+
+			Solver cpu;
+			cpu.setConstraint(glm::vec2(0.0f), 2000.0f);
+			cpu.setSimulationUpdateRate(1.0 / 60.0);
+			cpu.setSubStepsCount(8);
+			for (uint32_t i = 0; i < COUNT; ++i)
+			{
+				VerletObject obj = cpu.addObject(glm::vec2(-400.0f + 20.0f * (float)(i % 40), -250.0f + 20.0f * (float)(i / 40)), 2.0f);
+				cpu.setObjectVelocity(obj, glm::vec2(30.0f, -50.0f));
+			}
+
+			GpuSolver gpu;
+			if (!gpu.generate(COUNT))
+			{
+				report("compute shaders are not supported");
+				return;
+			}
+			gpu.upload(cpu);
+
+			for (int f = 0; f < FRAMES; ++f)
+			{
+				cpu.update(1.0 / 60.0);
+				gpu.update(1.0 / 60.0);
+			}
+
+			std::vector<float> gpuX, gpuY;
+			gpu.download(gpuX, gpuY);
+			float difference = 0.0f;
+			for (uint32_t i = 0; i < COUNT; ++i)
+				difference = std::max(difference, std::max(fabsf(gpuX[i] - cpu.getPositionsX()[i]), fabsf(gpuY[i] - cpu.getPositionsY()[i])));
+
+			report("free flight | %u objects | max position difference %.4f | %s", COUNT, difference, (difference < 0.01f) ? "match" : "DIFFER");
+		}
+
+		// pile: contacts are solved in another order, so the settled piles are compared instead of the objects
+		{
+			const uint32_t COUNT = 2000;
+			const float CONSTRAINT = 150.0f;
+
+			Solver cpu;
+			setupPile(cpu, COUNT, 2.0f, CONSTRAINT);
+
+			GpuSolver gpu;
+			gpu.generate(COUNT);
+			gpu.upload(cpu);
+
+			for (int f = 0; f < 240; ++f)
+			{
+				cpu.update(1.0 / 60.0);
+				gpu.update(1.0 / 60.0);
+			}
+
+			std::vector<float> gpuX, gpuY;
+			gpu.download(gpuX, gpuY);
+
+			const float* xs[2] = { cpu.getPositionsX(), gpuX.data() };
+			const float* ys[2] = { cpu.getPositionsY(), gpuY.data() };
+			for (int s = 0; s < 2; ++s)
+			{
+				float penetration;
+				uint32_t outside;
+				measureContacts(xs[s], ys[s], cpu.getRadii(), COUNT, cpu.getConstraint(), penetration, outside);
+
+				double height = 0.0;
+				for (uint32_t i = 0; i < COUNT; ++i)
+					height += ys[s][i] / (double)COUNT;
+				report("pile %s | %u objects | overlap %5.2f r | outside %u | mean y %6.1f", (s == 0) ? "cpu" : "gpu", COUNT, penetration, outside, height);
+			}
+		}
+
+		// update time, the gpu is waited for every frame
+		const int FRAMES = 10;
+		const uint32_t counts[] = { 10000, 100000, 250000 };
+		for (uint32_t count : counts)
+		{
+			Solver cpu;
+			setupSolver(cpu, count, 1.0f);
+
+			GpuSolver gpu;
+			gpu.generate(count);
+			gpu.upload(cpu);
+			gpu.update(1.0 / 60.0);
+			glFinish();
+
+			Timer cpuTimer;
+			for (int f = 0; f < FRAMES; ++f)
+				cpu.update(1.0 / 60.0);
+			const double cpuMs = (double)cpuTimer.getMicroseconds() / (1000.0 * FRAMES);
+
+			Timer gpuTimer;
+			for (int f = 0; f < FRAMES; ++f)
+			{
+				gpu.update(1.0 / 60.0);
+				glFinish();
+			}
+			const double gpuMs = (double)gpuTimer.getMicroseconds() / (1000.0 * FRAMES);
+
+			report("%7u objects | cpu %8.2f | gpu %8.2f", count, cpuMs, gpuMs);
+		}
+	}
+
+	// fountain without the basin, every stage of it has a gpu version
+	static std::shared_ptr<ParticleSystem> createFountain(size_t count)
+	{
+		auto sys = std::make_shared<ParticleSystem>(count);
+
+		auto emitter = std::make_shared<ParticleEmitter>();
+		emitter->m_emitRate = (float)count * 0.25f;
+
+		auto posGenerator = std::make_shared<BoxPosGen>();
+		posGenerator->m_maxStartPosOffset = glm::vec4{ 0.02f, 0.0f, 0.02f, 0.0f };
+		emitter->addGenerator(posGenerator);
+
+		auto colGenerator = std::make_shared<BasicColorGen>();
+		colGenerator->m_minStartCol = glm::vec4{ 0.0f, 0.0f, 0.0f, 1.0f };
+		colGenerator->m_maxStartCol = glm::vec4{ 0.013f, 0.036f, 0.153f, 1.0f };
+		colGenerator->m_minEndCol = glm::vec4{ 0.590f, 0.316f, 0.013f, 0.0f };
+		colGenerator->m_maxEndCol = glm::vec4{ 0.350f, 0.0f, 0.0f, 0.0f };
+		emitter->addGenerator(colGenerator);
+
+		auto velGenerator = std::make_shared<BasicVelGen>();
+		velGenerator->m_minStartVel = glm::vec4{ -0.05f, 0.22f, -0.05f, 0.0f };
+		velGenerator->m_maxStartVel = glm::vec4{ 0.05f, 0.25f, 0.05f, 0.0f };
+		emitter->addGenerator(velGenerator);
+
+		auto timeGenerator = std::make_shared<BasicTimeGen>();
+		timeGenerator->m_minTime = 3.0f;
+		timeGenerator->m_maxTime = 5.0f;
+		emitter->addGenerator(timeGenerator);
+		sys->addEmitter(emitter);
+
+		sys->addUpdater(std::make_shared<BasicTimeUpdater>());
+		sys->addUpdater(std::make_shared<BasicColorUpdater>());
+		auto eulerUpdater = std::make_shared<EulerUpdater>();
+		eulerUpdater->m_globalAcceleration = glm::vec4{ 0.0f, -12.0f, 0.0f, 0.0f };
+		sys->addUpdater(eulerUpdater);
+		sys->addUpdater(std::make_shared<FloorUpdater>());
+
+		return sys;
+	}
+
+	void Benchmark::runParticlesGpu()
+	{
+		report("--- gpu particles: fountain validated against the cpu ParticleSystem ---");
+
+		// every backend the driver supports, the compute one first
+		auto createBackend = [](int index) -> std::unique_ptr<GpuParticleBackend> {
+			if (index == 0)
+				return std::make_unique<ComputeParticleSystem>();
+			return std::make_unique<FeedbackParticleSystem>();
+		};
+		const int BACKENDS = 2;
+
+		// the random streams differ, so the alive counts and the distributions are compared
+		{
+			const size_t COUNT = 100000;
+			const int FRAMES = 300;
+
+			auto cpu = createFountain(COUNT);
+			std::unique_ptr<GpuParticleBackend> gpu[BACKENDS];
+			for (int b = 0; b < BACKENDS; ++b)
+			{
+				gpu[b] = createBackend(b);
+				if (!gpu[b]->generate(cpu.get()))
+					gpu[b].reset();
+			}
+
+			for (int f = 0; f < FRAMES; ++f)
+			{
+				cpu->update(1.0 / 60.0);
+				for (auto& backend : gpu)
+					if (backend) backend->update(1.0 / 60.0);
+			}
+
+			auto reportStats = [](const char* name, const glm::vec4* pos, const glm::vec4* col, size_t count) {
+				double height = 0.0, maxHeight = 0.0, alpha = 0.0;
+				for (size_t i = 0; i < count; ++i)
+				{
+					height += pos[i].y;
+					maxHeight = std::max(maxHeight, (double)pos[i].y);
+					alpha += col[i].a;
+				}
+				const double n = (double)std::max(count, (size_t)1);
+				report("%-18s | %6zu alive | mean y %.4f | max y %.4f | mean alpha %.3f", name, count, height / n, maxHeight, alpha / n);
+			};
+
+			const ParticleData* p = cpu->finalData();
+			reportStats("cpu", p->m_pos, p->m_col, p->m_countAlive);
+			for (int b = 0; b < BACKENDS; ++b)
+			{
+				if (!gpu[b])
+				{
+					report("%-18s | not supported", createBackend(b)->name());
+					continue;
+				}
+
+				std::vector<glm::vec4> gpuPos, gpuCol;
+				gpu[b]->download(gpuPos, gpuCol);
+				reportStats(gpu[b]->name(), gpuPos.data(), gpuCol.data(), gpuPos.size());
+			}
+		}
+
+		// the cpu path includes the upload the GLParticleRenderer does every frame, the gpu is waited for
+		const int FRAMES = 10;
+		const size_t counts[] = { 100000, 500000, 1000000 };
+		for (size_t count : counts)
+		{
+			auto cpu = createFountain(count);
+
+			GLuint buffers[2];
+			glGenBuffers(2, buffers);
+			for (GLuint buf : buffers)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, buf);
+				glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+			}
+
+			// warm up until the system is full
+			for (int f = 0; f < 240; ++f)
+				cpu->update(1.0 / 60.0);
+
+			Timer cpuTimer;
+			for (int f = 0; f < FRAMES; ++f)
+			{
+				cpu->update(1.0 / 60.0);
+				const size_t alive = cpu->numAliveParticles();
+				glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+				glBufferSubData(GL_ARRAY_BUFFER, 0, alive * sizeof(glm::vec4), cpu->finalData()->m_pos);
+				glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+				glBufferSubData(GL_ARRAY_BUFFER, 0, alive * sizeof(glm::vec4), cpu->finalData()->m_col);
+				glFinish();
+			}
+			const double cpuMs = (double)cpuTimer.getMicroseconds() / (1000.0 * FRAMES);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDeleteBuffers(2, buffers);
+
+			double gpuMs[BACKENDS] = { };
+			for (int b = 0; b < BACKENDS; ++b)
+			{
+				auto gpu = createBackend(b);
+				if (!gpu->generate(cpu.get()))
+					continue;
+
+				for (int f = 0; f < 240; ++f)
+					gpu->update(1.0 / 60.0);
+				glFinish();
+
+				Timer gpuTimer;
+				for (int f = 0; f < FRAMES; ++f)
+				{
+					gpu->update(1.0 / 60.0);
+					glFinish();
+				}
+				gpuMs[b] = (double)gpuTimer.getMicroseconds() / (1000.0 * FRAMES);
+			}
+
+			report("%7zu particles | cpu + upload %8.2f | compute %8.2f | transform feedback %8.2f", count, cpuMs, gpuMs[0], gpuMs[1]);
+		}
+	}
+
+	void Benchmark::runRenderers()
+	{
+		report("--- particle renderers: upload plus draw per frame on %s ---", ParticleRendererFactory::driverString().c_str());
+
+		const size_t counts[] = { 100000, 500000, 1000000 };
+		for (size_t count : counts)
+		{
+			const std::vector<ParticleRendererFactory::Timing> timings = ParticleRendererFactory::calibrate(count);
+			auto fastest = std::min_element(timings.begin(), timings.end(), [](const auto& a, const auto& b) { return a.ms < b.ms; });
+
+			for (const auto& t : timings)
+				report("%7zu particles | %-14s %8.3f ms | %3zu stalls%s", count, t.name.c_str(), t.ms, t.stalls, (&t == &*fastest) ? " | fastest" : "");
+		}
+	}
+
+	void Benchmark::runVertexPack()
+	{
+		const int FRAMES = 50;
+
+		JobSystem& jobs = JobSystem::instance();
+		const uint32_t previousThreads = jobs.activeThreads();
+
+		report("--- vertex pack: ms per frame of the persistent renderer's fill, into system memory ---");
+
+		const size_t counts[] = { 100000, 500000, 1000000 };
+		for (size_t count : counts)
+		{
+			ParticleData p(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const float t = (float)i / (float)count;
+				p.m_pos[i] = glm::vec4(t, 1.0f - t, 0.5f * t, 0.5f + t);
+				p.m_col[i] = glm::vec4(t, 0.5f, 1.0f - t, t);
+			}
+			p.m_countAlive = count;
+
+			// the streaming stores need the vertices 16 byte aligned
+			std::vector<__m128> vertices((count * sizeof(Vertex) + sizeof(__m128) - 1) / sizeof(__m128));
+			Vertex* dst = (Vertex*)vertices.data();
+
+			for (uint32_t threads : { 1u, jobs.threadCount() })
+			{
+				jobs.setActiveThreads(threads);
+				GLParticleRendererPersistent::packVertices(&p, dst, count);
+
+				Timer timer;
+				for (int f = 0; f < FRAMES; ++f)
+					GLParticleRendererPersistent::packVertices(&p, dst, count);
+				const double ms = (double)timer.getMicroseconds() / (1000.0 * FRAMES);
+
+				// the position with its size scale is copied as is, the color rounds to nearest
+				size_t wrong = 0;
+				for (size_t i = 0; i < count; ++i)
+				{
+					const Vertex& v = dst[i];
+					const glm::vec4& c = p.m_col[i];
+					const unsigned char rgba[] = { (unsigned char)lrintf(c.r * 255.0f), (unsigned char)lrintf(c.g * 255.0f),
+						(unsigned char)lrintf(c.b * 255.0f), (unsigned char)lrintf(c.a * 255.0f) };
+					if (glm::vec4(v.x, v.y, v.z, v.w) != p.m_pos[i] || v.r != rgba[0] || v.g != rgba[1] || v.b != rgba[2] || v.a != rgba[3])
+						wrong++;
+				}
+
+				report("%7zu particles | %2u threads | %6.3f ms | %5.2f ns per particle | %s", count, threads, ms, 1e6 * ms / (double)count,
+					(wrong == 0) ? "match" : "DIFFER");
+			}
+		}
+
+		jobs.setActiveThreads(previousThreads);
+	}
+
+	void Benchmark::runQuads()
+	{
+		report("--- point sprites against instanced quads: upload | draw per frame, 1280x720 off screen ---");
+
+		const int WIDTH = 1280, HEIGHT = 720;
+		const int FRAMES = 10;
+
+		// the camera and blending of the SceneView, a white mask in place of the particle texture
+		Texture target(TEXTURE_2D, WIDTH, HEIGHT);
+		target.setFormat(TEXEL_FLOAT, 4, 4);
+		target.init();
+		Texture mask(TEXTURE_2D, 1, 1);
+		mask.setFormat(TEXEL_FLOAT, 4, 4);
+		mask.init();
+		glm::vec4 white{ 1.0f };
+		mask.copy(&white);
+
+		RenderTarget rt;
+		rt.bind();
+		rt.pushViewport(0, 0, WIDTH, HEIGHT);
+		rt.selectAttachmentList(1, rt.attachTextureAny(target));
+
+		const std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		Shader pointProg(path.c_str(), "common.inc", "particles.vert", nullptr, "particles.frag", 1);
+		const glm::mat4 viewMat = glm::lookAt(glm::vec3(0.0f, 0.2f, 0.4f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 projMat = glm::perspective(glm::radians(54.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
+
+		glEnable(GL_POINT_SPRITE);
+		glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+		struct Mode
+		{
+			const char* name;
+			bool quads;
+			float stretch;
+		};
+		const Mode modes[] = { { "points", false, 0.0f }, { "quads", true, 0.0f }, { "stretched", true, 0.5f } };
+
+		const size_t counts[] = { 100000, 250000, 500000, 1000000 };
+		for (size_t count : counts)
+		{
+			auto sys = createFountain(count);
+			for (int f = 0; f < 240; ++f)
+				sys->update(1.0 / 60.0);
+
+			double uploadMs[3] = { }, drawMs[3] = { };
+			for (int m = 0; m < 3; ++m)
+			{
+				std::shared_ptr<IParticleRenderer> renderer = ParticleRendererFactory::create("gl");
+				renderer->generate(sys.get(), modes[m].quads);
+				renderer->quadSettings().spin = 1.0f;
+				renderer->quadSettings().stretch = modes[m].stretch;
+
+				mask.bindAny();
+				pointProg.bind();
+				pointProg.setUniformI("tex", mask.boundUnit());
+				pointProg.setUniformMat("modelViewMat", viewMat, false);
+				pointProg.setUniformMat("projectionMat", projMat, false);
+
+				ScenePass pass;
+				pass.viewMat = viewMat;
+				pass.projMat = projMat;
+				pass.viewportSize = glm::ivec2(WIDTH, HEIGHT);
+				pass.texUnit = mask.boundUnit();
+				renderer->setView(pass);
+
+				renderer->update();
+				renderer->render();
+				glFinish();
+
+				for (int f = 0; f < FRAMES; ++f)
+				{
+					glClear(GL_COLOR_BUFFER_BIT);
+
+					Timer uploadTimer;
+					renderer->update();
+					glFinish();
+					uploadMs[m] += (double)uploadTimer.getMicroseconds() / 1000.0;
+
+					Timer drawTimer;
+					renderer->render();
+					glFinish();
+					drawMs[m] += (double)drawTimer.getMicroseconds() / 1000.0;
+				}
+
+				pointProg.unbind();
+				renderer->destroy();
+			}
+
+			report("%7zu particles | points %6.2f | %6.2f | quads %6.2f | %6.2f | stretched %6.2f | %6.2f", sys->numAliveParticles(),
+				uploadMs[0] / FRAMES, drawMs[0] / FRAMES, uploadMs[1] / FRAMES, drawMs[1] / FRAMES, uploadMs[2] / FRAMES, drawMs[2] / FRAMES);
+		}
+
+		glDisable(GL_BLEND);
+		glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+		glDisable(GL_POINT_SPRITE);
+		rt.popViewport();
+		RenderTarget::unbind();
+	}
+
+	void Benchmark::runDepthSort()
+	{
+		const int FRAMES = 30;
+
+		JobSystem& jobs = JobSystem::instance();
+		const uint32_t previousThreads = jobs.activeThreads();
+
+		report("--- depth sort: ms per frame, fountain with an orbiting camera ---");
+		report("particles | threads |   full | coherent | incremental | paused");
+
+		const size_t counts[] = { 100000, 500000, 1000000 };
+		for (size_t count : counts)
+		{
+			auto sys = createFountain(count);
+			for (int f = 0; f < 240; ++f)
+				sys->update(1.0 / 60.0);
+
+			for (uint32_t threads : { 1u, jobs.threadCount() })
+			{
+				jobs.setActiveThreads(threads);
+
+				DepthSorter full, coherent;
+				full.setTemporalCoherence(false);
+				double fullMs = 0.0, coherentMs = 0.0;
+				int incremental = 0;
+				float angle = 0.0f;
+
+				for (int f = 0; f < FRAMES; ++f)
+				{
+					sys->update(1.0 / 60.0);
+					angle += 0.005f;
+					const glm::mat4 viewMat = glm::lookAt(glm::vec3(0.4f * sinf(angle), 0.2f, 0.4f * cosf(angle)), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+					full.sort(sys->finalData()->m_pos, sys->numAliveParticles(), viewMat);
+					coherent.sort(sys->finalData()->m_pos, sys->numAliveParticles(), viewMat);
+					fullMs += full.lastMilliseconds();
+					coherentMs += coherent.lastMilliseconds();
+					incremental += coherent.wasIncremental() ? 1 : 0;
+				}
+
+				// particles and camera stand still, the best case of the coherent sort
+				const glm::mat4 viewMat = glm::lookAt(glm::vec3(0.0f, 0.2f, 0.4f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+				double pausedMs = 0.0;
+				for (int f = 0; f < FRAMES; ++f)
+				{
+					coherent.sort(sys->finalData()->m_pos, sys->numAliveParticles(), viewMat);
+					pausedMs += coherent.lastMilliseconds();
+				}
+
+				report("%9zu | %7u | %6.2f | %8.2f | %5d of %2d | %6.2f", sys->numAliveParticles(), threads,
+					fullMs / FRAMES, coherentMs / FRAMES, incremental, FRAMES, pausedMs / FRAMES);
+			}
+		}
+
+		jobs.setActiveThreads(previousThreads);
+	}
+
+	void Benchmark::runTransparency()
+	{
+		report("--- transparency: ms per frame and mean color error to the depth sort, fountain with an orbiting camera, 1280x720 off screen ---");
+		report("particles | additive | depth sort | weighted oit | error additive | error oit");
+
+		const int WIDTH = 1280, HEIGHT = 720;
+		const int FRAMES = 10;
+
+		Texture target(TEXTURE_2D, WIDTH, HEIGHT);
+		target.setFormat(TEXEL_FLOAT, 4, 4);
+		target.init();
+		Texture mask(TEXTURE_2D, 1, 1);
+		mask.setFormat(TEXEL_FLOAT, 4, 4);
+		mask.init();
+		glm::vec4 white{ 1.0f };
+		mask.copy(&white);
+
+		WeightedOit oit;
+		oit.generate(WIDTH, HEIGHT);
+
+		RenderTarget rt;
+		rt.bind();
+		rt.pushViewport(0, 0, WIDTH, HEIGHT);
+
+		const std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		Shader pointProg(path.c_str(), "common.inc", "particles.vert", nullptr, "particles.frag", 1);
+		const glm::mat4 projMat = glm::perspective(glm::radians(54.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
+
+		glEnable(GL_POINT_SPRITE);
+		glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+
+		enum Mode { ADDITIVE = 0, SORTED, WEIGHTED_OIT, MODE_COUNT };
+
+		// one frame of a mode into the target, the way the SceneView draws it
+		auto drawFrame = [&](IParticleRenderer* renderer, Mode mode, const glm::mat4& viewMat) {
+			const RtAttachment dst = rt.attachTextureAny(target);
+			rt.selectAttachmentList(1, dst);
+			const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			glClearBufferfv(GL_COLOR, 0, black);
+
+			mask.bindAny();
+			pointProg.bind();
+			pointProg.setUniformI("tex", mask.boundUnit());
+			pointProg.setUniformMat("modelViewMat", viewMat, false);
+			pointProg.setUniformMat("projectionMat", projMat, false);
+			pointProg.setUniformI("oitPass", (mode == WEIGHTED_OIT) ? 1 : 0);
+
+			ScenePass pass;
+			pass.viewMat = viewMat;
+			pass.projMat = projMat;
+			pass.viewportSize = glm::ivec2(WIDTH, HEIGHT);
+			pass.texUnit = mask.boundUnit();
+			pass.weightedOit = (mode == WEIGHTED_OIT);
+			renderer->setView(pass);
+
+			if (mode == WEIGHTED_OIT)
+			{
+				oit.begin(rt);
+			}
+			else
+			{
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+			}
+
+			renderer->update();
+			renderer->render();
+			if (mode == WEIGHTED_OIT)
+				oit.composite(rt, dst);
+
+			glDisable(GL_BLEND);
+			pointProg.unbind();
+		};
+
+		std::vector<glm::vec4> images[MODE_COUNT];
+		const size_t counts[] = { 100000, 500000, 1000000 };
+		for (size_t count : counts)
+		{
+			auto sys = createFountain(count);
+			for (int f = 0; f < 240; ++f)
+				sys->update(1.0 / 60.0);
+
+			double frameMs[MODE_COUNT] = { };
+			for (int m = 0; m < MODE_COUNT; ++m)
+			{
+				std::shared_ptr<IParticleRenderer> renderer = ParticleRendererFactory::create("gl");
+				renderer->generate(sys.get(), false);
+				renderer->setDepthSort(m == SORTED);
+
+				float angle = 0.0f;
+				for (int f = 0; f <= FRAMES; ++f)
+				{
+					angle += 0.005f;
+					const glm::mat4 viewMat = glm::lookAt(glm::vec3(0.4f * sinf(angle), 0.2f, 0.4f * cosf(angle)), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+					// the first frame warms up the buffers and the sorter
+					Timer frameTimer;
+					drawFrame(renderer.get(), (Mode)m, viewMat);
+					glFinish();
+					if (f > 0)
+						frameMs[m] += (double)frameTimer.getMicroseconds() / 1000.0;
+				}
+
+				// the same still frame of every mode for the comparison
+				drawFrame(renderer.get(), (Mode)m, glm::lookAt(glm::vec3(0.0f, 0.2f, 0.4f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+				images[m].resize((size_t)WIDTH * HEIGHT);
+				target.bindAny();
+				glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, images[m].data());
+
+				renderer->destroy();
+			}
+
+			double error[MODE_COUNT] = { };
+			for (int m = 0; m < MODE_COUNT; ++m)
+			{
+				for (size_t i = 0; i < images[m].size(); ++i)
+				{
+					const glm::vec4 diff = glm::abs(images[m][i] - images[SORTED][i]);
+					error[m] += (double)(diff.x + diff.y + diff.z) / 3.0;
+				}
+				error[m] /= (double)images[m].size();
+			}
+
+			report("%9zu | %8.2f | %10.2f | %12.2f | %14.4f | %9.4f", sys->numAliveParticles(),
+				frameMs[ADDITIVE] / FRAMES, frameMs[SORTED] / FRAMES, frameMs[WEIGHTED_OIT] / FRAMES, error[ADDITIVE], error[WEIGHTED_OIT]);
+		}
+
+		glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+		glDisable(GL_POINT_SPRITE);
+		rt.popViewport();
+		RenderTarget::unbind();
+	}
+}
\ No newline at end of file
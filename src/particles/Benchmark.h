@@ -0,0 +1,57 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+namespace nhahn
+{
+	/*
+	 * In-app measurements, started from the property panel. They block the frame while
+	 * running, the results are kept as text lines for the ui and written to the debug log.
+	 */
+	class Benchmark
+	{
+	public:
+		/* orbit drift per time step and cost per particle of every EulerUpdater integrator */
+		static void runIntegrators();
+		/* Verlet solver update time for growing object counts, brute force against the grid broadphase */
+		static void runSolverBroadphase();
+		/* Verlet solver update time and speedup for every thread count of the job system */
+		static void runSolverScaling();
+		/* settled pile with and without sleeping: update time, overlaps and the response to objects dropped onto it */
+		static void runSolverSleeping();
+		/* hanging cloth of 100k distance links: update time per thread count, link colors and stretch */
+		static void runSolverCloth();
+		/* compute shader solver against the cpu one: free flight trajectories, a settled pile and update times */
+		static void runSolverGpu();
+		/* compute shader particle backend against the ParticleSystem: alive counts, statistics and update plus upload times */
+		static void runParticlesGpu();
+		/* update plus draw time of the renderers auto picks from for growing counts, the one it picks is marked */
+		static void runRenderers();
+		/* time of the persistent renderer's parallel vertex pack alone, single threaded and on all threads */
+		static void runVertexPack();
+		/* upload and draw time of point sprites against instanced quads, plain and stretched, drawn off screen */
+		static void runQuads();
+		/* DepthSorter time per frame for growing counts and thread counts, full sorts against temporal coherence */
+		static void runDepthSort();
+		/* frame time of additive blending, the depth sort and weighted blended transparency, and how far each image is from the sorted one */
+		static void runTransparency();
+
+		static const std::vector<std::string>& results() { return s_results; }
+		static void clearResults() { s_results.clear(); }
+
+	protected:
+		static void report(const char* format, ...);
+
+	private:
+		static std::vector<std::string> s_results;
+	};
+}
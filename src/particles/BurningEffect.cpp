@@ -9,7 +9,9 @@
 
 #include <string>
 #include "imgui.h"
+#include "EffectUI.h"
 #include "utility/Debug.h"
+#include "utility/FileSystem.h"
 #include "ui/CustomWidgets.h"
 
 
@@ -18,7 +20,8 @@ namespace nhahn
 	bool BurningEffect::initialize(size_t numParticles)
 	{
 		const size_t NUM_PARTICLES = numParticles == 0 ? IEffect::DEFAULT_PARTICLE_COUNT : numParticles;
-		m_system = std::make_shared<ParticleSystem>(NUM_PARTICLES);
+		// colors come from the gradient tables, the per particle color streams are not needed
+		m_system = std::make_shared<ParticleSystem>(NUM_PARTICLES, 0);
 
 		// emitter
 		auto particleEmitter = std::make_shared<ParticleEmitter>();
@@ -30,13 +33,6 @@ namespace nhahn
 			m_posGenerator->m_radius = 0.1f;
 			particleEmitter->addGenerator(m_posGenerator);
 
-			m_colGenerator = std::make_shared<BasicColorGen>();
-			m_colGenerator->m_minStartCol = glm::vec4{ 0, 0.69, 1.0, 1.0 };
-			m_colGenerator->m_maxStartCol = glm::vec4{ 0.74, 0.93, 1.0, 1.0 };
-			m_colGenerator->m_minEndCol = glm::vec4{ 1.0, 0.49, 0.0, 0.0 };
-			m_colGenerator->m_maxEndCol = glm::vec4{ 1.0, 0.26, 0.0, 0.0 };
-			particleEmitter->addGenerator(m_colGenerator);
-
 			auto velGenerator = std::make_shared<BasicVelGen>();
 			velGenerator->m_minStartVel = glm::vec4{ -0.05f, -0.05f, -0.05f, 0.0f };
 			velGenerator->m_maxStartVel = glm::vec4{ 0.05f, 0.05f, 0.05f, 0.0f };
@@ -52,8 +48,35 @@ namespace nhahn
 		auto timeUpdater = std::make_shared<BasicTimeUpdater>();
 		m_system->addUpdater(timeUpdater);
 
-		auto colorUpdater = std::make_shared<BasicColorUpdater>();
-		m_system->addUpdater(colorUpdater);
+		m_colorUpdater = std::make_shared<ColorLutUpdater>();
+		m_colorUpdater->m_minKeys = {
+			{ 0.0f, glm::vec4{ 0.0f, 0.69f, 1.0f, 1.0f } },
+			{ 0.25f, glm::vec4{ 1.0f, 0.85f, 0.4f, 1.0f } },
+			{ 1.0f, glm::vec4{ 1.0f, 0.49f, 0.0f, 0.0f } } };
+		m_colorUpdater->m_maxKeys = {
+			{ 0.0f, glm::vec4{ 0.74f, 0.93f, 1.0f, 1.0f } },
+			{ 0.25f, glm::vec4{ 1.0f, 0.7f, 0.2f, 1.0f } },
+			{ 1.0f, glm::vec4{ 1.0f, 0.26f, 0.0f, 0.0f } } };
+		m_colorUpdater->rebuild();
+		m_system->addUpdater(m_colorUpdater);
+
+		m_sizeUpdater = std::make_shared<SizeLutUpdater>();
+		m_sizeUpdater->m_minKeys = { { 0.0f, 0.5f }, { 0.15f, 1.2f }, { 1.0f, 0.2f } };
+		m_sizeUpdater->m_maxKeys = { { 0.0f, 0.8f }, { 0.15f, 1.8f }, { 1.0f, 0.4f } };
+		m_sizeUpdater->rebuild();
+		m_system->addUpdater(m_sizeUpdater);
+
+		m_turbulenceUpdater = std::make_shared<CurlNoiseUpdater>();
+		m_turbulenceUpdater->m_strength = 3.0f;
+		m_turbulenceUpdater->m_frequency = 3.0f;
+		m_turbulenceUpdater->setOctaves(2);
+		m_system->addUpdater(m_turbulenceUpdater);
+
+		// optional wind from an exported simulation, streamed from disk
+		m_windUpdater = std::make_shared<VectorFieldUpdater>();
+		m_windUpdater->m_mode = VectorFieldUpdater::FieldMode::VELOCITY;
+		m_windUpdater->load((FileSystem::getModuleDirectory() + "data\\volumes\\burning_wind.vol").c_str());
+		m_system->addUpdater(m_windUpdater);
 
 		m_eulerUpdater = std::make_shared<EulerUpdater>();
 		m_eulerUpdater->m_globalAcceleration = glm::vec4{ 0.0, 5.0, 0.0, 0.0 };
@@ -70,7 +93,7 @@ namespace nhahn
 		if (!m_renderer)
 			return false;
 
-		m_renderer->generate(m_system.get(), false);
+		m_renderer->generate(m_system.get(), m_useQuads);
 
 		return true;
 	}
@@ -78,6 +101,52 @@ namespace nhahn
 	void BurningEffect::clean()
 	{
 		if (m_renderer) m_renderer->destroy();
+		if (m_ageSeedRenderer) m_ageSeedRenderer->destroy();
+		if (m_quantizedRenderer) m_quantizedRenderer->destroy();
+	}
+
+	void BurningEffect::setAgeSeed(bool enabled)
+	{
+		// without an updater the shaders can rebuild, gpu color would draw the particles white
+		enabled = enabled && GLParticleRendererAgeSeed::supports(m_system.get());
+
+		if (enabled && !m_ageSeedRenderer)
+		{
+			m_ageSeedRenderer = std::make_shared<GLParticleRendererAgeSeed>();
+			m_ageSeedRenderer->generate(m_system.get(), false);
+		}
+		else if (!enabled)
+			m_ageSeedRenderer.reset();
+
+		// the upload formats are for the full color stream, gpu color replaces them
+		if (enabled)
+			m_vertexFormat = 0;
+
+		m_useAgeSeed = enabled;
+	}
+
+	void BurningEffect::setVertexFormat(int format)
+	{
+		// format 0 is the float upload of the factory renderers, which keep drawing it
+		if (format > 0 && !m_quantizedRenderer)
+		{
+			m_quantizedRenderer = std::make_shared<GLParticleRendererQuantized>();
+			m_quantizedRenderer->generate(m_system.get(), false);
+		}
+		if (m_quantizedRenderer)
+			m_quantizedRenderer->setFormat(format);
+		if (format > 0)
+			setAgeSeed(false);
+
+		m_vertexFormat = format;
+	}
+
+	void BurningEffect::setQuads(bool enabled)
+	{
+		// generated again with the other buffer layout, the particles are kept
+		m_renderer->destroy();
+		m_renderer->generate(m_system.get(), enabled);
+		m_useQuads = enabled;
 	}
 
 	void BurningEffect::update(double dt)
@@ -97,12 +166,24 @@ namespace nhahn
 
 	void BurningEffect::gpuUpdate(double dt)
 	{
-		m_renderer->update();
+		activeRenderer()->update();
+	}
+
+	void BurningEffect::setView(const ScenePass& pass)
+	{
+		m_renderer->setView(pass);
+		if (activeRenderer() != m_renderer.get())
+			activeRenderer()->setView(pass);
+	}
+
+	bool BurningEffect::bounds(glm::vec4& boundsMin, glm::vec4& boundsMax)
+	{
+		return systemBounds(m_system.get(), activeRenderer(), boundsMin, boundsMax);
 	}
 
 	void BurningEffect::render()
 	{
-		m_renderer->render();
+		activeRenderer()->render();
 	}
 
 	void BurningEffect::renderUI()
@@ -116,21 +197,89 @@ namespace nhahn
 
 		ImGui::SeparatorText("Settings:");
 
+		bool useAgeSeed = m_useAgeSeed;
+		int vertexFormat = m_vertexFormat;
+		uploadFormatUI(m_system.get(), useAgeSeed, vertexFormat, m_formatErrors);
+		if (useAgeSeed != m_useAgeSeed)
+			setAgeSeed(useAgeSeed);
+		if (vertexFormat != m_vertexFormat)
+			setVertexFormat(vertexFormat);
+
+		bool useQuads = m_useQuads;
+		if (quadsUI(*m_renderer, useQuads))
+			setQuads(useQuads);
+
+		rendererUI(*m_renderer, m_system->numAliveParticles());
+
 		ImGui::SliderFloat("rise speed", &m_eulerUpdater->m_globalAcceleration.y, 0.0f, 20.0f, "%.2f");
 		ImGui::SameLine(); ImGui::HelpMarker("CTRL+click to input value.");
+		int integrator = (int)m_eulerUpdater->m_integrator;
+		if (ImGui::Combo("integrator", &integrator, EulerUpdater::INTEGRATOR_NAMES, (int)EulerUpdater::Integrator::COUNT))
+			m_eulerUpdater->m_integrator = (EulerUpdater::Integrator)integrator;
+		ImGui::SameLine(); ImGui::HelpMarker("Verlet and RK2 evaluate the forces twice per step, but stay stable with larger steps.");
+
+		ImGui::SeparatorText("Turbulence:");
+
+		ImGui::Checkbox("enabled", &m_turbulenceUpdater->m_enabled);
+		ImGui::SameLine(); ImGui::HelpMarker("Curl noise sampled from cached volumes, one volume per octave.");
+		ImGui::SliderFloat("strength", &m_turbulenceUpdater->m_strength, 0.0f, 10.0f, "%.2f");
+		ImGui::SliderFloat("frequency", &m_turbulenceUpdater->m_frequency, 0.1f, 16.0f, "%.2f");
+		int octaves = (int)m_turbulenceUpdater->numOctaves();
+		if (ImGui::SliderInt("octaves", &octaves, 1, (int)CurlNoiseUpdater::MAX_OCTAVES))
+			m_turbulenceUpdater->setOctaves((uint32_t)octaves);
+		ImGui::SliderFloat("persistence", &m_turbulenceUpdater->m_persistence, 0.0f, 1.0f, "%.2f");
+		ImGui::DragFloat3("scroll speed", &m_turbulenceUpdater->m_scrollSpeed.x, 0.01f, -4.0f, 4.0f, "%.2f");
+
+		ImGui::SeparatorText("Wind:");
+
+		if (m_windUpdater->isLoaded())
+		{
+			ImGui::Checkbox("wind enabled", &m_windUpdater->m_enabled);
+			ImGui::SameLine(); ImGui::HelpMarker("Velocity field sequence streamed from data/volumes/burning_wind.vol.");
+			ImGui::SliderFloat("wind strength", &m_windUpdater->m_strength, 0.0f, 20.0f, "%.2f");
+			ImGui::SliderFloat("playback speed", &m_windUpdater->m_playbackSpeed, 0.0f, 4.0f, "%.2f");
+			ImGui::Checkbox("loop", &m_windUpdater->m_loop);
+			ImGui::Text("frame: %u", m_windUpdater->currentFrame());
+		}
+		else
+		{
+			ImGui::TextWrapped("No field sequence found at data/volumes/burning_wind.vol.");
+		}
 
 		ImGui::SeparatorText("Colors:");
 
-		ImGui::ColorEdit4("start color min", &m_colGenerator->m_minStartCol.x);
-		ImGui::SameLine(); ImGui::HelpMarker(
-			"Click on the color square to open a color picker.\n"
-			"Click and hold to use drag and drop.\n"
-			"Right-click on the color square to show options.\n"
-			"CTRL+click on individual component to input value.\n");
+		bool colorsChanged = false;
+		for (size_t i = 0; i < m_colorUpdater->m_minKeys.size(); ++i)
+		{
+			ImGui::PushID((int)i);
+			colorsChanged |= ImGui::ColorEdit4("min", &m_colorUpdater->m_minKeys[i].m_color.x);
+			if (i == 0)
+			{
+				ImGui::SameLine(); ImGui::HelpMarker(
+					"Colors over the lifetime of a particle, each particle picks a random blend between min and max.\n"
+					"Click on the color square to open a color picker.\n"
+					"CTRL+click on individual component to input value.\n");
+			}
+			colorsChanged |= ImGui::ColorEdit4("max", &m_colorUpdater->m_maxKeys[i].m_color.x);
+			colorsChanged |= ImGui::SliderFloat("age", &m_colorUpdater->m_minKeys[i].m_age, 0.0f, 1.0f, "%.2f");
+			m_colorUpdater->m_maxKeys[i].m_age = m_colorUpdater->m_minKeys[i].m_age;
+			ImGui::PopID();
+			ImGui::Spacing();
+		}
+		if (colorsChanged)
+			m_colorUpdater->rebuild();
 
-		ImGui::ColorEdit4("start color max", &m_colGenerator->m_maxStartCol.x);
+		ImGui::SeparatorText("Sizes:");
 
-		ImGui::ColorEdit4("end color min", &m_colGenerator->m_minEndCol.x);
-		ImGui::ColorEdit4("end color max", &m_colGenerator->m_maxEndCol.x);
+		bool sizesChanged = false;
+		for (size_t i = 0; i < m_sizeUpdater->m_minKeys.size(); ++i)
+		{
+			ImGui::PushID((int)(100 + i));
+			sizesChanged |= ImGui::SliderFloat("min size", &m_sizeUpdater->m_minKeys[i].m_size, 0.0f, 4.0f, "%.2f");
+			sizesChanged |= ImGui::SliderFloat("max size", &m_sizeUpdater->m_maxKeys[i].m_size, 0.0f, 4.0f, "%.2f");
+			ImGui::PopID();
+		}
+		if (sizesChanged)
+			m_sizeUpdater->rebuild();
 	}
 }
\ No newline at end of file
@@ -8,7 +8,9 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "Effect.h"
+#include "GLParticleRenderer.h"
 #include "ParticleSystem.h"
 #include "ParticleGenerators.h"
 #include "ParticleRenderer.h"
@@ -31,6 +33,8 @@ namespace nhahn
 		void update(double dt) override;
 		void cpuUpdate(double dt) override;
 		void gpuUpdate(double dt) override;
+		void setView(const ScenePass& pass) override;
+		bool bounds(glm::vec4& boundsMin, glm::vec4& boundsMax) override;
 		void render() override;
 		void renderUI() override;
 
@@ -38,11 +42,30 @@ namespace nhahn
 		int numAliveParticles() override { return m_system->numAliveParticles(); }
 		double aliveToAllRatio() override { return m_system->getAliveToAllRatio(); }
 
+	private:
+		void setAgeSeed(bool enabled);
+		void setVertexFormat(int format);
+		void setQuads(bool enabled);
+		IParticleRenderer* activeRenderer() const
+		{
+			if (m_useAgeSeed) return m_ageSeedRenderer.get();
+			return (m_vertexFormat > 0) ? m_quantizedRenderer.get() : m_renderer.get();
+		}
+
 	private:
 		std::shared_ptr<ParticleSystem> m_system;
 		std::shared_ptr<IParticleRenderer> m_renderer;
+		bool m_useQuads{ false };
+		std::shared_ptr<GLParticleRendererAgeSeed> m_ageSeedRenderer;
+		bool m_useAgeSeed{ false };
+		std::shared_ptr<GLParticleRendererQuantized> m_quantizedRenderer;
+		int m_vertexFormat{ 0 };
+		std::vector<GLParticleRendererQuantized::QuantizationError> m_formatErrors;
 		std::shared_ptr<SpherePosGen> m_posGenerator;
-		std::shared_ptr<BasicColorGen> m_colGenerator;
+		std::shared_ptr<ColorLutUpdater> m_colorUpdater;
+		std::shared_ptr<SizeLutUpdater> m_sizeUpdater;
 		std::shared_ptr<EulerUpdater> m_eulerUpdater;
+		std::shared_ptr<CurlNoiseUpdater> m_turbulenceUpdater;
+		std::shared_ptr<VectorFieldUpdater> m_windUpdater;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,360 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "ComputeParticleSystem.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <GL/glew.h>
+#include "render/Shader.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+
+
+namespace nhahn
+{
+	// local size of the particle_*.comp shaders
+	static const uint32_t GROUP_SIZE = 256;
+
+	// the modes of particle_emit.comp
+	enum PosMode { POS_NONE = 0, POS_BOX, POS_ROUND, POS_SPHERE };
+	enum VelMode { VEL_NONE = 0, VEL_BASIC, VEL_SPHERE, VEL_FROM_POS };
+
+	struct DrawArraysIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
+	static GLuint groupsFor(size_t count)
+	{
+		return (GLuint)((count + GROUP_SIZE - 1) / GROUP_SIZE);
+	}
+
+	// out of line, the header only forward declares Shader
+	ComputeParticleSystem::ComputeParticleSystem() { }
+	ComputeParticleSystem::~ComputeParticleSystem() { destroy(); }
+
+	bool ComputeParticleSystem::generate(ParticleSystem* sys)
+	{
+		ASSERT(sys != nullptr, "ComputeParticleSystem: particle system is null");
+
+		if (!GLEW_ARB_compute_shader || !GLEW_ARB_shader_storage_buffer_object || !GLEW_ARB_draw_indirect)
+		{
+			DBG("ComputeParticleSystem", DebugLevel::WARNING, "compute shaders or indirect draws are not supported\n");
+			return false;
+		}
+
+		destroy();
+		m_count = sys->numAllParticles();
+
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_emitShader = std::make_unique<Shader>(path.c_str(), "common.inc", "particle_emit.comp");
+
+		// the updaters are shared with the transform feedback backend
+		m_updateShader = std::make_unique<Shader>();
+		ShaderObject* update = m_updateShader->addObject();
+		for (const char* file : { "common.inc", "particle_update.inc", "particle_update.comp" })
+			update->addFile((path + file).c_str());
+		update->compile(COMPUTE_SHADER);
+		m_updateShader->link();
+
+		const size_t sizes[BUFFER_COUNT] = {
+			m_count * sizeof(glm::vec4),	// POS
+			m_count * sizeof(glm::vec4),	// COL
+			m_count * sizeof(glm::vec4),	// START_COL
+			m_count * sizeof(glm::vec4),	// END_COL
+			m_count * sizeof(glm::vec4),	// VEL
+			m_count * sizeof(glm::vec4),	// TIME
+			m_count * sizeof(uint32_t),		// FREE_LIST
+			sizeof(int32_t),				// FREE_COUNT
+			m_count * sizeof(glm::vec4),	// DRAW_POS
+			m_count * sizeof(glm::vec4),	// DRAW_COL
+			sizeof(DrawArraysIndirectCommand)
+		};
+		glGenBuffers(BUFFER_COUNT, m_buffers);
+		for (int b = 0; b < BUFFER_COUNT; ++b)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[b]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[b], nullptr, GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glGenBuffers(1, &m_readbackBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_readbackBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		// the same attributes as the GLParticleRenderer, so the particle shaders draw it unchanged
+		glGenVertexArrays(1, &m_vao);
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[DRAW_POS]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), nullptr);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[DRAW_COL]);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), nullptr);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		collectEmitters(sys);
+		collectUpdaters(sys);
+		reset();
+		return true;
+	}
+
+	void ComputeParticleSystem::destroy()
+	{
+		if (m_buffers[0] != 0)
+			glDeleteBuffers(BUFFER_COUNT, m_buffers);
+		std::fill(std::begin(m_buffers), std::end(m_buffers), 0);
+
+		if (m_readbackBuffer != 0)
+			glDeleteBuffers(1, &m_readbackBuffer);
+		m_readbackBuffer = 0;
+
+		if (m_vao != 0)
+			glDeleteVertexArrays(1, &m_vao);
+		m_vao = 0;
+
+		if (m_readbackFence)
+			glDeleteSync((GLsync)m_readbackFence);
+		m_readbackFence = nullptr;
+
+		m_emitShader.reset();
+		m_updateShader.reset();
+		m_emitters.clear();
+		m_count = 0;
+		m_countAlive = 0;
+	}
+
+	void ComputeParticleSystem::collectEmitters(ParticleSystem* sys)
+	{
+		m_emitters.clear();
+
+		for (const auto& emitter : sys->emitters())
+		{
+			EmitterDesc desc;
+			desc.emitter = emitter;
+			for (const auto& gen : emitter->generators())
+			{
+				if (auto box = std::dynamic_pointer_cast<BoxPosGen>(gen)) desc.boxPos = box;
+				else if (auto round = std::dynamic_pointer_cast<RoundPosGen>(gen)) desc.roundPos = round;
+				else if (auto sphere = std::dynamic_pointer_cast<SpherePosGen>(gen)) desc.spherePos = sphere;
+				else if (auto color = std::dynamic_pointer_cast<BasicColorGen>(gen)) desc.color = color;
+				else if (auto basicVel = std::dynamic_pointer_cast<BasicVelGen>(gen)) desc.basicVel = basicVel;
+				else if (auto sphereVel = std::dynamic_pointer_cast<SphereVelGen>(gen)) desc.sphereVel = sphereVel;
+				else if (auto velFromPos = std::dynamic_pointer_cast<VelFromPosGen>(gen)) desc.velFromPos = velFromPos;
+				else if (auto time = std::dynamic_pointer_cast<BasicTimeGen>(gen)) desc.time = time;
+				else
+					DBG("ComputeParticleSystem", DebugLevel::WARNING, "generator has no gpu version, it is skipped\n");
+			}
+			m_emitters.push_back(desc);
+		}
+	}
+
+	void ComputeParticleSystem::reset()
+	{
+		if (m_count == 0)
+			return;
+
+		// every slot is free and dead
+		std::vector<uint32_t> freeList(m_count);
+		std::iota(freeList.begin(), freeList.end(), 0);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[FREE_LIST]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_count * sizeof(uint32_t), freeList.data());
+
+		const int32_t freeCount = (int32_t)m_count;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[FREE_COUNT]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(freeCount), &freeCount);
+
+		const glm::vec4 deadTime{ -1.0f, 0.0f, 0.0f, 0.0f };
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[TIME]);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32F, GL_RGBA, GL_FLOAT, &deadTime.x);
+
+		const DrawArraysIndirectCommand command{ 0, 1, 0, 0 };
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[DRAW_COMMAND]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command), &command);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		m_countAlive = 0;
+	}
+
+	void ComputeParticleSystem::update(double dt)
+	{
+		if (m_count == 0 || !m_emitShader)
+			return;
+
+		// the alive particles are counted again from scratch
+		const DrawArraysIndirectCommand command{ 0, 1, 0, 0 };
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[DRAW_COMMAND]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command), &command);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		for (int b = 0; b < BUFFER_COUNT; ++b)
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, m_buffers[b]);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		m_emitShader->bind();
+		for (const auto& desc : m_emitters)
+		{
+			const size_t count = std::min((size_t)(dt * desc.emitter->m_emitRate), m_count);
+			if (count > 0)
+				emit(desc, (uint32_t)count);
+		}
+
+		m_updateShader->bind();
+		m_updateShader->setUniformI("particleCount", (int)m_count);
+		setUpdateUniforms(m_updateShader.get(), (float)dt);
+
+		m_updateShader->dispatch(groupsFor(m_count));
+
+		// the draw reads the appended particles as vertex attributes and the count as indirect command
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		glUseProgram(0);
+
+		readAliveCount();
+	}
+
+	void ComputeParticleSystem::emit(const EmitterDesc& desc, uint32_t count)
+	{
+		int posMode = POS_NONE;
+		glm::vec4 posCenter{ 0.0f }, posExtent{ 0.0f };
+		if (desc.boxPos)
+		{
+			posMode = POS_BOX;
+			posCenter = desc.boxPos->m_pos;
+			posExtent = desc.boxPos->m_maxStartPosOffset;
+		}
+		else if (desc.roundPos)
+		{
+			posMode = POS_ROUND;
+			posCenter = desc.roundPos->m_center;
+			posExtent = glm::vec4(desc.roundPos->m_radX, desc.roundPos->m_radY, 0.0f, 0.0f);
+		}
+		else if (desc.spherePos)
+		{
+			posMode = POS_SPHERE;
+			posCenter = desc.spherePos->m_center;
+			posExtent = glm::vec4(desc.spherePos->m_radius, 0.0f, 0.0f, 0.0f);
+		}
+
+		int velMode = VEL_NONE;
+		glm::vec4 minVel{ 0.0f }, maxVel{ 0.0f }, velOffset{ 0.0f };
+		if (desc.basicVel)
+		{
+			velMode = VEL_BASIC;
+			minVel = desc.basicVel->m_minStartVel;
+			maxVel = desc.basicVel->m_maxStartVel;
+		}
+		else if (desc.sphereVel)
+		{
+			velMode = VEL_SPHERE;
+			minVel.x = desc.sphereVel->m_minVel;
+			maxVel.x = desc.sphereVel->m_maxVel;
+		}
+		else if (desc.velFromPos)
+		{
+			velMode = VEL_FROM_POS;
+			minVel.x = desc.velFromPos->m_minScale;
+			maxVel.x = desc.velFromPos->m_maxScale;
+			velOffset = desc.velFromPos->m_offset;
+		}
+
+		m_emitShader->setUniformI("emitCount", (int)count);
+		m_emitShader->setUniformI("seed", (int)m_seed++);
+		m_emitShader->setUniformI("posMode", posMode);
+		m_emitShader->setUniformF("posCenter", posCenter);
+		m_emitShader->setUniformF("posExtent", posExtent);
+
+		m_emitShader->setUniformI("colorEnabled", desc.color ? 1 : 0);
+		if (desc.color)
+		{
+			m_emitShader->setUniformF("minStartCol", desc.color->m_minStartCol);
+			m_emitShader->setUniformF("maxStartCol", desc.color->m_maxStartCol);
+			m_emitShader->setUniformF("minEndCol", desc.color->m_minEndCol);
+			m_emitShader->setUniformF("maxEndCol", desc.color->m_maxEndCol);
+		}
+
+		m_emitShader->setUniformI("velMode", velMode);
+		m_emitShader->setUniformF("minVel", minVel);
+		m_emitShader->setUniformF("maxVel", maxVel);
+		m_emitShader->setUniformF("velOffset", velOffset);
+
+		m_emitShader->setUniformI("timeEnabled", desc.time ? 1 : 0);
+		m_emitShader->setUniformF("minTime", desc.time ? desc.time->m_minTime : 1.0f);
+		m_emitShader->setUniformF("maxTime", desc.time ? desc.time->m_maxTime : 1.0f);
+
+		m_emitShader->dispatch(groupsFor(count));
+
+		// the next emitter pops from the same free list
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	void ComputeParticleSystem::readAliveCount()
+	{
+		// the count of an earlier frame is picked up once its copy is done, waiting would stall the pipeline
+		if (m_readbackFence)
+		{
+			const GLenum status = glClientWaitSync((GLsync)m_readbackFence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				return;
+
+			glDeleteSync((GLsync)m_readbackFence);
+			m_readbackFence = nullptr;
+
+			GLuint count = 0;
+			glBindBuffer(GL_COPY_READ_BUFFER, m_readbackBuffer);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(count), &count);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+			setAliveCount(count);
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[DRAW_COMMAND]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_readbackBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void ComputeParticleSystem::render()
+	{
+		if (m_vao == 0)
+			return;
+
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_buffers[DRAW_COMMAND]);
+		glDrawArraysIndirect(GL_POINTS, nullptr);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
+	void ComputeParticleSystem::download(std::vector<glm::vec4>& pos, std::vector<glm::vec4>& col) const
+	{
+		DrawArraysIndirectCommand command{ 0, 0, 0, 0 };
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[DRAW_COMMAND]);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command), &command);
+
+		const size_t count = std::min((size_t)command.count, m_count);
+		pos.resize(count);
+		col.resize(count);
+		if (count > 0)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[DRAW_POS]);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(glm::vec4), pos.data());
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[DRAW_COL]);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(glm::vec4), col.data());
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "GpuParticleBackend.h"
+#include "ParticleGenerators.h"
+
+
+namespace nhahn
+{
+	/*
+	 * Compute shader backend. Particles stay in their slot for life, dead slots are kept in a free
+	 * list that the emitter pops with atomics, so the generators run on the gpu as well. Supported
+	 * are the box/round/sphere position, basic/sphere velocity, velocity from position, basic color
+	 * and time generators. The update pass appends the alive particles to the draw buffers and
+	 * counts them straight into an indirect draw command.
+	 */
+	class ComputeParticleSystem : public GpuParticleBackend
+	{
+	public:
+		// storage buffer binding points, the particle_*.comp shaders use the same numbers
+		enum BufferBinding
+		{
+			POS = 0,
+			COL,
+			START_COL,
+			END_COL,
+			VEL,
+			TIME,
+			FREE_LIST,
+			FREE_COUNT,
+			DRAW_POS,		// alive particles only, read by the draw call
+			DRAW_COL,
+			DRAW_COMMAND,	// DrawArraysIndirectCommand, .count is the alive counter
+			BUFFER_COUNT
+		};
+
+		ComputeParticleSystem();
+		~ComputeParticleSystem();
+
+		bool generate(ParticleSystem* sys) override;
+		void destroy() override;
+
+		void reset() override;
+		void update(double dt) override;
+		void render() override;
+
+		void download(std::vector<glm::vec4>& pos, std::vector<glm::vec4>& col) const override;
+
+		const char* name() const override { return "compute"; }
+
+	protected:
+		struct EmitterDesc
+		{
+			std::shared_ptr<ParticleEmitter> emitter;
+			std::shared_ptr<BoxPosGen> boxPos;
+			std::shared_ptr<RoundPosGen> roundPos;
+			std::shared_ptr<SpherePosGen> spherePos;
+			std::shared_ptr<BasicColorGen> color;
+			std::shared_ptr<BasicVelGen> basicVel;
+			std::shared_ptr<SphereVelGen> sphereVel;
+			std::shared_ptr<VelFromPosGen> velFromPos;
+			std::shared_ptr<BasicTimeGen> time;
+		};
+
+		void collectEmitters(ParticleSystem* sys);
+		void emit(const EmitterDesc& desc, uint32_t count);
+		void readAliveCount();
+
+	protected:
+		std::unique_ptr<Shader> m_emitShader;
+		std::unique_ptr<Shader> m_updateShader;
+
+		unsigned int m_buffers[BUFFER_COUNT]{ };
+		unsigned int m_vao{ 0 };
+		unsigned int m_readbackBuffer{ 0 };
+		void* m_readbackFence{ nullptr };
+		uint32_t m_seed{ 0 };
+
+		std::vector<EmitterDesc> m_emitters;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,186 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "DensityThinner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include "ParticleData.h"
+#include "utility/Debug.h"
+#include "utility/JobSystem.h"
+#include "utility/Timer.h"
+
+const size_t THIN_CHUNK = 8192;		// particles per job
+
+
+namespace nhahn
+{
+	// the seedHash of GLParticleRenderer.cpp on the bits of time.w, fixed for the life of a particle
+	static inline uint32_t lifetimeHash(float invLifetime)
+	{
+		uint32_t h;
+		memcpy(&h, &invLifetime, sizeof(h));
+		h ^= h >> 16;
+		h *= 0x7feb352d;
+		h ^= h >> 15;
+		h *= 0x846ca68b;
+		return h ^ (h >> 16);
+	}
+
+	size_t DensityThinner::thin(const ParticleData* p, size_t count, const glm::mat4& viewMat, const glm::mat4& projMat,
+		int viewportW, int viewportH, const ThinningSettings& settings, glm::vec4* pos, glm::vec4* col)
+	{
+		ASSERT(viewportW > 0 && viewportH > 0, "DensityThinner: empty viewport");
+
+		Timer timer;
+
+		const int tileSize = std::max(settings.tileSize, 4);
+		const int tilesX = (viewportW + tileSize - 1) / tileSize;
+		const int tilesY = (viewportH + tileSize - 1) / tileSize;
+
+		// the fractions of the last frame only carry over to the same grid
+		if (tilesX != m_tilesX || tilesY != m_tilesY || viewportW != m_viewportW || viewportH != m_viewportH)
+		{
+			m_keep.assign((size_t)tilesX * tilesY, 1.0f);
+			m_tilesX = tilesX;
+			m_tilesY = tilesY;
+			m_viewportW = viewportW;
+			m_viewportH = viewportH;
+		}
+
+		estimateDensity(p, count, viewMat, projMat, (float)tileSize);
+		updateKeepFractions(std::max(settings.budget, 0.01f), tileSize);
+		const size_t kept = selectParticles(p, count, pos, col);
+
+		m_ms = (double)timer.getMicroseconds() / 1000.0;
+		return kept;
+	}
+
+	void DensityThinner::estimateDensity(const ParticleData* p, size_t count, const glm::mat4& viewMat, const glm::mat4& projMat, float tileSize)
+	{
+		const size_t tileCount = (size_t)m_tilesX * m_tilesY;
+		const size_t jobs = (count + THIN_CHUNK - 1) / THIN_CHUNK;
+		m_tiles.resize(count);
+		m_jobAreas.assign(jobs * tileCount, 0.0f);
+
+		const glm::vec4* positions = p->m_pos;
+		int32_t* tiles = m_tiles.data();
+		float* jobAreas = m_jobAreas.data();
+		const int tilesX = m_tilesX, tilesY = m_tilesY;
+		const float halfW = 0.5f * (float)m_viewportW, halfH = 0.5f * (float)m_viewportH;
+		const float invTile = 1.0f / tileSize;
+
+		JobSystem::instance().parallelFor(count, THIN_CHUNK, [=](size_t begin, size_t end) {
+			float* areas = jobAreas + (begin / THIN_CHUNK) * tileCount;
+			for (size_t i = begin; i < end; ++i)
+			{
+				const glm::vec4 eyePos = viewMat * glm::vec4(glm::vec3(positions[i]), 1.0f);
+				const glm::vec4 clipPos = projMat * eyePos;
+				if (clipPos.w <= 0.0f || fabsf(clipPos.x) > clipPos.w || fabsf(clipPos.y) > clipPos.w || fabsf(clipPos.z) > clipPos.w)
+				{
+					tiles[i] = -1;
+					continue;
+				}
+
+				const float invW = 1.0f / clipPos.w;
+				const int tx = std::min((int)((clipPos.x * invW + 1.0f) * halfW * invTile), tilesX - 1);
+				const int ty = std::min((int)((clipPos.y * invW + 1.0f) * halfH * invTile), tilesY - 1);
+				const int tile = ty * tilesX + tx;
+				tiles[i] = tile;
+
+				// the point size of particles.vert, the whole sprite counts for the tile of its center
+				const float dist = sqrtf(eyePos.x * eyePos.x + eyePos.y * eyePos.y + eyePos.z * eyePos.z);
+				const float side = 2.0f * positions[i].w / sqrtf(std::max(0.5f * dist, 1e-6f));
+				areas[tile] += side * side;
+			}
+		});
+	}
+
+	void DensityThinner::updateKeepFractions(float budget, int tileSize)
+	{
+		const size_t tileCount = m_keep.size();
+		const size_t jobs = m_jobAreas.size() / std::max<size_t>(tileCount, 1);
+
+		m_denseTiles = 0;
+		m_maxOverdraw = 0.0f;
+		for (size_t t = 0; t < tileCount; ++t)
+		{
+			float area = 0.0f;
+			for (size_t j = 0; j < jobs; ++j)
+				area += m_jobAreas[j * tileCount + t];
+
+			// the last column and row are cut by the viewport
+			const int tileW = std::min(tileSize, m_viewportW - (int)(t % m_tilesX) * tileSize);
+			const int tileH = std::min(tileSize, m_viewportH - (int)(t / m_tilesX) * tileSize);
+			const float overdraw = area / (float)(tileW * tileH);
+			const float keep = (overdraw > budget) ? budget / overdraw : 1.0f;
+			m_maxOverdraw = std::max(m_maxOverdraw, overdraw);
+			m_denseTiles += (overdraw > budget) ? 1 : 0;
+
+			// half of the last frame's fraction damps the particles popping in and out at the threshold
+			m_keep[t] = 0.5f * (m_keep[t] + keep);
+		}
+	}
+
+	size_t DensityThinner::selectParticles(const ParticleData* p, size_t count, glm::vec4* pos, glm::vec4* col)
+	{
+		const size_t jobs = (count + THIN_CHUNK - 1) / THIN_CHUNK;
+		m_jobOffsets.assign(jobs + 1, 0);
+
+		const glm::vec4* time = p->m_time;
+		const float* keep = m_keep.data();
+		int32_t* tiles = m_tiles.data();
+		size_t* offsets = m_jobOffsets.data();
+		JobSystem& jobSystem = JobSystem::instance();
+
+		// the hash in the top 24 bits against the fraction, drops are marked for the copy
+		std::atomic<size_t> thinned{ 0 };
+		jobSystem.parallelFor(count, THIN_CHUNK, [=, &thinned](size_t begin, size_t end) {
+			size_t kept = 0, dropped = 0;
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (tiles[i] < 0)
+					continue;
+				const float u = (float)(lifetimeHash(time[i].w) >> 8) * (1.0f / 16777216.0f);
+				if (u < keep[tiles[i]])
+				{
+					kept++;
+				}
+				else
+				{
+					tiles[i] = -1;
+					dropped++;
+				}
+			}
+			offsets[begin / THIN_CHUNK + 1] = kept;
+			thinned += dropped;
+		});
+
+		for (size_t j = 0; j < jobs; ++j)
+			offsets[j + 1] += offsets[j];
+
+		const glm::vec4* srcPos = p->m_pos;
+		const glm::vec4* srcCol = p->m_col;
+		jobSystem.parallelFor(count, THIN_CHUNK, [=](size_t begin, size_t end) {
+			size_t out = offsets[begin / THIN_CHUNK];
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (tiles[i] < 0)
+					continue;
+				pos[out] = srcPos[i];
+				col[out] = srcCol[i];
+				col[out].a /= keep[tiles[i]];
+				out++;
+			}
+		});
+
+		m_thinned = thinned;
+		return offsets[jobs];
+	}
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+#include "utility/Types.h"
+#include "ParticleRenderer.h"
+
+
+namespace nhahn
+{
+	class ParticleData;
+
+	/*
+	 * Thins the point sprites where they pile up on screen, where fill rate and not the vertex count
+	 * limits. The particles are projected on the cpu and every screen tile sums the pixel areas of the
+	 * sprites centered in it, over the tile area that estimates its overdraw. A tile above the budget
+	 * keeps the fraction budget / overdraw of its particles, picked by a hash of the lifetime, so the
+	 * same particles stay from frame to frame. The kept ones get their alpha divided by the fraction,
+	 * which keeps the expected brightness of additive blending.
+	 */
+	class DensityThinner
+	{
+	public:
+		DensityThinner() { }
+
+		/* writes the kept ones of the first count particles to pos and col and returns how many, particles
+		   with the center outside of the view are dropped like the gl clips them */
+		size_t thin(const ParticleData* p, size_t count, const glm::mat4& viewMat, const glm::mat4& projMat,
+			int viewportW, int viewportH, const ThinningSettings& settings, glm::vec4* pos, glm::vec4* col);
+
+		/* how the last frame went, for the ui */
+		size_t numThinned() const { return m_thinned; }
+		size_t numDenseTiles() const { return m_denseTiles; }
+		/* estimated overdraw of the densest tile before thinning */
+		float maxOverdraw() const { return m_maxOverdraw; }
+		double lastMilliseconds() const { return m_ms; }
+
+	private:
+		void estimateDensity(const ParticleData* p, size_t count, const glm::mat4& viewMat, const glm::mat4& projMat, float tileSize);
+		void updateKeepFractions(float budget, int tileSize);
+		size_t selectParticles(const ParticleData* p, size_t count, glm::vec4* pos, glm::vec4* col);
+
+	private:
+		std::vector<int32_t> m_tiles;			// of every particle, -1 once it is dropped
+		std::vector<float> m_jobAreas;			// sprite pixels per tile of every job
+		std::vector<float> m_keep;				// fraction of the particles every tile keeps
+		std::vector<size_t> m_jobOffsets;		// kept particles of every job, then where they go
+
+		int m_viewportW{ 0 }, m_viewportH{ 0 };
+		int m_tilesX{ 0 }, m_tilesY{ 0 };
+		size_t m_thinned{ 0 };
+		size_t m_denseTiles{ 0 };
+		float m_maxOverdraw{ 0.0f };
+		double m_ms{ 0.0 };
+	};
+}
\ No newline at end of file
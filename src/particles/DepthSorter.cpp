@@ -0,0 +1,279 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "DepthSorter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <immintrin.h>
+#include "utility/Debug.h"
+#include "utility/JobSystem.h"
+#include "utility/Timer.h"
+
+const size_t RADIX = 256;
+const size_t RADIX_PASSES = 4;
+const size_t MIN_BLOCK_SIZE = 16384;	// keys per block of the radix passes
+const size_t MAX_BLOCKS = 64;
+
+
+namespace nhahn
+{
+	// floats as unsigned integers in the same order, negatives have all bits flipped, positives the sign bit
+	static inline __m128i sortableKeys(__m128 depth)
+	{
+		const __m128i bits = _mm_castps_si128(depth);
+		const __m128i mask = _mm_or_si128(_mm_srai_epi32(bits, 31), _mm_set1_epi32((int32_t)0x80000000));
+		return _mm_xor_si128(bits, mask);
+	}
+
+	static inline size_t blockCount(size_t count)
+	{
+		return std::min(MAX_BLOCKS, std::max<size_t>(1, count / MIN_BLOCK_SIZE));
+	}
+
+	void DepthSorter::sort(const glm::vec4* pos, size_t count, const glm::mat4& viewMat)
+	{
+		ASSERT(count <= UINT32_MAX, "DepthSorter: the indices are 32 bit");
+
+		Timer timer;
+
+		const bool seeded = m_coherent && m_count > 0;
+		seedOrder(count);
+		m_count = count;
+		m_incremental = false;
+		m_passes = 0;
+
+		if (count > 1)
+		{
+			m_keys.resize(count);
+
+			// the keys are computed in slot order, which reads the positions linearly, and a seed from the
+			// last frame only gathers them. A nearly sorted seed is cheaper to repair than to sort again,
+			// a bad guess falls through to the radix sort
+			if (seeded)
+			{
+				m_slotKeys.resize(count);
+				computeKeys(pos, viewMat, m_slotKeys.data());
+				gatherKeys();
+				if (countDescents() <= count / 4)
+					m_incremental = repairOrder();
+			}
+			else
+				computeKeys(pos, viewMat, m_keys.data());
+
+			if (!m_incremental)
+				radixSort();
+		}
+
+		m_ms = (double)timer.getMicroseconds() / 1000.0;
+	}
+
+	void DepthSorter::seedOrder(size_t count)
+	{
+		if (!m_coherent || m_count == 0)
+		{
+			m_indices.resize(count);
+			std::iota(m_indices.begin(), m_indices.end(), 0u);
+			return;
+		}
+
+		// the last order is a permutation of [0, m_count), the slots from count on died since and the
+		// slots from m_count on are new. Kills swap particles between slots, the sort takes care of that
+		size_t n = m_count;
+		if (count < m_count)
+			n = std::remove_if(m_indices.begin(), m_indices.begin() + m_count, [count](uint32_t i) { return i >= count; }) - m_indices.begin();
+
+		m_indices.resize(count);
+		for (size_t i = n; i < count; ++i)
+			m_indices[i] = (uint32_t)i;
+	}
+
+	void DepthSorter::computeKeys(const glm::vec4* pos, const glm::mat4& viewMat, uint32_t* keys) const
+	{
+		// eye space z, the camera looks down -z so the farthest particle has the smallest key
+		const __m128 rowX = _mm_set1_ps(viewMat[0][2]);
+		const __m128 rowY = _mm_set1_ps(viewMat[1][2]);
+		const __m128 rowZ = _mm_set1_ps(viewMat[2][2]);
+		const __m128 rowW = _mm_set1_ps(viewMat[3][2]);
+
+		JobSystem::instance().parallelFor(m_count, MIN_BLOCK_SIZE, [=](size_t begin, size_t end) {
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				__m128 x = _mm_load_ps(&pos[i + 0].x);
+				__m128 y = _mm_load_ps(&pos[i + 1].x);
+				__m128 z = _mm_load_ps(&pos[i + 2].x);
+				__m128 w = _mm_load_ps(&pos[i + 3].x);
+				_MM_TRANSPOSE4_PS(x, y, z, w);
+
+				const __m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, rowX), _mm_mul_ps(y, rowY)), _mm_add_ps(_mm_mul_ps(z, rowZ), rowW));
+				_mm_storeu_si128((__m128i*)(keys + i), sortableKeys(depth));
+			}
+
+			for (; i < end; ++i)
+			{
+				const float depth = pos[i].x * viewMat[0][2] + pos[i].y * viewMat[1][2] + pos[i].z * viewMat[2][2] + viewMat[3][2];
+				keys[i] = (uint32_t)_mm_cvtsi128_si32(sortableKeys(_mm_set_ss(depth)));
+			}
+		});
+	}
+
+	void DepthSorter::gatherKeys()
+	{
+		const uint32_t* slotKeys = m_slotKeys.data();
+		const uint32_t* indices = m_indices.data();
+		uint32_t* keys = m_keys.data();
+
+		JobSystem::instance().parallelFor(m_count, MIN_BLOCK_SIZE, [=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				keys[i] = slotKeys[indices[i]];
+		});
+	}
+
+	size_t DepthSorter::countDescents() const
+	{
+		const size_t blocks = blockCount(m_count);
+		const size_t blockSize = (m_count + blocks - 1) / blocks;
+		std::vector<size_t> descents(blocks, 0);
+
+		JobSystem::instance().parallelFor(blocks, 1, [&](size_t first, size_t last) {
+			for (size_t b = first; b < last; ++b)
+			{
+				const size_t end = std::min(m_count - 1, (b + 1) * blockSize);
+				size_t n = 0;
+				for (size_t i = b * blockSize; i < end; ++i)
+					n += (m_keys[i] > m_keys[i + 1]) ? 1 : 0;
+				descents[b] = n;
+			}
+		});
+
+		return std::accumulate(descents.begin(), descents.end(), (size_t)0);
+	}
+
+	bool DepthSorter::insertionSort(size_t begin, size_t end, size_t maxMoves)
+	{
+		uint32_t* keys = m_keys.data();
+		uint32_t* indices = m_indices.data();
+		size_t moves = 0;
+
+		for (size_t i = begin + 1; i < end; ++i)
+		{
+			const uint32_t key = keys[i];
+			if (keys[i - 1] <= key)
+				continue;
+
+			const uint32_t index = indices[i];
+			size_t j = i;
+			for (; j > begin && keys[j - 1] > key; --j)
+			{
+				keys[j] = keys[j - 1];
+				indices[j] = indices[j - 1];
+			}
+			keys[j] = key;
+			indices[j] = index;
+
+			// particles that moved far, the order is still valid for the radix sort to take over
+			moves += i - j;
+			if (moves > maxMoves)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool DepthSorter::repairOrder()
+	{
+		const size_t blocks = blockCount(m_count);
+		const size_t blockSize = (m_count + blocks - 1) / blocks;
+		std::atomic<bool> failed{ false };
+
+		// the blocks are repaired in parallel, the final pass only moves the particles that have to
+		// cross a block border and mostly just compares
+		JobSystem::instance().parallelFor(blocks, 1, [&](size_t first, size_t last) {
+			for (size_t b = first; b < last && !failed; ++b)
+			{
+				if (!insertionSort(b * blockSize, std::min(m_count, (b + 1) * blockSize), 2 * blockSize))
+					failed = true;
+			}
+		});
+
+		return !failed && insertionSort(0, m_count, m_count);
+	}
+
+	void DepthSorter::radixSort()
+	{
+		const size_t count = m_count;
+		const size_t blocks = blockCount(count);
+		const size_t blockSize = (count + blocks - 1) / blocks;
+
+		m_scratchKeys.resize(count);
+		m_scratchIndices.resize(count);
+		m_histograms.resize(blocks * RADIX);
+
+		for (size_t pass = 0; pass < RADIX_PASSES; ++pass)
+		{
+			const uint32_t shift = (uint32_t)(8 * pass);
+
+			const uint32_t* keys = m_keys.data();
+			const uint32_t* indices = m_indices.data();
+			uint32_t* dstKeys = m_scratchKeys.data();
+			uint32_t* dstIndices = m_scratchIndices.data();
+			uint32_t* histograms = m_histograms.data();
+
+			JobSystem::instance().parallelFor(blocks, 1, [=](size_t first, size_t last) {
+				for (size_t b = first; b < last; ++b)
+				{
+					uint32_t* histogram = histograms + b * RADIX;
+					std::fill(histogram, histogram + RADIX, 0u);
+
+					const size_t end = std::min(count, (b + 1) * blockSize);
+					for (size_t i = b * blockSize; i < end; ++i)
+						histogram[(keys[i] >> shift) & (RADIX - 1)]++;
+				}
+			});
+
+			// offsets in digit major, block minor order, so every block scatters into its own ranges and
+			// the pass stays stable. A digit holding every key leaves the order as it is
+			bool skip = false;
+			uint32_t offset = 0;
+			for (size_t d = 0; d < RADIX && !skip; ++d)
+			{
+				const uint32_t digitStart = offset;
+				for (size_t b = 0; b < blocks; ++b)
+				{
+					const uint32_t n = m_histograms[b * RADIX + d];
+					m_histograms[b * RADIX + d] = offset;
+					offset += n;
+				}
+				skip = (offset - digitStart == count);
+			}
+			if (skip)
+				continue;
+
+			JobSystem::instance().parallelFor(blocks, 1, [=](size_t first, size_t last) {
+				for (size_t b = first; b < last; ++b)
+				{
+					uint32_t* histogram = histograms + b * RADIX;
+
+					const size_t end = std::min(count, (b + 1) * blockSize);
+					for (size_t i = b * blockSize; i < end; ++i)
+					{
+						const uint32_t key = keys[i];
+						const uint32_t dst = histogram[(key >> shift) & (RADIX - 1)]++;
+						dstKeys[dst] = key;
+						dstIndices[dst] = indices[i];
+					}
+				}
+			});
+
+			m_keys.swap(m_scratchKeys);
+			m_indices.swap(m_scratchIndices);
+			m_passes++;
+		}
+	}
+}
\ No newline at end of file
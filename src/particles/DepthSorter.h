@@ -0,0 +1,73 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+#include "utility/Types.h"
+
+#ifndef GLM_FORCE_INTRINSICS
+#define GLM_FORCE_INTRINSICS
+#endif // !GLM_FORCE_INTRINSICS
+#include <glm/glm.hpp>
+
+
+namespace nhahn
+{
+	/*
+	 * Orders particles back to front along the view direction for alpha blending. The keys are the
+	 * eye space depths as sortable 32 bit integers, computed four at a time, and are sorted along with
+	 * the particle indices by four 8 bit passes of a least significant digit radix sort. Every pass
+	 * splits the keys into blocks for the job system threads, a pass is skipped when all keys share
+	 * its digit.
+	 * With temporal coherence the keys are gathered into the order of the last frame. A camera or particles
+	 * moving a little leave that order nearly sorted, then insertion sorts over the blocks and a last one
+	 * across their borders fix the swapped neighbours instead of running the radix passes.
+	 */
+	class DepthSorter
+	{
+	public:
+		DepthSorter() { }
+
+		/* sorts the first count particles for the view matrix, the result is valid until the next call */
+		void sort(const glm::vec4* pos, size_t count, const glm::mat4& viewMat);
+
+		const uint32_t* indices() const { return m_indices.data(); }
+		size_t count() const { return m_count; }
+
+		void setTemporalCoherence(bool enabled) { m_coherent = enabled; }
+		bool temporalCoherence() const { return m_coherent; }
+
+		/* how the last sort went, for the ui and the benchmark */
+		bool wasIncremental() const { return m_incremental; }
+		size_t numRadixPasses() const { return m_passes; }
+		double lastMilliseconds() const { return m_ms; }
+
+	private:
+		void seedOrder(size_t count);
+		void computeKeys(const glm::vec4* pos, const glm::mat4& viewMat, uint32_t* keys) const;
+		void gatherKeys();
+		size_t countDescents() const;
+		bool insertionSort(size_t begin, size_t end, size_t maxMoves);
+		bool repairOrder();
+		void radixSort();
+
+	private:
+		std::vector<uint32_t> m_keys;
+		std::vector<uint32_t> m_slotKeys;		// keys of the particle slots, gathered into the seeded order
+		std::vector<uint32_t> m_indices;
+		std::vector<uint32_t> m_scratchKeys;
+		std::vector<uint32_t> m_scratchIndices;
+		std::vector<uint32_t> m_histograms;		// 256 counters per block
+
+		size_t m_count{ 0 };
+		bool m_coherent{ true };
+		bool m_incremental{ false };
+		size_t m_passes{ 0 };
+		double m_ms{ 0.0 };
+	};
+}
\ No newline at end of file
@@ -7,11 +7,13 @@
 \*------------------------------------------------------------------------------------------------*/
 #include "Effect.h"
 
+#include <algorithm>
 #include <string>
 #include "TunnelEffect.h"
 #include "FountainEffect.h"
 #include "AttractorEffect.h"
 #include "BurningEffect.h"
+#include "VerletEffect.h"
 
 
 namespace nhahn
@@ -28,7 +30,23 @@ namespace nhahn
 			return std::make_shared<FountainEffect>();
 		else if (effect == "burning")
 			return std::make_shared<BurningEffect>();
+		else if (effect == "verlet")
+			return std::make_shared<VerletEffect>();
 
 		return nullptr;
 	}
+
+	bool IEffect::systemBounds(const ParticleSystem* sys, const IParticleRenderer* renderer, glm::vec4& boundsMin, glm::vec4& boundsMax)
+	{
+		const ParticleData* p = sys->finalData();
+		const float margin = renderer ? renderer->cullMargin() : -1.0f;
+		if (!p->m_boundsValid || margin < 0.0f)
+			return false;
+
+		// w holds the size scale of the particles
+		const glm::vec4 extent{ glm::vec3(margin * std::max(p->m_boundsMax.w, 0.0f)), 0.0f };
+		boundsMin = p->m_boundsMin - extent;
+		boundsMax = p->m_boundsMax + extent;
+		return true;
+	}
 }
\ No newline at end of file
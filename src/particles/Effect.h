@@ -8,9 +8,14 @@
 #pragma once
 
 #include <memory>
+#include "glm/glm.hpp"
+#include "ScenePass.h"
 
 namespace nhahn
 {
+	class ParticleSystem;
+	class IParticleRenderer;
+
 	class IEffect
 	{
 	public:
@@ -29,6 +34,11 @@ namespace nhahn
 		virtual void render() = 0;
 		virtual void renderUI() = 0;
 
+		/* camera and blending of the next gpu update and render, for effects drawing with their own shaders */
+		virtual void setView(const ScenePass& pass) { }
+		/* world space box around everything the next render draws, false when it isn't known */
+		virtual bool bounds(glm::vec4& boundsMin, glm::vec4& boundsMax) { return false; }
+
 		virtual int numAllParticles() = 0;
 		virtual int numAliveParticles() = 0;
 		virtual double aliveToAllRatio() = 0;
@@ -37,6 +47,10 @@ namespace nhahn
 		static const size_t DEFAULT_PARTICLE_NUM_FLAG = 0;		// for initialize method
 		static const size_t DEFAULT_PARTICLE_COUNT = 500000;	// 500k particles
 		//enum Name { };
+
+	protected:
+		/* bounds of the cpu particles from the last update, grown by the extent of what the renderer draws around them */
+		static bool systemBounds(const ParticleSystem* sys, const IParticleRenderer* renderer, glm::vec4& boundsMin, glm::vec4& boundsMax);
 	};
 
 	class EffectFactory
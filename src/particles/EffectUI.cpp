@@ -0,0 +1,85 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "EffectUI.h"
+
+#include "imgui.h"
+#include "DensityThinner.h"
+#include "DepthSorter.h"
+#include "ParticleRenderer.h"
+#include "ParticleSystem.h"
+#include "ui/CustomWidgets.h"
+
+
+namespace nhahn
+{
+	void uploadFormatUI(ParticleSystem* sys, bool& useAgeSeed, int& vertexFormat, std::vector<GLParticleRendererQuantized::QuantizationError>& errors)
+	{
+		ImGui::Checkbox("gpu color", &useAgeSeed);
+		ImGui::SameLine(); ImGui::HelpMarker("Uploads only position, age and a color seed per particle, half of the usual upload. Color, and size where the effect has size keys, are rebuilt in the vertex shader instead of by their updaters.");
+
+		ImGui::Combo("vertex format", &vertexFormat, GLParticleRendererQuantized::FORMAT_NAMES, GLParticleRendererQuantized::FORMAT_COUNT);
+		ImGui::SameLine(); ImGui::HelpMarker("Position and color formats of the upload. Half and unorm16 positions take half the bytes of float, unorm16 is relative to the bounds of the alive particles.\nThe error report encodes the current particles in every format and compares what the shaders get back.");
+		if (ImGui::Button("quantization error"))
+			errors = GLParticleRendererQuantized::measureErrors(sys);
+		for (const auto& error : errors)
+		{
+			ImGui::Text("%-18s %2d B  pos max %.1e mean %.1e (%.3f%%)  size %.1e  color %.4f", GLParticleRendererQuantized::FORMAT_NAMES[error.format], (int)error.bytesPerParticle,
+				error.maxPosError, error.meanPosError, 100.0f * error.relativePosError, error.maxSizeError, error.maxColorError);
+		}
+	}
+
+	bool quadsUI(IParticleRenderer& renderer, bool& useQuads)
+	{
+		const bool changed = ImGui::Checkbox("quads", &useQuads);
+		ImGui::SameLine(); ImGui::HelpMarker("Draws every particle as an instanced quad instead of a point sprite, which drivers clamp in size. The quads turn by a random angle plus the spin over their lifetime, or stretch along their velocity on screen.");
+		if (useQuads)
+		{
+			QuadSettings& quad = renderer.quadSettings();
+			ImGui::SliderFloat("quad size", &quad.size, 0.001f, 0.1f, "%.3f");
+			ImGui::SliderFloat("spin", &quad.spin, -4.0f, 4.0f, "%.2f turns");
+			ImGui::SliderFloat("stretch", &quad.stretch, 0.0f, 2.0f, "%.2f");
+		}
+		return changed;
+	}
+
+	void rendererUI(IParticleRenderer& renderer, size_t aliveCount)
+	{
+		bool depthSort = renderer.depthSorter() != nullptr;
+		if (ImGui::Checkbox("depth sort", &depthSort))
+			renderer.setDepthSort(depthSort);
+		ImGui::SameLine(); ImGui::HelpMarker("Draws the particles back to front with alpha blending instead of adding them up, sorted by their view depth on all threads every frame.\nTemporal coherence starts from the order of the last frame and repairs it while particles and camera move little, otherwise the full sort runs.\nSorts the float upload only, not the other vertex formats or gpu color.");
+		if (DepthSorter* sorter = renderer.depthSorter())
+		{
+			bool coherent = sorter->temporalCoherence();
+			if (ImGui::Checkbox("temporal coherence", &coherent))
+				sorter->setTemporalCoherence(coherent);
+			if (sorter->wasIncremental())
+				ImGui::Text("sort %.2f ms, incremental", sorter->lastMilliseconds());
+			else
+				ImGui::Text("sort %.2f ms, %d radix passes", sorter->lastMilliseconds(), (int)sorter->numRadixPasses());
+		}
+
+		bool chunkCulling = renderer.chunkCulling();
+		if (ImGui::Checkbox("cull chunks", &chunkCulling))
+			renderer.setChunkCulling(chunkCulling);
+		ImGui::SameLine(); ImGui::HelpMarker("Uploads and draws only the blocks of 4096 particle slots whose bounds reach into the view. The whole effect is skipped when its bounds are off screen, with or without this.\nOff while depth sorting or with stretched quads, and for the other vertex formats or gpu color.");
+		if (renderer.chunkCulling())
+			ImGui::Text("%d of %d particles culled", (int)renderer.numCulledParticles(), (int)aliveCount);
+
+		bool thinning = (renderer.thinner() != nullptr);
+		if (ImGui::Checkbox("thin dense tiles", &thinning))
+			renderer.setThinning(thinning);
+		ImGui::SameLine(); ImGui::HelpMarker("Splits the view into tiles and estimates from the projected particles how many layers of sprites cover each. Where that is over the budget a fixed share of the particles, picked by a hash of their lifetime so none flicker, is dropped and the rest are brightened to keep the sum. Exact for additive blending.\nPoints only, off while depth sorting or blending with weighted transparency.");
+		if (DensityThinner* thinner = renderer.thinner())
+		{
+			ImGui::SliderFloat("layer budget", &renderer.thinningSettings().budget, 1.0f, 128.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+			ImGui::Text("%d thinned in %d tiles, densest %.1f layers, %.2f ms", (int)thinner->numThinned(), (int)thinner->numDenseTiles(),
+				thinner->maxOverdraw(), thinner->lastMilliseconds());
+		}
+	}
+}
\ No newline at end of file
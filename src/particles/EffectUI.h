@@ -0,0 +1,32 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+#include "GLParticleRenderer.h"
+
+
+namespace nhahn
+{
+	class ParticleSystem;
+	class IParticleRenderer;
+
+	/*
+	 * Settings panel parts shared by the effects. The widgets work on copies of the effect's state,
+	 * the effect applies the changed values with its own setters since those swap renderers.
+	 */
+
+	/* "gpu color" and "vertex format" with the quantization error report of the current particles */
+	void uploadFormatUI(ParticleSystem* sys, bool& useAgeSeed, int& vertexFormat, std::vector<GLParticleRendererQuantized::QuantizationError>& errors);
+
+	/* "quads" and, while they are on, the quad settings of the renderer. True when useQuads changed */
+	bool quadsUI(IParticleRenderer& renderer, bool& useQuads);
+
+	/* depth sort, chunk culling and thinning of the renderer with their statistics */
+	void rendererUI(IParticleRenderer& renderer, size_t aliveCount);
+}
\ No newline at end of file
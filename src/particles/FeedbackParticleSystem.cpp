@@ -0,0 +1,308 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "FeedbackParticleSystem.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <GL/glew.h>
+#include "render/Shader.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+
+
+namespace nhahn
+{
+	static void setupVertexArray(GLuint vao, GLuint buffer)
+	{
+		typedef FeedbackParticleSystem::Vertex Vertex;
+		const size_t offsets[] = {
+			offsetof(Vertex, pos), offsetof(Vertex, col), offsetof(Vertex, startCol),
+			offsetof(Vertex, endCol), offsetof(Vertex, vel), offsetof(Vertex, time)
+		};
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (GLuint a = 0; a < 6; ++a)
+		{
+			glEnableVertexAttribArray(a);
+			glVertexAttribPointer(a, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsets[a]);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// out of line, the header only forward declares Shader
+	FeedbackParticleSystem::FeedbackParticleSystem() { }
+	FeedbackParticleSystem::~FeedbackParticleSystem() { destroy(); }
+
+	bool FeedbackParticleSystem::generate(ParticleSystem* sys)
+	{
+		ASSERT(sys != nullptr, "FeedbackParticleSystem: particle system is null");
+
+		if (!GLEW_VERSION_3_3)
+		{
+			DBG("FeedbackParticleSystem", DebugLevel::WARNING, "transform feedback with geometry shaders needs OpenGL 3.3\n");
+			return false;
+		}
+
+		destroy();
+		m_count = sys->numAllParticles();
+
+		// the vertex shader runs the updaters, the geometry shader drops the dead particles
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_updateShader = std::make_unique<Shader>();
+		ShaderObject* vert = m_updateShader->addObject();
+		for (const char* file : { "common_gl3.inc", "particle_update.inc", "particle_feedback.vert" })
+			vert->addFile((path + file).c_str());
+		vert->compile(VERTEX_SHADER);
+		ShaderObject* geom = m_updateShader->addObject();
+		for (const char* file : { "common_gl3.inc", "particle_feedback.geom" })
+			geom->addFile((path + file).c_str());
+		geom->compile(GEOMETRY_SHADER);
+		for (const char* varying : { "outPos", "outCol", "outStartCol", "outEndCol", "outVel", "outTime" })
+			m_updateShader->addFeedbackVarying(varying);
+		m_updateShader->setFeedbackMode(FEEDBACK_INTERLEAVED);
+		m_updateShader->link();
+
+		glGenBuffers(2, m_buffers);
+		glGenVertexArrays(2, m_vaos);
+		for (int b = 0; b < 2; ++b)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_buffers[b]);
+			glBufferData(GL_ARRAY_BUFFER, m_count * sizeof(Vertex), nullptr, GL_DYNAMIC_COPY);
+			setupVertexArray(m_vaos[b], m_buffers[b]);
+		}
+
+		glGenBuffers(1, &m_spawnBuffer);
+		glGenVertexArrays(1, &m_spawnVao);
+		setupVertexArray(m_spawnVao, m_spawnBuffer);
+
+		if (GLEW_ARB_transform_feedback2)
+		{
+			glGenTransformFeedbacks(2, m_feedbacks);
+			for (int b = 0; b < 2; ++b)
+			{
+				glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_feedbacks[b]);
+				glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_buffers[b]);
+			}
+			glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+		}
+
+		glGenQueries(2, m_queries);
+
+		m_emitters = sys->emitters();
+		collectUpdaters(sys);
+		reset();
+		return true;
+	}
+
+	void FeedbackParticleSystem::destroy()
+	{
+		if (m_buffers[0] != 0)
+			glDeleteBuffers(2, m_buffers);
+		std::fill(std::begin(m_buffers), std::end(m_buffers), 0);
+
+		if (m_vaos[0] != 0)
+			glDeleteVertexArrays(2, m_vaos);
+		std::fill(std::begin(m_vaos), std::end(m_vaos), 0);
+
+		if (m_feedbacks[0] != 0)
+			glDeleteTransformFeedbacks(2, m_feedbacks);
+		std::fill(std::begin(m_feedbacks), std::end(m_feedbacks), 0);
+
+		if (m_queries[0] != 0)
+			glDeleteQueries(2, m_queries);
+		std::fill(std::begin(m_queries), std::end(m_queries), 0);
+
+		if (m_spawnBuffer != 0)
+			glDeleteBuffers(1, &m_spawnBuffer);
+		m_spawnBuffer = 0;
+
+		if (m_spawnVao != 0)
+			glDeleteVertexArrays(1, &m_spawnVao);
+		m_spawnVao = 0;
+
+		m_updateShader.reset();
+		m_spawnData.reset();
+		m_spawnVertices.clear();
+		m_emitters.clear();
+		m_count = 0;
+		m_countAlive = 0;
+	}
+
+	void FeedbackParticleSystem::reset()
+	{
+		m_hasSource = false;
+		m_sourceCount = 0;
+		m_queryPending[0] = m_queryPending[1] = false;
+		m_countAlive = 0;
+	}
+
+	void FeedbackParticleSystem::update(double dt)
+	{
+		if (m_count == 0 || !m_updateShader)
+			return;
+
+		const size_t spawned = spawn(dt);
+		const unsigned int source = m_current;
+		const unsigned int target = 1 - m_current;
+
+		m_updateShader->bind();
+		setUpdateUniforms(m_updateShader.get(), (float)dt);
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		if (m_feedbacks[0] != 0)
+			glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_feedbacks[target]);
+		else
+			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_buffers[target]);
+
+		// the particles that do not fit into the target are not written, the older ones go first
+		m_query = 1 - m_query;
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, m_queries[m_query]);
+		glBeginTransformFeedback(GL_POINTS);
+		if (m_hasSource)
+			drawSource(source);
+		if (spawned > 0)
+		{
+			glBindVertexArray(m_spawnVao);
+			glDrawArrays(GL_POINTS, 0, (GLsizei)spawned);
+		}
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		m_queryPending[m_query] = true;
+
+		glBindVertexArray(0);
+		if (m_feedbacks[0] != 0)
+			glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+		else
+			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		glUseProgram(0);
+
+		m_current = target;
+		m_hasSource = true;
+
+		// without feedback objects the next draw needs the count of this one
+		readAliveCount(m_feedbacks[0] == 0);
+	}
+
+	size_t FeedbackParticleSystem::spawn(double dt)
+	{
+		size_t needed = 0;
+		for (const auto& emitter : m_emitters)
+			needed += (size_t)(dt * emitter->m_emitRate);
+		needed = std::min(needed, m_count);
+		if (needed == 0)
+			return 0;
+
+		// the emitters stop one short of the end, see ParticleEmitter::emit
+		if (!m_spawnData || m_spawnData->m_count < needed + 1)
+			m_spawnData = std::make_unique<ParticleData>(needed + 1);
+
+		m_spawnData->m_countAlive = 0;
+		for (const auto& emitter : m_emitters)
+			emitter->emit(dt, m_spawnData.get());
+
+		const size_t spawned = m_spawnData->m_countAlive;
+		m_spawnVertices.resize(spawned);
+		for (size_t i = 0; i < spawned; ++i)
+		{
+			Vertex& v = m_spawnVertices[i];
+			v.pos = m_spawnData->m_pos[i];
+			v.col = m_spawnData->m_col[i];
+			v.startCol = m_spawnData->m_startCol[i];
+			v.endCol = m_spawnData->m_endCol[i];
+			v.vel = m_spawnData->m_vel[i];
+			v.time = m_spawnData->m_time[i];
+		}
+
+		// orphaned, the spawn buffer of the last frame may still be read
+		glBindBuffer(GL_ARRAY_BUFFER, m_spawnBuffer);
+		glBufferData(GL_ARRAY_BUFFER, spawned * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+		if (spawned > 0)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, spawned * sizeof(Vertex), m_spawnVertices.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		return spawned;
+	}
+
+	void FeedbackParticleSystem::readAliveCount(bool wait)
+	{
+		GLuint written = 0;
+		if (wait)
+		{
+			glGetQueryObjectuiv(m_queries[m_query], GL_QUERY_RESULT, &written);
+			m_queryPending[m_query] = false;
+			m_sourceCount = written;
+			setAliveCount(written);
+			return;
+		}
+
+		// the query of the frame before is picked up once it is done, waiting would stall the pipeline
+		const unsigned int older = 1 - m_query;
+		if (!m_queryPending[older])
+			return;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(m_queries[older], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return;
+
+		glGetQueryObjectuiv(m_queries[older], GL_QUERY_RESULT, &written);
+		m_queryPending[older] = false;
+		setAliveCount(written);
+	}
+
+	void FeedbackParticleSystem::drawSource(unsigned int index) const
+	{
+		glBindVertexArray(m_vaos[index]);
+		if (m_feedbacks[0] != 0)
+			glDrawTransformFeedback(GL_POINTS, m_feedbacks[index]);
+		else if (m_sourceCount > 0)
+			glDrawArrays(GL_POINTS, 0, (GLsizei)m_sourceCount);
+	}
+
+	void FeedbackParticleSystem::render()
+	{
+		if (!m_hasSource)
+			return;
+
+		drawSource(m_current);
+		glBindVertexArray(0);
+	}
+
+	void FeedbackParticleSystem::download(std::vector<glm::vec4>& pos, std::vector<glm::vec4>& col) const
+	{
+		pos.clear();
+		col.clear();
+		if (!m_hasSource)
+			return;
+
+		GLuint written = (GLuint)m_sourceCount;
+		if (m_feedbacks[0] != 0)
+			glGetQueryObjectuiv(m_queries[m_query], GL_QUERY_RESULT, &written);
+
+		const size_t count = std::min((size_t)written, m_count);
+		if (count == 0)
+			return;
+
+		std::vector<Vertex> vertices(count);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffers[m_current]);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Vertex), vertices.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		pos.resize(count);
+		col.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			pos[i] = vertices[i].pos;
+			col[i] = vertices[i].col;
+		}
+	}
+}
\ No newline at end of file
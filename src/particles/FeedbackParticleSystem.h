@@ -0,0 +1,81 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "GpuParticleBackend.h"
+#include "ParticleData.h"
+
+
+namespace nhahn
+{
+	/*
+	 * Transform feedback backend for drivers without compute shaders (GL 3.3). The alive particles
+	 * live in one of two vertex buffers, each update draws them as points through the updaters and
+	 * a geometry shader writes the survivors to the other buffer. New particles are made by the cpu
+	 * generators into a small spawn buffer that is drawn into the same feedback pass, so every
+	 * generator works here. Draws and counts come from transform feedback objects when the driver
+	 * has them (GL 4.0), otherwise the written count is read back every frame.
+	 */
+	class FeedbackParticleSystem : public GpuParticleBackend
+	{
+	public:
+		// one interleaved vertex, the attribute locations follow the member order
+		struct Vertex
+		{
+			glm::vec4 pos;		// location 0, the same as for the particle shaders
+			glm::vec4 col;		// location 1
+			glm::vec4 startCol;
+			glm::vec4 endCol;
+			glm::vec4 vel;
+			glm::vec4 time;
+		};
+
+		FeedbackParticleSystem();
+		~FeedbackParticleSystem();
+
+		bool generate(ParticleSystem* sys) override;
+		void destroy() override;
+
+		void reset() override;
+		void update(double dt) override;
+		void render() override;
+
+		void download(std::vector<glm::vec4>& pos, std::vector<glm::vec4>& col) const override;
+
+		const char* name() const override { return "transform feedback"; }
+
+	protected:
+		size_t spawn(double dt);
+		void readAliveCount(bool wait);
+		void drawSource(unsigned int index) const;
+
+	protected:
+		std::unique_ptr<Shader> m_updateShader;
+		std::vector<std::shared_ptr<ParticleEmitter>> m_emitters;
+
+		// ping-pong, m_current holds the particles of the last update
+		unsigned int m_buffers[2]{ };
+		unsigned int m_vaos[2]{ };
+		unsigned int m_feedbacks[2]{ };		// only with transform feedback objects
+		unsigned int m_current{ 0 };
+		bool m_hasSource{ false };			// false after a reset, the buffers hold no particles yet
+		size_t m_sourceCount{ 0 };			// written count of m_current, only without feedback objects
+
+		unsigned int m_spawnBuffer{ 0 };
+		unsigned int m_spawnVao{ 0 };
+		std::unique_ptr<ParticleData> m_spawnData;
+		std::vector<Vertex> m_spawnVertices;
+
+		// the written count is picked up a frame later, the query of the running frame is still busy
+		unsigned int m_queries[2]{ };
+		bool m_queryPending[2]{ };
+		unsigned int m_query{ 0 };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,284 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "FieldVolume.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "utility/Debug.h"
+
+
+namespace nhahn
+{
+	static const char VOLUME_MAGIC[4] = { 'O', 'G', 'P', 'V' };
+	static const uint32_t VOLUME_FLAG_WRAP = 1 << 0;
+
+	void FieldVolume::allocate(const glm::uvec3& dim, const glm::vec4& boundsMin, const glm::vec4& boundsMax, uint32_t frames)
+	{
+		ASSERT(dim.x > 1 && dim.y > 1 && dim.z > 1, "FieldVolume: needs at least two voxels per axis\n");
+		ASSERT(frames > 0, "FieldVolume: needs at least one frame\n");
+
+		release();
+
+		m_dim = dim;
+		m_frameCount = frames;
+		m_boundsMin = glm::vec4(boundsMin.x, boundsMin.y, boundsMin.z, 0.0f);
+		m_boundsMax = glm::vec4(boundsMax.x, boundsMax.y, boundsMax.z, 0.0f);
+
+		m_ownedVoxels = (glm::vec4*)_aligned_malloc(memoryUsage(), 16);
+		memset(m_ownedVoxels, 0, memoryUsage());
+		m_voxels = m_ownedVoxels;
+
+		updateTransform();
+	}
+
+	bool FieldVolume::load(const char* filepath)
+	{
+		release();
+
+		if (!FileSystem::mapFile(filepath, &m_mapped))
+			return false;
+
+		const VolumeFileHeader* header = static_cast<const VolumeFileHeader*>(m_mapped.data);
+		const size_t voxels = (m_mapped.size < sizeof(VolumeFileHeader)) ? 0 : (size_t)header->dim[0] * header->dim[1] * header->dim[2];
+
+		if (voxels == 0
+			|| memcmp(header->magic, VOLUME_MAGIC, sizeof(VOLUME_MAGIC)) != 0
+			|| header->version != FILE_VERSION
+			|| header->dim[0] < 2 || header->dim[1] < 2 || header->dim[2] < 2
+			|| header->frameCount == 0
+			|| m_mapped.size < sizeof(VolumeFileHeader) + voxels * header->frameCount * sizeof(glm::vec4))
+		{
+			DBG("FieldVolume", DebugLevel::WARNING, "'%s' is not a valid volume file\n", filepath);
+			FileSystem::unmapFile(&m_mapped);
+			return false;
+		}
+
+		m_dim = glm::uvec3(header->dim[0], header->dim[1], header->dim[2]);
+		m_frameCount = header->frameCount;
+		m_frameRate = header->frameRate;
+		m_boundsMin = glm::vec4(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2], 0.0f);
+		m_boundsMax = glm::vec4(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2], 0.0f);
+		m_addressing = (header->flags & VOLUME_FLAG_WRAP) ? VolumeAddressing::WRAP : VolumeAddressing::CLAMP;
+		m_voxels = reinterpret_cast<const glm::vec4*>(static_cast<const char*>(m_mapped.data) + sizeof(VolumeFileHeader));
+
+		updateTransform();
+
+		DBG("FieldVolume", DebugLevel::DEBUG, "mapped '%s' (%ux%ux%u, %u frames)\n", filepath, m_dim.x, m_dim.y, m_dim.z, m_frameCount);
+		return true;
+	}
+
+	bool FieldVolume::save(const char* filepath) const
+	{
+		if (!isValid())
+			return false;
+
+		FILE* file = fopen(filepath, "wb");
+		if (file == NULL)
+			return false;
+
+		VolumeFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, VOLUME_MAGIC, sizeof(VOLUME_MAGIC));
+		header.version = FILE_VERSION;
+		header.dim[0] = m_dim.x;
+		header.dim[1] = m_dim.y;
+		header.dim[2] = m_dim.z;
+		header.frameCount = m_frameCount;
+		header.flags = (m_addressing == VolumeAddressing::WRAP) ? VOLUME_FLAG_WRAP : 0;
+		header.frameRate = m_frameRate;
+		for (int i = 0; i < 4; ++i)
+		{
+			header.boundsMin[i] = m_boundsMin[i];
+			header.boundsMax[i] = m_boundsMax[i];
+		}
+
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && fwrite(m_voxels, sizeof(glm::vec4), voxelsPerFrame() * m_frameCount, file) == voxelsPerFrame() * m_frameCount;
+		fclose(file);
+
+		return ok;
+	}
+
+	void FieldVolume::release()
+	{
+		if (m_ownedVoxels)
+			_aligned_free(m_ownedVoxels);
+		if (m_mapped.data)
+			FileSystem::unmapFile(&m_mapped);
+
+		m_ownedVoxels = nullptr;
+		m_voxels = nullptr;
+		m_dim = glm::uvec3(0);
+		m_frameCount = 0;
+		m_frameRate = 0.0f;
+	}
+
+	void FieldVolume::prefetchFrame(uint32_t frame) const
+	{
+		if (!isMapped() || frame >= m_frameCount)
+			return;
+
+		const size_t frameSize = voxelsPerFrame() * sizeof(glm::vec4);
+		const size_t offset = sizeof(VolumeFileHeader) + frame * frameSize;
+		FileSystem::prefetchMappedRange(&m_mapped, offset, frameSize);
+
+		// the prefetch is only a hint, touching every page makes sure it is resident
+		const volatile char* data = static_cast<const char*>(m_mapped.data) + offset;
+		char sum = 0;
+		for (size_t i = 0; i < frameSize; i += 4096)
+			sum += data[i];
+		(void)sum;
+	}
+
+	void FieldVolume::evictFrame(uint32_t frame) const
+	{
+		if (!isMapped() || frame >= m_frameCount)
+			return;
+
+		const size_t frameSize = voxelsPerFrame() * sizeof(glm::vec4);
+		FileSystem::evictMappedRange(&m_mapped, sizeof(VolumeFileHeader) + frame * frameSize, frameSize);
+	}
+
+	void FieldVolume::bake(const std::function<glm::vec4(const glm::vec4&)>& fn, uint32_t frame)
+	{
+		glm::vec4* voxels = writableFrameData(frame);
+
+		for (uint32_t z = 0; z < m_dim.z; ++z)
+			for (uint32_t y = 0; y < m_dim.y; ++y)
+				for (uint32_t x = 0; x < m_dim.x; ++x)
+					*voxels++ = fn(voxelPosition(x, y, z));
+	}
+
+	void FieldVolume::bakeSignedDistance(const std::function<float(const glm::vec4&)>& dist, uint32_t frame)
+	{
+		const float h = 0.5f * std::min(m_cellSize.x, std::min(m_cellSize.y, m_cellSize.z));
+
+		bake([&dist, h](const glm::vec4& p) {
+			// central differences give the gradient, which is the surface normal near the surface
+			glm::vec4 grad{
+				dist(p + glm::vec4(h, 0.0f, 0.0f, 0.0f)) - dist(p - glm::vec4(h, 0.0f, 0.0f, 0.0f)),
+				dist(p + glm::vec4(0.0f, h, 0.0f, 0.0f)) - dist(p - glm::vec4(0.0f, h, 0.0f, 0.0f)),
+				dist(p + glm::vec4(0.0f, 0.0f, h, 0.0f)) - dist(p - glm::vec4(0.0f, 0.0f, h, 0.0f)),
+				0.0f };
+
+			const float len = glm::length(grad);
+			if (len > 0.0f)
+				grad /= len;
+
+			grad.w = dist(p);
+			return grad;
+		}, frame);
+	}
+
+	glm::vec4 FieldVolume::sample(const glm::vec4& p, uint32_t frame) const
+	{
+		glm::vec4 result;
+		_mm_store_ps(&result.x, sample(_mm_loadu_ps(&p.x), frame));
+		return result;
+	}
+
+	glm::vec4 FieldVolume::voxelPosition(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return glm::vec4(
+			m_boundsMin.x + x * m_cellSize.x,
+			m_boundsMin.y + y * m_cellSize.y,
+			m_boundsMin.z + z * m_cellSize.z,
+			1.0f);
+	}
+
+	glm::vec4* FieldVolume::writableFrameData(uint32_t frame)
+	{
+		ASSERT(m_ownedVoxels != nullptr, "FieldVolume: mapped volumes are read only\n");
+		ASSERT(frame < m_frameCount, "FieldVolume: frame %u out of range\n", frame);
+
+		return m_ownedVoxels + frame * voxelsPerFrame();
+	}
+
+	void FieldVolume::updateTransform()
+	{
+		if (m_dim.x == 0)
+			return;
+
+		// clamped volumes have voxels on both borders, tiled volumes repeat the first voxel after the last
+		const float offset = (m_addressing == VolumeAddressing::WRAP) ? 0.0f : 1.0f;
+		const glm::vec4 extent = m_boundsMax - m_boundsMin;
+
+		m_cellSize = glm::vec4(
+			extent.x / ((float)m_dim.x - offset),
+			extent.y / ((float)m_dim.y - offset),
+			extent.z / ((float)m_dim.z - offset),
+			0.0f);
+		m_invCellSize = glm::vec4(1.0f / m_cellSize.x, 1.0f / m_cellSize.y, 1.0f / m_cellSize.z, 0.0f);
+		m_maxCoord = glm::vec4((float)m_dim.x - 1.0f, (float)m_dim.y - 1.0f, (float)m_dim.z - 1.0f, 0.0f);
+	}
+
+	FieldVolumePrefetcher::FieldVolumePrefetcher(std::shared_ptr<FieldVolume> volume, uint32_t framesAhead)
+		: m_volume(volume)
+		, m_framesAhead(framesAhead)
+	{
+		m_thread = std::thread(&FieldVolumePrefetcher::run, this);
+	}
+
+	FieldVolumePrefetcher::~FieldVolumePrefetcher()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wakeUp.notify_one();
+		m_thread.join();
+	}
+
+	void FieldVolumePrefetcher::request(uint32_t frame)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_requestedFrame == frame && m_hasRequest)
+				return;
+			m_requestedFrame = frame;
+			m_hasRequest = true;
+		}
+		m_wakeUp.notify_one();
+	}
+
+	void FieldVolumePrefetcher::run()
+	{
+		const uint32_t frameCount = m_volume->frameCount();
+		if (frameCount == 0)
+			return;
+		uint32_t lastFrame = UINT32_MAX;
+
+		while (true)
+		{
+			uint32_t frame;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wakeUp.wait(lock, [this] { return m_quit || m_hasRequest; });
+				if (m_quit)
+					return;
+				frame = m_requestedFrame;
+				m_hasRequest = false;
+			}
+
+			if (frame == lastFrame)
+				continue;
+
+			for (uint32_t i = 0; i <= m_framesAhead; ++i)
+				m_volume->prefetchFrame((frame + i) % frameCount);
+
+			// long sequences do not fit into memory, mark what was played back already as the first to reclaim
+			if (lastFrame != UINT32_MAX && frameCount > m_framesAhead + 2)
+			{
+				for (uint32_t f = lastFrame; f != frame; f = (f + 1) % frameCount)
+					if ((f + frameCount - frame) % frameCount > m_framesAhead)
+						m_volume->evictFrame(f);
+			}
+			lastFrame = frame;
+		}
+	}
+}
\ No newline at end of file
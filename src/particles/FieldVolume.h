@@ -0,0 +1,207 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <immintrin.h>
+#include "utility/Types.h"
+#include "utility/FileSystem.h"
+
+#ifndef GLM_FORCE_INTRINSICS
+#define GLM_FORCE_INTRINSICS
+#endif // !GLM_FORCE_INTRINSICS
+#include <glm/glm.hpp>
+
+
+namespace nhahn
+{
+	/*
+	 * Layout of volume files (*.vol): the header is followed by frameCount frames of
+	 * dim[0] * dim[1] * dim[2] glm::vec4 voxels with x running fastest. The header is
+	 * 64 bytes so the voxels stay 16 byte aligned when the file is memory mapped.
+	 * Sequences (e.g. exported fluid simulations) simply store several frames, frames
+	 * are stored back to back so a single frame is one contiguous range of the file.
+	 */
+	struct VolumeFileHeader
+	{
+		char magic[4];			// "OGPV"
+		uint32_t version;
+		uint32_t dim[3];
+		uint32_t frameCount;
+		float boundsMin[4];
+		float boundsMax[4];
+		uint32_t flags;			// bit 0: tiled (wrap addressing)
+		float frameRate;		// frames per second of sequences, 0 if unspecified
+	};
+
+	static_assert(sizeof(VolumeFileHeader) == 64, "volume header has to keep the voxels 16 byte aligned");
+
+	enum class VolumeAddressing
+	{
+		CLAMP,		// samples outside of the bounds get the border voxels
+		WRAP		// volume tiles infinitely, the bounds span exactly one period
+	};
+
+	/* dense grid of vec4 voxels, either owned or memory mapped from a volume file */
+	class FieldVolume
+	{
+	public:
+		static const uint32_t FILE_VERSION = 1;
+
+		FieldVolume() { }
+		~FieldVolume() { release(); }
+
+		FieldVolume(const FieldVolume&) = delete;
+		FieldVolume& operator=(const FieldVolume&) = delete;
+
+		void allocate(const glm::uvec3& dim, const glm::vec4& boundsMin, const glm::vec4& boundsMax, uint32_t frames = 1);
+		bool load(const char* filepath);
+		bool save(const char* filepath) const;
+		void release();
+
+		/* addressing changes the voxel spacing, so set it before baking */
+		void setAddressing(VolumeAddressing mode) { m_addressing = mode; updateTransform(); }
+		void setFrameRate(float fps) { m_frameRate = fps; }
+
+		/* pulls the pages of a mapped frame into memory, blocks until they are resident */
+		void prefetchFrame(uint32_t frame) const;
+		/* hints the os that the pages of a mapped frame are no longer needed, see FileSystem::evictMappedRange */
+		void evictFrame(uint32_t frame) const;
+
+		/* evaluates fn at every voxel position of the frame */
+		void bake(const std::function<glm::vec4(const glm::vec4&)>& fn, uint32_t frame = 0);
+		/* stores (normalized gradient, distance) per voxel, the layout SdfCollisionUpdater expects */
+		void bakeSignedDistance(const std::function<float(const glm::vec4&)>& dist, uint32_t frame = 0);
+
+		/* trilinear lookup, w of p is ignored */
+		inline __m128 sample(__m128 p, uint32_t frame = 0) const;
+		glm::vec4 sample(const glm::vec4& p, uint32_t frame = 0) const;
+
+		bool isValid() const { return m_voxels != nullptr; }
+		bool isMapped() const { return m_mapped.data != nullptr; }
+
+		glm::uvec3 dim() const { return m_dim; }
+		uint32_t frameCount() const { return m_frameCount; }
+		float frameRate() const { return m_frameRate; }
+		size_t voxelsPerFrame() const { return (size_t)m_dim.x * m_dim.y * m_dim.z; }
+		size_t memoryUsage() const { return voxelsPerFrame() * m_frameCount * sizeof(glm::vec4); }
+
+		const glm::vec4& boundsMin() const { return m_boundsMin; }
+		const glm::vec4& boundsMax() const { return m_boundsMax; }
+		glm::vec4 voxelPosition(uint32_t x, uint32_t y, uint32_t z) const;
+
+		const glm::vec4* frameData(uint32_t frame) const { return m_voxels + frame * voxelsPerFrame(); }
+		glm::vec4* writableFrameData(uint32_t frame);
+
+	protected:
+		void updateTransform();
+
+	protected:
+		const glm::vec4* m_voxels{ nullptr };
+		glm::vec4* m_ownedVoxels{ nullptr };
+		MappedFile m_mapped;
+
+		glm::uvec3 m_dim{ 0 };
+		uint32_t m_frameCount{ 0 };
+		float m_frameRate{ 0.0f };
+		VolumeAddressing m_addressing{ VolumeAddressing::CLAMP };
+
+		// loaded with _mm_load_ps by sample() and the field updaters
+		alignas(16) glm::vec4 m_boundsMin{ 0.0f };
+		alignas(16) glm::vec4 m_boundsMax{ 0.0f };
+		alignas(16) glm::vec4 m_cellSize{ 0.0f };
+		alignas(16) glm::vec4 m_invCellSize{ 0.0f };
+		alignas(16) glm::vec4 m_maxCoord{ 0.0f };
+	};
+
+	/* keeps the frames ahead of the playback position resident, so sampling a mapped sequence never waits on the disk */
+	class FieldVolumePrefetcher
+	{
+	public:
+		FieldVolumePrefetcher(std::shared_ptr<FieldVolume> volume, uint32_t framesAhead = 2);
+		~FieldVolumePrefetcher();
+
+		FieldVolumePrefetcher(const FieldVolumePrefetcher&) = delete;
+		FieldVolumePrefetcher& operator=(const FieldVolumePrefetcher&) = delete;
+
+		/* called with the frame being played back, never blocks */
+		void request(uint32_t frame);
+
+	protected:
+		void run();
+
+	protected:
+		std::shared_ptr<FieldVolume> m_volume;
+		uint32_t m_framesAhead;
+
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_wakeUp;
+		uint32_t m_requestedFrame{ 0 };
+		bool m_hasRequest{ false };
+		bool m_quit{ false };
+	};
+
+	inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+	{
+		return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+	}
+
+	inline __m128 FieldVolume::sample(__m128 p, uint32_t frame) const
+	{
+		const glm::vec4* __restrict voxels = frameData(frame);
+
+		// position in voxel space
+		__m128 g = _mm_mul_ps(_mm_sub_ps(p, _mm_load_ps(&m_boundsMin.x)), _mm_load_ps(&m_invCellSize.x));
+		if (m_addressing == VolumeAddressing::CLAMP)
+			g = _mm_min_ps(_mm_max_ps(g, _mm_setzero_ps()), _mm_load_ps(&m_maxCoord.x));
+
+		const __m128 gf = _mm_floor_ps(g);
+		const __m128 f = _mm_sub_ps(g, gf);
+
+		alignas(16) int32_t c[4];
+		_mm_store_si128((__m128i*)c, _mm_cvttps_epi32(gf));
+
+		const int32_t dx = (int32_t)m_dim.x, dy = (int32_t)m_dim.y, dz = (int32_t)m_dim.z;
+		int32_t x0, y0, z0, x1, y1, z1;
+		if (m_addressing == VolumeAddressing::WRAP)
+		{
+			x0 = c[0] % dx; x0 += (x0 < 0) ? dx : 0; x1 = (x0 + 1 == dx) ? 0 : x0 + 1;
+			y0 = c[1] % dy; y0 += (y0 < 0) ? dy : 0; y1 = (y0 + 1 == dy) ? 0 : y0 + 1;
+			z0 = c[2] % dz; z0 += (z0 < 0) ? dz : 0; z1 = (z0 + 1 == dz) ? 0 : z0 + 1;
+		}
+		else
+		{
+			x0 = c[0]; x1 = std::min(x0 + 1, dx - 1);
+			y0 = c[1]; y1 = std::min(y0 + 1, dy - 1);
+			z0 = c[2]; z1 = std::min(z0 + 1, dz - 1);
+		}
+
+		const size_t slice = (size_t)dx * dy;
+		const size_t r00 = y0 * (size_t)dx + z0 * slice;
+		const size_t r10 = y1 * (size_t)dx + z0 * slice;
+		const size_t r01 = y0 * (size_t)dx + z1 * slice;
+		const size_t r11 = y1 * (size_t)dx + z1 * slice;
+
+		const __m128 fx = _mm_shuffle_ps(f, f, _MM_SHUFFLE(0, 0, 0, 0));
+		const __m128 fy = _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 1, 1));
+		const __m128 fz = _mm_shuffle_ps(f, f, _MM_SHUFFLE(2, 2, 2, 2));
+
+		const __m128 c00 = lerp4(_mm_load_ps(&voxels[r00 + x0].x), _mm_load_ps(&voxels[r00 + x1].x), fx);
+		const __m128 c10 = lerp4(_mm_load_ps(&voxels[r10 + x0].x), _mm_load_ps(&voxels[r10 + x1].x), fx);
+		const __m128 c01 = lerp4(_mm_load_ps(&voxels[r01 + x0].x), _mm_load_ps(&voxels[r01 + x1].x), fx);
+		const __m128 c11 = lerp4(_mm_load_ps(&voxels[r11 + x0].x), _mm_load_ps(&voxels[r11 + x1].x), fx);
+
+		return lerp4(lerp4(c00, c10, fy), lerp4(c01, c11, fy), fz);
+	}
+}
\ No newline at end of file
@@ -9,7 +9,9 @@
 
 #include <string>
 #include "imgui.h"
+#include "EffectUI.h"
 #include "utility/Debug.h"
+#include "utility/FileSystem.h"
 #include "ui/CustomWidgets.h"
 
 
@@ -62,14 +64,34 @@ namespace nhahn
 		m_floorUpdater = std::make_shared<FloorUpdater>();
 		m_system->addUpdater(m_floorUpdater);
 
+		// basin around the fountain, prefer a prebuilt distance field over baking one
+		m_basinUpdater = std::make_shared<SdfCollisionUpdater>();
+		m_basinUpdater->m_volume = std::make_shared<FieldVolume>();
+		std::string basinPath = FileSystem::getModuleDirectory() + "data\\volumes\\fountain_basin.vol";
+		if (!m_basinUpdater->m_volume->load(basinPath.c_str()))
+		{
+			m_basinUpdater->m_volume->allocate(glm::uvec3{ 64, 20, 64 }, glm::vec4{ -0.25f, -0.05f, -0.25f, 0.0f }, glm::vec4{ 0.25f, 0.1f, 0.25f, 0.0f });
+			m_basinUpdater->m_volume->bakeSignedDistance([](const glm::vec4& p) {
+				// torus lying on the floor
+				const float ringDist = sqrtf(p.x * p.x + p.z * p.z) - 0.18f;
+				return sqrtf(ringDist * ringDist + p.y * p.y) - 0.025f;
+			});
+		}
+		m_system->addUpdater(m_basinUpdater);
+
 		DBG("FountainEffect", DebugLevel::DEBUG, "Particles memory usage: %dmb\n", (int)(m_system->computeMemoryUsage() / (1024 * 1024)));
+		DBG("FountainEffect", DebugLevel::DEBUG, "Basin volume memory usage: %dkb\n", (int)(m_basinUpdater->m_volume->memoryUsage() / 1024));
 		return true;
 	}
 
 	bool FountainEffect::initializeRenderer(const char* name)
 	{
 		m_renderer = ParticleRendererFactory::create(name);
-		m_renderer->generate(m_system.get(), false);
+
+		if (!m_renderer)
+			return false;
+
+		m_renderer->generate(m_system.get(), m_useQuads);
 
 		return true;
 	}
@@ -77,6 +99,118 @@ namespace nhahn
 	void FountainEffect::clean()
 	{
 		if (m_renderer) m_renderer->destroy();
+		if (m_ageSeedRenderer) m_ageSeedRenderer->destroy();
+		if (m_quantizedRenderer) m_quantizedRenderer->destroy();
+		if (m_gpuSystem) m_gpuSystem->destroy();
+		if (m_analyticSystem) m_analyticSystem->destroy();
+	}
+
+	void FountainEffect::reset()
+	{
+		m_system->reset();
+		if (m_gpuSystem) m_gpuSystem->reset();
+		if (m_analyticSystem) m_analyticSystem->reset();
+	}
+
+	int FountainEffect::numAliveParticles()
+	{
+		if (m_useAnalytic)
+			return (int)m_analyticSystem->numAliveParticles();
+		return (int)(m_useGpu ? m_gpuSystem->numAliveParticles() : m_system->numAliveParticles());
+	}
+
+	double FountainEffect::aliveToAllRatio()
+	{
+		if (m_useAnalytic)
+			return m_analyticSystem->getAliveToAllRatio();
+		return m_useGpu ? m_gpuSystem->getAliveToAllRatio() : m_system->getAliveToAllRatio();
+	}
+
+	void FountainEffect::setGpuBackend(bool enabled)
+	{
+		if (enabled && !m_gpuSystem)
+		{
+			m_gpuSystem = GpuParticleBackend::create(m_system.get());
+			if (!m_gpuSystem)
+				enabled = false;
+		}
+
+		// the particles are not carried over, the backend that takes over starts empty
+		m_useGpu = enabled;
+		if (m_useGpu)
+		{
+			m_useAnalytic = false;
+			m_gpuSystem->reset();
+		}
+		else
+			m_system->reset();
+	}
+
+	void FountainEffect::setAnalytic(bool enabled)
+	{
+		if (enabled && !m_analyticSystem)
+		{
+			m_analyticSystem = std::make_unique<AnalyticParticleSystem>();
+			if (!m_analyticSystem->generate(m_system.get()))
+			{
+				m_analyticSystem.reset();
+				enabled = false;
+			}
+		}
+
+		m_useAnalytic = enabled;
+		if (m_useAnalytic)
+		{
+			m_useGpu = false;
+			m_analyticSystem->reset();
+		}
+		else
+			m_system->reset();
+	}
+
+	void FountainEffect::setAgeSeed(bool enabled)
+	{
+		// without an updater the shaders can rebuild, gpu color would draw the particles white
+		enabled = enabled && GLParticleRendererAgeSeed::supports(m_system.get());
+
+		// generating the renderer makes the system skip the updaters it rebuilds, destroying it restores them
+		if (enabled && !m_ageSeedRenderer)
+		{
+			m_ageSeedRenderer = std::make_shared<GLParticleRendererAgeSeed>();
+			m_ageSeedRenderer->generate(m_system.get(), false);
+		}
+		else if (!enabled)
+			m_ageSeedRenderer.reset();
+
+		// the upload formats are for the full color stream, gpu color replaces them
+		if (enabled)
+			m_vertexFormat = 0;
+
+		m_useAgeSeed = enabled;
+	}
+
+	void FountainEffect::setVertexFormat(int format)
+	{
+		// format 0 is the float upload of the factory renderers, which keep drawing it
+		if (format > 0 && !m_quantizedRenderer)
+		{
+			m_quantizedRenderer = std::make_shared<GLParticleRendererQuantized>();
+			m_quantizedRenderer->generate(m_system.get(), false);
+		}
+		if (m_quantizedRenderer)
+			m_quantizedRenderer->setFormat(format);
+		if (format > 0)
+			setAgeSeed(false);
+
+		m_vertexFormat = format;
+	}
+
+	void FountainEffect::setQuads(bool enabled)
+	{
+		// generated again with the other buffer layout, the particles are kept
+		m_renderer->destroy();
+		m_renderer->generate(m_system.get(), enabled);
+		m_useQuads = enabled;
 	}
 
 	void FountainEffect::update(double dt)
@@ -90,17 +224,46 @@ namespace nhahn
 
 	void FountainEffect::cpuUpdate(double dt)
 	{
-		m_system->update(dt);
+		if (!m_useGpu && !m_useAnalytic)
+			m_system->update(dt);
 	}
 
 	void FountainEffect::gpuUpdate(double dt)
 	{
-		m_renderer->update();
+		// the analytic particles only upload their new spawns
+		if (m_useAnalytic)
+			m_analyticSystem->update(dt);
+		else if (m_useGpu)
+			m_gpuSystem->update(dt);
+		else
+			activeRenderer()->update();
+	}
+
+	void FountainEffect::setView(const ScenePass& pass)
+	{
+		if (m_analyticSystem)
+			m_analyticSystem->setView(pass);
+		m_renderer->setView(pass);
+		if (activeRenderer() != m_renderer.get())
+			activeRenderer()->setView(pass);
+	}
+
+	bool FountainEffect::bounds(glm::vec4& boundsMin, glm::vec4& boundsMax)
+	{
+		// the gpu backends keep their positions on the gpu
+		if (!m_useGpu && !m_useAnalytic)
+			return systemBounds(m_system.get(), activeRenderer(), boundsMin, boundsMax);
+		return false;
 	}
 
 	void FountainEffect::render()
 	{
-		m_renderer->render();
+		if (m_useAnalytic)
+			m_analyticSystem->render();
+		else if (m_useGpu)
+			m_gpuSystem->render();
+		else
+			activeRenderer()->render();
 	}
 
 	void FountainEffect::renderUI()
@@ -114,11 +277,45 @@ namespace nhahn
 
 		ImGui::SeparatorText("Settings:");
 
+		bool useGpu = m_useGpu;
+		if (ImGui::Checkbox("gpu backend", &useGpu))
+			setGpuBackend(useGpu);
+		ImGui::SameLine(); ImGui::HelpMarker("Keeps the particles in gpu buffers, nothing is uploaded per frame. Uses compute shaders, or transform feedback with the generators on the cpu on drivers without them.\nThe basin collision has no gpu version and is skipped, switching restarts the effect.");
+
+		bool useAnalytic = m_useAnalytic;
+		if (ImGui::Checkbox("analytic", &useAnalytic))
+			setAnalytic(useAnalytic);
+		ImGui::SameLine(); ImGui::HelpMarker("Stateless particles, position and color are evaluated from the spawn time in the vertex shader and the cpu only writes the new spawns.\nThe basin collision has no closed form and is skipped.");
+
+		bool useAgeSeed = m_useAgeSeed;
+		int vertexFormat = m_vertexFormat;
+		uploadFormatUI(m_system.get(), useAgeSeed, vertexFormat, m_formatErrors);
+		if (useAgeSeed != m_useAgeSeed)
+			setAgeSeed(useAgeSeed);
+		if (vertexFormat != m_vertexFormat)
+			setVertexFormat(vertexFormat);
+
+		bool useQuads = m_useQuads;
+		if (quadsUI(*m_renderer, useQuads))
+			setQuads(useQuads);
+
+		rendererUI(*m_renderer, m_system->numAliveParticles());
+
+		int integrator = (int)m_eulerUpdater->m_integrator;
+		if (ImGui::Combo("integrator", &integrator, EulerUpdater::INTEGRATOR_NAMES, (int)EulerUpdater::Integrator::COUNT))
+			m_eulerUpdater->m_integrator = (EulerUpdater::Integrator)integrator;
+		ImGui::SameLine(); ImGui::HelpMarker("Verlet and RK2 evaluate the forces twice per step, but stay stable with larger steps.");
+
 		ImGui::SliderFloat("gravity", &m_eulerUpdater->m_globalAcceleration.y, -20.0f, 0.0f, "%.2f");
 		ImGui::SameLine(); ImGui::HelpMarker("CTRL+click to input value.");
 
 		ImGui::SliderFloat("bounce", &m_floorUpdater->m_bounceFactor, 0.0f, 1.0f, "%.3f");
 
+		ImGui::Checkbox("basin", &m_basinUpdater->m_enabled);
+		ImGui::SameLine(); ImGui::HelpMarker("Collision with a ring sampled from a signed distance field volume.");
+		ImGui::SliderFloat("basin bounce", &m_basinUpdater->m_bounceFactor, 0.0f, 1.0f, "%.3f");
+		ImGui::SliderFloat("basin friction", &m_basinUpdater->m_friction, 0.0f, 1.0f, "%.3f");
+
 		ImGui::SeparatorText("Colors:");
 
 		ImGui::ColorEdit4("start color min", &m_colGenerator->m_minStartCol.x);
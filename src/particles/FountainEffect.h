@@ -8,7 +8,11 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+#include "AnalyticParticleSystem.h"
 #include "Effect.h"
+#include "GLParticleRenderer.h"
+#include "GpuParticleBackend.h"
 #include "ParticleSystem.h"
 #include "ParticleGenerators.h"
 #include "ParticleRenderer.h"
@@ -25,25 +29,50 @@ namespace nhahn
 
 		bool initialize(size_t numParticles) override;
 		bool initializeRenderer(const char* name) override;
-		void reset() override { m_system->reset(); }
+		void reset() override;
 		void clean() override;
 
 		void update(double dt) override;
 		void cpuUpdate(double dt) override;
 		void gpuUpdate(double dt) override;
+		void setView(const ScenePass& pass) override;
+		bool bounds(glm::vec4& boundsMin, glm::vec4& boundsMax) override;
 		void render() override;
 		void renderUI() override;
 
 		int numAllParticles() override { return m_system->numAllParticles(); }
-		int numAliveParticles() override { return m_system->numAliveParticles(); }
-		double aliveToAllRatio() override { return m_system->getAliveToAllRatio(); }
+		int numAliveParticles() override;
+		double aliveToAllRatio() override;
+
+	private:
+		void setGpuBackend(bool enabled);
+		void setAnalytic(bool enabled);
+		void setAgeSeed(bool enabled);
+		void setVertexFormat(int format);
+		void setQuads(bool enabled);
+		IParticleRenderer* activeRenderer() const
+		{
+			if (m_useAgeSeed) return m_ageSeedRenderer.get();
+			return (m_vertexFormat > 0) ? m_quantizedRenderer.get() : m_renderer.get();
+		}
 
 	private:
 		std::shared_ptr<ParticleSystem> m_system;
+		std::unique_ptr<GpuParticleBackend> m_gpuSystem;
+		bool m_useGpu{ false };
+		std::unique_ptr<AnalyticParticleSystem> m_analyticSystem;
+		bool m_useAnalytic{ false };
 		std::shared_ptr<IParticleRenderer> m_renderer;
+		bool m_useQuads{ false };
+		std::shared_ptr<GLParticleRendererAgeSeed> m_ageSeedRenderer;
+		bool m_useAgeSeed{ false };
+		std::shared_ptr<GLParticleRendererQuantized> m_quantizedRenderer;
+		int m_vertexFormat{ 0 };
+		std::vector<GLParticleRendererQuantized::QuantizationError> m_formatErrors;
 		std::shared_ptr<BoxPosGen> m_posGenerator;
 		std::shared_ptr<BasicColorGen> m_colGenerator;
 		std::shared_ptr<EulerUpdater> m_eulerUpdater;
 		std::shared_ptr<FloorUpdater> m_floorUpdater;
+		std::shared_ptr<SdfCollisionUpdater> m_basinUpdater;
 	};
 }
\ No newline at end of file
@@ -7,11 +7,20 @@
 \*------------------------------------------------------------------------------------------------*/
 #include "GLParticleRenderer.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <immintrin.h>
 #include <GL/glew.h>
 #include "ParticleSystem.h"
+#include "render/Shader.h"
+#include "render/Texture.h"
 #include "utility/Debug.h"
+#include "utility/FileSystem.h"
+#include "utility/JobSystem.h"
 
 const GLuint POS_ELEMENTS = 4;
+const size_t PACK_CHUNK = 8192;		// vertices per job of the persistent fill, a multiple of four
 
 
 namespace nhahn
@@ -25,6 +34,15 @@ namespace nhahn
 		}
 	}
 
+	void destroyVertexArray(GLuint& vao)
+	{
+		if (vao != 0)
+		{
+			glDeleteVertexArrays(1, &vao);
+			vao = 0;
+		}
+	}
+
 	void genSingleBuffer(GLuint& buf, GLuint count, GLuint components, float** mappedBuffer)
 	{
 		glGenBuffers(1, &buf);
@@ -61,6 +79,14 @@ namespace nhahn
 			glVertexAttribPointer(attribID, elements, GL_FLOAT, GL_FALSE, (elements) * sizeof(float), (void*)((0) * sizeof(float)));
 	}
 
+	void setAttribDivisor(GLuint attribID, GLuint divisor)
+	{
+		if (GLEW_ARB_vertex_attrib_binding)
+			glVertexBindingDivisor(attribID, divisor);
+		else
+			glVertexAttribDivisor(attribID, divisor);
+	}
+
 	void generateBuffers(GLuint& vao, GLuint& bufPos, GLuint& bufCol, GLuint count, GLuint posElements, float** mappedBuffer1, float** mappedBuffer2)
 	{
 		glGenVertexArrays(1, &vao);
@@ -77,7 +103,11 @@ namespace nhahn
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
-	void GLParticleRenderer::generate(ParticleSystem* sys, bool)
+	// out of line, the header only forward declares Shader
+	GLParticleRenderer::GLParticleRenderer() { }
+	GLParticleRenderer::~GLParticleRenderer() { destroy(); }
+
+	void GLParticleRenderer::generate(ParticleSystem* sys, bool useQuads)
 	{
 		ASSERT(sys != nullptr, "GLParticleRenderer: particle system is null");
 
@@ -86,12 +116,23 @@ namespace nhahn
 		const size_t count = sys->numAllParticles();
 
 		generateBuffers(m_vao, m_bufPos, m_bufCol, count, 4, nullptr, nullptr);
+
+		m_useQuads = useQuads;
+		if (m_useQuads)
+			generateQuads(count);
 	}
 
 	void GLParticleRenderer::destroy()
 	{
 		destroyBuffer(m_bufPos);
 		destroyBuffer(m_bufCol);
+		destroyBuffer(m_bufMotion);
+		destroyBuffer(m_bufCorners);
+		destroyBuffer(m_bufIndices);
+		destroyVertexArray(m_vao);
+		m_quadShader.reset();
+		m_sortedShader.reset();
+		m_useQuads = false;
 	}
 
 	void GLParticleRenderer::update()
@@ -100,7 +141,19 @@ namespace nhahn
 		ASSERT(m_bufPos > 0 && m_bufCol > 0, "GLParticleSystem: buffers are empty");
 
 		const size_t count = m_system->numAliveParticles();
-		if (count > 0)
+		m_countDrawn = count;
+		m_culled = 0;
+
+		// sorted quads are gathered in draw order by render
+		if (m_sorter && m_useQuads)
+			return;
+
+		if (count > 0 && thins() && uploadThinned(count))
+			return;
+
+		if (count > 0 && cullsChunks())
+			uploadVisibleChunks(count);
+		else if (count > 0)
 		{
 			float* posPtr = (float*)(m_system->finalData()->m_pos);
 			float* colPtr = (float*)(m_system->finalData()->m_col);
@@ -114,13 +167,28 @@ namespace nhahn
 			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float) * 4, colPtr);
 
 			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			if (m_useQuads)
+				updateQuads(count);
 		}
 	}
 
 	void GLParticleRenderer::render()
 	{
+		const size_t count = m_countDrawn;
+		if (m_sorter && count > 0)
+		{
+			renderSorted(count);
+			return;
+		}
+
+		if (m_useQuads)
+		{
+			renderQuads(count);
+			return;
+		}
+
 		glBindVertexArray(m_vao);
-		const size_t count = m_system->numAliveParticles();
 
 		if (count > 0)
 			glDrawArrays(GL_POINTS, 0, count);
@@ -134,7 +202,19 @@ namespace nhahn
 		ASSERT(m_bufPos > 0 && m_bufCol > 0, "GLParticleRendererUseMap: buffers are empty");
 
 		const size_t count = m_system->numAliveParticles();
-		if (count > 0)
+		m_countDrawn = count;
+		m_culled = 0;
+
+		// sorted quads are gathered in draw order by render
+		if (m_sorter && m_useQuads)
+			return;
+
+		if (count > 0 && thins() && uploadThinned(count))
+			return;
+
+		if (count > 0 && cullsChunks())
+			uploadVisibleChunks(count);
+		else if (count > 0)
 		{
 			float* posPtr = (float*)(m_system->finalData()->m_pos);
 			float* colPtr = (float*)(m_system->finalData()->m_col);
@@ -152,13 +232,19 @@ namespace nhahn
 			glUnmapBuffer(GL_ARRAY_BUFFER);
 
 			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			if (m_useQuads)
+				updateQuads(count);
 		}
 	}
 
-	void GLParticleRendererDoubleVao::generate(ParticleSystem* sys, bool)
+	void GLParticleRendererDoubleVao::generate(ParticleSystem* sys, bool useQuads)
 	{
 		ASSERT(sys != nullptr, "GLParticleRendererDoubleVao: sys is null");
 
+		if (useQuads)
+			DBG("GLParticleRendererDoubleVao", DebugLevel::WARNING, "no quad path, drawing points\n");
+
 		m_system = sys;
 
 		const size_t count = sys->numAllParticles();
@@ -174,12 +260,14 @@ namespace nhahn
 		destroyBuffer(m_doubleBufPos[1]);
 		destroyBuffer(m_doubleBufCol[0]);
 		destroyBuffer(m_doubleBufCol[1]);
+		destroyVertexArray(m_doubleVao[0]);
+		destroyVertexArray(m_doubleVao[1]);
 	}
 
 	void GLParticleRendererDoubleVao::update()
 	{
 		ASSERT(m_system != nullptr, "GLParticleRendererDoubleVao: m_system is null");
-		ASSERT(m_bufPos > 0 && m_bufCol > 0, "GLParticleRendererDoubleVao: buffers are empty");
+		ASSERT(m_doubleBufPos[m_id] > 0 && m_doubleBufCol[m_id] > 0, "GLParticleRendererDoubleVao: buffers are empty");
 
 		const size_t count = m_system->numAliveParticles();
 		if (count > 0)
@@ -210,11 +298,332 @@ namespace nhahn
 		m_id = 1 - m_id;
 	}
 
-	void GLParticleRendererPersistent::generate(ParticleSystem* sys, bool)
+	// the position with the word of the given lane in place of w, streamed past the caches
+	template <int LANE>
+	static inline void streamVertex(float* out, __m128 pos, __m128 words)
+	{
+		_mm_stream_ps(out, _mm_blend_ps(pos, _mm_shuffle_ps(words, words, _MM_SHUFFLE(LANE, LANE, LANE, LANE)), 0x8));
+	}
+
+	// four float colors to RGBA8, one packed color per lane. The packs saturate, so no clamping is needed
+	static inline __m128i packRgba8(const float* c)
+	{
+		const __m128 scale = _mm_set1_ps(255.0f);
+		const __m128i c01 = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(c + 0), scale)),
+			_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(c + 4), scale)));
+		const __m128i c23 = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(c + 8), scale)),
+			_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(c + 12), scale)));
+		return _mm_packus_epi16(c01, c23);
+	}
+
+	/*
+	 * Builds the vertices [begin, end) from the particle streams, the position with its size scale
+	 * followed by the color converted to RGBA8. Colors saturate to [0, 1] and round to nearest. Four
+	 * vertices fill five __m128, which go straight to the mapped buffer with non-temporal stores, they
+	 * are only read by the gpu. begin has to be a multiple of four for the stores to stay aligned.
+	 */
+	static void packVertexRange(const glm::vec4* pos, const glm::vec4* col, Vertex* dst, size_t begin, size_t end)
+	{
+		static_assert(sizeof(Vertex) == 5 * sizeof(float), "packVertexRange writes four vertices per five __m128");
+		ASSERT(begin % 4 == 0 && ((uintptr_t)dst & 15) == 0, "packVertexRange: the vertices are not aligned");
+
+		const float* p = (const float*)(pos + begin);
+		const float* c = (const float*)(col + begin);
+		float* out = (float*)(dst + begin);
+		const __m128 scale = _mm_set1_ps(255.0f);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4, p += 16, c += 16, out += 20)
+		{
+			const __m128 rgba = _mm_castsi128_ps(packRgba8(c));
+			const __m128 p0 = _mm_load_ps(p + 0);
+			const __m128 p1 = _mm_load_ps(p + 4);
+			const __m128 p2 = _mm_load_ps(p + 8);
+			const __m128 p3 = _mm_load_ps(p + 12);
+
+			// the color of vertex k sits in lane k of rgba and lands in lane k of the register after its position
+			_mm_stream_ps(out + 0, p0);
+			_mm_stream_ps(out + 4, _mm_blend_ps(_mm_shuffle_ps(p1, p1, _MM_SHUFFLE(2, 1, 0, 0)), rgba, 0x1));
+			_mm_stream_ps(out + 8, _mm_blend_ps(_mm_shuffle_ps(p1, p2, _MM_SHUFFLE(1, 0, 3, 3)), rgba, 0x2));
+			_mm_stream_ps(out + 12, _mm_blend_ps(_mm_shuffle_ps(p2, p3, _MM_SHUFFLE(0, 0, 3, 2)), rgba, 0x4));
+			_mm_stream_ps(out + 16, _mm_blend_ps(_mm_shuffle_ps(p3, p3, _MM_SHUFFLE(3, 3, 2, 1)), rgba, 0x8));
+		}
+
+		// the last up to three vertices are not aligned
+		for (; i < end; ++i, p += 4, c += 4, out += 5)
+		{
+			const __m128i c0 = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(c), scale)), _mm_setzero_si128());
+			_mm_storeu_ps(out, _mm_load_ps(p));
+			_mm_store_ss(out + 4, _mm_castsi128_ps(_mm_packus_epi16(c0, c0)));
+		}
+
+		// the streaming stores are weakly ordered, they have to land before the draw is issued
+		_mm_sfence();
+	}
+
+	void GLParticleRendererPersistent::packVertices(const ParticleData* p, Vertex* dst, size_t count)
+	{
+		const glm::vec4* pos = p->m_pos;
+		const glm::vec4* col = p->m_col;
+		JobSystem::instance().parallelFor(count, PACK_CHUNK, [pos, col, dst](size_t begin, size_t end) {
+			packVertexRange(pos, col, dst, begin, end);
+		});
+	}
+
+	void GLParticleRendererPersistent::generate(ParticleSystem* sys, bool useQuads)
 	{
 		ASSERT(sys != nullptr, "GLParticleRendererPersistent: sys is null");
 
+		if (!GLEW_ARB_buffer_storage)
+		{
+			DBG("GLParticleRendererPersistent", DebugLevel::WARNING, "ARB_buffer_storage missing, falling back to glBufferSubData\n");
+			GLParticleRenderer::generate(sys, useQuads);
+			return;
+		}
+
+		if (useQuads)
+			DBG("GLParticleRendererPersistent", DebugLevel::WARNING, "no quad path, drawing points\n");
+
 		m_system = sys;
+		// a multiple of four keeps every region aligned for the streaming stores of packVertexRange
+		m_regionSize = (sys->numAllParticles() + 3) & ~(size_t)3;
+
+		glGenVertexArrays(1, &m_vao);
+		glBindVertexArray(m_vao);
+
+		glGenBuffers(1, &m_bufPos);
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+
+		// coherent, so the writes need no flush, the fences keep them off the regions in flight
+		const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr neededSize = sizeof(Vertex) * m_regionSize * REGION_COUNT;
+
+		glBufferStorage(GL_ARRAY_BUFFER, neededSize, nullptr, mapFlags);
+		m_ptr = (Vertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, neededSize, mapFlags);
+		ASSERT(m_ptr != nullptr, "GLParticleRendererPersistent: mapping the buffer failed");
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, r));
+
+		glBindVertexArray(0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_id = 0;
+		m_stalls = 0;
+		std::fill(std::begin(m_regionCount), std::end(m_regionCount), 0);
+	}
+
+	void GLParticleRendererPersistent::destroy()
+	{
+		for (void*& fence : m_fences)
+		{
+			if (fence)
+			{
+				glDeleteSync((GLsync)fence);
+				fence = nullptr;
+			}
+		}
+
+		if (m_ptr)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			m_ptr = nullptr;
+		}
+
+		GLParticleRenderer::destroy();
+	}
+
+	void GLParticleRendererPersistent::waitForRegion(unsigned int region)
+	{
+		GLsync fence = (GLsync)m_fences[region];
+		if (!fence)
+			return;
+
+		GLenum state = glClientWaitSync(fence, 0, 0);
+		if (state == GL_TIMEOUT_EXPIRED)
+		{
+			m_stalls++;
+			DBG("GLParticleRendererPersistent", DebugLevel::DEBUG, "waiting for the gpu, %d stalls so far\n", (int)m_stalls);
+
+			do
+			{
+				state = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			} while (state == GL_TIMEOUT_EXPIRED);
+		}
+		ASSERT(state != GL_WAIT_FAILED, "GLParticleRendererPersistent: waiting for the fence failed");
+
+		glDeleteSync(fence);
+		m_fences[region] = nullptr;
+	}
+
+	void GLParticleRendererPersistent::update()
+	{
+		if (!m_ptr)
+		{
+			GLParticleRenderer::update();
+			return;
+		}
+
+		ASSERT(m_system != nullptr, "GLParticleRendererPersistent: m_system is null");
+
+		waitForRegion(m_id);
+
+		const size_t count = std::min(m_system->numAliveParticles(), m_regionSize);
+		packVertices(m_system->finalData(), m_ptr + m_id * m_regionSize, count);
+
+		m_regionCount[m_id] = count;
+	}
+
+	void GLParticleRendererPersistent::render()
+	{
+		if (!m_ptr)
+		{
+			GLParticleRenderer::render();
+			return;
+		}
+
+		const size_t count = m_regionCount[m_id];
+		if (count > 0)
+		{
+			glBindVertexArray(m_vao);
+			glDrawArrays(GL_POINTS, (GLint)(m_id * m_regionSize), (GLsizei)count);
+			glBindVertexArray(0);
+
+			m_fences[m_id] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		m_id = (m_id + 1) % REGION_COUNT;
+	}
+
+	// binds shader with the texture unit, camera and pass of the SceneView. Returns the program
+	// bound before so the caller can restore it after drawing
+	static GLint bindWithScenePass(Shader* shader, const ScenePass& pass)
+	{
+		GLint program = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+		shader->bind();
+		shader->setUniformI("tex", pass.texUnit);
+		shader->setUniformMat("modelViewMat", pass.viewMat, false);
+		shader->setUniformMat("projectionMat", pass.projMat, false);
+		shader->setUniformI("oitPass", pass.weightedOit ? 1 : 0);
+		shader->setUniformI("overdrawPass", pass.overdraw ? 1 : 0);
+		return program;
+	}
+
+	// the modes of particles_age.inc
+	enum AgeSeedColorMode { COLOR_NONE = 0, COLOR_BASIC, COLOR_GRADIENT };
+	static const int GRADIENT_ROWS = 3;
+
+	static_assert(ColorLutUpdater::LUT_SIZE == SizeLutUpdater::LUT_SIZE, "the gradient texture holds both tables");
+
+	// the hash of the bits of time.w that lutCoords in ParticleUpdaters.cpp uses, fixed for the life of a particle
+	static inline __m128i seedHash(__m128 invLifetime)
+	{
+		__m128i h = _mm_castps_si128(invLifetime);
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+		h = _mm_mullo_epi32(h, _mm_set1_epi32(0x7feb352d));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+		h = _mm_mullo_epi32(h, _mm_set1_epi32((int32_t)0x846ca68b));
+		return _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+	}
+
+	// age as 16 bit unorm in the low half, the seed in the high half. Seeded like lutCoords, so the
+	// gradients pick the same variation as on the cpu
+	static inline __m128 ageSeedWords(__m128 age, __m128 invLifetime)
+	{
+		const __m128 clamped = _mm_min_ps(_mm_max_ps(age, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		const __m128i ageBits = _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(65535.0f)));
+		const __m128i h = seedHash(invLifetime);
+
+		return _mm_castsi128_ps(_mm_or_si128(ageBits, _mm_and_si128(h, _mm_set1_epi32((int32_t)0xffff0000))));
+	}
+
+	static void packAgeSeedVertices(const glm::vec4* pos, const glm::vec4* time, AgeSeedVertex* dst, size_t begin, size_t end)
+	{
+		static_assert(sizeof(AgeSeedVertex) == sizeof(__m128), "packAgeSeedVertices writes one vertex per __m128");
+
+		const float* p = (const float*)(pos + begin);
+		const float* t = (const float*)(time + begin);
+		float* out = (float*)(dst + begin);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4, p += 16, t += 16, out += 16)
+		{
+			__m128 t0 = _mm_load_ps(t + 0);
+			__m128 t1 = _mm_load_ps(t + 4);
+			__m128 t2 = _mm_load_ps(t + 8);
+			__m128 t3 = _mm_load_ps(t + 12);
+			_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+			// t2 holds the ages, t3 the inverse lifetimes
+			const __m128 words = ageSeedWords(t2, t3);
+			streamVertex<0>(out + 0, _mm_load_ps(p + 0), words);
+			streamVertex<1>(out + 4, _mm_load_ps(p + 4), words);
+			streamVertex<2>(out + 8, _mm_load_ps(p + 8), words);
+			streamVertex<3>(out + 12, _mm_load_ps(p + 12), words);
+		}
+
+		for (; i < end; ++i, p += 4, t += 4, out += 4)
+		{
+			const __m128 ti = _mm_load_ps(t);
+			const __m128 words = ageSeedWords(_mm_shuffle_ps(ti, ti, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(ti, ti, _MM_SHUFFLE(3, 3, 3, 3)));
+			streamVertex<0>(out, _mm_load_ps(p), words);
+		}
+
+		_mm_sfence();
+	}
+
+	static void findAgeSeedStages(ParticleSystem* sys, std::shared_ptr<BasicColorGen>& colorGen, std::shared_ptr<BasicColorUpdater>& basicColor,
+		std::shared_ptr<ColorLutUpdater>& colorLut, std::shared_ptr<SizeLutUpdater>& sizeLut)
+	{
+		colorGen.reset();
+		basicColor.reset();
+		colorLut.reset();
+		sizeLut.reset();
+
+		for (const auto& em : sys->emitters())
+			for (const auto& gen : em->generators())
+				if (auto color = std::dynamic_pointer_cast<BasicColorGen>(gen)) colorGen = color;
+
+		for (const auto& up : sys->updaters())
+		{
+			if (auto color = std::dynamic_pointer_cast<BasicColorUpdater>(up)) basicColor = color;
+			else if (auto lut = std::dynamic_pointer_cast<ColorLutUpdater>(up)) colorLut = lut;
+			else if (auto size = std::dynamic_pointer_cast<SizeLutUpdater>(up)) sizeLut = size;
+		}
+
+		// the blend is only rebuilt from the ranges of the generator
+		if (!colorGen)
+			basicColor.reset();
+	}
+
+	// out of line, the header only forward declares Shader and Texture
+	GLParticleRendererAgeSeed::GLParticleRendererAgeSeed() { }
+	GLParticleRendererAgeSeed::~GLParticleRendererAgeSeed() { destroy(); }
+
+	bool GLParticleRendererAgeSeed::supports(ParticleSystem* sys)
+	{
+		std::shared_ptr<BasicColorGen> colorGen;
+		std::shared_ptr<BasicColorUpdater> basicColor;
+		std::shared_ptr<ColorLutUpdater> colorLut;
+		std::shared_ptr<SizeLutUpdater> sizeLut;
+		findAgeSeedStages(sys, colorGen, basicColor, colorLut, sizeLut);
+
+		return basicColor || colorLut;
+	}
+
+	void GLParticleRendererAgeSeed::generate(ParticleSystem* sys, bool)
+	{
+		ASSERT(sys != nullptr, "GLParticleRendererAgeSeed: sys is null");
+
+		destroy();
+		m_system = sys;
+		findAgeSeedStages(sys, m_colorGen, m_basicColor, m_colorLut, m_sizeLut);
 
 		const size_t count = sys->numAllParticles();
 
@@ -223,94 +632,882 @@ namespace nhahn
 
 		glGenBuffers(1, &m_bufPos);
 		glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
-		const GLsizeiptr bufBasicSize = (sizeof(float) * 3 + sizeof(GLubyte) * 4) * count;
+		glBufferData(GL_ARRAY_BUFFER, sizeof(AgeSeedVertex) * count, nullptr, GL_STREAM_DRAW);
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(AgeSeedVertex), (void*)offsetof(AgeSeedVertex, x));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(AgeSeedVertex), (void*)offsetof(AgeSeedVertex, age));
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// particles.vert rebuilds color and size when the include defines AGE_SEED_PARTICLES
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_shader = std::make_unique<Shader>();
+		ShaderObject* frag = m_shader->addObject();
+		for (const char* file : { "common.inc", "particles.frag" })
+			frag->addFile((path + file).c_str());
+		frag->compile(FRAGMENT_SHADER);
+		ShaderObject* vert = m_shader->addObject();
+		for (const char* file : { "common.inc", "particles_age.inc", "particles.vert" })
+			vert->addFile((path + file).c_str());
+		vert->compile(VERTEX_SHADER);
+		m_shader->link();
+
+		m_gradient = std::make_unique<Texture>(TEXTURE_2D, (int)ColorLutUpdater::LUT_SIZE, GRADIENT_ROWS);
+		m_gradient->setFormat(TEXEL_FLOAT, 4, 4);
+		m_gradient->init();
+
+		// the shaders take over, the color stream is left as it is
+		for (const ParticleUpdater* up : { (const ParticleUpdater*)m_basicColor.get(), (const ParticleUpdater*)m_colorLut.get(), (const ParticleUpdater*)m_sizeLut.get() })
+			if (up) sys->setUpdaterSkipped(up, true);
+	}
 
-		if (GLEW_ARB_buffer_storage)
+	void GLParticleRendererAgeSeed::destroy()
+	{
+		if (m_system)
 		{
-			const GLbitfield creationFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_DYNAMIC_STORAGE_BIT;
-			const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
-			const unsigned int BUFFERING_COUNT = 3;
-			const GLsizeiptr neededSize = bufBasicSize * BUFFERING_COUNT;
+			for (const ParticleUpdater* up : { (const ParticleUpdater*)m_basicColor.get(), (const ParticleUpdater*)m_colorLut.get(), (const ParticleUpdater*)m_sizeLut.get() })
+				if (up) m_system->setUpdaterSkipped(up, false);
+		}
 
-			glBufferStorage(GL_ARRAY_BUFFER, neededSize, nullptr, creationFlags);
+		m_colorGen.reset();
+		m_basicColor.reset();
+		m_colorLut.reset();
+		m_sizeLut.reset();
+		m_shader.reset();
+		m_gradient.reset();
+		m_gradientUploaded = false;
+		m_countUploaded = 0;
+
+		GLParticleRenderer::destroy();
+	}
+
+	void GLParticleRendererAgeSeed::uploadGradient()
+	{
+		const size_t size = ColorLutUpdater::LUT_SIZE;
+		glm::vec4 texels[GRADIENT_ROWS * ColorLutUpdater::LUT_SIZE];
 
-			m_ptr = (Vertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, neededSize, mapFlags);
+		for (size_t j = 0; j < size; ++j)
+		{
+			texels[j] = m_colorLut ? m_colorLut->minTable()[j] : glm::vec4(1.0f);
+			texels[size + j] = m_colorLut ? m_colorLut->maxTable()[j] : glm::vec4(1.0f);
+			texels[2 * size + j] = m_sizeLut ? glm::vec4(m_sizeLut->minTable()[j], m_sizeLut->maxTable()[j], 0.0f, 0.0f) : glm::vec4(1.0f);
 		}
-		else
-			printf("GLEW_ARB_buffer_storage missing...");
 
-		//glEnableVertexAttribArray(0);
+		m_gradient->copy(texels);
+		m_gradientUploaded = true;
+		m_colorLutRevision = m_colorLut ? m_colorLut->revision() : 0;
+		m_sizeLutRevision = m_sizeLut ? m_sizeLut->revision() : 0;
+	}
+
+	void GLParticleRendererAgeSeed::update()
+	{
+		ASSERT(m_system != nullptr, "GLParticleRendererAgeSeed: m_system is null");
+		ASSERT(m_bufPos > 0, "GLParticleRendererAgeSeed: buffers are empty");
+
+		// the tables only change when the keys are rebuilt
+		const bool colorLutChanged = m_colorLut && m_colorLut->revision() != m_colorLutRevision;
+		const bool sizeLutChanged = m_sizeLut && m_sizeLut->revision() != m_sizeLutRevision;
+		if ((m_colorLut || m_sizeLut) && (!m_gradientUploaded || colorLutChanged || sizeLutChanged))
+			uploadGradient();
+
+		m_countUploaded = m_system->numAliveParticles();
+		if (m_countUploaded == 0)
+			return;
+
+		const glm::vec4* pos = m_system->finalData()->m_pos;
+		const glm::vec4* time = m_system->finalData()->m_time;
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+		AgeSeedVertex* dst = (AgeSeedVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, m_countUploaded * sizeof(AgeSeedVertex), GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+		if (dst)
+		{
+			JobSystem::instance().parallelFor(m_countUploaded, PACK_CHUNK, [pos, time, dst](size_t begin, size_t end) {
+				packAgeSeedVertices(pos, time, dst, begin, end);
+			});
+		}
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void GLParticleRendererAgeSeed::render()
+	{
+		if (m_countUploaded == 0 || !m_shader)
+			return;
+
+		int colorMode = COLOR_NONE;
+		if (m_colorLut)
+			colorMode = COLOR_GRADIENT;
+		else if (m_basicColor)
+			colorMode = COLOR_BASIC;
+
+		m_gradient->bindAny();
+
+		const GLint program = bindWithScenePass(m_shader.get(), m_pass);
+		m_shader->setUniformI("colorMode", colorMode);
+		if (colorMode == COLOR_BASIC)
+		{
+			m_shader->setUniformF("minStartCol", m_colorGen->m_minStartCol);
+			m_shader->setUniformF("maxStartCol", m_colorGen->m_maxStartCol);
+			m_shader->setUniformF("minEndCol", m_colorGen->m_minEndCol);
+			m_shader->setUniformF("maxEndCol", m_colorGen->m_maxEndCol);
+		}
+		m_shader->setUniformI("sizeEnabled", m_sizeLut ? 1 : 0);
+		m_shader->setUniformI("gradient", m_gradient->boundUnit());
+		m_shader->setUniformF("gradientSize", (float)ColorLutUpdater::LUT_SIZE);
+
+		glBindVertexArray(m_vao);
+		glDrawArrays(GL_POINTS, 0, (GLsizei)m_countUploaded);
+		glBindVertexArray(0);
+
+		glUseProgram(program);
+	}
+
+	using PositionFormat = GLParticleRendererQuantized::PositionFormat;
+	using ColorFormat = GLParticleRendererQuantized::ColorFormat;
+
+	struct AttribFormat
+	{
+		GLenum type;
+		GLboolean normalized;
+		size_t bytes;			// per particle
+	};
+
+	static const AttribFormat POSITION_FORMATS[(int)PositionFormat::COUNT] = {
+		{ GL_FLOAT, GL_FALSE, 16 },
+		{ GL_HALF_FLOAT, GL_FALSE, 8 },
+		{ GL_UNSIGNED_SHORT, GL_TRUE, 8 }
+	};
+
+	static const AttribFormat COLOR_FORMATS[(int)ColorFormat::COUNT] = {
+		{ GL_FLOAT, GL_FALSE, 16 },
+		{ GL_UNSIGNED_BYTE, GL_TRUE, 4 },
+		{ GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, 4 }
+	};
+
+	const char* const GLParticleRendererQuantized::FORMAT_NAMES[FORMAT_COUNT] = {
+		"float + float", "float + rgba8", "float + rgb10a2",
+		"half + float", "half + rgba8", "half + rgb10a2",
+		"unorm16 + float", "unorm16 + rgba8", "unorm16 + rgb10a2"
+	};
+
+	static const float MIN_EXTENT = 1e-6f;	// keeps the 16 bit scale finite for flat bounds
+
+	// four float colors to 10 bits per channel and 2 bits of alpha, one packed color per lane
+	static inline __m128i packRgb10a2(const float* c)
+	{
+		__m128 r = _mm_load_ps(c + 0);
+		__m128 g = _mm_load_ps(c + 4);
+		__m128 b = _mm_load_ps(c + 8);
+		__m128 a = _mm_load_ps(c + 12);
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+
+		const auto quantize = [](__m128 v, float maxValue) {
+			const __m128 clamped = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+			return _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(maxValue)));
+		};
+
+		__m128i words = quantize(r, 1023.0f);
+		words = _mm_or_si128(words, _mm_slli_epi32(quantize(g, 1023.0f), 10));
+		words = _mm_or_si128(words, _mm_slli_epi32(quantize(b, 1023.0f), 20));
+		return _mm_or_si128(words, _mm_slli_epi32(quantize(a, 3.0f), 30));
+	}
+
+	// min and max of all four components over the particles, reduced per chunk on the job system threads
+	static void positionBounds(const glm::vec4* pos, size_t count, glm::vec4& minPos, glm::vec4& maxPos)
+	{
+		const size_t chunks = (count + PACK_CHUNK - 1) / PACK_CHUNK;
+		std::vector<glm::vec4> chunkMin(chunks, glm::vec4(FLT_MAX)), chunkMax(chunks, glm::vec4(-FLT_MAX));
+
+		JobSystem::instance().parallelFor(count, PACK_CHUNK, [pos, &chunkMin, &chunkMax](size_t begin, size_t end) {
+			__m128 lo = _mm_load_ps(&pos[begin].x);
+			__m128 hi = lo;
+			for (size_t i = begin + 1; i < end; ++i)
+			{
+				const __m128 p = _mm_load_ps(&pos[i].x);
+				lo = _mm_min_ps(lo, p);
+				hi = _mm_max_ps(hi, p);
+			}
+			_mm_storeu_ps(&chunkMin[begin / PACK_CHUNK].x, lo);
+			_mm_storeu_ps(&chunkMax[begin / PACK_CHUNK].x, hi);
+		});
+
+		minPos = glm::vec4(FLT_MAX);
+		maxPos = glm::vec4(-FLT_MAX);
+		for (size_t c = 0; c < chunks; ++c)
+		{
+			minPos = glm::min(minPos, chunkMin[c]);
+			maxPos = glm::max(maxPos, chunkMax[c]);
+		}
+	}
+
+	// count positions from src to the 16 byte aligned dst. The 16 bit format maps offset to 0 and scale
+	// is 65535 over the extent of the bounds. The stores are streamed, the caller fences
+	static void encodePositions(PositionFormat format, const glm::vec4* src, void* dst, size_t count, __m128 offset, __m128 scale)
+	{
+		const float* p = (const float*)src;
+		size_t i = 0;
+
+		switch (format)
+		{
+		case PositionFormat::FLOAT:
+		{
+			float* out = (float*)dst;
+			for (; i < count; ++i)
+				_mm_stream_ps(out + 4 * i, _mm_load_ps(p + 4 * i));
+			break;
+		}
+		case PositionFormat::HALF:
+		{
+			__m128i* out = (__m128i*)dst;
+			for (; i + 2 <= count; i += 2)
+			{
+				const __m128i h0 = _mm_cvtps_ph(_mm_load_ps(p + 4 * i), _MM_FROUND_TO_NEAREST_INT);
+				const __m128i h1 = _mm_cvtps_ph(_mm_load_ps(p + 4 * i + 4), _MM_FROUND_TO_NEAREST_INT);
+				_mm_stream_si128(out + i / 2, _mm_unpacklo_epi64(h0, h1));
+			}
+			if (i < count)
+				_mm_storel_epi64(out + i / 2, _mm_cvtps_ph(_mm_load_ps(p + 4 * i), _MM_FROUND_TO_NEAREST_INT));
+			break;
+		}
+		case PositionFormat::UNORM16:
+		{
+			// the conversion rounds to nearest, the pack saturates what lies outside of the bounds
+			const auto quantize = [offset, scale](const float* v) {
+				return _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(v), offset), scale));
+			};
+
+			__m128i* out = (__m128i*)dst;
+			for (; i + 2 <= count; i += 2)
+				_mm_stream_si128(out + i / 2, _mm_packus_epi32(quantize(p + 4 * i), quantize(p + 4 * i + 4)));
+			if (i < count)
+			{
+				const __m128i q = quantize(p + 4 * i);
+				_mm_storel_epi64(out + i / 2, _mm_packus_epi32(q, q));
+			}
+			break;
+		}
+		default:
+			FAIL("encodePositions: unknown format");
+		}
+	}
+
+	// count colors from src to the 16 byte aligned dst, streamed like the positions
+	static void encodeColors(ColorFormat format, const glm::vec4* src, void* dst, size_t count)
+	{
+		const float* c = (const float*)src;
+
+		if (format == ColorFormat::FLOAT)
+		{
+			float* out = (float*)dst;
+			for (size_t i = 0; i < count; ++i)
+				_mm_stream_ps(out + 4 * i, _mm_load_ps(c + 4 * i));
+			return;
+		}
+
+		__m128i (*pack)(const float*) = (format == ColorFormat::RGBA8) ? packRgba8 : packRgb10a2;
+		__m128i* out = (__m128i*)dst;
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_stream_si128(out + i / 4, pack(c + 4 * i));
+
+		if (i < count)
+		{
+			alignas(16) float tail[16] = { };
+			alignas(16) uint32_t words[4];
+			std::copy(c + 4 * i, c + 4 * count, tail);
+			_mm_store_si128((__m128i*)words, pack(tail));
+			std::copy(words, words + (count - i), (uint32_t*)dst + i);
+		}
+	}
+
+	// what the vertex attributes and particles_quantized.inc make of the encoded streams
+	static glm::vec4 decodePosition(PositionFormat format, const void* data, size_t i, const glm::vec4& offset, const glm::vec4& scale)
+	{
+		switch (format)
+		{
+		case PositionFormat::FLOAT:
+			return ((const glm::vec4*)data)[i];
+		case PositionFormat::HALF:
+		{
+			glm::vec4 v;
+			_mm_storeu_ps(&v.x, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)((const uint16_t*)data + 4 * i))));
+			return v;
+		}
+		default:
+		{
+			const uint16_t* q = (const uint16_t*)data + 4 * i;
+			return offset + glm::vec4(q[0], q[1], q[2], q[3]) * (1.0f / 65535.0f) * scale;
+		}
+		}
+	}
+
+	static glm::vec4 decodeColor(ColorFormat format, const void* data, size_t i)
+	{
+		switch (format)
+		{
+		case ColorFormat::FLOAT:
+			return ((const glm::vec4*)data)[i];
+		case ColorFormat::RGBA8:
+		{
+			const uint8_t* b = (const uint8_t*)data + 4 * i;
+			return glm::vec4(b[0], b[1], b[2], b[3]) * (1.0f / 255.0f);
+		}
+		default:
+		{
+			const uint32_t w = ((const uint32_t*)data)[i];
+			return glm::vec4(w & 1023u, (w >> 10) & 1023u, (w >> 20) & 1023u, 0.0f) * (1.0f / 1023.0f) + glm::vec4(0.0f, 0.0f, 0.0f, (w >> 30) / 3.0f);
+		}
+		}
+	}
+
+	GLParticleRendererQuantized::GLParticleRendererQuantized() { }
+	GLParticleRendererQuantized::~GLParticleRendererQuantized() { destroy(); }
+
+	size_t GLParticleRendererQuantized::bytesPerParticle(int format)
+	{
+		return POSITION_FORMATS[(int)positionFormat(format)].bytes + COLOR_FORMATS[(int)colorFormat(format)].bytes;
+	}
+
+	std::vector<GLParticleRendererQuantized::QuantizationError> GLParticleRendererQuantized::measureErrors(ParticleSystem* sys)
+	{
+		ASSERT(sys != nullptr, "GLParticleRendererQuantized: sys is null");
+
+		const size_t count = sys->numAliveParticles();
+		const glm::vec4* pos = sys->finalData()->m_pos;
+		const glm::vec4* col = sys->finalData()->m_col;
+
+		glm::vec4 minPos{ 0.0f }, maxPos{ 0.0f };
+		if (count > 0)
+			positionBounds(pos, count, minPos, maxPos);
+		const glm::vec4 extent = glm::max(maxPos - minPos, glm::vec4(MIN_EXTENT));
+		const float largestExtent = std::max(extent.x, std::max(extent.y, extent.z));
+		const __m128 offset = _mm_loadu_ps(&minPos.x);
+		const __m128 scale = _mm_div_ps(_mm_set1_ps(65535.0f), _mm_loadu_ps(&extent.x));
+
+		// one chunk at a time in the widest format
+		std::vector<__m128> encodedPos(PACK_CHUNK), encodedCol(PACK_CHUNK);
+
+		std::vector<QuantizationError> errors;
+		for (int format = 0; format < FORMAT_COUNT; ++format)
+		{
+			QuantizationError error{ format, bytesPerParticle(format), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			double sumPosError = 0.0;
+
+			for (size_t begin = 0; begin < count; begin += PACK_CHUNK)
+			{
+				const size_t n = std::min(PACK_CHUNK, count - begin);
+				encodePositions(positionFormat(format), pos + begin, encodedPos.data(), n, offset, scale);
+				encodeColors(colorFormat(format), col + begin, encodedCol.data(), n);
+				_mm_sfence();
+
+				for (size_t i = 0; i < n; ++i)
+				{
+					const glm::vec4 dp = decodePosition(positionFormat(format), encodedPos.data(), i, minPos, extent) - pos[begin + i];
+					const glm::vec4 dc = glm::abs(decodeColor(colorFormat(format), encodedCol.data(), i) - col[begin + i]);
+
+					const float posError = glm::length(glm::vec3(dp));
+					sumPosError += posError;
+					error.maxPosError = std::max(error.maxPosError, posError);
+					error.maxSizeError = std::max(error.maxSizeError, std::abs(dp.w));
+					error.maxColorError = std::max(error.maxColorError, std::max(std::max(dc.x, dc.y), std::max(dc.z, dc.w)));
+				}
+			}
+
+			error.meanPosError = (count > 0) ? (float)(sumPosError / (double)count) : 0.0f;
+			error.relativePosError = error.maxPosError / largestExtent;
+			errors.push_back(error);
+		}
+
+		return errors;
+	}
+
+	void GLParticleRendererQuantized::setFormat(int format)
+	{
+		ASSERT(format >= 0 && format < FORMAT_COUNT, "GLParticleRendererQuantized: unknown format");
+		m_format = format;
+	}
+
+	void GLParticleRendererQuantized::generate(ParticleSystem* sys, bool)
+	{
+		ASSERT(sys != nullptr, "GLParticleRendererQuantized: sys is null");
+
+		destroy();
+		m_system = sys;
+
+		// room for the widest format, the attributes are set with every upload
+		const size_t count = sys->numAllParticles();
+
+		glGenVertexArrays(1, &m_vao);
+		glBindVertexArray(m_vao);
+
+		glGenBuffers(1, &m_bufPos);
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+		glBufferData(GL_ARRAY_BUFFER, bytesPerParticle(0) * count + 16, nullptr, GL_STREAM_DRAW);
 
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 16, reinterpret_cast<void*>(0 + 0));
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 16, (void*)((3) * sizeof(float)));
 
-		/*glBindVertexBuffer(0, m_bufPos, 0, sizeof(float)*7);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// particles.vert decodes the positions when the include defines QUANTIZED_PARTICLES
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_shader = std::make_unique<Shader>();
+		ShaderObject* frag = m_shader->addObject();
+		for (const char* file : { "common.inc", "particles.frag" })
+			frag->addFile((path + file).c_str());
+		frag->compile(FRAGMENT_SHADER);
+		ShaderObject* vert = m_shader->addObject();
+		for (const char* file : { "common.inc", "particles_quantized.inc", "particles.vert" })
+			vert->addFile((path + file).c_str());
+		vert->compile(VERTEX_SHADER);
+		m_shader->link();
+	}
+
+	void GLParticleRendererQuantized::destroy()
+	{
+		m_shader.reset();
+		m_countUploaded = 0;
+
+		GLParticleRenderer::destroy();
+	}
+
+	void GLParticleRendererQuantized::update()
+	{
+		ASSERT(m_system != nullptr, "GLParticleRendererQuantized: m_system is null");
+		ASSERT(m_bufPos > 0, "GLParticleRendererQuantized: buffers are empty");
+
+		m_countUploaded = m_system->numAliveParticles();
+		if (m_countUploaded == 0)
+			return;
+
+		const size_t count = m_countUploaded;
+		const glm::vec4* pos = m_system->finalData()->m_pos;
+		const glm::vec4* col = m_system->finalData()->m_col;
+		const PositionFormat posFormat = positionFormat(m_format);
+		const ColorFormat colFormat = colorFormat(m_format);
+		const AttribFormat& posAttrib = POSITION_FORMATS[(int)posFormat];
+		const AttribFormat& colAttrib = COLOR_FORMATS[(int)colFormat];
+
+		// float and half positions are drawn as they are
+		m_posOffset = glm::vec4(0.0f);
+		m_posScale = glm::vec4(1.0f);
+		__m128 offset = _mm_setzero_ps();
+		__m128 scale = _mm_set1_ps(1.0f);
+		if (posFormat == PositionFormat::UNORM16)
+		{
+			glm::vec4 maxPos;
+			positionBounds(pos, count, m_posOffset, maxPos);
+			m_posScale = glm::max(maxPos - m_posOffset, glm::vec4(MIN_EXTENT));
+			offset = _mm_loadu_ps(&m_posOffset.x);
+			scale = _mm_div_ps(_mm_set1_ps(65535.0f), _mm_loadu_ps(&m_posScale.x));
+		}
 
-		glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, sizeof(float)*0);
-		glVertexAttribBinding(0, 0);
-		glVertexAttribFormat(1, 4, GL_FLOAT, GL_FALSE, sizeof(float) * 3);
-		glVertexAttribBinding(1, 0);*/
+		// the colors follow the positions, aligned for the streaming stores
+		const size_t colorOffset = (count * posAttrib.bytes + 15) & ~(size_t)15;
+		const size_t size = colorOffset + count * colAttrib.bytes;
 
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+		char* dst = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+		if (dst)
+		{
+			JobSystem::instance().parallelFor(count, PACK_CHUNK, [&](size_t begin, size_t end) {
+				encodePositions(posFormat, pos + begin, dst + begin * posAttrib.bytes, end - begin, offset, scale);
+				encodeColors(colFormat, col + begin, dst + colorOffset + begin * colAttrib.bytes, end - begin);
+				_mm_sfence();
+			});
+		}
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+
+		glBindVertexArray(m_vao);
+		glVertexAttribPointer(0, 4, posAttrib.type, posAttrib.normalized, 0, (void*)0);
+		glVertexAttribPointer(1, 4, colAttrib.type, colAttrib.normalized, 0, (void*)colorOffset);
 		glBindVertexArray(0);
 
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		m_id = 0;
 	}
 
-	void GLParticleRendererPersistent::update()
+	void GLParticleRendererQuantized::render()
 	{
-		ASSERT(m_system != nullptr, "GLParticleRendererPersistent: m_system is null");
-		ASSERT(m_bufPos > 0 && m_bufCol > 0, "GLParticleRendererPersistent: buffers are empty");
+		if (m_countUploaded == 0 || !m_shader)
+			return;
 
-		const size_t count = m_system->numAliveParticles();
-		if (count > 0)
+		const GLint program = bindWithScenePass(m_shader.get(), m_pass);
+		m_shader->setUniformF("posOffset", m_posOffset);
+		m_shader->setUniformF("posScale", m_posScale);
+
+		glBindVertexArray(m_vao);
+		glDrawArrays(GL_POINTS, 0, (GLsizei)m_countUploaded);
+		glBindVertexArray(0);
+
+		glUseProgram(program);
+	}
+
+	// rotation of the quads, a start angle from the seed plus the spin over the normalized age
+	static inline __m128 quadAngles(__m128 age, __m128 invLifetime, __m128 spin)
+	{
+		const __m128 start = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(seedHash(invLifetime), 8)), _mm_set1_ps(6.28318531f / 16777216.0f));
+		return _mm_add_ps(start, _mm_mul_ps(age, spin));
+	}
+
+	static void packMotion(const glm::vec4* vel, const glm::vec4* time, float* dst, size_t begin, size_t end, float spin)
+	{
+		const float* v = (const float*)(vel + begin);
+		const float* t = (const float*)(time + begin);
+		float* out = dst + 4 * begin;
+		const __m128 spinAngle = _mm_set1_ps(spin * 6.28318531f);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4, v += 16, t += 16, out += 16)
 		{
-			float* posPtr = (float*)(m_system->finalData()->m_pos);
-			float* colPtr = (float*)(m_system->finalData()->m_col);
-			const size_t maxCount = m_system->numAllParticles();
+			__m128 t0 = _mm_load_ps(t + 0);
+			__m128 t1 = _mm_load_ps(t + 4);
+			__m128 t2 = _mm_load_ps(t + 8);
+			__m128 t3 = _mm_load_ps(t + 12);
+			_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+			const __m128 angles = quadAngles(t2, t3, spinAngle);
+			streamVertex<0>(out + 0, _mm_load_ps(v + 0), angles);
+			streamVertex<1>(out + 4, _mm_load_ps(v + 4), angles);
+			streamVertex<2>(out + 8, _mm_load_ps(v + 8), angles);
+			streamVertex<3>(out + 12, _mm_load_ps(v + 12), angles);
+		}
+
+		for (; i < end; ++i, v += 4, t += 4, out += 4)
+		{
+			const __m128 ti = _mm_load_ps(t);
+			const __m128 angle = quadAngles(_mm_shuffle_ps(ti, ti, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(ti, ti, _MM_SHUFFLE(3, 3, 3, 3)), spinAngle);
+			streamVertex<0>(out, _mm_load_ps(v), angle);
+		}
 
-			for (size_t i = m_id * maxCount, j = 0; i < m_id * maxCount + count; i += 2, j += 8)
+		_mm_sfence();
+	}
+
+	void GLParticleRenderer::generateQuads(size_t count)
+	{
+		glBindVertexArray(m_vao);
+
+		// position and color advance once per quad
+		genSingleBuffer(m_bufMotion, (GLuint)count, 4, nullptr);
+		setVertexAttrib(m_bufMotion, 2, 4);
+		for (GLuint attrib : { 0u, 1u, 2u })
+			setAttribDivisor(attrib, 1);
+
+		// corners of a unit quad around the particle, drawn as a strip
+		const float corners[] = { -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f };
+		glGenBuffers(1, &m_bufCorners);
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufCorners);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+		setVertexAttrib(m_bufCorners, 3, 2);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_quadShader = std::make_unique<Shader>(path.c_str(), "common.inc", "billboards.vert", nullptr, "billboards.frag", 1);
+	}
+
+	void GLParticleRenderer::updateQuads(size_t count)
+	{
+		const glm::vec4* vel = m_system->finalData()->m_vel;
+		const glm::vec4* time = m_system->finalData()->m_time;
+		const float spin = m_quadSettings.spin;
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufMotion);
+		float* dst = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, count * sizeof(float) * 4, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+		if (dst)
+		{
+			JobSystem::instance().parallelFor(count, PACK_CHUNK, [vel, time, dst, spin](size_t begin, size_t end) {
+				packMotion(vel, time, dst, begin, end, spin);
+			});
+		}
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void GLParticleRenderer::renderQuads(size_t count)
+	{
+		Shader* shader = m_sorter ? m_sortedShader.get() : m_quadShader.get();
+		if (count == 0 || !shader)
+			return;
+
+		const GLint program = bindWithScenePass(shader, m_pass);
+		shader->setUniformF("quadSize", m_quadSettings.size);
+		shader->setUniformF("stretch", m_quadSettings.stretch);
+
+		glBindVertexArray(m_vao);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count);
+		glBindVertexArray(0);
+
+		glUseProgram(program);
+	}
+
+	// the points or quads program with particles_sorted.inc ahead of the fragment shader
+	static std::unique_ptr<Shader> buildSortedShader(const char* vertFile, const char* fragFile)
+	{
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		auto shader = std::make_unique<Shader>();
+		ShaderObject* frag = shader->addObject();
+		for (const char* file : { "common.inc", "particles_sorted.inc", fragFile })
+			frag->addFile((path + file).c_str());
+		frag->compile(FRAGMENT_SHADER);
+		ShaderObject* vert = shader->addObject();
+		for (const char* file : { "common.inc", vertFile })
+			vert->addFile((path + file).c_str());
+		vert->compile(VERTEX_SHADER);
+		shader->link();
+		return shader;
+	}
+
+	// four particles in the order of the sorter, the motion is built like in packMotion
+	static void gatherQuads(const ParticleData* data, const uint32_t* indices, float* pos, float* col, float* motion, size_t begin, size_t end, float spin)
+	{
+		const __m128 spinAngle = _mm_set1_ps(spin * 6.28318531f);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const uint32_t* idx = indices + i;
+			__m128 t0 = _mm_load_ps(&data->m_time[idx[0]].x);
+			__m128 t1 = _mm_load_ps(&data->m_time[idx[1]].x);
+			__m128 t2 = _mm_load_ps(&data->m_time[idx[2]].x);
+			__m128 t3 = _mm_load_ps(&data->m_time[idx[3]].x);
+			_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+			const __m128 angles = quadAngles(t2, t3, spinAngle);
+
+			for (size_t k = 0; k < 4; ++k)
 			{
-				m_ptr[i].x = posPtr[j + 0];
-				m_ptr[i].y = posPtr[j + 1];
-				m_ptr[i].z = posPtr[j + 2];
-				m_ptr[i].r = (GLubyte)(255.0f * colPtr[j + 0]);
-				m_ptr[i].g = (GLubyte)(255.0f * colPtr[j + 1]);
-				m_ptr[i].b = (GLubyte)(255.0f * colPtr[j + 2]);
-				m_ptr[i].a = (GLubyte)(255.0f * colPtr[j + 3]);
-
-				m_ptr[i + 1].x = posPtr[j + 4];
-				m_ptr[i + 1].y = posPtr[j + 5];
-				m_ptr[i + 1].z = posPtr[j + 6];
-				m_ptr[i + 1].r = (GLubyte)(255.0f * colPtr[j + 4]);
-				m_ptr[i + 1].g = (GLubyte)(255.0f * colPtr[j + 5]);
-				m_ptr[i + 1].b = (GLubyte)(255.0f * colPtr[j + 6]);
-				m_ptr[i + 1].a = (GLubyte)(255.0f * colPtr[j + 7]);
+				_mm_stream_ps(pos + 4 * (i + k), _mm_load_ps(&data->m_pos[idx[k]].x));
+				_mm_stream_ps(col + 4 * (i + k), _mm_load_ps(&data->m_col[idx[k]].x));
 			}
-			//float *mem = (float *)m_mappedPosBuf + m_id*maxCount * 3;
-			//memcpy(mem, posPtr, count*sizeof(float) * 3);
+			streamVertex<0>(motion + 4 * i + 0, _mm_load_ps(&data->m_vel[idx[0]].x), angles);
+			streamVertex<1>(motion + 4 * i + 4, _mm_load_ps(&data->m_vel[idx[1]].x), angles);
+			streamVertex<2>(motion + 4 * i + 8, _mm_load_ps(&data->m_vel[idx[2]].x), angles);
+			streamVertex<3>(motion + 4 * i + 12, _mm_load_ps(&data->m_vel[idx[3]].x), angles);
+		}
+
+		for (; i < end; ++i)
+		{
+			const uint32_t index = indices[i];
+			const __m128 ti = _mm_load_ps(&data->m_time[index].x);
+			const __m128 angle = quadAngles(_mm_shuffle_ps(ti, ti, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(ti, ti, _MM_SHUFFLE(3, 3, 3, 3)), spinAngle);
+			_mm_stream_ps(pos + 4 * i, _mm_load_ps(&data->m_pos[index].x));
+			_mm_stream_ps(col + 4 * i, _mm_load_ps(&data->m_col[index].x));
+			streamVertex<0>(motion + 4 * i, _mm_load_ps(&data->m_vel[index].x), angle);
+		}
 
+		_mm_sfence();
+	}
 
-			//float *mem = (float *)m_mappedColBuf + m_id*maxCount * 4;
-			//memcpy(mem, colPtr, count*sizeof(float) * 4);
+	bool GLParticleRenderer::setDepthSort(bool enabled)
+	{
+		if (enabled && !m_sorter)
+			m_sorter = std::make_unique<DepthSorter>();
+		else if (!enabled && m_sorter)
+		{
+			m_sorter.reset();
+			m_sortedShader.reset();
 
-			//glBindBuffer(GL_ARRAY_BUFFER, 0);
+			// the vao has to be bound to drop the element buffer from it
+			glBindVertexArray(m_vao);
+			destroyBuffer(m_bufIndices);
+			glBindVertexArray(0);
 		}
+
+		return true;
 	}
 
-	void GLParticleRendererPersistent::render()
+	void GLParticleRenderer::uploadSortedQuads(size_t count)
 	{
-		glBindVertexArray(m_vao);
+		const ParticleData* data = m_system->finalData();
+		const uint32_t* indices = m_sorter->indices();
+		const float spin = m_quadSettings.spin;
 
-		const size_t count = m_system->numAliveParticles();
-		const size_t maxCount = m_system->numAllParticles();
-		if (count > 0)
-			glDrawArrays(GL_POINTS, m_id * maxCount, count);
+		const GLsizeiptr size = count * sizeof(float) * 4;
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+		float* pos = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufCol);
+		float* col = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufMotion);
+		float* motion = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+
+		if (pos && col && motion)
+		{
+			JobSystem::instance().parallelFor(count, PACK_CHUNK, [=](size_t begin, size_t end) {
+				gatherQuads(data, indices, pos, col, motion, begin, end, spin);
+			});
+		}
 
-		//glBindVertexArray(0);
+		for (GLuint buf : { m_bufPos, m_bufCol, m_bufMotion })
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buf);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void GLParticleRenderer::renderSorted(size_t count)
+	{
+		m_sorter->sort(m_system->finalData()->m_pos, count, m_pass.viewMat);
+
+		if (!m_sortedShader)
+			m_sortedShader = m_useQuads ? buildSortedShader("billboards.vert", "billboards.frag") : buildSortedShader("particles.vert", "particles.frag");
+
+		// the additive blending of the pass needs no order, it is set again after the draw. The weighted
+		// transparency and the overdraw count keep their own
+		const bool ownBlending = !m_pass.ownsBlending();
+		if (ownBlending)
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		if (m_useQuads)
+		{
+			uploadSortedQuads(count);
+			renderQuads(count);
+		}
+		else
+		{
+			glBindVertexArray(m_vao);
+			if (m_bufIndices == 0)
+			{
+				// room for every particle, the element binding is part of the vao
+				glGenBuffers(1, &m_bufIndices);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIndices);
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_system->numAllParticles() * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+			}
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, count * sizeof(uint32_t), m_sorter->indices());
+
+			const GLint program = bindWithScenePass(m_sortedShader.get(), m_pass);
+			glDrawElements(GL_POINTS, (GLsizei)count, GL_UNSIGNED_INT, nullptr);
+			glUseProgram(program);
+
+			glBindVertexArray(0);
+		}
+
+		if (ownBlending)
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	}
+
+	void GLParticleRenderer::setView(const ScenePass& pass)
+	{
+		m_frustum.set(pass.projMat * pass.viewMat);
+		m_pass = pass;
+		m_hasView = true;
+	}
+
+	float GLParticleRenderer::cullMargin() const
+	{
+		// points are clipped by their center, quads reach out half their diagonal. Stretched quads grow
+		// with the speed, which has no bound
+		if (!m_useQuads)
+			return 0.0f;
+		return (m_quadSettings.stretch > 0.0f) ? -1.0f : 0.7072f * m_quadSettings.size;
+	}
+
+	bool GLParticleRenderer::cullsChunks() const
+	{
+		// the sorted draw indexes every alive particle
+		return m_chunkCulling && m_hasView && !m_sorter && m_system->finalData()->m_boundsValid && cullMargin() >= 0.0f;
+	}
+
+	void GLParticleRenderer::uploadVisibleChunks(size_t count)
+	{
+		const ParticleData* p = m_system->finalData();
+		const float margin = cullMargin() * std::max(p->m_boundsMax.w, 0.0f);
+
+		m_visibleRuns.clear();
+		for (size_t c = 0, chunks = p->numBoundsChunks(); c < chunks; ++c)
+		{
+			if (!m_frustum.intersects(p->m_chunkMin[c], p->m_chunkMax[c], margin))
+				continue;
+
+			const size_t begin = c * ParticleData::BOUNDS_CHUNK;
+			const size_t end = std::min(count, begin + ParticleData::BOUNDS_CHUNK);
+			if (!m_visibleRuns.empty() && m_visibleRuns.back().second == begin)
+				m_visibleRuns.back().second = end;
+			else if (begin < end)
+				m_visibleRuns.emplace_back(begin, end);
+		}
+
+		// one call per run, packed to the front of the buffers
+		size_t drawn = 0;
+		for (const auto& run : m_visibleRuns)
+		{
+			const size_t n = run.second - run.first;
+			glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+			glBufferSubData(GL_ARRAY_BUFFER, drawn * sizeof(float) * POS_ELEMENTS, n * sizeof(float) * POS_ELEMENTS, p->m_pos + run.first);
+			glBindBuffer(GL_ARRAY_BUFFER, m_bufCol);
+			glBufferSubData(GL_ARRAY_BUFFER, drawn * sizeof(float) * 4, n * sizeof(float) * 4, p->m_col + run.first);
+			drawn += n;
+		}
+
+		if (m_useQuads && drawn > 0)
+		{
+			const float spin = m_quadSettings.spin;
+
+			glBindBuffer(GL_ARRAY_BUFFER, m_bufMotion);
+			float* dst = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, drawn * sizeof(float) * 4, GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_WRITE_BIT);
+			if (dst)
+			{
+				size_t offset = 0;
+				for (const auto& run : m_visibleRuns)
+				{
+					const glm::vec4* vel = p->m_vel + run.first;
+					const glm::vec4* time = p->m_time + run.first;
+					float* out = dst + 4 * offset;
+					JobSystem::instance().parallelFor(run.second - run.first, PACK_CHUNK, [vel, time, out, spin](size_t begin, size_t end) {
+						packMotion(vel, time, out, begin, end, spin);
+					});
+					offset += run.second - run.first;
+				}
+			}
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_countDrawn = drawn;
+		m_culled = count - drawn;
+	}
+
+	bool GLParticleRenderer::setThinning(bool enabled)
+	{
+		if (!enabled)
+			m_thinner.reset();
+		else if (!m_thinner)
+			m_thinner = std::make_unique<DensityThinner>();
+		return true;
+	}
+
+	bool GLParticleRenderer::thins() const
+	{
+		// quads aren't clipped by their center and the sorted draw indexes every alive particle. The raised
+		// alpha of the thinned particles only adds up with additive blending, the weighted transparency of
+		// the pass would read it as coverage
+		return m_thinner && m_hasView && !m_sorter && !m_useQuads && !m_pass.weightedOit;
+	}
+
+	bool GLParticleRenderer::uploadThinned(size_t count)
+	{
+		const glm::ivec2 viewport = m_pass.viewportSize;
+		if (viewport.x <= 0 || viewport.y <= 0)
+			return false;
+
+		m_thinnedPos.resize(count);
+		m_thinnedCol.resize(count);
+		const size_t kept = m_thinner->thin(m_system->finalData(), count, m_pass.viewMat, m_pass.projMat, viewport.x, viewport.y,
+			m_thinningSettings, m_thinnedPos.data(), m_thinnedCol.data());
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, kept * sizeof(float) * POS_ELEMENTS, m_thinnedPos.data());
+		glBindBuffer(GL_ARRAY_BUFFER, m_bufCol);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, kept * sizeof(float) * 4, m_thinnedCol.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		m_id = (m_id + 1) % 3;
+		m_countDrawn = kept;
+		m_culled = count - kept;
+		return true;
 	}
 }
\ No newline at end of file
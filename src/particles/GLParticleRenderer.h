@@ -7,28 +7,96 @@
 \*------------------------------------------------------------------------------------------------*/
 #pragma once
 
+#include <memory>
+#include <vector>
+#include "DensityThinner.h"
+#include "DepthSorter.h"
 #include "ParticleRenderer.h"
+#include "ParticleGenerators.h"
+#include "ParticleUpdaters.h"
+#include "ViewFrustum.h"
 
 
 namespace nhahn
 {
+	class Shader;
+	class Texture;
+
+	/*
+	 * Uploads position and color with glBufferSubData and draws them as points. With useQuads every
+	 * particle is an instance of a shared four vertex quad instead, drawn by billboards.vert with a
+	 * third stream holding the velocity and rotation angle. Unlike point sprites the quads are not
+	 * clamped in size by the driver and can turn and stretch along the velocity.
+	 * With the depth sort on, the points are drawn through an index buffer in the order of the
+	 * DepthSorter. Instanced attributes can't be indexed, sorted quads gather their three streams in
+	 * draw order instead of uploading them in update.
+	 * With chunk culling on, update only uploads the ParticleData bounds chunks inside the view set
+	 * last, packed to the front of the buffers, and render draws just those.
+	 * With thinning on, the points kept by the DensityThinner are uploaded instead, it takes over from
+	 * the chunk culling since it drops the particles outside of the view as well.
+	 * The renderers deriving from it with their own buffer layout draw unsorted points only.
+	 */
 	class GLParticleRenderer : public IParticleRenderer
 	{
 	public:
-		GLParticleRenderer() { }
-		~GLParticleRenderer() { destroy(); }
+		GLParticleRenderer();
+		~GLParticleRenderer();
 
 		void generate(ParticleSystem* sys, bool useQuads) override;
 		void destroy() override;
 		void update() override;
 		void render() override;
 
+		bool setDepthSort(bool enabled) override;
+		DepthSorter* depthSorter() override { return m_sorter.get(); }
+
+		void setView(const ScenePass& pass) override;
+		bool setChunkCulling(bool enabled) override { m_chunkCulling = enabled; return true; }
+		bool chunkCulling() const override { return m_chunkCulling; }
+		size_t numCulledParticles() const override { return m_culled; }
+		float cullMargin() const override;
+
+		bool setThinning(bool enabled) override;
+		DensityThinner* thinner() override { return m_thinner.get(); }
+
+	protected:
+		void generateQuads(size_t count);
+		void updateQuads(size_t count);
+		void renderQuads(size_t count);
+		void renderSorted(size_t count);
+		void uploadSortedQuads(size_t count);
+		bool cullsChunks() const;
+		void uploadVisibleChunks(size_t count);
+		bool thins() const;
+		bool uploadThinned(size_t count);
+
 	protected:
 		ParticleSystem* m_system{ nullptr };
 
 		unsigned int m_bufPos{ 0 };
 		unsigned int m_bufCol{ 0 };
 		unsigned int m_vao{ 0 };
+
+		bool m_useQuads{ false };
+		unsigned int m_bufMotion{ 0 };			// velocity in xyz, rotation angle in w, per instance
+		unsigned int m_bufCorners{ 0 };			// the shared quad
+		std::unique_ptr<Shader> m_quadShader;
+
+		std::unique_ptr<DepthSorter> m_sorter;		// kept over destroy like the quad settings
+		unsigned int m_bufIndices{ 0 };				// element buffer of the sorted points
+		std::unique_ptr<Shader> m_sortedShader;		// the points or quads program with particles_sorted.inc
+
+		bool m_chunkCulling{ false };
+		ViewFrustum m_frustum;
+		bool m_hasView{ false };
+		ScenePass m_pass;							// camera and blending of the SceneView
+		std::vector<std::pair<size_t, size_t>> m_visibleRuns;	// slot ranges of neighbouring visible chunks
+		size_t m_countDrawn{ 0 };					// uploaded by the last update
+		size_t m_culled{ 0 };
+
+		std::unique_ptr<DensityThinner> m_thinner;
+		std::vector<glm::vec4> m_thinnedPos;		// the kept particles, packed for the upload
+		std::vector<glm::vec4> m_thinnedCol;
 	};
 
 	class GLParticleRendererUseMap : public GLParticleRenderer
@@ -50,32 +118,169 @@ namespace nhahn
 		virtual void destroy() override;
 		virtual void update() override;
 		virtual void render() override;
+		virtual bool setDepthSort(bool enabled) override { return IParticleRenderer::setDepthSort(enabled); }
+		virtual bool setChunkCulling(bool enabled) override { return IParticleRenderer::setChunkCulling(enabled); }
+		virtual bool setThinning(bool enabled) override { return IParticleRenderer::setThinning(enabled); }
 
 	protected:
-		unsigned int m_doubleBufPos[2];
-		unsigned int m_doubleBufCol[2];
-		unsigned int m_doubleVao[2];
-		unsigned int m_id;
+		unsigned int m_doubleBufPos[2]{ };
+		unsigned int m_doubleBufCol[2]{ };
+		unsigned int m_doubleVao[2]{ };
+		unsigned int m_id{ 0 };
 	};
 
+	// 20 bytes, the particle position with the size scale in .w and the color packed to RGBA8
 	struct Vertex
 	{
-		float x, y, z;
+		float x, y, z, w;
 		unsigned char r, g, b, a;
 	};
 
+	/*
+	 * Packs position and color on all job system threads into a persistently mapped buffer split
+	 * into three regions, one per frame in flight. Every draw places a fence on its region and the
+	 * region is only written again once that fence has signaled, so the cpu waits only when the gpu
+	 * falls more than two frames behind. Those waits are counted as stalls.
+	 * Falls back to GLParticleRenderer without ARB_buffer_storage.
+	 */
 	class GLParticleRendererPersistent : public GLParticleRenderer
 	{
 	public:
+		static const unsigned int REGION_COUNT = 3;
+
 		GLParticleRendererPersistent() { }
 		~GLParticleRendererPersistent() { destroy(); }
 
 		virtual void generate(ParticleSystem* sys, bool useQuads) override;
+		virtual void destroy() override;
+		virtual void update() override;
+		virtual void render() override;
+		virtual bool setDepthSort(bool enabled) override { return IParticleRenderer::setDepthSort(enabled); }
+		virtual bool setChunkCulling(bool enabled) override { return IParticleRenderer::setChunkCulling(enabled); }
+		virtual bool setThinning(bool enabled) override { return IParticleRenderer::setThinning(enabled); }
+
+		/* updates that had to wait for the gpu to release their region */
+		size_t numStalls() const { return m_stalls; }
+
+		/* writes the first count particles of p to dst on all job system threads, dst has to be 16 byte aligned */
+		static void packVertices(const ParticleData* p, Vertex* dst, size_t count);
+
+	protected:
+		void waitForRegion(unsigned int region);
+
+	protected:
+		unsigned int m_id{ 0 };							// region of the next update and draw
+		Vertex* m_ptr{ nullptr };
+		size_t m_regionSize{ 0 };						// in vertices
+		size_t m_regionCount[REGION_COUNT]{ };			// vertices written into each region
+		void* m_fences[REGION_COUNT]{ };				// GLsync of the last draw from each region
+		size_t m_stalls{ 0 };
+	};
+
+	// 16 bytes, the age (.x) and seed (.y) of the color attribute are normalized 16 bit integers
+	struct AgeSeedVertex
+	{
+		float x, y, z;
+		unsigned short age, seed;
+	};
+
+	/*
+	 * Uploads the position and a packed age and seed word per particle, half of what the other
+	 * renderers send. Color and size are rebuilt in particles.vert from the BasicColorGen ranges or
+	 * the ColorLutUpdater and SizeLutUpdater tables, which take the same seed as on the cpu, so the
+	 * system skips those updaters while this renderer is generated. Draws with its own program and
+	 * takes the texture and camera uniforms from the one bound by the SceneView.
+	 * Not registered in the factory, the effects supporting it create it directly.
+	 */
+	class GLParticleRendererAgeSeed : public GLParticleRenderer
+	{
+	public:
+		GLParticleRendererAgeSeed();
+		~GLParticleRendererAgeSeed();
+
+		/* true if the system colors its particles with an updater the shaders can rebuild */
+		static bool supports(ParticleSystem* sys);
+
+		virtual void generate(ParticleSystem* sys, bool useQuads) override;
+		virtual void destroy() override;
+		virtual void update() override;
+		virtual void render() override;
+		virtual bool setDepthSort(bool enabled) override { return IParticleRenderer::setDepthSort(enabled); }
+		virtual bool setChunkCulling(bool enabled) override { return IParticleRenderer::setChunkCulling(enabled); }
+		virtual bool setThinning(bool enabled) override { return IParticleRenderer::setThinning(enabled); }
+
+	protected:
+		void uploadGradient();
+
+	protected:
+		std::unique_ptr<Shader> m_shader;
+		std::unique_ptr<Texture> m_gradient;
+		size_t m_countUploaded{ 0 };
+
+		std::shared_ptr<BasicColorGen> m_colorGen;
+		std::shared_ptr<BasicColorUpdater> m_basicColor;
+		std::shared_ptr<ColorLutUpdater> m_colorLut;
+		std::shared_ptr<SizeLutUpdater> m_sizeLut;
+		bool m_gradientUploaded{ false };
+		uint32_t m_colorLutRevision{ 0 };	// of the tables in m_gradient
+		uint32_t m_sizeLutRevision{ 0 };
+	};
+
+	/*
+	 * Uploads position and color as two streams in smaller formats. Positions go up as float, half
+	 * or 16 bit normalized to the bounds of the alive particles, which are found on the cpu every
+	 * frame and handed to particles_quantized.inc as an offset and scale. Colors go up as float,
+	 * RGBA8 or RGB10A2. The encoders run on all job system threads. w of the position, the size
+	 * scale, takes the same format as xyz.
+	 * Draws with its own program like GLParticleRendererAgeSeed, the effects create it directly.
+	 */
+	class GLParticleRendererQuantized : public GLParticleRenderer
+	{
+	public:
+		enum class PositionFormat { FLOAT = 0, HALF, UNORM16, COUNT };
+		enum class ColorFormat { FLOAT = 0, RGBA8, RGB10A2, COUNT };
+
+		// every position format with every color format, the index is position * color count + color
+		static const int FORMAT_COUNT = (int)PositionFormat::COUNT * (int)ColorFormat::COUNT;
+		static const char* const FORMAT_NAMES[FORMAT_COUNT];
+
+		struct QuantizationError
+		{
+			int format;
+			size_t bytesPerParticle;
+			float maxPosError;		// distance of xyz
+			float meanPosError;
+			float relativePosError;	// max error over the largest extent of the bounds
+			float maxSizeError;		// of w
+			float maxColorError;	// largest difference of a channel
+		};
+
+		GLParticleRendererQuantized();
+		~GLParticleRendererQuantized();
+
+		static PositionFormat positionFormat(int format) { return (PositionFormat)(format / (int)ColorFormat::COUNT); }
+		static ColorFormat colorFormat(int format) { return (ColorFormat)(format % (int)ColorFormat::COUNT); }
+		static size_t bytesPerParticle(int format);
+
+		/* encodes the alive particles of the system in every format and decodes them again on the cpu */
+		static std::vector<QuantizationError> measureErrors(ParticleSystem* sys);
+
+		void setFormat(int format);
+		int format() const { return m_format; }
+
+		virtual void generate(ParticleSystem* sys, bool useQuads) override;
+		virtual void destroy() override;
 		virtual void update() override;
 		virtual void render() override;
+		virtual bool setDepthSort(bool enabled) override { return IParticleRenderer::setDepthSort(enabled); }
+		virtual bool setChunkCulling(bool enabled) override { return IParticleRenderer::setChunkCulling(enabled); }
+		virtual bool setThinning(bool enabled) override { return IParticleRenderer::setThinning(enabled); }
 
 	protected:
-		unsigned int m_id;
-		Vertex* m_ptr = nullptr;
+		std::unique_ptr<Shader> m_shader;
+		int m_format{ 0 };
+		size_t m_countUploaded{ 0 };
+		glm::vec4 m_posOffset{ 0.0f };
+		glm::vec4 m_posScale{ 1.0f };
 	};
 }
\ No newline at end of file
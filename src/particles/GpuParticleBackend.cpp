@@ -0,0 +1,117 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "GpuParticleBackend.h"
+
+#include <algorithm>
+#include "ComputeParticleSystem.h"
+#include "FeedbackParticleSystem.h"
+#include "render/Shader.h"
+#include "utility/Debug.h"
+
+
+namespace nhahn
+{
+	// the modes of particle_update.inc
+	enum ColorMode { COLOR_NONE = 0, COLOR_BASIC, COLOR_POS, COLOR_VEL };
+	enum IntegrateMode { INTEGRATE_NONE = 0, INTEGRATE_EXPLICIT, INTEGRATE_SEMI_IMPLICIT };
+
+	static const char* const ATTRACTOR_UNIFORMS[GpuParticleBackend::MAX_ATTRACTORS] = {
+		"attractors[0]", "attractors[1]", "attractors[2]", "attractors[3]",
+		"attractors[4]", "attractors[5]", "attractors[6]", "attractors[7]"
+	};
+
+	std::unique_ptr<GpuParticleBackend> GpuParticleBackend::create(ParticleSystem* sys)
+	{
+		std::unique_ptr<GpuParticleBackend> backend = std::make_unique<ComputeParticleSystem>();
+		if (backend->generate(sys))
+			return backend;
+
+		backend = std::make_unique<FeedbackParticleSystem>();
+		if (backend->generate(sys))
+			return backend;
+
+		return nullptr;
+	}
+
+	void GpuParticleBackend::collectUpdaters(ParticleSystem* sys)
+	{
+		m_timeUpdater.reset();
+		m_colorUpdater.reset();
+		m_attractorUpdater.reset();
+		m_eulerUpdater.reset();
+		m_floorUpdater.reset();
+		m_skippedUpdaters = 0;
+
+		for (const auto& up : sys->updaters())
+		{
+			if (auto time = std::dynamic_pointer_cast<BasicTimeUpdater>(up)) m_timeUpdater = time;
+			else if (std::dynamic_pointer_cast<BasicColorUpdater>(up)
+				|| std::dynamic_pointer_cast<PosColorUpdater>(up)
+				|| std::dynamic_pointer_cast<VelColorUpdater>(up)) m_colorUpdater = up;
+			else if (auto attractor = std::dynamic_pointer_cast<AttractorUpdater>(up)) m_attractorUpdater = attractor;
+			else if (auto euler = std::dynamic_pointer_cast<EulerUpdater>(up)) m_eulerUpdater = euler;
+			else if (auto floor = std::dynamic_pointer_cast<FloorUpdater>(up)) m_floorUpdater = floor;
+			else
+				m_skippedUpdaters++;
+		}
+
+		if (m_skippedUpdaters > 0)
+			DBG("GpuParticleBackend", DebugLevel::DEBUG, "%d updaters have no gpu version, they are skipped\n", (int)m_skippedUpdaters);
+	}
+
+	void GpuParticleBackend::setUpdateUniforms(Shader* shader, float dt) const
+	{
+		shader->setUniformF("dt", dt);
+		shader->setUniformI("timeEnabled", m_timeUpdater ? 1 : 0);
+
+		int colorMode = COLOR_NONE;
+		glm::vec4 colorMin{ 0.0f }, colorMax{ 1.0f };
+		if (std::dynamic_pointer_cast<BasicColorUpdater>(m_colorUpdater))
+		{
+			colorMode = COLOR_BASIC;
+		}
+		else if (auto posColor = std::dynamic_pointer_cast<PosColorUpdater>(m_colorUpdater))
+		{
+			colorMode = COLOR_POS;
+			colorMin = posColor->m_minPos;
+			colorMax = posColor->m_maxPos;
+		}
+		else if (auto velColor = std::dynamic_pointer_cast<VelColorUpdater>(m_colorUpdater))
+		{
+			colorMode = COLOR_VEL;
+			colorMin = velColor->m_minVel;
+			colorMax = velColor->m_maxVel;
+		}
+		shader->setUniformI("colorMode", colorMode);
+		shader->setUniformF("colorMin", colorMin);
+		shader->setUniformF("colorMax", colorMax);
+
+		const size_t attractorCount = m_attractorUpdater ? std::min(m_attractorUpdater->collectionSize(), (size_t)MAX_ATTRACTORS) : 0;
+		shader->setUniformI("attractorCount", (int)attractorCount);
+		for (size_t a = 0; a < attractorCount; ++a)
+			shader->setUniformF(ATTRACTOR_UNIFORMS[a], m_attractorUpdater->get(a));
+
+		// the higher order integrators would need the forces at predicted positions, they fall back to semi-implicit
+		int integrator = INTEGRATE_NONE;
+		if (m_eulerUpdater)
+			integrator = (m_eulerUpdater->m_integrator == EulerUpdater::Integrator::EXPLICIT_EULER) ? INTEGRATE_EXPLICIT : INTEGRATE_SEMI_IMPLICIT;
+		shader->setUniformI("integrator", integrator);
+		shader->setUniformF("globalAcceleration", m_eulerUpdater ? m_eulerUpdater->m_globalAcceleration : glm::vec4(0.0f));
+
+		shader->setUniformI("floorEnabled", m_floorUpdater ? 1 : 0);
+		shader->setUniformF("floorY", m_floorUpdater ? m_floorUpdater->m_floorY : 0.0f);
+		shader->setUniformF("bounceFactor", m_floorUpdater ? m_floorUpdater->m_bounceFactor : 0.0f);
+	}
+
+	void GpuParticleBackend::setAliveCount(size_t count)
+	{
+		m_countAlive = std::min(count, m_count);
+		const double ratio = (m_count > 0) ? (double)m_countAlive / (double)m_count : 0.0;
+		m_aliveToAllRatio = m_aliveToAllRatio * 0.5 + ratio * 0.5;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "ParticleSystem.h"
+#include "ParticleUpdaters.h"
+
+
+namespace nhahn
+{
+	class Shader;
+
+	/*
+	 * Simulates a cpu ParticleSystem on the gpu, so effects can switch over without changes.
+	 * The settings are read from the generators and updaters of the cpu system every frame,
+	 * the particles themselves only live in gpu buffers and are drawn from there with the
+	 * particle shaders. Supported updaters are time, basic/position/velocity color, attractor,
+	 * Euler and floor, the others are skipped.
+	 */
+	class GpuParticleBackend
+	{
+	public:
+		static const uint32_t MAX_ATTRACTORS = 8;
+
+		GpuParticleBackend() { }
+		virtual ~GpuParticleBackend() { }
+
+		GpuParticleBackend(const GpuParticleBackend&) = delete;
+		GpuParticleBackend& operator=(const GpuParticleBackend&) = delete;
+
+		/* compute shaders when the driver has them, transform feedback otherwise. Null if neither works */
+		static std::unique_ptr<GpuParticleBackend> create(ParticleSystem* sys);
+
+		/* allocates the buffers for all particles of the cpu system, false if the driver lacks support */
+		virtual bool generate(ParticleSystem* sys) = 0;
+		virtual void destroy() = 0;
+
+		virtual void reset() = 0;
+		virtual void update(double dt) = 0;
+		virtual void render() = 0;
+
+		/* reads the alive particles back, stalls until the gpu is done so only use it to validate */
+		virtual void download(std::vector<glm::vec4>& pos, std::vector<glm::vec4>& col) const = 0;
+
+		virtual const char* name() const = 0;
+
+		size_t numAllParticles() const { return m_count; }
+		/* read back without stalling, so it lags a frame or two behind */
+		size_t numAliveParticles() const { return m_countAlive; }
+		double getAliveToAllRatio() const { return m_aliveToAllRatio; }
+		size_t numSkippedUpdaters() const { return m_skippedUpdaters; }
+
+	protected:
+		/* picks the supported updaters of the cpu system */
+		void collectUpdaters(ParticleSystem* sys);
+		/* updater settings for the shaders including particle_update.inc */
+		void setUpdateUniforms(Shader* shader, float dt) const;
+		void setAliveCount(size_t count);
+
+	protected:
+		size_t m_count{ 0 };
+		size_t m_countAlive{ 0 };
+		double m_aliveToAllRatio{ 0.0 };
+
+		// the updaters run in the order time, color, forces, Euler, floor
+		std::shared_ptr<BasicTimeUpdater> m_timeUpdater;
+		std::shared_ptr<ParticleUpdater> m_colorUpdater;
+		std::shared_ptr<AttractorUpdater> m_attractorUpdater;
+		std::shared_ptr<EulerUpdater> m_eulerUpdater;
+		std::shared_ptr<FloorUpdater> m_floorUpdater;
+		size_t m_skippedUpdaters{ 0 };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,340 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "GpuSolver.h"
+
+#include <algorithm>
+#include <string>
+#include <GL/glew.h>
+#include "Solver.h"
+#include "render/Shader.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+
+
+namespace nhahn
+{
+	// local size of the object shaders and block size of the scan, see verlet_*.comp
+	static const uint32_t GROUP_SIZE = 256;
+
+	static const size_t OBJECT_BUFFER_STRIDE[GpuSolver::BUFFER_COUNT] = {
+		sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(glm::u8vec4), sizeof(glm::vec2),
+		sizeof(uint32_t), sizeof(uint32_t),
+		0, 0, 0, 0	// grid buffers, sized by updateGrid
+	};
+
+	static GLuint groupsFor(size_t count)
+	{
+		return (GLuint)((count + GROUP_SIZE - 1) / GROUP_SIZE);
+	}
+
+	static void storageBarrier()
+	{
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	// out of line, the header only forward declares Shader
+	GpuSolver::GpuSolver() { }
+	GpuSolver::~GpuSolver() { destroy(); }
+
+	bool GpuSolver::generate(size_t capacity)
+	{
+		if (!GLEW_ARB_compute_shader || !GLEW_ARB_shader_storage_buffer_object)
+		{
+			DBG("GpuSolver", DebugLevel::WARNING, "compute shaders are not supported\n");
+			return false;
+		}
+
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_gridShader = std::make_unique<Shader>(path.c_str(), "common.inc", "verlet_grid.comp");
+		m_scanShader = std::make_unique<Shader>(path.c_str(), "common.inc", "verlet_scan.comp");
+		m_collideShader = std::make_unique<Shader>(path.c_str(), "common.inc", "verlet_collide.comp");
+		m_integrateShader = std::make_unique<Shader>(path.c_str(), "common.inc", "verlet_integrate.comp");
+
+		m_count = 0;
+		m_maxRadius = 0.0f;
+		clearSpawns();
+		allocateObjectBuffers(std::max(capacity, (size_t)GROUP_SIZE));
+		return true;
+	}
+
+	void GpuSolver::destroy()
+	{
+		for (GLuint& buf : m_buffers)
+		{
+			if (buf != 0)
+				glDeleteBuffers(1, &buf);
+			buf = 0;
+		}
+
+		m_gridShader.reset();
+		m_scanShader.reset();
+		m_collideShader.reset();
+		m_integrateShader.reset();
+		m_capacity = 0;
+		m_gridCapacity = 0;
+		m_count = 0;
+		clearSpawns();
+	}
+
+	void GpuSolver::allocateObjectBuffers(size_t capacity)
+	{
+		// the objects so far are copied over on the gpu
+		for (int b = 0; b < BUFFER_COUNT; ++b)
+		{
+			const size_t stride = OBJECT_BUFFER_STRIDE[b];
+			if (stride == 0)
+				continue;
+
+			GLuint buf;
+			glGenBuffers(1, &buf);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+			glBufferData(GL_COPY_WRITE_BUFFER, capacity * stride, nullptr, GL_DYNAMIC_DRAW);
+
+			if (m_buffers[b] != 0)
+			{
+				glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[b]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_count * stride);
+				glDeleteBuffers(1, &m_buffers[b]);
+			}
+			m_buffers[b] = buf;
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		m_capacity = capacity;
+		m_bufferGeneration++;
+	}
+
+	void GpuSolver::upload(const Solver& solver)
+	{
+		m_count = 0;
+		m_maxRadius = 0.0f;
+		clearSpawns();
+
+		const size_t count = (size_t)solver.getObjectsCount();
+		if (count > m_capacity)
+			allocateObjectBuffers(count * 2);
+
+		const struct { BufferBinding binding; const void* data; } uploads[] = {
+			{ POS_X, solver.getPositionsX() },
+			{ POS_Y, solver.getPositionsY() },
+			{ LAST_X, solver.getLastPositionsX() },
+			{ LAST_Y, solver.getLastPositionsY() },
+			{ RADIUS, solver.getRadii() },
+			{ COLOR, solver.getColors() }
+		};
+		for (const auto& upload : uploads)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[upload.binding]);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * OBJECT_BUFFER_STRIDE[upload.binding], upload.data);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		const float* radii = solver.getRadii();
+		for (size_t i = 0; i < count; ++i)
+			m_maxRadius = std::max(m_maxRadius, radii[i]);
+
+		const glm::vec3 constraint = solver.getConstraint();
+		setConstraint(glm::vec2(constraint), constraint.z);
+		m_gravity = solver.getGravity();
+		m_subSteps = solver.getSubStepsCount();
+		m_frameDt = solver.getSimulationUpdateRate();
+		m_count = count;
+	}
+
+	void GpuSolver::addObject(glm::vec2 position, float radius, glm::u8vec4 color, glm::vec2 velocity)
+	{
+		// the same as Solver::addObject followed by setObjectVelocity
+		const glm::vec2 last = position - velocity * (float)getStepDt();
+		m_spawnPosX.push_back(position.x);
+		m_spawnPosY.push_back(position.y);
+		m_spawnLastX.push_back(last.x);
+		m_spawnLastY.push_back(last.y);
+		m_spawnRadius.push_back(radius);
+		m_spawnColor.push_back(color);
+
+		m_maxRadius = std::max(m_maxRadius, radius);
+	}
+
+	void GpuSolver::flushSpawns()
+	{
+		const size_t count = m_spawnRadius.size();
+		if (count == 0)
+			return;
+
+		if (m_count + count > m_capacity)
+			allocateObjectBuffers(std::max(m_capacity * 2, m_count + count));
+
+		// the staged objects follow the ones in the buffers, one upload per buffer
+		const struct { BufferBinding binding; const void* data; } uploads[] = {
+			{ POS_X, m_spawnPosX.data() },
+			{ POS_Y, m_spawnPosY.data() },
+			{ LAST_X, m_spawnLastX.data() },
+			{ LAST_Y, m_spawnLastY.data() },
+			{ RADIUS, m_spawnRadius.data() },
+			{ COLOR, m_spawnColor.data() }
+		};
+		for (const auto& upload : uploads)
+		{
+			const size_t stride = OBJECT_BUFFER_STRIDE[upload.binding];
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[upload.binding]);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, m_count * stride, count * stride, upload.data);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		clearSpawns();
+		m_count += count;
+	}
+
+	void GpuSolver::clearSpawns()
+	{
+		m_spawnPosX.clear();
+		m_spawnPosY.clear();
+		m_spawnLastX.clear();
+		m_spawnLastY.clear();
+		m_spawnRadius.clear();
+		m_spawnColor.clear();
+	}
+
+	void GpuSolver::updateGrid()
+	{
+		// the same grid as the cpu Solver, cells one diameter wide over the constraint
+		const float extent = 2.0f * m_constraint.z;
+		m_cellSize = std::max(2.0f * m_maxRadius, extent / (float)MAX_GRID_DIM);
+		m_gridOrigin = glm::vec2(m_constraint) - glm::vec2(m_constraint.z);
+		m_gridWidth = std::clamp((uint32_t)ceilf(extent / m_cellSize), 1u, (uint32_t)MAX_GRID_DIM);
+
+		const size_t cells = (size_t)m_gridWidth * m_gridWidth;
+		if (cells <= m_gridCapacity)
+			return;
+
+		const size_t sizes[] = {
+			cells * sizeof(uint32_t),				// CELL_COUNT
+			(cells + 1) * sizeof(uint32_t),			// CELL_START
+			m_capacity * sizeof(uint32_t),			// CELL_OBJECTS
+			groupsFor(cells) * sizeof(uint32_t)		// BLOCK_SUMS
+		};
+		for (int b = CELL_COUNT; b <= BLOCK_SUMS; ++b)
+		{
+			if (m_buffers[b] == 0)
+				glGenBuffers(1, &m_buffers[b]);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[b]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[b - CELL_COUNT], nullptr, GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		m_gridCapacity = cells;
+	}
+
+	void GpuSolver::bindBuffers() const
+	{
+		for (int b = 0; b < BUFFER_COUNT; ++b)
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, m_buffers[b]);
+	}
+
+	void GpuSolver::update(double dt)
+	{
+		if (!m_gridShader)
+			return;
+
+		flushSpawns();
+		if (m_count == 0)
+			return;
+
+		// cell objects has one entry per object, it has to follow the object buffers
+		GLint cellObjectsSize = 0;
+		if (m_buffers[CELL_OBJECTS] != 0)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[CELL_OBJECTS]);
+			glGetBufferParameteriv(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &cellObjectsSize);
+		}
+		if ((size_t)cellObjectsSize < m_capacity * sizeof(uint32_t))
+			m_gridCapacity = 0;
+
+		updateGrid();
+		bindBuffers();
+
+		const float stepDt = (float)getStepDt();
+		for (uint32_t i = 0; i < m_subSteps; ++i)
+			dispatchSubStep(stepDt);
+
+		// the renderer reads the positions as vertex attributes
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+		glUseProgram(0);
+	}
+
+	void GpuSolver::dispatchSubStep(float dt)
+	{
+		const GLuint objectGroups = groupsFor(m_count);
+		const uint32_t cells = m_gridWidth * m_gridWidth;
+		const GLuint cellGroups = groupsFor(cells);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[CELL_COUNT]);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		// count objects per cell
+		m_gridShader->bind();
+		m_gridShader->setUniformI("stage", 0);
+		m_gridShader->setUniformI("objectCount", (int)m_count);
+		m_gridShader->setUniformI("gridSize", (int)m_gridWidth, (int)m_gridWidth);
+		m_gridShader->setUniformF("gridOrigin", m_gridOrigin);
+		m_gridShader->setUniformF("invCellSize", 1.0f / m_cellSize);
+		m_gridShader->dispatch(objectGroups);
+		storageBarrier();
+
+		// cell starts from the counts
+		m_scanShader->bind();
+		m_scanShader->setUniformI("cellTotal", (int)cells);
+		m_scanShader->setUniformI("blockCount", (int)cellGroups);
+		for (int stage = 0; stage < 3; ++stage)
+		{
+			m_scanShader->setUniformI("stage", stage);
+			m_scanShader->dispatch(stage == 1 ? 1 : cellGroups);
+			storageBarrier();
+		}
+
+		// objects into their cell ranges
+		m_gridShader->bind();
+		m_gridShader->setUniformI("stage", 1);
+		m_gridShader->dispatch(objectGroups);
+		storageBarrier();
+
+		m_collideShader->bind();
+		m_collideShader->setUniformI("objectCount", (int)m_count);
+		m_collideShader->setUniformI("gridSize", (int)m_gridWidth, (int)m_gridWidth);
+		m_collideShader->setUniformF("responseCoef", Solver::RESPONSE_COEF);
+		m_collideShader->dispatch(objectGroups);
+		storageBarrier();
+
+		m_integrateShader->bind();
+		m_integrateShader->setUniformI("objectCount", (int)m_count);
+		m_integrateShader->setUniformF("constraint", m_constraint);
+		m_integrateShader->setUniformF("gravity", m_gravity);
+		m_integrateShader->setUniformF("dt", dt);
+		m_integrateShader->dispatch(objectGroups);
+		storageBarrier();
+	}
+
+	void GpuSolver::download(std::vector<float>& posX, std::vector<float>& posY) const
+	{
+		posX.resize(m_count);
+		posY.resize(m_count);
+		if (m_count == 0)
+			return;
+
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[POS_X]);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_count * sizeof(float), posX.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[POS_Y]);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_count * sizeof(float), posY.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+
+
+namespace nhahn
+{
+	class Solver;
+	class Shader;
+
+	/*
+	 * Verlet Solver running in compute shaders. The objects are kept in one shader storage buffer
+	 * per array like the cpu Solver, the VerletRenderer draws them from there without a readback.
+	 * Each sub step counts the objects into a uniform grid with atomics, prefix sums the counts into
+	 * cell ranges and scatters the objects into them. Collisions are solved Jacobi style: every
+	 * object sums the pushes of its neighbours and only moves itself, so no two invocations write
+	 * the same object. That converges slower than the cpu Solver's sequential contacts, piles end up
+	 * the same but single trajectories differ once objects touch.
+	 */
+	class GpuSolver
+	{
+	public:
+		// storage buffer binding points, the verlet_*.comp shaders use the same numbers
+		enum BufferBinding
+		{
+			POS_X = 0,
+			POS_Y,
+			LAST_X,
+			LAST_Y,
+			RADIUS,
+			COLOR,
+			TEMP,			// vec2 positions after the collision pass
+			OBJECT_CELL,
+			OBJECT_SLOT,	// index of the object within its cell
+			CELL_COUNT,
+			CELL_START,		// cells + 1 entries
+			CELL_OBJECTS,
+			BLOCK_SUMS,
+			BUFFER_COUNT
+		};
+
+		static const uint32_t MAX_GRID_DIM = 1024;
+
+		GpuSolver();
+		~GpuSolver();
+
+		GpuSolver(const GpuSolver&) = delete;
+		GpuSolver& operator=(const GpuSolver&) = delete;
+
+		/* compiles the shaders and allocates buffers for capacity objects, they grow when exceeded */
+		bool generate(size_t capacity);
+		void destroy();
+
+		/* replaces the objects and settings with the ones of a cpu solver */
+		void upload(const Solver& solver);
+		/* staged on the cpu, the next update writes all staged objects with one upload per buffer */
+		void addObject(glm::vec2 position, float radius, glm::u8vec4 color, glm::vec2 velocity);
+		void update(double dt);
+
+		/* reads the positions back, stalls until the gpu is done so only use it to validate */
+		void download(std::vector<float>& posX, std::vector<float>& posY) const;
+
+		void setConstraint(glm::vec2 position, float radius) { m_constraint = glm::vec3(position, radius); }
+		void setSubStepsCount(uint32_t subSteps) { m_subSteps = subSteps; }
+		void setSimulationUpdateRate(double rate) { m_frameDt = rate; }
+
+		/* including the staged objects, the buffers hold all of them after the next update */
+		size_t getObjectsCount() const { return m_count + m_spawnRadius.size(); }
+		double getStepDt() const { return m_frameDt / (double)m_subSteps; }
+		glm::vec3 getConstraint() const { return m_constraint; }
+		unsigned int getBuffer(BufferBinding binding) const { return m_buffers[binding]; }
+
+		/* changes whenever the object buffers are reallocated, users of getBuffer have to rebind then */
+		uint32_t getBufferGeneration() const { return m_bufferGeneration; }
+
+	protected:
+		void allocateObjectBuffers(size_t capacity);
+		void flushSpawns();
+		void clearSpawns();
+		void updateGrid();
+		void bindBuffers() const;
+		void dispatchSubStep(float dt);
+
+	protected:
+		std::unique_ptr<Shader> m_gridShader;
+		std::unique_ptr<Shader> m_scanShader;
+		std::unique_ptr<Shader> m_collideShader;
+		std::unique_ptr<Shader> m_integrateShader;
+
+		unsigned int m_buffers[BUFFER_COUNT]{ };
+		uint32_t m_bufferGeneration{ 0 };
+		size_t m_capacity{ 0 };
+		size_t m_count{ 0 };							// objects in the buffers
+		float m_maxRadius{ 0.0f };
+
+		// objects of addObject waiting for the next update, one array per object buffer
+		std::vector<float> m_spawnPosX;
+		std::vector<float> m_spawnPosY;
+		std::vector<float> m_spawnLastX;
+		std::vector<float> m_spawnLastY;
+		std::vector<float> m_spawnRadius;
+		std::vector<glm::u8vec4> m_spawnColor;
+
+		// settings, the same defaults as the cpu Solver
+		glm::vec3 m_constraint{ 0.0f, 0.0f, 100.0f };
+		glm::vec2 m_gravity{ 0.0f, 1000.0f };
+		uint32_t m_subSteps{ 1 };
+		double m_frameDt{ 0.0 };
+
+		// uniform grid over the constraint
+		glm::vec2 m_gridOrigin{ 0.0f };
+		float m_cellSize{ 1.0f };
+		uint32_t m_gridWidth{ 0 };
+		size_t m_gridCapacity{ 0 };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "Noise.h"
+
+#include <math.h>
+
+
+namespace nhahn
+{
+	static inline uint32_t hashLattice(int x, int y, int z, uint32_t seed)
+	{
+		uint32_t h = seed;
+		h ^= (uint32_t)x * 0x8da6b343u;
+		h ^= (uint32_t)y * 0xd8163841u;
+		h ^= (uint32_t)z * 0xcb1ab31fu;
+		h ^= h >> 16;
+		h *= 0x7feb352du;
+		h ^= h >> 15;
+		h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	static inline float gradDot(uint32_t hash, float x, float y, float z)
+	{
+		// one of the 12 cube edge directions
+		switch (hash % 12)
+		{
+		case 0:  return  x + y;
+		case 1:  return -x + y;
+		case 2:  return  x - y;
+		case 3:  return -x - y;
+		case 4:  return  x + z;
+		case 5:  return -x + z;
+		case 6:  return  x - z;
+		case 7:  return -x - z;
+		case 8:  return  y + z;
+		case 9:  return -y + z;
+		case 10: return  y - z;
+		default: return -y - z;
+		}
+	}
+
+	static inline float fade(float t)
+	{
+		return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+	}
+
+	static inline int wrapIndex(int i, int period)
+	{
+		i %= period;
+		return i < 0 ? i + period : i;
+	}
+
+	float Noise::periodicPerlin(const glm::vec3& p, int period, uint32_t seed)
+	{
+		const float fx = floorf(p.x), fy = floorf(p.y), fz = floorf(p.z);
+		const float x = p.x - fx, y = p.y - fy, z = p.z - fz;
+
+		const int x0 = wrapIndex((int)fx, period), x1 = wrapIndex(x0 + 1, period);
+		const int y0 = wrapIndex((int)fy, period), y1 = wrapIndex(y0 + 1, period);
+		const int z0 = wrapIndex((int)fz, period), z1 = wrapIndex(z0 + 1, period);
+
+		const float n000 = gradDot(hashLattice(x0, y0, z0, seed), x, y, z);
+		const float n100 = gradDot(hashLattice(x1, y0, z0, seed), x - 1.0f, y, z);
+		const float n010 = gradDot(hashLattice(x0, y1, z0, seed), x, y - 1.0f, z);
+		const float n110 = gradDot(hashLattice(x1, y1, z0, seed), x - 1.0f, y - 1.0f, z);
+		const float n001 = gradDot(hashLattice(x0, y0, z1, seed), x, y, z - 1.0f);
+		const float n101 = gradDot(hashLattice(x1, y0, z1, seed), x - 1.0f, y, z - 1.0f);
+		const float n011 = gradDot(hashLattice(x0, y1, z1, seed), x, y - 1.0f, z - 1.0f);
+		const float n111 = gradDot(hashLattice(x1, y1, z1, seed), x - 1.0f, y - 1.0f, z - 1.0f);
+
+		const float u = fade(x), v = fade(y), w = fade(z);
+		const float nx00 = n000 + u * (n100 - n000);
+		const float nx10 = n010 + u * (n110 - n010);
+		const float nx01 = n001 + u * (n101 - n001);
+		const float nx11 = n011 + u * (n111 - n011);
+		const float nxy0 = nx00 + v * (nx10 - nx00);
+		const float nxy1 = nx01 + v * (nx11 - nx01);
+
+		return nxy0 + w * (nxy1 - nxy0);
+	}
+
+	glm::vec4 Noise::periodicCurl(const glm::vec3& p, int period, uint32_t seed)
+	{
+		const float h = 1e-3f;
+		const glm::vec3 dx{ h, 0.0f, 0.0f };
+		const glm::vec3 dy{ 0.0f, h, 0.0f };
+		const glm::vec3 dz{ 0.0f, 0.0f, h };
+
+		// partial derivatives of the potential (psi0, psi1, psi2)
+		const uint32_t s0 = seed, s1 = seed + 0x9e3779b9u, s2 = seed + 0x3c6ef372u;
+		const float dPsi2dy = periodicPerlin(p + dy, period, s2) - periodicPerlin(p - dy, period, s2);
+		const float dPsi1dz = periodicPerlin(p + dz, period, s1) - periodicPerlin(p - dz, period, s1);
+		const float dPsi0dz = periodicPerlin(p + dz, period, s0) - periodicPerlin(p - dz, period, s0);
+		const float dPsi2dx = periodicPerlin(p + dx, period, s2) - periodicPerlin(p - dx, period, s2);
+		const float dPsi1dx = periodicPerlin(p + dx, period, s1) - periodicPerlin(p - dx, period, s1);
+		const float dPsi0dy = periodicPerlin(p + dy, period, s0) - periodicPerlin(p - dy, period, s0);
+
+		const float inv2h = 0.5f / h;
+		return glm::vec4{
+			(dPsi2dy - dPsi1dz) * inv2h,
+			(dPsi0dz - dPsi2dx) * inv2h,
+			(dPsi1dx - dPsi0dy) * inv2h,
+			0.0f };
+	}
+}
\ No newline at end of file
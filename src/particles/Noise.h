@@ -0,0 +1,32 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include "utility/Types.h"
+
+#ifndef GLM_FORCE_INTRINSICS
+#define GLM_FORCE_INTRINSICS
+#endif // !GLM_FORCE_INTRINSICS
+#include <glm/glm.hpp>
+
+
+namespace nhahn
+{
+	class Noise
+	{
+	public:
+		/* gradient noise in [-1, 1] that repeats every period lattice cells on each axis */
+		static float periodicPerlin(const glm::vec3& p, int period, uint32_t seed);
+
+		/*
+		 * divergence free noise, the curl of a vector potential made of three perlin fields.
+		 * p is given in lattice cells, the result repeats every period cells, w is 0
+		 */
+		static glm::vec4 periodicCurl(const glm::vec3& p, int period, uint32_t seed);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "OverdrawCounter.h"
+
+#include <algorithm>
+#include <string>
+#include "render/Shader.h"
+#include "render/Texture.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+
+
+namespace nhahn
+{
+	OverdrawCounter::OverdrawCounter() { }
+	OverdrawCounter::~OverdrawCounter() { destroy(); }
+
+	bool OverdrawCounter::generate(int width, int height)
+	{
+		ASSERT(width > 0 && height > 0, "OverdrawCounter: empty target size");
+		destroy();
+
+		// full floats count exactly up to 2^24 fragments per pixel
+		m_counts = std::make_unique<Texture>(TEXTURE_2D, width, height);
+		m_counts->setFormat(TEXEL_FLOAT, 1, 4);
+		m_counts->init();
+		m_width = width;
+		m_height = height;
+
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_heatmapShader = std::make_unique<Shader>(path.c_str(), "common.inc", "quad.vert", nullptr, "overdraw_heatmap.frag", 1);
+
+		return true;
+	}
+
+	void OverdrawCounter::destroy()
+	{
+		m_heatmapShader.reset();
+		m_counts.reset();
+		m_readback.clear();
+		m_stats = OverdrawStats();
+	}
+
+	void OverdrawCounter::begin(RenderTarget& rt)
+	{
+		ASSERT(m_counts, "OverdrawCounter: target is not generated");
+
+		rt.selectAttachmentList(1, rt.attachTextureAny(*m_counts));
+		const float clearCount[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, clearCount);
+
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+	}
+
+	void OverdrawCounter::resolve(RenderTarget& rt, RtAttachment dst)
+	{
+		m_readback.resize((size_t)m_width * (size_t)m_height);
+		m_counts->bindAny();
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, m_readback.data());
+
+		double fragments = 0.0;
+		size_t covered = 0;
+		float maxCount = 0.0f;
+		for (float c : m_readback)
+		{
+			fragments += c;
+			covered += (c > 0.0f) ? 1 : 0;
+			maxCount = std::max(maxCount, c);
+		}
+
+		m_stats.fragments = (size_t)fragments;
+		m_stats.coveredPixels = covered;
+		m_stats.pixels = m_readback.size();
+		m_stats.overdraw = (float)(fragments / (double)m_stats.pixels);
+		m_stats.coveredOverdraw = (covered > 0) ? (float)(fragments / (double)covered) : 0.0f;
+		m_stats.maxCount = maxCount;
+
+		rt.selectAttachmentList(1, dst);
+		glDisable(GL_BLEND);
+
+		m_heatmapShader->bind();
+		m_heatmapShader->setUniformI("counts", m_counts->boundUnit());
+		m_heatmapShader->setUniformF("maxCount", std::max(maxCount, 1.0f));
+		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+		m_heatmapShader->unbind();
+	}
+}
\ No newline at end of file
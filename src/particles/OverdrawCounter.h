@@ -0,0 +1,63 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "render/RenderTarget.h"
+
+
+namespace nhahn
+{
+	class Shader;
+	class Texture;
+
+	struct OverdrawStats
+	{
+		size_t fragments{ 0 };			// shaded by the particle draws
+		size_t coveredPixels{ 0 };		// hit by at least one fragment
+		size_t pixels{ 0 };
+		float overdraw{ 0.0f };			// fragments per pixel of the target
+		float coveredOverdraw{ 0.0f };	// fragments per covered pixel
+		float maxCount{ 0.0f };			// of the busiest pixel
+	};
+
+	/*
+	 * Instrumentation pass that counts the fragments per pixel. While the program's overdrawPass is
+	 * set, particles.frag and billboards.frag write a one that is added into a float target instead
+	 * of their color, so every fragment counts whether its sprite texel is transparent or not. The
+	 * resolve reads the counts back for the stats, which stalls, and draws them as a heatmap.
+	 */
+	class OverdrawCounter
+	{
+	public:
+		OverdrawCounter();
+		~OverdrawCounter();
+
+		OverdrawCounter(const OverdrawCounter&) = delete;
+		OverdrawCounter& operator=(const OverdrawCounter&) = delete;
+
+		bool generate(int width, int height);
+		void destroy();
+
+		/* draws of rt go to the cleared count target until resolve */
+		void begin(RenderTarget& rt);
+		/* overwrites dst, an attachment of rt, with the heatmap. Leaves blending disabled */
+		void resolve(RenderTarget& rt, RtAttachment dst);
+
+		const OverdrawStats& stats() const { return m_stats; }
+
+	private:
+		std::unique_ptr<Texture> m_counts;
+		std::unique_ptr<Shader> m_heatmapShader;
+		std::vector<float> m_readback;
+		OverdrawStats m_stats;
+		int m_width{ 0 };
+		int m_height{ 0 };
+	};
+}
\ No newline at end of file
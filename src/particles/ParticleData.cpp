@@ -21,8 +21,9 @@ namespace nhahn
 		_aligned_free(m_time);
 	}
 
-	void ParticleData::generate(size_t maxSize)
+	void ParticleData::generate(size_t maxSize, uint32_t streams)
 	{
+		m_streams = streams;
 		m_count = maxSize;
 		m_countAlive = 0;
 
@@ -30,13 +31,19 @@ namespace nhahn
 
 		m_pos = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
 		m_col = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
-		m_startCol = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
-		m_endCol = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
+		if (hasStreams(STREAM_START_COL))
+			m_startCol = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
+		if (hasStreams(STREAM_END_COL))
+			m_endCol = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
 		m_vel = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
 		m_acc = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
 		m_time = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * maxSize, 16);
 
 		m_alive.reset(new bool[maxSize]);
+
+		m_chunkMin.resize((maxSize + BOUNDS_CHUNK - 1) / BOUNDS_CHUNK);
+		m_chunkMax.resize(m_chunkMin.size());
+		m_boundsValid = false;
 	}
 
 	void ParticleData::kill(size_t id)
@@ -58,16 +65,32 @@ namespace nhahn
 	{
 		m_pos[a] = m_pos[b];
 		m_col[a] = m_col[b];
-		m_startCol[a] = m_startCol[b];
-		m_endCol[a] = m_endCol[b];
+		if (m_startCol) m_startCol[a] = m_startCol[b];
+		if (m_endCol) m_endCol[a] = m_endCol[b];
 		m_vel[a] = m_vel[b];
 		m_acc[a] = m_acc[b];
 		m_time[a] = m_time[b];
+
+		// kills move the last alive particle into another chunk
+		growBounds(a);
+	}
+
+	void ParticleData::growBounds(size_t id)
+	{
+		if (!m_boundsValid)
+			return;
+
+		const size_t chunk = id / BOUNDS_CHUNK;
+		m_chunkMin[chunk] = glm::min(m_chunkMin[chunk], m_pos[id]);
+		m_chunkMax[chunk] = glm::max(m_chunkMax[chunk], m_pos[id]);
+		m_boundsMin = glm::min(m_boundsMin, m_pos[id]);
+		m_boundsMax = glm::max(m_boundsMax, m_pos[id]);
 	}
 
 	void ParticleData::copyOnlyAlive(const ParticleData* source, ParticleData* destination)
 	{
 		assert(source->m_count == destination->m_count);
+		assert(destination->hasStreams(source->m_streams));
 
 		size_t id = 0;
 		for (size_t i = 0; i < source->m_countAlive; ++i)
@@ -76,8 +99,8 @@ namespace nhahn
 			{
 				destination->m_pos[id] = source->m_pos[i];
 				destination->m_col[id] = source->m_col[i];
-				destination->m_startCol[id] = source->m_startCol[i];
-				destination->m_endCol[id] = source->m_endCol[i];
+				if (source->m_startCol) destination->m_startCol[id] = source->m_startCol[i];
+				if (source->m_endCol) destination->m_endCol[id] = source->m_endCol[i];
 				destination->m_vel[id] = source->m_vel[i];
 				destination->m_acc[id] = source->m_acc[i];
 				destination->m_time[id] = source->m_time[i];
@@ -91,6 +114,10 @@ namespace nhahn
 
 	size_t ParticleData::computeMemoryUsage(const ParticleData& p)
 	{
-		return p.m_count * (sizeof(glm::vec4) * 7 + sizeof(bool)) + sizeof(size_t) * 2;
+		size_t streams = 5;
+		if (p.m_startCol) streams++;
+		if (p.m_endCol) streams++;
+
+		return p.m_count * (sizeof(glm::vec4) * streams + sizeof(bool)) + sizeof(size_t) * 2;
 	}
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 \*------------------------------------------------------------------------------------------------*/
 #pragma once
 
+#include <memory>
+#include <vector>
 #include "utility/Types.h"
 
 #ifndef GLM_FORCE_INTRINSICS
@@ -19,14 +21,22 @@ namespace nhahn
     class ParticleData
     {
     public:
+        /* optional streams, effects that color particles from a lookup table do not need the per particle colors */
+        static const uint32_t STREAM_START_COL = 1 << 0;
+        static const uint32_t STREAM_END_COL = 1 << 1;
+        static const uint32_t STREAMS_ALL = STREAM_START_COL | STREAM_END_COL;
+
+        /* slots per chunk of the bounds, the unit of the renderers' chunk culling */
+        static const size_t BOUNDS_CHUNK = 4096;
+
         ParticleData() { }
-        explicit ParticleData(size_t maxCount) { generate(maxCount); }
+        explicit ParticleData(size_t maxCount, uint32_t streams = STREAMS_ALL) { generate(maxCount, streams); }
         ~ParticleData();
 
         ParticleData(const ParticleData&) = delete;
         ParticleData& operator=(const ParticleData&) = delete;
 
-        void generate(size_t maxSize);
+        void generate(size_t maxSize, uint32_t streams = STREAMS_ALL);
         void kill(size_t id);
         void wake(size_t id);
         void swapData(size_t a, size_t b);
@@ -34,16 +44,31 @@ namespace nhahn
         static void copyOnlyAlive(const ParticleData* source, ParticleData* destination);
         static size_t computeMemoryUsage(const ParticleData& p);
 
+        bool hasStreams(uint32_t streams) const { return (m_streams & streams) == streams; }
+
+        size_t numBoundsChunks() const { return (m_countAlive + BOUNDS_CHUNK - 1) / BOUNDS_CHUNK; }
+        /* grows the bounds over the position of the particle in slot id after it moved or changed slots */
+        void growBounds(size_t id);
+
     public:
-        glm::vec4* m_pos;
-        glm::vec4* m_col;
-        glm::vec4* m_startCol;
-        glm::vec4* m_endCol;
-        glm::vec4* m_vel;
-        glm::vec4* m_acc;
-        glm::vec4* m_time;
+        glm::vec4* m_pos{ nullptr };        // .w is the size scale
+        glm::vec4* m_col{ nullptr };
+        glm::vec4* m_startCol{ nullptr };   // optional, STREAM_START_COL
+        glm::vec4* m_endCol{ nullptr };     // optional, STREAM_END_COL
+        glm::vec4* m_vel{ nullptr };
+        glm::vec4* m_acc{ nullptr };
+        glm::vec4* m_time{ nullptr };
         std::unique_ptr<bool[]>  m_alive;
 
+        // boxes around the alive positions, .w spans the size scales. Reduced by the EulerUpdater and
+        // invalid from the start of every ParticleSystem::update until it ran
+        glm::vec4 m_boundsMin{ 0.0f };
+        glm::vec4 m_boundsMax{ 0.0f };
+        std::vector<glm::vec4> m_chunkMin;  // of every BOUNDS_CHUNK slots
+        std::vector<glm::vec4> m_chunkMax;
+        bool m_boundsValid{ false };
+
+        uint32_t m_streams{ 0 };
         size_t m_count{ 0 };
         size_t m_countAlive{ 0 };
     };
@@ -8,6 +8,7 @@
 #include "ParticleGenerators.h"
 
 #include "utility/Utils.h"
+#include "utility/Debug.h"
 #include <glm/gtc/random.hpp>
 
 #ifndef M_PI
@@ -122,6 +123,8 @@ namespace nhahn
 
 	void BasicColorGen::generate(double dt, ParticleData* p, size_t startId, size_t endId)
 	{
+		ASSERT(p->hasStreams(ParticleData::STREAM_START_COL | ParticleData::STREAM_END_COL), "BasicColorGen: needs the start and end color streams\n");
+
 		glm::vec4* RESTRICT startCol = p->m_startCol;
 		glm::vec4* RESTRICT endCol = p->m_endCol;
 
@@ -167,7 +170,7 @@ namespace nhahn
 			v = randFloat(m_minVel, m_maxVel);
 
 			r = v * sinf(phi);
-			vel[i] = glm::vec4(v * cosf(phi), r * cosf(theta), r * sinf(theta), 1.0f);
+			vel[i] = glm::vec4(v * cosf(phi), r * cosf(theta), r * sinf(theta), 0.0f);
 		}
 	}
 
@@ -183,6 +186,7 @@ namespace nhahn
 			scalev = glm::vec4(scale, scale, scale, scale);
 			glm::vec4 vel = (pos[i] - glm::vec4(m_offset));
 			veloc[i] = glm::vec4(scalev * vel);
+			veloc[i].w = 0.0f;
 		}
 	}
 
@@ -7,13 +7,97 @@
 \*------------------------------------------------------------------------------------------------*/
 #include "ParticleRenderer.h"
 
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+#include <GL/glew.h>
 #include "GLParticleRenderer.h"
+#include "ParticleSystem.h"
+#include "render/Shader.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+#include "utility/Timer.h"
 
 
 namespace nhahn
 {
 	template <typename T> std::shared_ptr<IParticleRenderer> createRenderer() { return std::make_shared<T>(); }
 	std::unique_ptr<ParticleRendererFactory::MapOfRendererGenerators> ParticleRendererFactory::s_generatorMap;
+	const char* const ParticleRendererFactory::AUTO = "auto";
+
+	void AutoParticleRenderer::generate(ParticleSystem* sys, bool useQuads)
+	{
+		ASSERT(sys != nullptr, "AutoParticleRenderer: sys is null");
+
+		// the quad and thinning settings stay with the effect when it generates again
+		if (m_renderer)
+		{
+			m_quadSettings = m_renderer->quadSettings();
+			m_thinningSettings = m_renderer->thinningSettings();
+		}
+
+		m_system = sys;
+		m_useQuads = useQuads;
+		m_selected = (useQuads || m_depthSort || m_chunkCulling || m_thinning) ? "gl" : ParticleRendererFactory::selectFastest(sys->numAllParticles());
+		m_renderer = ParticleRendererFactory::create(m_selected.c_str());
+		m_renderer->quadSettings() = m_quadSettings;
+		m_renderer->thinningSettings() = m_thinningSettings;
+		m_renderer->generate(sys, useQuads);
+		m_renderer->setDepthSort(m_depthSort);
+		m_renderer->setChunkCulling(m_chunkCulling);
+		m_renderer->setThinning(m_thinning);
+	}
+
+	bool AutoParticleRenderer::setDepthSort(bool enabled)
+	{
+		m_depthSort = enabled;
+		if (!m_renderer || m_renderer->setDepthSort(enabled))
+			return true;
+
+		// the fastest renderer has its own buffer layout, switch over to one that sorts
+		m_renderer->destroy();
+		generate(m_system, m_useQuads);
+		return true;
+	}
+
+	bool AutoParticleRenderer::setChunkCulling(bool enabled)
+	{
+		m_chunkCulling = enabled;
+		if (!m_renderer || m_renderer->setChunkCulling(enabled))
+			return true;
+
+		m_renderer->destroy();
+		generate(m_system, m_useQuads);
+		return true;
+	}
+
+	bool AutoParticleRenderer::setThinning(bool enabled)
+	{
+		m_thinning = enabled;
+		if (!m_renderer || m_renderer->setThinning(enabled))
+			return true;
+
+		m_renderer->destroy();
+		generate(m_system, m_useQuads);
+		return true;
+	}
+
+	void AutoParticleRenderer::destroy()
+	{
+		if (m_renderer)
+			m_renderer->destroy();
+	}
+
+	void AutoParticleRenderer::update()
+	{
+		m_renderer->update();
+	}
+
+	void AutoParticleRenderer::render()
+	{
+		m_renderer->render();
+	}
 
 	void ParticleRendererFactory::initGeneratorMap()
 	{
@@ -25,6 +109,7 @@ namespace nhahn
 		(*s_generatorMap)["gl_map"] = &createRenderer<GLParticleRendererUseMap>;
 		(*s_generatorMap)["gl_double"] = &createRenderer<GLParticleRendererDoubleVao>;
 		(*s_generatorMap)["gl_persistent"] = &createRenderer<GLParticleRendererPersistent>;
+		(*s_generatorMap)[AUTO] = &createRenderer<AutoParticleRenderer>;
 	}
 
 	std::shared_ptr<IParticleRenderer> ParticleRendererFactory::create(const char* name)
@@ -45,4 +130,153 @@ namespace nhahn
 
 		return (s_generatorMap->find(name) != s_generatorMap->end());
 	}
+
+	std::vector<std::string> ParticleRendererFactory::names()
+	{
+		if (!s_generatorMap)
+			initGeneratorMap();
+
+		std::vector<std::string> result;
+		for (const auto& [name, generator] : *s_generatorMap)
+		{
+			if (name != AUTO)
+				result.push_back(name);
+		}
+		return result;
+	}
+
+	std::vector<std::string> ParticleRendererFactory::calibratedNames()
+	{
+		// gl_double draws the buffer of the previous update, a frame behind the others
+		std::vector<std::string> result = names();
+		result.erase(std::remove(result.begin(), result.end(), "gl_double"), result.end());
+		return result;
+	}
+
+	std::string ParticleRendererFactory::driverString()
+	{
+		auto glString = [](GLenum name) {
+			const char* str = (const char*)glGetString(name);
+			return std::string(str ? str : "unknown");
+		};
+		return glString(GL_VENDOR) + " | " + glString(GL_RENDERER) + " | " + glString(GL_VERSION);
+	}
+
+	std::string ParticleRendererFactory::selectFastest(size_t count)
+	{
+		// one line per driver and count: driver string, particle count and renderer name separated by tabs
+		const std::string cachePath = FileSystem::getModuleDirectory() + "data\\renderers.cache";
+		const std::string driver = driverString();
+
+		std::vector<std::string> lines;
+		if (FileSystem::fileExists(cachePath.c_str()))
+		{
+			char* text = FileSystem::readTextFile(cachePath.c_str());
+			std::istringstream stream(text);
+			delete[] text;
+
+			std::string line;
+			while (std::getline(stream, line))
+			{
+				const size_t first = line.find('\t');
+				const size_t last = line.rfind('\t');
+				if (first == std::string::npos || first == last)
+					continue;
+
+				if (line.compare(0, first, driver) == 0 && strtoull(line.c_str() + first + 1, nullptr, 10) == count)
+				{
+					// entries of renderers that no longer exist or are no longer calibrated are measured again
+					const std::string name = line.substr(last + 1);
+					const std::vector<std::string> candidates = calibratedNames();
+					if (std::find(candidates.begin(), candidates.end(), name) != candidates.end())
+					{
+						DBG("ParticleRendererFactory", DebugLevel::DEBUG, "using cached renderer '%s' for %d particles\n", name.c_str(), (int)count);
+						return name;
+					}
+					continue;
+				}
+				lines.push_back(line);
+			}
+		}
+
+		const std::vector<Timing> timings = calibrate(count);
+		ASSERT(!timings.empty(), "ParticleRendererFactory: no renderer to calibrate");
+
+		auto fastest = std::min_element(timings.begin(), timings.end(), [](const Timing& a, const Timing& b) { return a.ms < b.ms; });
+		for (const Timing& t : timings)
+			DBG("ParticleRendererFactory", DebugLevel::INFO, "%-14s %7.3f ms, %d stalls\n", t.name.c_str(), t.ms, (int)t.stalls);
+		DBG("ParticleRendererFactory", DebugLevel::INFO, "selected '%s' for %d particles on %s\n", fastest->name.c_str(), (int)count, driver.c_str());
+
+		lines.push_back(driver + "\t" + std::to_string(count) + "\t" + fastest->name);
+
+		FILE* file = fopen(cachePath.c_str(), "wt");
+		if (file)
+		{
+			for (const std::string& line : lines)
+				fprintf(file, "%s\n", line.c_str());
+			fclose(file);
+		}
+		else
+			DBG("ParticleRendererFactory", DebugLevel::WARNING, "could not write renderer cache '%s'\n", cachePath.c_str());
+
+		return fastest->name;
+	}
+
+	std::vector<ParticleRendererFactory::Timing> ParticleRendererFactory::calibrate(size_t count)
+	{
+		const int WARMUP_FRAMES = 4;
+		const int FRAMES = 16;
+
+		// the contents do not matter for the upload, they only have to be valid numbers
+		ParticleSystem sys(count);
+		ParticleData* p = sys.finalData();
+		for (size_t i = 0; i < count; ++i)
+		{
+			p->m_pos[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			p->m_col[i] = glm::vec4(1.0f);
+		}
+		p->m_countAlive = count;
+
+		// the vertices are fetched and shaded with the particle program, but nothing reaches the screen
+		const std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		Shader shader(path.c_str(), "common.inc", "particles.vert", nullptr, "particles.frag", 1);
+		shader.bind();
+		glEnable(GL_RASTERIZER_DISCARD);
+
+		std::vector<Timing> timings;
+		for (const std::string& name : calibratedNames())
+		{
+			std::shared_ptr<IParticleRenderer> renderer = create(name.c_str());
+			renderer->generate(&sys, false);
+
+			for (int f = 0; f < WARMUP_FRAMES; ++f)
+			{
+				renderer->update();
+				renderer->render();
+			}
+			glFinish();
+
+			Timer timer;
+			for (int f = 0; f < FRAMES; ++f)
+			{
+				renderer->update();
+				renderer->render();
+			}
+			glFinish();
+
+			Timing timing;
+			timing.name = name;
+			timing.ms = (double)timer.getMicroseconds() / (1000.0 * FRAMES);
+			auto persistent = std::dynamic_pointer_cast<GLParticleRendererPersistent>(renderer);
+			timing.stalls = persistent ? persistent->numStalls() : 0;
+			timings.push_back(timing);
+
+			renderer->destroy();
+		}
+
+		glDisable(GL_RASTERIZER_DISCARD);
+		shader.unbind();
+
+		return timings;
+	}
 }
\ No newline at end of file
@@ -10,12 +10,36 @@
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
+
+#ifndef GLM_FORCE_INTRINSICS
+#define GLM_FORCE_INTRINSICS
+#endif // !GLM_FORCE_INTRINSICS
+#include <glm/glm.hpp>
+#include "ScenePass.h"
 
 
 namespace nhahn
 {
+	class DepthSorter;
+	class DensityThinner;
 	class ParticleSystem;
 
+	// billboards of the instanced quad path, generate with useQuads
+	struct QuadSettings
+	{
+		float size{ 0.004f };		// edge length in world units at a size scale (.w of the position) of 1
+		float spin{ 0.0f };			// turns over the lifetime, on top of a random start angle
+		float stretch{ 0.0f };		// elongation along the velocity on screen per unit of speed, replaces the rotation
+	};
+
+	// the adaptive thinning of dense screen tiles, only the point sprites are thinned
+	struct ThinningSettings
+	{
+		float budget{ 16.0f };		// fragments per pixel a tile may reach, estimated from the sprite sizes
+		int tileSize{ 32 };			// edge length of the tiles in pixels
+	};
+
 	class IParticleRenderer
 	{
 	public:
@@ -29,6 +53,78 @@ namespace nhahn
 		virtual void destroy() = 0;
 		virtual void update() = 0;
 		virtual void render() = 0;
+
+		/* only read by renderers drawing quads */
+		virtual QuadSettings& quadSettings() { return m_quadSettings; }
+
+		/* draws back to front with alpha blending instead of adding up, false if the renderer can't sort */
+		virtual bool setDepthSort(bool enabled) { return !enabled; }
+		/* null while not sorting */
+		virtual DepthSorter* depthSorter() { return nullptr; }
+
+		/* camera and blending of the next update and render, for the culling and the renderers' own shaders */
+		virtual void setView(const ScenePass& pass) { }
+		/* uploads and draws only the ParticleData bounds chunks inside the view, false if the renderer can't */
+		virtual bool setChunkCulling(bool enabled) { return !enabled; }
+		virtual bool chunkCulling() const { return false; }
+		/* alive particles the last update left out */
+		virtual size_t numCulledParticles() const { return 0; }
+		/* how far a particle reaches beyond its position in world units per unit of size scale, negative if unbounded */
+		virtual float cullMargin() const { return 0.0f; }
+
+		/* drops a fraction of the particles in screen tiles over the overdraw budget and raises the alpha of the
+		   rest to keep the brightness, false if the renderer can't */
+		virtual bool setThinning(bool enabled) { return !enabled; }
+		/* null while not thinning */
+		virtual DensityThinner* thinner() { return nullptr; }
+		virtual ThinningSettings& thinningSettings() { return m_thinningSettings; }
+
+	protected:
+		QuadSettings m_quadSettings;
+		ThinningSettings m_thinningSettings;
+	};
+
+	/*
+	 * Registered as "auto". Asks the factory for the fastest renderer of the driver and particle
+	 * count among those drawing the image of "gl" on generate and forwards to it. Quads, the depth sort, the chunk culling and the thinning
+	 * are only done by "gl", which is taken for them.
+	 */
+	class AutoParticleRenderer : public IParticleRenderer
+	{
+	public:
+		AutoParticleRenderer() { }
+		~AutoParticleRenderer() { destroy(); }
+
+		void generate(ParticleSystem* sys, bool useQuads) override;
+		void destroy() override;
+		void update() override;
+		void render() override;
+
+		QuadSettings& quadSettings() override { return m_renderer ? m_renderer->quadSettings() : m_quadSettings; }
+
+		bool setDepthSort(bool enabled) override;
+		DepthSorter* depthSorter() override { return m_renderer ? m_renderer->depthSorter() : nullptr; }
+
+		void setView(const ScenePass& pass) override { if (m_renderer) m_renderer->setView(pass); }
+		bool setChunkCulling(bool enabled) override;
+		bool chunkCulling() const override { return m_chunkCulling; }
+		size_t numCulledParticles() const override { return m_renderer ? m_renderer->numCulledParticles() : 0; }
+		float cullMargin() const override { return m_renderer ? m_renderer->cullMargin() : -1.0f; }
+
+		bool setThinning(bool enabled) override;
+		DensityThinner* thinner() override { return m_renderer ? m_renderer->thinner() : nullptr; }
+		ThinningSettings& thinningSettings() override { return m_renderer ? m_renderer->thinningSettings() : m_thinningSettings; }
+
+		const std::string& selected() const { return m_selected; }
+
+	private:
+		std::shared_ptr<IParticleRenderer> m_renderer;
+		std::string m_selected;
+		ParticleSystem* m_system{ nullptr };
+		bool m_useQuads{ false };
+		bool m_depthSort{ false };
+		bool m_chunkCulling{ false };
+		bool m_thinning{ false };
 	};
 
 	class ParticleRendererFactory
@@ -36,9 +132,29 @@ namespace nhahn
 		using MapOfRendererGenerators = std::map<std::string, std::shared_ptr<IParticleRenderer>(*)()>;
 
 	public:
+		static const char* const AUTO;
+
+		struct Timing
+		{
+			std::string name;
+			double ms;			// update plus draw per frame, including the wait for the gpu
+			size_t stalls;		// waits on a fence, only the persistent renderer counts them
+		};
+
 		static bool isAvailable(const char* name);
 		static std::shared_ptr<IParticleRenderer> create(const char* name);
 
+		/* every renderer except auto */
+		static std::vector<std::string> names();
+		/* the renderers that draw the same image as gl, gl_double draws the frame before and is left out */
+		static std::vector<std::string> calibratedNames();
+		/* fastest of calibratedNames() for count particles, measured once per driver and cached in data\renderers.cache */
+		static std::string selectFastest(size_t count);
+		/* times every renderer of calibratedNames() with count particles, blocks for a moment and needs a current context */
+		static std::vector<Timing> calibrate(size_t count);
+		/* vendor, renderer and version of the gl driver, the key of the cache */
+		static std::string driverString();
+
 	protected:
 		static void initGeneratorMap();
 		static std::unique_ptr<MapOfRendererGenerators> s_generatorMap;
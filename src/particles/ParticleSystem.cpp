@@ -7,6 +7,8 @@
 \*------------------------------------------------------------------------------------------------*/
 #include "ParticleSystem.h"
 
+#include <algorithm>
+
 
 namespace nhahn
 {
@@ -25,11 +27,11 @@ namespace nhahn
 		}
 	}
 
-	ParticleSystem::ParticleSystem(size_t maxCount)
+	ParticleSystem::ParticleSystem(size_t maxCount, uint32_t streams)
 	{
 		m_count = maxCount;
-		m_particles.generate(maxCount);
-		m_aliveParticles.generate(maxCount);
+		m_particles.generate(maxCount, streams);
+		m_aliveParticles.generate(maxCount, streams);
 
 		for (size_t i = 0; i < maxCount; ++i)
 			m_particles.m_alive[i] = false;
@@ -37,6 +39,9 @@ namespace nhahn
 
 	void ParticleSystem::update(double dt)
 	{
+		// the EulerUpdater reduces them again once everything has moved
+		m_particles.m_boundsValid = false;
+
 		for (auto& em : m_emitters)
 		{
 			em->emit(dt, &m_particles);
@@ -59,7 +64,8 @@ namespace nhahn
 
 		for (auto& up : m_updaters)
 		{
-			up->update(dt, &m_particles);
+			if (!isUpdaterSkipped(up.get()))
+				up->update(dt, &m_particles);
 		}
 
 		double ratio = (double)m_particles.m_countAlive / (double)m_count;
@@ -68,6 +74,20 @@ namespace nhahn
 		//ParticleData::copyOnlyAlive(&m_particles, &m_aliveParticles);
 	}
 
+	void ParticleSystem::setUpdaterSkipped(const ParticleUpdater* up, bool skipped)
+	{
+		auto it = std::find(m_skippedUpdaters.begin(), m_skippedUpdaters.end(), up);
+		if (skipped && it == m_skippedUpdaters.end())
+			m_skippedUpdaters.push_back(up);
+		else if (!skipped && it != m_skippedUpdaters.end())
+			m_skippedUpdaters.erase(it);
+	}
+
+	bool ParticleSystem::isUpdaterSkipped(const ParticleUpdater* up) const
+	{
+		return std::find(m_skippedUpdaters.begin(), m_skippedUpdaters.end(), up) != m_skippedUpdaters.end();
+	}
+
 	void ParticleSystem::reset()
 	{
 		m_particles.m_countAlive = 0;
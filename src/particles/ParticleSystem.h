@@ -35,6 +35,7 @@ namespace nhahn
 		virtual void emit(double dt, ParticleData* p);
 
 		void addGenerator(std::shared_ptr<ParticleGenerator> gen) { m_generators.push_back(gen); }
+		const std::vector<std::shared_ptr<ParticleGenerator>>& generators() const { return m_generators; }
 
 	public:
 		float m_emitRate{ 0.0 };
@@ -55,7 +56,7 @@ namespace nhahn
 	class ParticleSystem
 	{
 	public:
-		explicit ParticleSystem(size_t maxCount);
+		explicit ParticleSystem(size_t maxCount, uint32_t streams = ParticleData::STREAMS_ALL);
 		virtual ~ParticleSystem() { }
 
 		ParticleSystem(const ParticleSystem&) = delete;
@@ -69,8 +70,15 @@ namespace nhahn
 
 		void addEmitter(std::shared_ptr<ParticleEmitter> em) { m_emitters.push_back(em); }
 		void addUpdater(std::shared_ptr<ParticleUpdater> up) { m_updaters.push_back(up); }
+		const std::vector<std::shared_ptr<ParticleEmitter>>& emitters() const { return m_emitters; }
+		const std::vector<std::shared_ptr<ParticleUpdater>>& updaters() const { return m_updaters; }
+
+		/* a skipped updater stays in the list for its settings, but update does not run it. For stages evaluated in the shaders */
+		void setUpdaterSkipped(const ParticleUpdater* up, bool skipped);
+		bool isUpdaterSkipped(const ParticleUpdater* up) const;
 
 		ParticleData* finalData() { return &m_particles; }
+		const ParticleData* finalData() const { return &m_particles; }
 
 		double getAliveToAllRatio() const { return m_aliveToAllRatio; }
 
@@ -84,6 +92,7 @@ namespace nhahn
 
 		std::vector<std::shared_ptr<ParticleEmitter>> m_emitters;
 		std::vector<std::shared_ptr<ParticleUpdater>> m_updaters;
+		std::vector<const ParticleUpdater*> m_skippedUpdaters;
 
 		double m_aliveToAllRatio{ 0.0 };
 	};
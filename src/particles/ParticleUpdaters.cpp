@@ -8,9 +8,15 @@
 #include "ParticleUpdaters.h"
 
 #include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <glm/common.hpp>
 #include <glm/gtc/random.hpp>
-#include <xmmintrin.h>
+#include <immintrin.h>
+#include <filesystem>
+#include "Noise.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
 
 #define SSE_MODE_NONE 0
 #define SSE_MODE_SSE2 1
@@ -22,7 +28,208 @@
 
 namespace nhahn
 {
+	// out = a + s * b per component, out may alias a. Shared by the integrators, two particles per AVX register
+	static inline void madd(glm::vec4* out, const glm::vec4* a, const glm::vec4* b, const glm::vec4& s, size_t count)
+	{
+		size_t i = 0;
+	#if SSE_MODE == SSE_MODE_AVX
+		const __m256 s2 = _mm256_setr_ps(s.x, s.y, s.z, s.w, s.x, s.y, s.z, s.w);
+		for (; i + 1 < count; i += 2)
+			_mm256_storeu_ps(&out[i].x, _mm256_add_ps(_mm256_loadu_ps(&a[i].x), _mm256_mul_ps(_mm256_loadu_ps(&b[i].x), s2)));
+	#elif SSE_MODE == SSE_MODE_SSE2
+		const __m128 s1 = _mm_setr_ps(s.x, s.y, s.z, s.w);
+		for (; i < count; ++i)
+			_mm_store_ps(&out[i].x, _mm_add_ps(_mm_load_ps(&a[i].x), _mm_mul_ps(_mm_load_ps(&b[i].x), s1)));
+	#endif
+		for (; i < count; ++i)
+			out[i] = a[i] + b[i] * s;
+	}
+
+	// madd of the position pass, which also reduces the bounds of every chunk and of the whole system
+	// while the new positions are still in registers. w takes part, the size scale is kept by s.w = 0
+	static void maddBounds(glm::vec4* out, const glm::vec4* a, const glm::vec4* b, const glm::vec4& s, ParticleData* p)
+	{
+		const size_t count = p->m_countAlive;
+		const __m128 s1 = _mm_setr_ps(s.x, s.y, s.z, s.w);
+		__m128 sysMin = _mm_set1_ps(FLT_MAX);
+		__m128 sysMax = _mm_set1_ps(-FLT_MAX);
+
+		for (size_t begin = 0, chunk = 0; begin < count; begin += ParticleData::BOUNDS_CHUNK, ++chunk)
+		{
+			const size_t end = std::min(count, begin + ParticleData::BOUNDS_CHUNK);
+			size_t i = begin;
+		#if SSE_MODE == SSE_MODE_AVX
+			const __m256 s2 = _mm256_set_m128(s1, s1);
+			__m256 lo2 = _mm256_set1_ps(FLT_MAX);
+			__m256 hi2 = _mm256_set1_ps(-FLT_MAX);
+			for (; i + 1 < end; i += 2)
+			{
+				const __m256 v = _mm256_add_ps(_mm256_loadu_ps(&a[i].x), _mm256_mul_ps(_mm256_loadu_ps(&b[i].x), s2));
+				_mm256_storeu_ps(&out[i].x, v);
+				lo2 = _mm256_min_ps(lo2, v);
+				hi2 = _mm256_max_ps(hi2, v);
+			}
+			__m128 lo = _mm_min_ps(_mm256_castps256_ps128(lo2), _mm256_extractf128_ps(lo2, 1));
+			__m128 hi = _mm_max_ps(_mm256_castps256_ps128(hi2), _mm256_extractf128_ps(hi2, 1));
+		#else
+			__m128 lo = _mm_set1_ps(FLT_MAX);
+			__m128 hi = _mm_set1_ps(-FLT_MAX);
+		#endif
+			for (; i < end; ++i)
+			{
+				const __m128 v = _mm_add_ps(_mm_load_ps(&a[i].x), _mm_mul_ps(_mm_load_ps(&b[i].x), s1));
+				_mm_store_ps(&out[i].x, v);
+				lo = _mm_min_ps(lo, v);
+				hi = _mm_max_ps(hi, v);
+			}
+
+			// the ParticleData members and chunk vectors are only aligned like glm::vec4
+			_mm_storeu_ps(&p->m_chunkMin[chunk].x, lo);
+			_mm_storeu_ps(&p->m_chunkMax[chunk].x, hi);
+			sysMin = _mm_min_ps(sysMin, lo);
+			sysMax = _mm_max_ps(sysMax, hi);
+		}
+
+		_mm_storeu_ps(&p->m_boundsMin.x, sysMin);
+		_mm_storeu_ps(&p->m_boundsMax.x, sysMax);
+		p->m_boundsValid = (count > 0);	// still FLT_MAX / -FLT_MAX without particles
+	}
+
+	const char* const EulerUpdater::INTEGRATOR_NAMES[(int)Integrator::COUNT] = {
+		"explicit euler",
+		"semi-implicit euler",
+		"velocity verlet",
+		"rk2 (midpoint)"
+	};
+
+	EulerUpdater::~EulerUpdater()
+	{
+		_aligned_free(m_scratchPos);
+		_aligned_free(m_scratchVel);
+		_aligned_free(m_scratchAcc);
+	}
+
 	void EulerUpdater::update(double dt, ParticleData* p)
+	{
+		switch (m_integrator)
+		{
+		case Integrator::EXPLICIT_EULER: integrateExplicit(dt, p); break;
+		case Integrator::VELOCITY_VERLET: integrateVelocityVerlet(dt, p); break;
+		case Integrator::RK2: integrateRK2(dt, p); break;
+		default: integrateSemiImplicit(dt, p); break;
+		}
+	}
+
+	void EulerUpdater::reserveScratch(size_t count)
+	{
+		if (count <= m_scratchCount)
+			return;
+
+		_aligned_free(m_scratchPos);
+		_aligned_free(m_scratchVel);
+		_aligned_free(m_scratchAcc);
+
+		m_scratchPos = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * count, 16);
+		m_scratchVel = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * count, 16);
+		m_scratchAcc = (glm::vec4*)_aligned_malloc(sizeof(glm::vec4) * count, 16);
+		m_scratchCount = count;
+	}
+
+	void EulerUpdater::removeForces(const glm::vec4* pos, const glm::vec4* acc, glm::vec4* out, size_t count)
+	{
+		if (m_forces.empty())
+		{
+			memcpy(out, acc, sizeof(glm::vec4) * count);
+			return;
+		}
+
+		memset(out, 0, sizeof(glm::vec4) * count);
+		for (auto& force : m_forces)
+			force->accumulate(pos, out, count);
+		for (size_t i = 0; i < count; ++i)
+			out[i] = acc[i] - out[i];
+	}
+
+	void EulerUpdater::addForces(const glm::vec4* pos, glm::vec4* acc, size_t count)
+	{
+		for (auto& force : m_forces)
+			force->accumulate(pos, acc, count);
+	}
+
+	// Note: as in the semi-implicit path the global acceleration is scaled by dt once more,
+	// all integrators keep that convention so the effects do not need to be retuned
+
+	void EulerUpdater::integrateExplicit(double dt, ParticleData* p)
+	{
+		const float localDT = (float)dt;
+		const glm::vec4 globalA{ localDT * m_globalAcceleration.x, localDT * m_globalAcceleration.y, localDT * m_globalAcceleration.z, 0.0f };
+		const size_t endId = p->m_countAlive;
+
+		for (size_t i = 0; i < endId; ++i)
+			p->m_acc[i] += globalA;
+
+		// position with the old velocity, pos.w is the size and is left alone
+		maddBounds(p->m_pos, p->m_pos, p->m_vel, glm::vec4(localDT, localDT, localDT, 0.0f), p);
+		madd(p->m_vel, p->m_vel, p->m_acc, glm::vec4(localDT), endId);
+	}
+
+	void EulerUpdater::integrateVelocityVerlet(double dt, ParticleData* p)
+	{
+		const float localDT = (float)dt;
+		const float halfDT = 0.5f * localDT;
+		const glm::vec4 globalA{ localDT * m_globalAcceleration.x, localDT * m_globalAcceleration.y, localDT * m_globalAcceleration.z, 0.0f };
+		const size_t endId = p->m_countAlive;
+
+		reserveScratch(p->m_count);
+
+		glm::vec4* RESTRICT acc = p->m_acc;
+		glm::vec4* RESTRICT vel = p->m_vel;
+		glm::vec4* RESTRICT pos = p->m_pos;
+
+		for (size_t i = 0; i < endId; ++i)
+			acc[i] += globalA;
+
+		// the acceleration without the registered forces, those are evaluated again at the new positions
+		removeForces(pos, acc, m_scratchAcc, endId);
+
+		// x += v dt + a dt^2 / 2
+		madd(pos, pos, vel, glm::vec4(localDT, localDT, localDT, 0.0f), endId);
+		maddBounds(pos, pos, acc, glm::vec4(halfDT * localDT, halfDT * localDT, halfDT * localDT, 0.0f), p);
+
+		// v += (a + a(x)) dt / 2, accelerations from updaters that are not a ParticleForce are kept constant
+		addForces(pos, m_scratchAcc, endId);
+		madd(vel, vel, acc, glm::vec4(halfDT), endId);
+		madd(vel, vel, m_scratchAcc, glm::vec4(halfDT), endId);
+	}
+
+	void EulerUpdater::integrateRK2(double dt, ParticleData* p)
+	{
+		const float localDT = (float)dt;
+		const float halfDT = 0.5f * localDT;
+		const glm::vec4 globalA{ localDT * m_globalAcceleration.x, localDT * m_globalAcceleration.y, localDT * m_globalAcceleration.z, 0.0f };
+		const size_t endId = p->m_countAlive;
+
+		reserveScratch(p->m_count);
+
+		glm::vec4* RESTRICT acc = p->m_acc;
+		glm::vec4* RESTRICT vel = p->m_vel;
+		glm::vec4* RESTRICT pos = p->m_pos;
+
+		for (size_t i = 0; i < endId; ++i)
+			acc[i] += globalA;
+
+		// state at the midpoint of the step
+		madd(m_scratchPos, pos, vel, glm::vec4(halfDT, halfDT, halfDT, 0.0f), endId);
+		madd(m_scratchVel, vel, acc, glm::vec4(halfDT), endId);
+		removeForces(pos, acc, m_scratchAcc, endId);
+		addForces(m_scratchPos, m_scratchAcc, endId);
+
+		// full step with the midpoint derivatives
+		maddBounds(pos, pos, m_scratchVel, glm::vec4(localDT, localDT, localDT, 0.0f), p);
+		madd(vel, vel, m_scratchAcc, glm::vec4(localDT), endId);
+	}
+
+	void EulerUpdater::integrateSemiImplicit(double dt, ParticleData* p)
 	{
 		const glm::vec4 globalA{ (float)dt * m_globalAcceleration.x, (float)dt * m_globalAcceleration.y, (float)dt * m_globalAcceleration.z, 0.0f };
 		const float localDT = (float)dt;
@@ -38,9 +245,6 @@ namespace nhahn
 
 		for (size_t i = 0; i < endId; ++i)
 			vel[i] += localDT * acc[i];
-
-		for (size_t i = 0; i < endId; ++i)
-			pos[i] += localDT * vel[i];
 	#elif SSE_MODE == SSE_MODE_SSE2
 		__m128 ga = *(__m128*)(&globalA.data);
 		__m128* pa, * pb, pc;
@@ -60,14 +264,6 @@ namespace nhahn
 			pc = _mm_mul_ps(*pb, ldt);
 			*pa = _mm_add_ps(*pa, pc);
 		}
-
-		for (size_t i = 0; i < endId; i++)
-		{
-			pa = (__m128*)(&pos[i].x);
-			pb = (__m128*)(&vel[i].x);
-			pc = _mm_mul_ps(*pb, ldt);
-			*pa = _mm_add_ps(*pa, pc);
-		}
 	#elif SSE_MODE == SSE_MODE_AVX
 		__m256 ga = _mm256_set_m128(*(__m128*)(&globalA.data), *(__m128*)(&globalA.data));
 		__m256* pa, * pb, pc;
@@ -95,19 +291,10 @@ namespace nhahn
 		{
 			vel[i] += localDT * acc[i];
 		}
-
-		for (size_t i = 0; i < endId; i += 2)
-		{
-			pa = (__m256*)(&pos[i].x);
-			pb = (__m256*)(&vel[i].x);
-			pc = _mm256_mul_ps(*pb, ldt);
-			*pa = _mm256_add_ps(*pa, pc);
-		}
-		for (; i < endId; i++)
-		{
-			pos[i] += localDT * vel[i];
-		}
 	#endif // AVX
+
+		// pos.w holds the size, so only xyz is integrated
+		maddBounds(pos, pos, vel, glm::vec4(localDT, localDT, localDT, 0.0f), p);
 	}
 
 	void FloorUpdater::update(double dt, ParticleData* p)
@@ -138,6 +325,219 @@ namespace nhahn
 
 	}
 
+	void SdfCollisionUpdater::update(double dt, ParticleData* p)
+	{
+		if (!m_enabled || !m_volume || !m_volume->isValid())
+			return;
+
+		glm::vec4* RESTRICT acc = p->m_acc;
+		glm::vec4* RESTRICT vel = p->m_vel;
+		glm::vec4* RESTRICT pos = p->m_pos;
+
+		const FieldVolume& volume = *m_volume;
+		const __m128 boundsMin = _mm_load_ps(&volume.boundsMin().x);
+		const __m128 boundsMax = _mm_load_ps(&volume.boundsMax().x);
+		const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		const __m128 bounce = _mm_set1_ps(m_bounceFactor);
+		const __m128 tangential = _mm_set1_ps(1.0f - m_friction);
+
+		const size_t endId = p->m_countAlive;
+		for (size_t i = 0; i < endId; ++i)
+		{
+			__m128 ps = _mm_load_ps(&pos[i].x);
+
+			// nothing to collide with outside of the volume
+			const __m128 outside = _mm_or_ps(_mm_cmplt_ps(ps, boundsMin), _mm_cmpgt_ps(ps, boundsMax));
+			if (_mm_movemask_ps(outside) & 0x7)
+				continue;
+
+			const __m128 s = volume.sample(ps);
+			const float dist = _mm_cvtss_f32(_mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3))) - m_radius;
+			if (dist >= 0.0f)
+				continue;
+
+			// the interpolated gradient is the contact normal
+			__m128 n = _mm_and_ps(s, xyzMask);
+			const __m128 len2 = _mm_dp_ps(n, n, 0x7F);
+			if (_mm_cvtss_f32(len2) < 1e-12f)
+				continue;
+			n = _mm_div_ps(n, _mm_sqrt_ps(len2));
+
+			// project back onto the surface
+			ps = _mm_sub_ps(ps, _mm_mul_ps(n, _mm_set1_ps(dist)));
+			_mm_store_ps(&pos[i].x, ps);
+			p->growBounds(i);
+
+			// remove the part of the force pushing into the surface
+			__m128 a = _mm_load_ps(&acc[i].x);
+			const __m128 an = _mm_dp_ps(a, n, 0x7F);
+			if (_mm_cvtss_f32(an) < 0.0f)
+				_mm_store_ps(&acc[i].x, _mm_sub_ps(a, _mm_mul_ps(n, an)));
+
+			// reflect the normal velocity and damp the tangential one
+			__m128 v = _mm_load_ps(&vel[i].x);
+			const __m128 vn = _mm_dp_ps(v, n, 0x7F);
+			if (_mm_cvtss_f32(vn) < 0.0f)
+			{
+				const __m128 normalPart = _mm_mul_ps(n, vn);
+				const __m128 tangentPart = _mm_sub_ps(v, normalPart);
+				v = _mm_sub_ps(_mm_mul_ps(tangentPart, tangential), _mm_mul_ps(normalPart, bounce));
+				_mm_store_ps(&vel[i].x, v);
+			}
+		}
+	}
+
+	void CurlNoiseUpdater::setOctaves(uint32_t count)
+	{
+		count = std::min(count, MAX_OCTAVES);
+
+		m_octaves.resize(count);
+		for (uint32_t o = 0; o < count; ++o)
+		{
+			if (m_octaves[o])
+				continue;
+
+			const uint32_t seed = m_seed + o * 7919u;
+			const std::string dir = FileSystem::getModuleDirectory() + "data\\volumes\\";
+			const std::string path = dir + "curl_" + std::to_string(seed) + "_" + std::to_string(VOLUME_DIM) + ".vol";
+
+			auto volume = std::make_shared<FieldVolume>();
+			if (!volume->load(path.c_str()))
+			{
+				// the volume spans exactly one noise period in lattice units, so it tiles seamlessly
+				const float period = (float)LATTICE_PERIOD;
+				volume->setAddressing(VolumeAddressing::WRAP);
+				volume->allocate(glm::uvec3{ VOLUME_DIM }, glm::vec4{ 0.0f }, glm::vec4{ period, period, period, 0.0f });
+				volume->bake([seed](const glm::vec4& p) {
+					return Noise::periodicCurl(glm::vec3{ p.x, p.y, p.z }, LATTICE_PERIOD, seed);
+				});
+
+				std::error_code ec;
+				std::filesystem::create_directories(dir, ec);
+				if (!volume->save(path.c_str()))
+					DBG("CurlNoiseUpdater", DebugLevel::WARNING, "could not cache noise volume '%s'\n", path.c_str());
+			}
+			m_octaves[o] = volume;
+		}
+	}
+
+	void CurlNoiseUpdater::update(double dt, ParticleData* p)
+	{
+		if (!m_enabled || m_octaves.empty())
+			return;
+
+		// keep the scroll offset inside one period, so precision does not degrade over time
+		const float period = (float)LATTICE_PERIOD;
+		m_scroll += (float)dt * m_scrollSpeed;
+		m_scroll = glm::vec4{ fmodf(m_scroll.x, period), fmodf(m_scroll.y, period), fmodf(m_scroll.z, period), 0.0f };
+
+		const size_t numOctaves = m_octaves.size();
+		__m128 frequency[MAX_OCTAVES], amplitude[MAX_OCTAVES];
+		const FieldVolume* volumes[MAX_OCTAVES];
+		float freq = m_frequency, amp = m_strength * (float)dt;
+		for (size_t o = 0; o < numOctaves; ++o)
+		{
+			frequency[o] = _mm_set1_ps(freq);
+			amplitude[o] = _mm_set1_ps(amp);
+			volumes[o] = m_octaves[o].get();
+			freq *= 2.0f;
+			amp *= m_persistence;
+		}
+		const __m128 scroll = _mm_setr_ps(m_scroll.x, m_scroll.y, m_scroll.z, 0.0f);
+
+		glm::vec4* RESTRICT vel = p->m_vel;
+		glm::vec4* RESTRICT pos = p->m_pos;
+
+		const size_t endId = p->m_countAlive;
+		for (size_t i = 0; i < endId; ++i)
+		{
+			const __m128 ps = _mm_load_ps(&pos[i].x);
+			__m128 v = _mm_load_ps(&vel[i].x);
+
+			// the volumes hold w = 0, so vel.w stays untouched
+			for (size_t o = 0; o < numOctaves; ++o)
+			{
+				const __m128 q = _mm_add_ps(_mm_mul_ps(ps, frequency[o]), scroll);
+				v = _mm_add_ps(v, _mm_mul_ps(volumes[o]->sample(q), amplitude[o]));
+			}
+
+			_mm_store_ps(&vel[i].x, v);
+		}
+	}
+
+	bool VectorFieldUpdater::load(const char* filepath)
+	{
+		m_prefetcher.reset();
+		m_volume.reset();
+
+		auto volume = std::make_shared<FieldVolume>();
+		if (!volume->load(filepath))
+			return false;
+
+		m_volume = volume;
+		m_prefetcher = std::make_unique<FieldVolumePrefetcher>(m_volume);
+		m_time = 0.0;
+		m_currentFrame = 0;
+
+		DBG("VectorFieldUpdater", DebugLevel::DEBUG, "streaming %u frames, %dmb per frame\n",
+			m_volume->frameCount(), (int)(m_volume->voxelsPerFrame() * sizeof(glm::vec4) / (1024 * 1024)));
+		return true;
+	}
+
+	void VectorFieldUpdater::update(double dt, ParticleData* p)
+	{
+		const uint32_t frameCount = m_volume ? m_volume->frameCount() : 0;
+		if (!m_enabled || frameCount == 0)
+			return;
+
+		const float frameRate = m_volume->frameRate() > 0.0f ? m_volume->frameRate() : m_defaultFrameRate;
+		m_time += dt * m_playbackSpeed;
+
+		// position in the sequence, the last frame holds when not looping
+		double framePos = m_time * frameRate;
+		if (m_loop)
+			framePos = fmod(framePos, (double)frameCount);
+		else
+			framePos = std::min(framePos, (double)(frameCount - 1));
+
+		const uint32_t frame0 = (uint32_t)framePos;
+		const uint32_t frame1 = m_loop ? (frame0 + 1) % frameCount : std::min(frame0 + 1, frameCount - 1);
+		m_currentFrame = frame0;
+		m_prefetcher->request(frame0);
+
+		const FieldVolume& volume = *m_volume;
+		const __m128 blend = _mm_set1_ps((float)(framePos - frame0));
+		const __m128 boundsMin = _mm_load_ps(&volume.boundsMin().x);
+		const __m128 boundsMax = _mm_load_ps(&volume.boundsMax().x);
+		const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		const __m128 factor = (m_mode == FieldMode::FORCE)
+			? _mm_set1_ps(m_strength * (float)dt)
+			: _mm_set1_ps(std::min(m_strength * (float)dt, 1.0f));
+
+		glm::vec4* RESTRICT vel = p->m_vel;
+		glm::vec4* RESTRICT pos = p->m_pos;
+
+		const size_t endId = p->m_countAlive;
+		for (size_t i = 0; i < endId; ++i)
+		{
+			const __m128 ps = _mm_load_ps(&pos[i].x);
+
+			// the field is only defined inside of its bounds
+			const __m128 outside = _mm_or_ps(_mm_cmplt_ps(ps, boundsMin), _mm_cmpgt_ps(ps, boundsMax));
+			if (_mm_movemask_ps(outside) & 0x7)
+				continue;
+
+			const __m128 f = _mm_and_ps(lerp4(volume.sample(ps, frame0), volume.sample(ps, frame1), blend), xyzMask);
+
+			__m128 v = _mm_load_ps(&vel[i].x);
+			if (m_mode == FieldMode::FORCE)
+				v = _mm_add_ps(v, _mm_mul_ps(f, factor));
+			else
+				v = _mm_add_ps(v, _mm_mul_ps(_mm_and_ps(_mm_sub_ps(f, v), xyzMask), factor));
+			_mm_store_ps(&vel[i].x, v);
+		}
+	}
+
 	inline float inverse(float x)
 	{
 		// re-interpret as a 32 bit integer
@@ -159,19 +559,18 @@ namespace nhahn
 	}
 
 	void AttractorUpdater::update(double dt, ParticleData* p)
+	{
+		accumulate(p->m_pos, p->m_acc, p->m_countAlive);
+	}
+
+	void AttractorUpdater::accumulate(const glm::vec4* pos, glm::vec4* acc, size_t count)
 	{
 		const size_t countAttractors = m_attractors.size();
 		glm::vec4 attr[8];
 		for (size_t i = 0; i < countAttractors; ++i)
 			attr[i] = glm::vec4(m_attractors[i]);
 
-		const float localDT = (float)dt;
-
-		glm::vec4* RESTRICT acc = p->m_acc;
-		glm::vec4* RESTRICT vel = p->m_vel;
-		glm::vec4* RESTRICT pos = p->m_pos;
-
-		const size_t endId = p->m_countAlive;
+		const size_t endId = count;
 		glm::vec4 off = glm::vec4(0.0f);
 	#if SSE_MODE == SSE_MODE_NONE
 		float dist;
@@ -185,15 +584,17 @@ namespace nhahn
 			for (a = 0; a < countAttractors; ++a)
 			{
 		#if SSE_MODE == SSE_MODE_NONE
-				off = attr[a] - p->m_pos[i];
+				off = attr[a] - pos[i];
+				off.w = 0.0f;
 				dist = off.x * off.x + off.y * off.y + off.z * off.z;
 				dist = attr[a].w / dist;// *inverse(dist);
-				p->m_acc[i] += off * dist;
+				acc[i] += off * dist;
 		#elif SSE_MODE == SSE_MODE_SSE2 || SSE_MODE == SSE_MODE_AVX
-				off = attr[a] - p->m_pos[i];
+				off = attr[a] - pos[i];
+				off.w = 0.0f;
 				tempDist = _mm_dp_ps(*(__m128*)(&off.data), *(__m128*)(&off.data), 0x71);
 				tempDist.m128_f32[0] = attr[a].w / tempDist.m128_f32[0];// *inverse2(fabs(tempDist.m128_f32[0]);
-				p->m_acc[i] += off * tempDist.m128_f32[0];
+				acc[i] += off * tempDist.m128_f32[0];
 		#endif
 			}
 		}
@@ -201,6 +602,8 @@ namespace nhahn
 
 	void BasicColorUpdater::update(double dt, ParticleData* p)
 	{
+		ASSERT(p->hasStreams(ParticleData::STREAM_START_COL | ParticleData::STREAM_END_COL), "BasicColorUpdater: needs the start and end color streams\n");
+
 		const size_t endId = p->m_countAlive;
 
 		glm::vec4* RESTRICT col = p->m_col;
@@ -225,8 +628,152 @@ namespace nhahn
 	#endif
 	}
 
+	template <typename Key, typename T>
+	static void bakeGradient(std::vector<Key> keys, T Key::* value, const T& fallback, T* lut, size_t lutSize)
+	{
+		std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.m_age < b.m_age; });
+
+		for (size_t j = 0; j < lutSize; ++j)
+		{
+			const float age = (float)j / (float)(lutSize - 1);
+
+			if (keys.empty())
+				lut[j] = fallback;
+			else if (age <= keys.front().m_age)
+				lut[j] = keys.front().*value;
+			else if (age >= keys.back().m_age)
+				lut[j] = keys.back().*value;
+			else
+			{
+				size_t k = 1;
+				while (keys[k].m_age < age)
+					++k;
+
+				const Key& a = keys[k - 1];
+				const Key& b = keys[k];
+				const float t = (b.m_age > a.m_age) ? (age - a.m_age) / (b.m_age - a.m_age) : 0.0f;
+				lut[j] = a.*value + (b.*value - a.*value) * t;
+			}
+		}
+		lut[lutSize] = lut[lutSize - 1];
+	}
+
+	// table position and seed for up to four particles. The seed hashes the bits of time.w (1 / lifetime),
+	// which is random per particle and constant over its life, so no extra stream is needed for it
+	static inline void lutCoords(const glm::vec4* RESTRICT time, size_t count, float scale, int32_t* index, float* frac, float* seed)
+	{
+		__m128 t0, t1, t2, t3;
+		if (count == 4)
+		{
+			t0 = _mm_load_ps(&time[0].x);
+			t1 = _mm_load_ps(&time[1].x);
+			t2 = _mm_load_ps(&time[2].x);
+			t3 = _mm_load_ps(&time[3].x);
+		}
+		else
+		{
+			t0 = _mm_load_ps(&time[0].x);
+			t1 = count > 1 ? _mm_load_ps(&time[1].x) : _mm_setzero_ps();
+			t2 = count > 2 ? _mm_load_ps(&time[2].x) : _mm_setzero_ps();
+			t3 = _mm_setzero_ps();
+		}
+		_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+		// t2 holds the ages, t3 the inverse lifetimes
+		const __m128 pos = _mm_mul_ps(_mm_min_ps(_mm_max_ps(t2, _mm_setzero_ps()), _mm_set1_ps(1.0f)), _mm_set1_ps(scale));
+		const __m128i i = _mm_cvttps_epi32(pos);
+		_mm_store_si128((__m128i*)index, i);
+		_mm_store_ps(frac, _mm_sub_ps(pos, _mm_cvtepi32_ps(i)));
+
+		__m128i h = _mm_castps_si128(t3);
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+		h = _mm_mullo_epi32(h, _mm_set1_epi32(0x7feb352d));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+		h = _mm_mullo_epi32(h, _mm_set1_epi32((int32_t)0x846ca68b));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+		_mm_store_ps(seed, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 8)), _mm_set1_ps(1.0f / 16777216.0f)));
+	}
+
+	void ColorLutUpdater::rebuild()
+	{
+		bakeGradient(m_minKeys, &ColorKey::m_color, glm::vec4(1.0f), m_minLut, LUT_SIZE);
+		bakeGradient(m_maxKeys.empty() ? m_minKeys : m_maxKeys, &ColorKey::m_color, glm::vec4(1.0f), m_maxLut, LUT_SIZE);
+		m_revision++;
+	}
+
+	void ColorLutUpdater::update(double dt, ParticleData* p)
+	{
+		const size_t endId = p->m_countAlive;
+
+		glm::vec4* RESTRICT col = p->m_col;
+		const glm::vec4* RESTRICT time = p->m_time;
+		const bool variation = !m_maxKeys.empty();
+
+		alignas(16) int32_t index[4];
+		alignas(16) float frac[4];
+		alignas(16) float seed[4];
+
+		for (size_t i = 0; i < endId; i += 4)
+		{
+			const size_t count = std::min<size_t>(4, endId - i);
+			lutCoords(time + i, count, (float)(LUT_SIZE - 1), index, frac, seed);
+
+			for (size_t k = 0; k < count; ++k)
+			{
+				const __m128 f = _mm_set1_ps(frac[k]);
+				__m128 c = lerp4(_mm_load_ps(&m_minLut[index[k]].x), _mm_load_ps(&m_minLut[index[k] + 1].x), f);
+				if (variation)
+				{
+					const __m128 cMax = lerp4(_mm_load_ps(&m_maxLut[index[k]].x), _mm_load_ps(&m_maxLut[index[k] + 1].x), f);
+					c = lerp4(c, cMax, _mm_set1_ps(seed[k]));
+				}
+				_mm_store_ps(&col[i + k].x, c);
+			}
+		}
+	}
+
+	void SizeLutUpdater::rebuild()
+	{
+		bakeGradient(m_minKeys, &SizeKey::m_size, 1.0f, m_minLut, LUT_SIZE);
+		bakeGradient(m_maxKeys.empty() ? m_minKeys : m_maxKeys, &SizeKey::m_size, 1.0f, m_maxLut, LUT_SIZE);
+		m_revision++;
+	}
+
+	void SizeLutUpdater::update(double dt, ParticleData* p)
+	{
+		const size_t endId = p->m_countAlive;
+
+		glm::vec4* RESTRICT pos = p->m_pos;
+		const glm::vec4* RESTRICT time = p->m_time;
+
+		alignas(16) int32_t index[4];
+		alignas(16) float frac[4];
+		alignas(16) float seed[4];
+		alignas(16) float size[4];
+
+		for (size_t i = 0; i < endId; i += 4)
+		{
+			const size_t count = std::min<size_t>(4, endId - i);
+			lutCoords(time + i, count, (float)(LUT_SIZE - 1), index, frac, seed);
+
+			// gather the table entries, then interpolate all four particles at once
+			const __m128 min0 = _mm_setr_ps(m_minLut[index[0]], m_minLut[index[1]], m_minLut[index[2]], m_minLut[index[3]]);
+			const __m128 min1 = _mm_setr_ps(m_minLut[index[0] + 1], m_minLut[index[1] + 1], m_minLut[index[2] + 1], m_minLut[index[3] + 1]);
+			const __m128 max0 = _mm_setr_ps(m_maxLut[index[0]], m_maxLut[index[1]], m_maxLut[index[2]], m_maxLut[index[3]]);
+			const __m128 max1 = _mm_setr_ps(m_maxLut[index[0] + 1], m_maxLut[index[1] + 1], m_maxLut[index[2] + 1], m_maxLut[index[3] + 1]);
+
+			const __m128 f = _mm_load_ps(frac);
+			_mm_store_ps(size, lerp4(lerp4(min0, min1, f), lerp4(max0, max1, f), _mm_load_ps(seed)));
+
+			for (size_t k = 0; k < count; ++k)
+				pos[i + k].w = size[k];
+		}
+	}
+
 	void PosColorUpdater::update(double dt, ParticleData* p)
 	{
+		ASSERT(p->hasStreams(ParticleData::STREAM_START_COL | ParticleData::STREAM_END_COL), "PosColorUpdater: needs the start and end color streams\n");
+
 		glm::vec4* RESTRICT pos = p->m_pos;
 		glm::vec4* RESTRICT col = p->m_col;
 		glm::vec4* RESTRICT startCol = p->m_startCol;
@@ -252,6 +799,8 @@ namespace nhahn
 
 	void VelColorUpdater::update(double dt, ParticleData* p)
 	{
+		ASSERT(p->hasStreams(ParticleData::STREAM_START_COL | ParticleData::STREAM_END_COL), "VelColorUpdater: needs the start and end color streams\n");
+
 		glm::vec4* RESTRICT vel = p->m_vel;
 		glm::vec4* RESTRICT col = p->m_col;
 		glm::vec4* RESTRICT startCol = p->m_startCol;
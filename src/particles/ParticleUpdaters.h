@@ -8,6 +8,7 @@
 #pragma once
 
 #include "ParticleSystem.h"
+#include "FieldVolume.h"
 
 #ifndef GLM_FORCE_INTRINSICS
 #define GLM_FORCE_INTRINSICS
@@ -17,13 +18,62 @@
 
 namespace nhahn
 {
+	// forces that only depend on the particle position. Integrators that need the acceleration
+	// at predicted positions (velocity Verlet, RK2) evaluate them again through this interface
+	class ParticleForce
+	{
+	public:
+		virtual ~ParticleForce() { }
+
+		virtual void accumulate(const glm::vec4* pos, glm::vec4* acc, size_t count) = 0;
+	};
+
 	class EulerUpdater : public ParticleUpdater
 	{
 	public:
+		enum class Integrator
+		{
+			EXPLICIT_EULER,
+			SEMI_IMPLICIT_EULER,	// velocity first, then position with the new velocity
+			VELOCITY_VERLET,		// evaluates the forces twice per step
+			RK2,					// midpoint method, evaluates the forces twice per step
+			COUNT
+		};
+
+		static const char* const INTEGRATOR_NAMES[(int)Integrator::COUNT];
+
+		EulerUpdater() { }
+		virtual ~EulerUpdater();
+
+		EulerUpdater(const EulerUpdater&) = delete;
+		EulerUpdater& operator=(const EulerUpdater&) = delete;
+
 		virtual void update(double dt, ParticleData* p) override;
 
+		/* forces re-evaluated by the higher order integrators, the updater still has to run before this one */
+		void addForce(std::shared_ptr<ParticleForce> force) { m_forces.push_back(force); }
+
 	public:
 		glm::vec4 m_globalAcceleration{ 0.0f };
+		Integrator m_integrator{ Integrator::SEMI_IMPLICIT_EULER };
+
+	protected:
+		void integrateExplicit(double dt, ParticleData* p);
+		void integrateSemiImplicit(double dt, ParticleData* p);
+		void integrateVelocityVerlet(double dt, ParticleData* p);
+		void integrateRK2(double dt, ParticleData* p);
+
+		/* out = acc minus the registered forces at pos, addForces puts them back at other positions */
+		void removeForces(const glm::vec4* pos, const glm::vec4* acc, glm::vec4* out, size_t count);
+		void addForces(const glm::vec4* pos, glm::vec4* acc, size_t count);
+		void reserveScratch(size_t count);
+
+	protected:
+		std::vector<std::shared_ptr<ParticleForce>> m_forces;
+		glm::vec4* m_scratchPos{ nullptr };
+		glm::vec4* m_scratchVel{ nullptr };
+		glm::vec4* m_scratchAcc{ nullptr };
+		size_t m_scratchCount{ 0 };
 	};
 
 	// collision with the floor - note: not a proper collision model
@@ -37,10 +87,86 @@ namespace nhahn
 		float m_bounceFactor{ 0.5f };
 	};
 
-	class AttractorUpdater : public ParticleUpdater
+	// collision with static geometry given as a sampled signed distance field,
+	// the volume voxels hold (normalized gradient, distance) - see FieldVolume::bakeSignedDistance
+	class SdfCollisionUpdater : public ParticleUpdater
+	{
+	public:
+		virtual void update(double dt, ParticleData* p) override;
+
+	public:
+		std::shared_ptr<FieldVolume> m_volume;
+		float m_bounceFactor{ 0.5f };
+		float m_friction{ 0.1f };
+		float m_radius{ 0.0f };		// distance kept to the surface
+		bool m_enabled{ true };
+	};
+
+	// turbulence from curl noise baked into tiled volumes, one volume per octave.
+	// The volumes are cached in the data folder so the noise is only baked once
+	class CurlNoiseUpdater : public ParticleUpdater
+	{
+	public:
+		static const uint32_t MAX_OCTAVES = 4;
+		static const uint32_t VOLUME_DIM = 32;		// voxels per axis of a cached volume
+		static const int LATTICE_PERIOD = 4;		// noise cells per volume period
+
+		virtual void update(double dt, ParticleData* p) override;
+
+		/* loads the cached volumes or bakes the missing ones */
+		void setOctaves(uint32_t count);
+		uint32_t numOctaves() const { return (uint32_t)m_octaves.size(); }
+
+	public:
+		float m_strength{ 1.0f };
+		float m_frequency{ 2.0f };				// noise cells per world unit of the first octave
+		float m_persistence{ 0.5f };			// amplitude falloff per octave
+		glm::vec4 m_scrollSpeed{ 0.0f, 0.3f, 0.0f, 0.0f };	// in noise cells per second
+		uint32_t m_seed{ 1337 };
+		bool m_enabled{ true };
+
+	protected:
+		std::vector<std::shared_ptr<FieldVolume>> m_octaves;
+		glm::vec4 m_scroll{ 0.0f };
+	};
+
+	// drives particles with an externally simulated field sequence (see VolumeFileHeader),
+	// the file is memory mapped and the upcoming frames are prefetched on a background thread
+	class VectorFieldUpdater : public ParticleUpdater
+	{
+	public:
+		enum class FieldMode
+		{
+			VELOCITY,	// particles are pulled towards the field velocity
+			FORCE		// field is added as acceleration
+		};
+
+		bool load(const char* filepath);
+		bool isLoaded() const { return m_volume != nullptr; }
+		uint32_t currentFrame() const { return m_currentFrame; }
+
+		virtual void update(double dt, ParticleData* p) override;
+
+	public:
+		FieldMode m_mode{ FieldMode::FORCE };
+		float m_strength{ 1.0f };
+		float m_playbackSpeed{ 1.0f };
+		float m_defaultFrameRate{ 30.0f };	// used when the file does not specify one
+		bool m_loop{ true };
+		bool m_enabled{ true };
+
+	protected:
+		std::shared_ptr<FieldVolume> m_volume;
+		std::unique_ptr<FieldVolumePrefetcher> m_prefetcher;
+		double m_time{ 0.0 };
+		uint32_t m_currentFrame{ 0 };
+	};
+
+	class AttractorUpdater : public ParticleUpdater, public ParticleForce
 	{
 	public:
 		virtual void update(double dt, ParticleData* p) override;
+		virtual void accumulate(const glm::vec4* pos, glm::vec4* acc, size_t count) override;
 
 		size_t collectionSize() const { return m_attractors.size(); }
 		void add(const glm::vec4& attr) { m_attractors.push_back(attr); }
@@ -56,6 +182,77 @@ namespace nhahn
 		virtual void update(double dt, ParticleData* p) override;
 	};
 
+	struct ColorKey
+	{
+		float m_age;		// normalized age, 0 is birth and 1 is death
+		glm::vec4 m_color;
+	};
+
+	struct SizeKey
+	{
+		float m_age;
+		float m_size;		// scale of the default particle size
+	};
+
+	// color over life baked from gradient keys into a small table, indexed by the normalized age.
+	// Per particle variation blends towards a second gradient using a seed derived from the particle,
+	// so unlike BasicColorUpdater the start and end color streams are not needed
+	class ColorLutUpdater : public ParticleUpdater
+	{
+	public:
+		static const size_t LUT_SIZE = 64;
+
+		ColorLutUpdater() { rebuild(); }
+
+		virtual void update(double dt, ParticleData* p) override;
+
+		/* bakes the keys into the tables, needs to be called after changing them */
+		void rebuild();
+
+		/* LUT_SIZE + 1 entries each, for renderers evaluating the gradient in the shaders */
+		const glm::vec4* minTable() const { return m_minLut; }
+		const glm::vec4* maxTable() const { return m_maxLut; }
+
+		/* counts the rebuilds, renderers copying the tables compare it to skip unchanged ones */
+		uint32_t revision() const { return m_revision; }
+
+	public:
+		std::vector<ColorKey> m_minKeys;
+		std::vector<ColorKey> m_maxKeys;	// leave empty for no per particle variation
+
+	protected:
+		// one extra entry repeats the last one, so age 1.0 needs no bounds check
+		alignas(16) glm::vec4 m_minLut[LUT_SIZE + 1];	// read with _mm_load_ps
+		alignas(16) glm::vec4 m_maxLut[LUT_SIZE + 1];
+		uint32_t m_revision{ 0 };
+	};
+
+	// size over life, written to pos.w - see ColorLutUpdater
+	class SizeLutUpdater : public ParticleUpdater
+	{
+	public:
+		static const size_t LUT_SIZE = 64;
+
+		SizeLutUpdater() { rebuild(); }
+
+		virtual void update(double dt, ParticleData* p) override;
+
+		void rebuild();
+
+		const float* minTable() const { return m_minLut; }
+		const float* maxTable() const { return m_maxLut; }
+		uint32_t revision() const { return m_revision; }
+
+	public:
+		std::vector<SizeKey> m_minKeys;
+		std::vector<SizeKey> m_maxKeys;
+
+	protected:
+		float m_minLut[LUT_SIZE + 1];
+		float m_maxLut[LUT_SIZE + 1];
+		uint32_t m_revision{ 0 };
+	};
+
 	class PosColorUpdater : public ParticleUpdater
 	{
 	public:
@@ -0,0 +1,34 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#ifndef GLM_FORCE_INTRINSICS
+#define GLM_FORCE_INTRINSICS
+#endif // !GLM_FORCE_INTRINSICS
+#include <glm/glm.hpp>
+
+
+namespace nhahn
+{
+	/*
+	 * How the SceneView draws the particles of the next update and render. Handed to the effects
+	 * and renderers before the update, so nothing has to be read back from the gl state.
+	 */
+	struct ScenePass
+	{
+		glm::mat4 viewMat{ 1.0f };
+		glm::mat4 projMat{ 1.0f };
+		glm::ivec2 viewportSize{ 0 };	// pixels of the target
+		int texUnit{ 0 };				// unit of the particle texture
+		bool weightedOit{ false };		// into the WeightedOit targets, which blend per target and need no order
+		bool overdraw{ false };			// counts the fragments for the OverdrawCounter
+
+		/* the pass sets up its own blending, which renderers have to keep. Otherwise it blends additively */
+		bool ownsBlending() const { return weightedOit || overdraw; }
+	};
+}
\ No newline at end of file
@@ -7,76 +7,860 @@
 \*------------------------------------------------------------------------------------------------*/
 #include "Solver.h"
 #include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include "utility/Debug.h"
+#include "utility/JobSystem.h"
+
+#define RESTRICT __restrict
 
 namespace nhahn
 {
+    // objects per job, small enough to balance, large enough to hide the scheduling
+    static constexpr size_t OBJECTS_CHUNK = 2048;
+
+    // links per job, a link touches two objects at random so the chunks are smaller
+    static constexpr size_t LINKS_CHUNK = 1024;
+
+    // the colors of an object are tracked in a 64 bit mask while batching
+    static constexpr uint32_t MAX_LINK_COLORS = 64;
+    static_assert(2 * (Solver::MAX_OBJECT_LINKS - 1) < MAX_LINK_COLORS, "Solver: a link may find no free color");
+
+    // multiple of the sleep velocity an object needs to wake the sleeping objects it hits
+    static constexpr float WAKE_FACTOR = 4.0f;
+
+    // pushes two overlapping circles apart, objects on the exact same spot have no direction to separate
+    static inline void resolveContact(float& x_1, float& y_1, float radius_1, float& x_2, float& y_2, float radius_2)
+    {
+        const float vx = x_1 - x_2;
+        const float vy = y_1 - y_2;
+        const float dist2 = vx * vx + vy * vy;
+        const float min_dist = radius_1 + radius_2;
+
+        if (dist2 < min_dist * min_dist && dist2 > 0.0f) {
+            const float dist = sqrt(dist2);
+            const float mass_ratio_1 = radius_1 / min_dist;
+            const float mass_ratio_2 = radius_2 / min_dist;
+            const float delta = 0.5f * Solver::RESPONSE_COEF * (dist - min_dist) / dist;
+
+            x_1 -= vx * (mass_ratio_2 * delta);
+            y_1 -= vy * (mass_ratio_2 * delta);
+            x_2 += vx * (mass_ratio_1 * delta);
+            y_2 += vy * (mass_ratio_1 * delta);
+        }
+    }
+
+    template <typename Func>
+    void Solver::forEachObjectRange(Func&& func)
+    {
+        if (_multithreaded)
+            JobSystem::instance().parallelFor(_pos_x.size(), OBJECTS_CHUNK, func);
+        else
+            func(0, _pos_x.size());
+    }
+
+    VerletObject Solver::addObject(glm::vec2 position, float radius)
+    {
+        _pos_x.push_back(position.x);
+        _pos_y.push_back(position.y);
+        _last_x.push_back(position.x);
+        _last_y.push_back(position.y);
+        _accel_x.push_back(0.0f);
+        _accel_y.push_back(0.0f);
+        _radius.push_back(radius);
+        _color.push_back(glm::u8vec4(255));
+        _rest_time.push_back(0.0f);
+        _rest_x.push_back(position.x);
+        _rest_y.push_back(position.y);
+        _link_count.push_back(0);
+        return { *this, static_cast<uint32_t>(_pos_x.size() - 1) };
+    }
+
+    uint32_t Solver::addLink(VerletObject object_1, VerletObject object_2, float stiffness)
+    {
+        const uint32_t id_1 = object_1.getIndex();
+        const uint32_t id_2 = object_2.getIndex();
+        ASSERT(id_1 != id_2 && id_1 < _pos_x.size() && id_2 < _pos_x.size(), "Solver: invalid link %u - %u\n", id_1, id_2);
+        if (_link_count[id_1] >= MAX_OBJECT_LINKS || _link_count[id_2] >= MAX_OBJECT_LINKS) {
+            DBG("Solver", DebugLevel::WARNING, "link %u - %u rejected, objects may have at most %u links\n", id_1, id_2, MAX_OBJECT_LINKS);
+            return INVALID_LINK;
+        }
+        _link_count[id_1]++;
+        _link_count[id_2]++;
+
+        const float dx = _pos_x[id_2] - _pos_x[id_1];
+        const float dy = _pos_y[id_2] - _pos_y[id_1];
+        _links.push_back({ id_1, id_2, sqrt(dx * dx + dy * dy), std::clamp(stiffness, 0.0f, 1.0f) });
+        _links_dirty = true;
+        return static_cast<uint32_t>(_links.size() - 1);
+    }
+
+    void Solver::setPinned(VerletObject object, bool pinned)
+    {
+        const uint32_t id = object.getIndex();
+        auto it = std::find_if(_pins.begin(), _pins.end(), [id](const Pin& pin) { return pin.id == id; });
+        if (pinned && it == _pins.end())
+            _pins.push_back({ id, object.getPosition() });
+        else if (!pinned && it != _pins.end())
+            _pins.erase(it);
+
+        // the link weights depend on which ends are pinned
+        _links_dirty = true;
+    }
+
     void Solver::update(double dt)
     {
+        if (_links_dirty)
+            rebuildLinkBatches();
+
         _time += dt;
-        const float step_dt = getStepDt();
+        const float step_dt = static_cast<float>(getStepDt());
         for (uint32_t i{ _sub_steps }; i--;) {
             applyGravity();
             checkCollisions(step_dt);
+            solveLinks();
             applyConstraint();
             updateObjects(step_dt);
+            applyPins();
         }
     }
 
     void Solver::applyGravity()
     {
-        std::for_each(_objects.begin(), _objects.end(), [this](auto& obj) {
-            obj.accelerate(_gravity);
+        forEachObjectRange([this](size_t begin, size_t end) {
+            float* RESTRICT accel_x = _accel_x.data();
+            float* RESTRICT accel_y = _accel_y.data();
+            const __m256 gx = _mm256_set1_ps(_gravity.x);
+            const __m256 gy = _mm256_set1_ps(_gravity.y);
+
+            size_t i{ begin };
+            for (; i + 8 <= end; i += 8) {
+                _mm256_storeu_ps(accel_x + i, _mm256_add_ps(_mm256_loadu_ps(accel_x + i), gx));
+                _mm256_storeu_ps(accel_y + i, _mm256_add_ps(_mm256_loadu_ps(accel_y + i), gy));
+            }
+            for (; i < end; ++i) {
+                accel_x[i] += _gravity.x;
+                accel_y[i] += _gravity.y;
+            }
         });
     }
 
     void Solver::checkCollisions(float dt)
     {
-        const float    response_coef = 0.75f;
-        const uint64_t objects_count = _objects.size();
-
-        // Iterate on all objects
-        for (uint64_t i{ 0 }; i < objects_count; ++i) {
-            VerletObject& object_1 = _objects[i];
-
-            // Iterate on object involved in new collision pairs
-            for (uint64_t k{ i + 1 }; k < objects_count; ++k) {
-                VerletObject& object_2 = _objects[k];
-                const glm::vec2 v = object_1.pos - object_2.pos;
-                const float        dist2 = v.x * v.x + v.y * v.y;
-                const float        min_dist = object_1.radius + object_2.radius;
-
-                // Check overlapping
-                if (dist2 < min_dist * min_dist) {
-                    const float        dist = sqrt(dist2);
-                    const glm::vec2 n = v / dist;
-                    const float mass_ratio_1 = object_1.radius / (object_1.radius + object_2.radius);
-                    const float mass_ratio_2 = object_2.radius / (object_1.radius + object_2.radius);
-                    const float delta = 0.5f * response_coef * (dist - min_dist);
-
-                    // Update positions
-                    object_1.pos -= n * (mass_ratio_2 * delta);
-                    object_2.pos += n * (mass_ratio_1 * delta);
+        if (_broadphase == Broadphase::BRUTE_FORCE) {
+            const uint32_t objects_count = static_cast<uint32_t>(_pos_x.size());
+
+            // Iterate on all objects
+            for (uint32_t i{ 0 }; i < objects_count; ++i) {
+                // Iterate on object involved in new collision pairs
+                for (uint32_t k{ i + 1 }; k < objects_count; ++k)
+                    solveContact(i, k);
+            }
+            _sleeping_count = 0;
+            return;
+        }
+
+        rebuildGrid();
+        updateActiveCells();
+
+        // per step displacement above which an object wakes the sleeping objects it touches
+        const float wake_step = WAKE_FACTOR * _sleep_velocity * dt;
+        _wake_step2 = wake_step * wake_step;
+
+        if (_multithreaded) {
+            checkCollisionsParallel();
+            return;
+        }
+
+        NarrowPhaseScratch scratch;
+        solveGridColumns(0, _grid_width, scratch);
+    }
+
+    void Solver::checkCollisionsParallel()
+    {
+        // Pairs of a stripe reach one column into the stripes left and right of it. With stripes of
+        // at least two columns, stripes of the same parity never share an object and can run at once
+        JobSystem& jobs = JobSystem::instance();
+        const uint32_t stripes_wanted = std::max(2u, jobs.activeThreads() * 4);
+        const uint32_t stripe_width = std::max(2u, (_grid_width + stripes_wanted - 1) / stripes_wanted);
+        const uint32_t stripes_count = (_grid_width + stripe_width - 1) / stripe_width;
+
+        for (uint32_t parity{ 0 }; parity < 2; ++parity) {
+            const uint32_t phase_stripes = (stripes_count + 1 - parity) / 2;
+            jobs.parallelFor(phase_stripes, 1, [this, parity, stripe_width](size_t begin, size_t end) {
+                NarrowPhaseScratch scratch;
+                for (size_t s{ begin }; s < end; ++s) {
+                    const uint32_t x_begin = (2 * static_cast<uint32_t>(s) + parity) * stripe_width;
+                    solveGridColumns(x_begin, x_begin + stripe_width, scratch);
+                }
+            });
+        }
+    }
+
+    void Solver::solveContact(uint32_t i, uint32_t k)
+    {
+        resolveContact(_pos_x[i], _pos_y[i], _radius[i], _pos_x[k], _pos_y[k], _radius[k]);
+    }
+
+    // pushes the first circle out of a second one that does not move
+    static inline void resolveStaticContact(float& x_1, float& y_1, float radius_1, float x_2, float y_2, float radius_2)
+    {
+        const float vx = x_1 - x_2;
+        const float vy = y_1 - y_2;
+        const float dist2 = vx * vx + vy * vy;
+        const float min_dist = radius_1 + radius_2;
+
+        if (dist2 < min_dist * min_dist && dist2 > 0.0f) {
+            const float dist = sqrt(dist2);
+            const float delta = 0.5f * Solver::RESPONSE_COEF * (dist - min_dist) / dist;
+            x_1 -= vx * delta;
+            y_1 -= vy * delta;
+        }
+    }
+
+    // tests object a of the row against the candidates [begin, end) of the same or the next row, eight per test.
+    // resolve(c) is called for every overlapping candidate
+    template <typename Resolve>
+    static inline void solveCandidates(const float* ax, const float* ay, float ar, const float* px, const float* py, const float* pr,
+                                       uint32_t begin, uint32_t end, Resolve&& resolve)
+    {
+        for (uint32_t b{ begin }; b < end; b += 8) {
+            const uint32_t valid = (end - b >= 8) ? 0xffu : (1u << (end - b)) - 1u;
+            const __m256 min_dist = _mm256_add_ps(_mm256_set1_ps(ar), _mm256_loadu_ps(pr + b));
+            const __m256 min_dist2 = _mm256_mul_ps(min_dist, min_dist);
+            const __m256 bx = _mm256_loadu_ps(px + b);
+            const __m256 by = _mm256_loadu_ps(py + b);
+
+            uint32_t lane{ 0 };
+            while (lane < 8) {
+                const __m256 vx = _mm256_sub_ps(_mm256_set1_ps(*ax), bx);
+                const __m256 vy = _mm256_sub_ps(_mm256_set1_ps(*ay), by);
+                const __m256 dist2 = _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy));
+                const __m256 overlap = _mm256_and_ps(
+                    _mm256_cmp_ps(dist2, min_dist2, _CMP_LT_OQ),
+                    _mm256_cmp_ps(dist2, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+                // lanes before the last resolved one are done already
+                const uint32_t hits = static_cast<uint32_t>(_mm256_movemask_ps(overlap)) & valid & (0xffu << lane);
+                if (hits == 0)
+                    break;
+
+                // resolving moves a, the remaining lanes are tested again with its new position
+                while ((hits & (1u << lane)) == 0)
+                    ++lane;
+                resolve(b + lane);
+                ++lane;
+            }
+        }
+    }
+
+    void Solver::gatherGridRow(uint32_t y, uint32_t x_begin, uint32_t x_end, GridRowScratch& row) const
+    {
+        row.x.clear();
+        row.y.clear();
+        row.radius.clear();
+        row.id.clear();
+        row.cell_start.clear();
+        row.asleep.clear();
+        row.speed2.clear();
+
+        for (uint32_t x{ x_begin }; x < x_end; ++x) {
+            const uint32_t cell = y * _grid_width + x;
+            row.cell_start.push_back(static_cast<uint32_t>(row.id.size()));
+            for (uint32_t a{ _cell_start[cell] }; a < _cell_start[cell + 1]; ++a) {
+                const uint32_t id = _cell_objects[a];
+                row.x.push_back(_pos_x[id]);
+                row.y.push_back(_pos_y[id]);
+                row.radius.push_back(_radius[id]);
+                row.id.push_back(id);
+                if (_sleeping) {
+                    const float dx = _pos_x[id] - _last_x[id];
+                    const float dy = _pos_y[id] - _last_y[id];
+                    row.asleep.push_back(_rest_time[id] >= SLEEP_DELAY);
+                    row.speed2.push_back(dx * dx + dy * dy);
+                }
+            }
+        }
+        row.cell_start.push_back(static_cast<uint32_t>(row.id.size()));
+
+        // the last test of a range may load up to seven entries past the end
+        const size_t count = row.id.size();
+        row.x.resize(count + 8, 0.0f);
+        row.y.resize(count + 8, 0.0f);
+        row.radius.resize(count + 8, 0.0f);
+    }
+
+    void Solver::solveSleepingContact(GridRowScratch& row_1, uint32_t a, GridRowScratch& row_2, uint32_t c)
+    {
+        uint8_t& asleep_1 = row_1.asleep[a];
+        uint8_t& asleep_2 = row_2.asleep[c];
+        if (asleep_1 && asleep_2)
+            return;
+
+        // fast objects wake the sleeping ones they hit, slow ones rest on them like on static objects
+        if (asleep_2 && row_1.speed2[a] > _wake_step2) {
+            asleep_2 = 0;
+            _rest_time[row_2.id[c]] = 0.0f;
+        }
+        if (asleep_1 && row_2.speed2[c] > _wake_step2) {
+            asleep_1 = 0;
+            _rest_time[row_1.id[a]] = 0.0f;
+        }
+
+        if (asleep_2)
+            resolveStaticContact(row_1.x[a], row_1.y[a], row_1.radius[a], row_2.x[c], row_2.y[c], row_2.radius[c]);
+        else if (asleep_1)
+            resolveStaticContact(row_2.x[c], row_2.y[c], row_2.radius[c], row_1.x[a], row_1.y[a], row_1.radius[a]);
+        else
+            resolveContact(row_1.x[a], row_1.y[a], row_1.radius[a], row_2.x[c], row_2.y[c], row_2.radius[c]);
+    }
+
+    void Solver::scatterGridRow(const GridRowScratch& row)
+    {
+        for (size_t a{ 0 }; a < row.id.size(); ++a) {
+            _pos_x[row.id[a]] = row.x[a];
+            _pos_y[row.id[a]] = row.y[a];
+        }
+    }
+
+    void Solver::solveGridColumns(uint32_t x_begin, uint32_t x_end, NarrowPhaseScratch& scratch)
+    {
+        x_end = std::min(x_end, _grid_width);
+        if (x_begin >= x_end || _grid_height == 0)
+            return;
+
+        // the neighbourhood reaches one column past the stripe on both sides. Cells are ordered by x within a
+        // row, so the forward neighbours { 1, 0 } and { -1..1, 1 } are two contiguous ranges of the gathered rows
+        const uint32_t gather_begin = (x_begin > 0) ? x_begin - 1 : 0;
+        const uint32_t gather_end = std::min(x_end + 1, _grid_width);
+
+        // rows without active cells are skipped, a gathered row stays dirty until it is scattered
+        bool row_gathered = false;
+        for (uint32_t y{ 0 }; y < _grid_height; ++y) {
+            const uint8_t* active = &_cell_active[y * _grid_width];
+            if (std::find(active + x_begin, active + x_end, 1) == active + x_end) {
+                if (row_gathered)
+                    scatterGridRow(scratch.row);
+                row_gathered = false;
+                continue;
+            }
+
+            if (!row_gathered)
+                gatherGridRow(y, gather_begin, gather_end, scratch.row);
+
+            GridRowScratch& row = scratch.row;
+            GridRowScratch& next = scratch.next_row;
+            const bool has_next = y + 1 < _grid_height;
+            if (has_next)
+                gatherGridRow(y + 1, gather_begin, gather_end, next);
+
+            for (uint32_t x{ x_begin }; x < x_end; ++x) {
+                if (!active[x])
+                    continue;
+
+                const uint32_t column = x - gather_begin;
+                const uint32_t begin = row.cell_start[column];
+                const uint32_t end = row.cell_start[column + 1];
+                const uint32_t right_end = row.cell_start[std::min(column + 2, gather_end - gather_begin)];
+                const uint32_t below_begin = has_next ? next.cell_start[(column > 0) ? column - 1 : 0] : 0;
+                const uint32_t below_end = has_next ? next.cell_start[std::min(column + 2, gather_end - gather_begin)] : 0;
+
+                for (uint32_t a{ begin }; a < end; ++a) {
+                    auto resolve_row = [&](uint32_t c) {
+                        if (_sleeping)
+                            solveSleepingContact(row, a, row, c);
+                        else
+                            resolveContact(row.x[a], row.y[a], row.radius[a], row.x[c], row.y[c], row.radius[c]);
+                    };
+                    auto resolve_next = [&](uint32_t c) {
+                        if (_sleeping)
+                            solveSleepingContact(row, a, next, c);
+                        else
+                            resolveContact(row.x[a], row.y[a], row.radius[a], next.x[c], next.y[c], next.radius[c]);
+                    };
+
+                    // rest of the cell and the cell to the right
+                    solveCandidates(&row.x[a], &row.y[a], row.radius[a], row.x.data(), row.y.data(), row.radius.data(), a + 1, right_end, resolve_row);
+                    // the three cells below
+                    if (has_next)
+                        solveCandidates(&row.x[a], &row.y[a], row.radius[a], next.x.data(), next.y.data(), next.radius.data(), below_begin, below_end, resolve_next);
+                }
+            }
+
+            // the row is done, the next one keeps the positions it got so far
+            scatterGridRow(row);
+            std::swap(scratch.row, scratch.next_row);
+            row_gathered = has_next;
+        }
+        if (row_gathered)
+            scatterGridRow(scratch.row);
+    }
+
+    void Solver::rebuildGrid()
+    {
+        float max_radius = 0.0f;
+        for (const float radius : _radius)
+            max_radius = std::max(max_radius, radius);
+
+        // the grid covers the constraint, objects outside of it are clamped into the border cells
+        const float extent = 2.0f * _constraint_radius;
+        _grid_cell_size = std::max(2.0f * max_radius, extent / static_cast<float>(MAX_GRID_DIM));
+        _grid_origin = _constraint_center - glm::vec2(_constraint_radius);
+        // enough cells to cover the extent, rounding can push the count one past the limit
+        _grid_width = std::clamp(static_cast<uint32_t>(std::ceil(extent / _grid_cell_size)), 1u, MAX_GRID_DIM);
+        _grid_height = _grid_width;
+
+        const uint32_t cells_count = _grid_width * _grid_height;
+        const uint32_t objects_count = static_cast<uint32_t>(_pos_x.size());
+        const float inv_cell_size = 1.0f / _grid_cell_size;
+
+        // counting sort: histogram, prefix sum, scatter
+        _cell_start.assign(cells_count + 1, 0);
+        _object_cell.resize(objects_count);
+        _cell_objects.resize(objects_count);
+
+        for (uint32_t i{ 0 }; i < objects_count; ++i) {
+            const glm::vec2 p = (glm::vec2(_pos_x[i], _pos_y[i]) - _grid_origin) * inv_cell_size;
+            const uint32_t x = static_cast<uint32_t>(std::clamp(static_cast<int32_t>(p.x), 0, static_cast<int32_t>(_grid_width) - 1));
+            const uint32_t y = static_cast<uint32_t>(std::clamp(static_cast<int32_t>(p.y), 0, static_cast<int32_t>(_grid_height) - 1));
+            _object_cell[i] = y * _grid_width + x;
+            ++_cell_start[_object_cell[i] + 1];
+        }
+
+        for (uint32_t c{ 0 }; c < cells_count; ++c)
+            _cell_start[c + 1] += _cell_start[c];
+
+        // scatter walks backwards so every cell keeps the object order
+        for (uint32_t i{ objects_count }; i--;) {
+            const uint32_t cell = _object_cell[i];
+            _cell_objects[--_cell_start[cell + 1]] = i;
+        }
+        // the scatter moved the end of every cell back to its begin, shift them into place
+        for (uint32_t c{ 0 }; c < cells_count; ++c)
+            _cell_start[c] = _cell_start[c + 1];
+        _cell_start[cells_count] = objects_count;
+    }
+
+    void Solver::updateActiveCells()
+    {
+        const uint32_t cells_count = _grid_width * _grid_height;
+        _cell_active.assign(cells_count, 1);
+        _active_cells_count = cells_count;
+        if (!_sleeping) {
+            _sleeping_count = 0;
+            return;
+        }
+
+        _cell_awake.assign(cells_count, 0);
+        uint32_t sleeping_count = 0;
+        for (uint32_t i{ 0 }; i < static_cast<uint32_t>(_pos_x.size()); ++i) {
+            if (_rest_time[i] < SLEEP_DELAY)
+                _cell_awake[_object_cell[i]] = 1;
+            else
+                ++sleeping_count;
+        }
+        _sleeping_count = sleeping_count;
+
+        // an awake object can push into the neighbouring cells, so those have to be solved as well
+        _active_cells_count = 0;
+        for (uint32_t y{ 0 }; y < _grid_height; ++y) {
+            const uint32_t y_begin = (y > 0) ? y - 1 : 0;
+            const uint32_t y_end = std::min(y + 2, _grid_height);
+            for (uint32_t x{ 0 }; x < _grid_width; ++x) {
+                const uint32_t x_begin = (x > 0) ? x - 1 : 0;
+                const uint32_t x_end = std::min(x + 2, _grid_width);
+                uint8_t active = 0;
+                for (uint32_t ny{ y_begin }; ny < y_end && !active; ++ny)
+                    for (uint32_t nx{ x_begin }; nx < x_end; ++nx)
+                        active |= _cell_awake[ny * _grid_width + nx];
+
+                _cell_active[y * _grid_width + x] = active;
+                _active_cells_count += active;
+            }
+        }
+    }
+
+    void Solver::collectOverlaps(std::vector<ObjectPair>& pairs, bool use_grid)
+    {
+        pairs.clear();
+        auto test = [this, &pairs](uint32_t i, uint32_t k) {
+            const glm::vec2 v = glm::vec2(_pos_x[i] - _pos_x[k], _pos_y[i] - _pos_y[k]);
+            const float min_dist = _radius[i] + _radius[k];
+            if (v.x * v.x + v.y * v.y < min_dist * min_dist)
+                pairs.emplace_back(std::min(i, k), std::max(i, k));
+        };
+
+        if (use_grid) {
+            rebuildGrid();
+            forEachGridPair(test);
+        }
+        else {
+            const uint32_t objects_count = static_cast<uint32_t>(_pos_x.size());
+            for (uint32_t i{ 0 }; i < objects_count; ++i)
+                for (uint32_t k{ i + 1 }; k < objects_count; ++k)
+                    test(i, k);
+        }
+
+        std::sort(pairs.begin(), pairs.end());
+    }
+
+    bool Solver::validateBroadphase()
+    {
+        std::vector<ObjectPair> grid_pairs;
+        std::vector<ObjectPair> brute_pairs;
+        collectOverlaps(grid_pairs, true);
+        collectOverlaps(brute_pairs, false);
+
+        if (grid_pairs != brute_pairs) {
+            DBG("Solver", DebugLevel::WARNING, "broadphase mismatch: grid found %d overlapping pairs, brute force %d\n",
+                (int)grid_pairs.size(), (int)brute_pairs.size());
+            return false;
+        }
+        return true;
+    }
+
+    bool Solver::validateNarrowPhase(float tolerance)
+    {
+        const std::vector<float> start_x = _pos_x;
+        const std::vector<float> start_y = _pos_y;
+        const bool sleeping = _sleeping;
+        const uint32_t sleeping_count = _sleeping_count;
+        const uint32_t active_cells_count = _active_cells_count;
+        _sleeping = false;
+
+        // one collision pass through the gathered rows and the SIMD candidate tests
+        rebuildGrid();
+        updateActiveCells();
+        NarrowPhaseScratch scratch;
+        solveGridColumns(0, _grid_width, scratch);
+        const std::vector<float> grid_x = _pos_x;
+        const std::vector<float> grid_y = _pos_y;
+
+        // the brute force contact solve over the same pairs. Each contact moves the objects the next one sees,
+        // so the pairs are replayed in the order of the narrow phase: the rest of the cell and the cell to the
+        // right, then the three cells below. Which pairs the grid finds is checked by validateBroadphase
+        _pos_x = start_x;
+        _pos_y = start_y;
+        for (uint32_t y{ 0 }; y < _grid_height; ++y) {
+            const uint32_t row = y * _grid_width;
+            const uint32_t next_row = row + _grid_width;
+            for (uint32_t x{ 0 }; x < _grid_width; ++x) {
+                const uint32_t right_end = _cell_start[row + std::min(x + 2, _grid_width)];
+                for (uint32_t a{ _cell_start[row + x] }; a < _cell_start[row + x + 1]; ++a) {
+                    for (uint32_t c{ a + 1 }; c < right_end; ++c)
+                        solveContact(_cell_objects[a], _cell_objects[c]);
+                    if (y + 1 == _grid_height)
+                        continue;
+                    const uint32_t below_begin = _cell_start[next_row + ((x > 0) ? x - 1 : 0)];
+                    const uint32_t below_end = _cell_start[next_row + std::min(x + 2, _grid_width)];
+                    for (uint32_t c{ below_begin }; c < below_end; ++c)
+                        solveContact(_cell_objects[a], _cell_objects[c]);
                 }
             }
         }
+
+        // the deviation is measured in radii of the object that moved
+        float max_error = 0.0f;
+        uint32_t worst = 0;
+        for (uint32_t i{ 0 }; i < static_cast<uint32_t>(_pos_x.size()); ++i) {
+            const float dx = grid_x[i] - _pos_x[i];
+            const float dy = grid_y[i] - _pos_y[i];
+            const float error = sqrtf(dx * dx + dy * dy) / _radius[i];
+            if (error > max_error) {
+                max_error = error;
+                worst = i;
+            }
+        }
+
+        _pos_x = start_x;
+        _pos_y = start_y;
+        _sleeping = sleeping;
+        _sleeping_count = sleeping_count;
+        _active_cells_count = active_cells_count;
+
+        if (max_error > tolerance) {
+            DBG("Solver", DebugLevel::WARNING, "narrow phase mismatch: object %d is %.4f radii off the brute force position\n",
+                (int)worst, max_error);
+            return false;
+        }
+        return true;
     }
 
     void Solver::applyConstraint()
     {
-        for (auto& obj : _objects) {
-            const glm::vec2 v = _constraint_center - obj.pos;
-            const float        dist = sqrt(v.x * v.x + v.y * v.y);
-            if (dist > (_constraint_radius - obj.radius)) {
-                const glm::vec2 n = v / dist;
-                obj.pos = _constraint_center - n * (_constraint_radius - obj.radius);
+        forEachObjectRange([this](size_t begin, size_t end) {
+            float* RESTRICT pos_x = _pos_x.data();
+            float* RESTRICT pos_y = _pos_y.data();
+            const float* RESTRICT radius = _radius.data();
+            const __m256 cx = _mm256_set1_ps(_constraint_center.x);
+            const __m256 cy = _mm256_set1_ps(_constraint_center.y);
+            const __m256 cr = _mm256_set1_ps(_constraint_radius);
+
+            size_t i{ begin };
+            for (; i + 8 <= end; i += 8) {
+                const __m256 px = _mm256_loadu_ps(pos_x + i);
+                const __m256 py = _mm256_loadu_ps(pos_y + i);
+                const __m256 vx = _mm256_sub_ps(cx, px);
+                const __m256 vy = _mm256_sub_ps(cy, py);
+                const __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)));
+                const __m256 max_dist = _mm256_sub_ps(cr, _mm256_loadu_ps(radius + i));
+                const __m256 outside = _mm256_cmp_ps(dist, max_dist, _CMP_GT_OQ);
+                if (_mm256_movemask_ps(outside) == 0)
+                    continue;
+
+                // pos = center - n * max_dist, lanes inside keep their position
+                const __m256 scale = _mm256_div_ps(max_dist, dist);
+                _mm256_storeu_ps(pos_x + i, _mm256_blendv_ps(px, _mm256_sub_ps(cx, _mm256_mul_ps(vx, scale)), outside));
+                _mm256_storeu_ps(pos_y + i, _mm256_blendv_ps(py, _mm256_sub_ps(cy, _mm256_mul_ps(vy, scale)), outside));
+            }
+            for (; i < end; ++i) {
+                const float vx = _constraint_center.x - pos_x[i];
+                const float vy = _constraint_center.y - pos_y[i];
+                const float dist = sqrt(vx * vx + vy * vy);
+                const float max_dist = _constraint_radius - radius[i];
+                if (dist > max_dist) {
+                    pos_x[i] = _constraint_center.x - vx / dist * max_dist;
+                    pos_y[i] = _constraint_center.y - vy / dist * max_dist;
+                }
             }
+        });
+    }
+
+    void Solver::rebuildLinkBatches()
+    {
+        _links_dirty = false;
+
+        std::vector<uint8_t> pinned(_pos_x.size(), 0);
+        for (const Pin& pin : _pins)
+            pinned[pin.id] = 1;
+
+        // greedy coloring: every link takes the lowest color neither of its objects has yet. addLink keeps
+        // the links per object low enough that one is always free, a link without one is left out
+        std::vector<uint64_t> object_colors(_pos_x.size(), 0);
+        std::vector<uint32_t> link_color(_links.size());
+        std::vector<uint32_t> color_count(MAX_LINK_COLORS + 1, 0);
+        uint32_t colors_count = 0;
+        for (size_t l{ 0 }; l < _links.size(); ++l) {
+            const LinkDesc& link = _links[l];
+            const uint64_t used = object_colors[link.object_1] | object_colors[link.object_2];
+            if (used == ~0ull) {
+                DBG("Solver", DebugLevel::WARNING, "link %u - %u left out, no free link color\n", link.object_1, link.object_2);
+                link_color[l] = MAX_LINK_COLORS;
+                continue;
+            }
+
+            uint32_t color{ 0 };
+            while (used & (1ull << color))
+                ++color;
+
+            object_colors[link.object_1] |= 1ull << color;
+            object_colors[link.object_2] |= 1ull << color;
+            link_color[l] = color;
+            color_count[color + 1]++;
+            colors_count = std::max(colors_count, color + 1);
+        }
+
+        // counting sort by color
+        _link_batch_start.assign(color_count.begin(), color_count.begin() + colors_count + 1);
+        for (uint32_t c{ 0 }; c < colors_count; ++c)
+            _link_batch_start[c + 1] += _link_batch_start[c];
+
+        std::vector<uint32_t> insert(_link_batch_start.begin(), _link_batch_start.end() - 1);
+        _link_batches.resize(_link_batch_start.back());
+        for (size_t l{ 0 }; l < _links.size(); ++l) {
+            if (link_color[l] == MAX_LINK_COLORS)
+                continue;
+
+            const LinkDesc& link = _links[l];
+            const float inv_mass_1 = pinned[link.object_1] ? 0.0f : 1.0f;
+            const float inv_mass_2 = pinned[link.object_2] ? 0.0f : 1.0f;
+            const float inv_mass_sum = inv_mass_1 + inv_mass_2;
+            const float share = (inv_mass_sum > 0.0f) ? link.stiffness / inv_mass_sum : 0.0f;
+            _link_batches[insert[link_color[l]]++] = { link.object_1, link.object_2, link.length, inv_mass_1 * share, inv_mass_2 * share };
+        }
+
+        for (uint32_t c{ 0 }; c < colors_count; ++c) {
+            std::sort(_link_batches.begin() + _link_batch_start[c], _link_batches.begin() + _link_batch_start[c + 1],
+                      [](const Link& a, const Link& b) { return a.object_1 < b.object_1; });
+        }
+    }
+
+    // moves both ends of the links [begin, end) towards their rest length, no two of the links may share an object
+    void Solver::solveLinkRange(const Link* RESTRICT links, size_t begin, size_t end, float* pos_x, float* pos_y, float* rest_time)
+    {
+        for (size_t l{ begin }; l < end; ++l) {
+            const Link& link = links[l];
+            const float dx = pos_x[link.object_2] - pos_x[link.object_1];
+            const float dy = pos_y[link.object_2] - pos_y[link.object_1];
+            const float dist = sqrt(dx * dx + dy * dy);
+            if (dist == 0.0f)
+                continue;
+
+            const float delta = (dist - link.length) / dist;
+            pos_x[link.object_1] += dx * delta * link.weight_1;
+            pos_y[link.object_1] += dy * delta * link.weight_1;
+            pos_x[link.object_2] -= dx * delta * link.weight_2;
+            pos_y[link.object_2] -= dy * delta * link.weight_2;
+
+            // linked objects are kept awake, the rest time only counts for objects at rest on their own
+            if (rest_time) {
+                rest_time[link.object_1] = 0.0f;
+                rest_time[link.object_2] = 0.0f;
+            }
+        }
+    }
+
+    void Solver::solveLinks()
+    {
+        float* rest_time = _sleeping ? _rest_time.data() : nullptr;
+        for (uint32_t iteration{ 0 }; iteration < _link_iterations; ++iteration) {
+            for (size_t c{ 0 }; c + 1 < _link_batch_start.size(); ++c) {
+                const size_t begin = _link_batch_start[c];
+                const size_t count = _link_batch_start[c + 1] - begin;
+                const Link* links = _link_batches.data() + begin;
+
+                if (_multithreaded && count > LINKS_CHUNK) {
+                    JobSystem::instance().parallelFor(count, LINKS_CHUNK, [this, links, rest_time](size_t b, size_t e) {
+                        solveLinkRange(links, b, e, _pos_x.data(), _pos_y.data(), rest_time);
+                    });
+                }
+                else {
+                    solveLinkRange(links, 0, count, _pos_x.data(), _pos_y.data(), rest_time);
+                }
+            }
+        }
+    }
+
+    void Solver::applyPins()
+    {
+        for (const Pin& pin : _pins) {
+            _pos_x[pin.id] = _last_x[pin.id] = pin.position.x;
+            _pos_y[pin.id] = _last_y[pin.id] = pin.position.y;
         }
     }
 
     void Solver::updateObjects(float dt)
     {
-        std::for_each(_objects.begin(), _objects.end(), [dt](auto& obj) {
-            obj.update(dt);
+        // the brute force broadphase has no cells to track activity, it keeps everything awake
+        if (_sleeping && _broadphase == Broadphase::UNIFORM_GRID) {
+            updateObjectsSleeping(dt);
+            return;
+        }
+        forEachObjectRange([this, dt](size_t begin, size_t end) {
+            float* RESTRICT pos_x = _pos_x.data();
+            float* RESTRICT pos_y = _pos_y.data();
+            float* RESTRICT last_x = _last_x.data();
+            float* RESTRICT last_y = _last_y.data();
+            float* RESTRICT accel_x = _accel_x.data();
+            float* RESTRICT accel_y = _accel_y.data();
+            const float dt2 = dt * dt;
+            const __m256 dt2_8 = _mm256_set1_ps(dt2);
+            const __m256 zero = _mm256_setzero_ps();
+
+            // pos += (pos - pos_last) + accel * dt^2, then the acceleration is reset
+            size_t i{ begin };
+            for (; i + 8 <= end; i += 8) {
+                const __m256 px = _mm256_loadu_ps(pos_x + i);
+                const __m256 py = _mm256_loadu_ps(pos_y + i);
+                const __m256 dx = _mm256_sub_ps(px, _mm256_loadu_ps(last_x + i));
+                const __m256 dy = _mm256_sub_ps(py, _mm256_loadu_ps(last_y + i));
+                _mm256_storeu_ps(last_x + i, px);
+                _mm256_storeu_ps(last_y + i, py);
+                _mm256_storeu_ps(pos_x + i, _mm256_add_ps(_mm256_add_ps(px, dx), _mm256_mul_ps(_mm256_loadu_ps(accel_x + i), dt2_8)));
+                _mm256_storeu_ps(pos_y + i, _mm256_add_ps(_mm256_add_ps(py, dy), _mm256_mul_ps(_mm256_loadu_ps(accel_y + i), dt2_8)));
+                _mm256_storeu_ps(accel_x + i, zero);
+                _mm256_storeu_ps(accel_y + i, zero);
+            }
+            for (; i < end; ++i) {
+                const float dx = pos_x[i] - last_x[i];
+                const float dy = pos_y[i] - last_y[i];
+                last_x[i] = pos_x[i];
+                last_y[i] = pos_y[i];
+                pos_x[i] += dx + accel_x[i] * dt2;
+                pos_y[i] += dy + accel_y[i] * dt2;
+                accel_x[i] = 0.0f;
+                accel_y[i] = 0.0f;
+            }
+        });
+    }
+
+    void Solver::updateObjectsSleeping(float dt)
+    {
+        forEachObjectRange([this, dt](size_t begin, size_t end) {
+            float* RESTRICT pos_x = _pos_x.data();
+            float* RESTRICT pos_y = _pos_y.data();
+            float* RESTRICT last_x = _last_x.data();
+            float* RESTRICT last_y = _last_y.data();
+            float* RESTRICT accel_x = _accel_x.data();
+            float* RESTRICT accel_y = _accel_y.data();
+            float* RESTRICT rest_time = _rest_time.data();
+            float* RESTRICT rest_x = _rest_x.data();
+            float* RESTRICT rest_y = _rest_y.data();
+            const float dt2 = dt * dt;
+            const float tolerance = _sleep_velocity * SLEEP_DELAY;
+            const float tolerance2 = tolerance * tolerance;
+            const __m256 dt_8 = _mm256_set1_ps(dt);
+            const __m256 dt2_8 = _mm256_set1_ps(dt2);
+            const __m256 tolerance2_8 = _mm256_set1_ps(tolerance2);
+            const __m256 delay_8 = _mm256_set1_ps(SLEEP_DELAY);
+            const __m256 zero = _mm256_setzero_ps();
+
+            // Same integration as updateObjects, but sleeping objects keep their position and drop velocity and
+            // acceleration. Leaving the tolerance around the rest position moves it there and wakes the object
+            size_t i{ begin };
+            for (; i + 8 <= end; i += 8) {
+                const __m256 px = _mm256_loadu_ps(pos_x + i);
+                const __m256 py = _mm256_loadu_ps(pos_y + i);
+                const __m256 rest = _mm256_loadu_ps(rest_time + i);
+                const __m256 asleep = _mm256_cmp_ps(rest, delay_8, _CMP_GE_OQ);
+
+                const __m256 dx = _mm256_sub_ps(px, _mm256_loadu_ps(last_x + i));
+                const __m256 dy = _mm256_sub_ps(py, _mm256_loadu_ps(last_y + i));
+                const __m256 nx = _mm256_blendv_ps(_mm256_add_ps(_mm256_add_ps(px, dx), _mm256_mul_ps(_mm256_loadu_ps(accel_x + i), dt2_8)), px, asleep);
+                const __m256 ny = _mm256_blendv_ps(_mm256_add_ps(_mm256_add_ps(py, dy), _mm256_mul_ps(_mm256_loadu_ps(accel_y + i), dt2_8)), py, asleep);
+                _mm256_storeu_ps(last_x + i, px);
+                _mm256_storeu_ps(last_y + i, py);
+                _mm256_storeu_ps(pos_x + i, nx);
+                _mm256_storeu_ps(pos_y + i, ny);
+                _mm256_storeu_ps(accel_x + i, zero);
+                _mm256_storeu_ps(accel_y + i, zero);
+
+                const __m256 rx = _mm256_loadu_ps(rest_x + i);
+                const __m256 ry = _mm256_loadu_ps(rest_y + i);
+                const __m256 ox = _mm256_sub_ps(nx, rx);
+                const __m256 oy = _mm256_sub_ps(ny, ry);
+                const __m256 away = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)), tolerance2_8, _CMP_GT_OQ);
+                _mm256_storeu_ps(rest_x + i, _mm256_blendv_ps(rx, nx, away));
+                _mm256_storeu_ps(rest_y + i, _mm256_blendv_ps(ry, ny, away));
+                _mm256_storeu_ps(rest_time + i, _mm256_andnot_ps(away, _mm256_min_ps(_mm256_add_ps(rest, dt_8), delay_8)));
+            }
+            for (; i < end; ++i) {
+                const bool asleep = rest_time[i] >= SLEEP_DELAY;
+                if (!asleep) {
+                    const float dx = pos_x[i] - last_x[i];
+                    const float dy = pos_y[i] - last_y[i];
+                    last_x[i] = pos_x[i];
+                    last_y[i] = pos_y[i];
+                    pos_x[i] += dx + accel_x[i] * dt2;
+                    pos_y[i] += dy + accel_y[i] * dt2;
+                }
+                else {
+                    last_x[i] = pos_x[i];
+                    last_y[i] = pos_y[i];
+                }
+                accel_x[i] = 0.0f;
+                accel_y[i] = 0.0f;
+
+                const float ox = pos_x[i] - rest_x[i];
+                const float oy = pos_y[i] - rest_y[i];
+                if (ox * ox + oy * oy > tolerance2) {
+                    rest_x[i] = pos_x[i];
+                    rest_y[i] = pos_y[i];
+                    rest_time[i] = 0.0f;
+                }
+                else
+                    rest_time[i] = std::min(rest_time[i] + dt, SLEEP_DELAY);
+            }
         });
     }
 }
\ No newline at end of file
@@ -7,51 +7,66 @@
 \*------------------------------------------------------------------------------------------------*/
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <utility>
 #include <vector>
 #include "glm/glm.hpp"
 
 
 namespace nhahn
 {
-    struct VerletObject
+    class Solver;
+
+    /*
+     * handle to an object of the Solver, the object data itself lives in the solver's arrays.
+     * Stays valid as long as the solver exists, objects are never removed or reordered
+     */
+    class VerletObject
     {
     public:
-    	VerletObject(glm::vec2 pos, float radius)
-            : pos(pos), pos_last(pos), accel(glm::vec2(0.0f)), radius(radius) {}
-    
-        void update(float dt)
-        {
-            // Compute how much we moved
-            const glm::vec2 displacement = pos - pos_last;
-    
-            // Update position
-            pos_last = pos;
-            pos = pos + displacement + accel * (dt * dt);
-            // Reset acceleration
-            accel = {};
-        }
-    
-        void accelerate(glm::vec2 a) { accel += a; }
-    
-        void setVelocity(glm::vec2 v, float dt) { pos_last = pos - (v * dt); }
-        void addVelocity(glm::vec2 v, float dt) { pos_last -= v * dt; }
-    
-        [[nodiscard]]
-        glm::vec2 getVelocity(float dt) const { return (pos - pos_last) / dt; }
-    
-    	glm::vec2 pos;
-    	glm::vec2 pos_last;
-    	glm::vec2 accel;
-    	float radius = 10.0f;
-    	glm::u8vec4 color = glm::u8vec4(255);
+        VerletObject(Solver& solver, uint32_t index) : _solver(&solver), _index(index) {}
+
+        void accelerate(glm::vec2 a);
+
+        void setVelocity(glm::vec2 v, float dt);
+        void addVelocity(glm::vec2 v, float dt);
+
+        void setPosition(glm::vec2 pos);
+        void setColor(glm::u8vec4 color);
+
+        [[nodiscard]]
+        glm::vec2 getVelocity(float dt) const;
+
+        [[nodiscard]]
+        glm::vec2 getPosition() const;
+
+        [[nodiscard]]
+        float getRadius() const;
+
+        [[nodiscard]]
+        glm::u8vec4 getColor() const;
+
+        [[nodiscard]]
+        uint32_t getIndex() const { return _index; }
+
+    private:
+        Solver*  _solver;
+        uint32_t _index;
     };
 
     class Solver
     {
     public:
+        enum class Broadphase
+        {
+            BRUTE_FORCE,    // tests all pairs, reference for validation
+            UNIFORM_GRID    // counting sort into cells at least one diameter wide, tests neighbouring cells only
+        };
+
         Solver() = default;
 
-        VerletObject& addObject(glm::vec2 position, float radius) { return _objects.emplace_back(position, radius); }
+        VerletObject addObject(glm::vec2 position, float radius);
 
         void update(double dt);
 
@@ -65,34 +80,233 @@ namespace nhahn
 
         void setSubStepsCount(uint32_t sub_steps) { _sub_steps = sub_steps; }
 
-        void setObjectVelocity(VerletObject& object, glm::vec2 v) { object.setVelocity(v, getStepDt()); }
+        void setBroadphase(Broadphase broadphase) { _broadphase = broadphase; }
+
+        /* runs the sub steps on the shared JobSystem, collisions in odd/even column stripes of the grid */
+        void setMultithreaded(bool enabled) { _multithreaded = enabled; }
+
+        /*
+         * objects staying within velocity_threshold * SLEEP_DELAY of one spot for SLEEP_DELAY seconds fall asleep.
+         * Sleeping objects are not integrated and act as static for slow objects resting on them, objects hitting
+         * them faster than WAKE_FACTOR times the threshold wake them. Cells with no awake object around skip their collisions.
+         * The average velocity is measured instead of the per step one, undamped piles keep oscillating.
+         * Only used with the grid broadphase
+         */
+        void setSleeping(bool enabled, float velocity_threshold = 20.0f)
+        {
+            _sleeping = enabled;
+            _sleep_velocity = velocity_threshold;
+            std::fill(_rest_time.begin(), _rest_time.end(), 0.0f);
+        }
+
+        /*
+         * keeps both objects at their current distance, a stiffness of 1 restores it fully every sub step.
+         * Links are graph colored so no two links of a color share an object, each color is solved in parallel.
+         * Returns INVALID_LINK and adds nothing when one of the objects already has MAX_OBJECT_LINKS links
+         */
+        uint32_t addLink(VerletObject object_1, VerletObject object_2, float stiffness = 1.0f);
+
+        /* passes over all links per sub step, long chains and large cloths need several to stay stiff */
+        void setLinkIterations(uint32_t iterations) { _link_iterations = std::max(iterations, 1u); }
+
+        /* pinned objects stay where they were pinned, links only pull on their other end */
+        void setPinned(VerletObject object, bool pinned);
+
+        /* compares the overlapping pairs found by the grid with the brute force ones, O(n^2) */
+        bool validateBroadphase();
+
+        /*
+         * solves one collision pass with the SIMD grid narrow phase and one with the brute force contact solve
+         * from the same positions and compares where the objects end up, they are left untouched. The tolerance is in radii
+         */
+        bool validateNarrowPhase(float tolerance);
+
+        void setObjectVelocity(VerletObject object, glm::vec2 v) { object.setVelocity(v, static_cast<float>(getStepDt())); }
+
+        [[nodiscard]]
+        VerletObject getObject(uint32_t index) { return { *this, index }; }
+
+        // object data for rendering, one entry per object
+        [[nodiscard]]
+        const float* getPositionsX() const { return _pos_x.data(); }
+
+        [[nodiscard]]
+        const float* getPositionsY() const { return _pos_y.data(); }
+
+        [[nodiscard]]
+        const float* getRadii() const { return _radius.data(); }
+
+        [[nodiscard]]
+        const float* getLastPositionsX() const { return _last_x.data(); }
+
+        [[nodiscard]]
+        const float* getLastPositionsY() const { return _last_y.data(); }
+
+        [[nodiscard]]
+        const glm::u8vec4* getColors() const { return _color.data(); }
 
         [[nodiscard]]
-        const std::vector<VerletObject>& getObjects() const { return _objects; }
+        glm::vec2 getGravity() const { return _gravity; }
 
         [[nodiscard]]
         glm::vec3 getConstraint() const { return { _constraint_center.x, _constraint_center.y, _constraint_radius }; }
 
         [[nodiscard]]
-        uint64_t getObjectsCount() const { return _objects.size(); }
+        uint64_t getObjectsCount() const { return _pos_x.size(); }
+
+        [[nodiscard]]
+        uint64_t getLinksCount() const { return _links.size(); }
+
+        /* colors of the last link batching, each one is a parallel batch */
+        [[nodiscard]]
+        uint32_t getLinkColorsCount() const { return _link_batch_start.empty() ? 0 : static_cast<uint32_t>(_link_batch_start.size() - 1); }
 
         [[nodiscard]]
         double getTime() const { return _time; }
 
+        [[nodiscard]]
+        uint32_t getSubStepsCount() const { return _sub_steps; }
+
+        [[nodiscard]]
+        double getSimulationUpdateRate() const { return _frame_dt; }
+
         [[nodiscard]]
         double getStepDt() const { return _frame_dt / static_cast<double>(_sub_steps); }
 
+        [[nodiscard]]
+        Broadphase getBroadphase() const { return _broadphase; }
+
+        [[nodiscard]]
+        bool isMultithreaded() const { return _multithreaded; }
+
+        [[nodiscard]]
+        bool isSleeping() const { return _sleeping; }
+
+        /* objects asleep during the last sub step */
+        [[nodiscard]]
+        uint32_t getSleepingCount() const { return _sleeping_count; }
+
+        /* grid cells whose collisions were solved during the last sub step */
+        [[nodiscard]]
+        uint32_t getActiveCellsCount() const { return _active_cells_count; }
+
+        static constexpr float SLEEP_DELAY = 0.5f;
+
+        // share of the overlap two touching objects are pushed apart per sub step
+        static constexpr float RESPONSE_COEF = 0.75f;
+
+        // links of one object, two objects at the limit still leave one of the 64 link colors free
+        static constexpr uint32_t MAX_OBJECT_LINKS = 32;
+        static constexpr uint32_t INVALID_LINK = ~0u;
+
     private:
+        friend class VerletObject;
+
+        using ObjectPair = std::pair<uint32_t, uint32_t>;
+
+        // one grid row of a stripe copied into contiguous arrays, neighbouring cells are neighbouring ranges
+        struct GridRowScratch
+        {
+            std::vector<float>    x;
+            std::vector<float>    y;
+            std::vector<float>    radius;
+            std::vector<uint32_t> id;
+            std::vector<uint32_t> cell_start;   // start in the arrays of each gathered column, columns + 1 entries
+            std::vector<uint8_t>  asleep;       // only gathered while sleeping is enabled
+            std::vector<float>    speed2;       // squared displacement of the last step
+        };
+
+        struct NarrowPhaseScratch
+        {
+            GridRowScratch row;
+            GridRowScratch next_row;
+        };
+
+        struct LinkDesc
+        {
+            uint32_t object_1;
+            uint32_t object_2;
+            float    length;
+            float    stiffness;
+        };
+
+        // link as solved, the weights are the stiffness split by how much each end may move
+        struct Link
+        {
+            uint32_t object_1;
+            uint32_t object_2;
+            float    length;
+            float    weight_1;
+            float    weight_2;
+        };
+
+        struct Pin
+        {
+            uint32_t  id;
+            glm::vec2 position;
+        };
+
+        // runs func(begin, end) over the objects, split across the job system when multithreaded
+        template <typename Func>
+        void forEachObjectRange(Func&& func);
+
         void applyGravity();
 
         void checkCollisions(float dt);
 
+        void checkCollisionsParallel();
+
+        void solveContact(uint32_t i, uint32_t k);
+
+        void solveGridColumns(uint32_t x_begin, uint32_t x_end, NarrowPhaseScratch& scratch);
+
+        void gatherGridRow(uint32_t y, uint32_t x_begin, uint32_t x_end, GridRowScratch& row) const;
+
+        void scatterGridRow(const GridRowScratch& row);
+
+        void solveSleepingContact(GridRowScratch& row_1, uint32_t a, GridRowScratch& row_2, uint32_t c);
+
+        void rebuildGrid();
+
+        void updateActiveCells();
+
+        /*
+         * calls func(i, k) for every pair sharing a cell or lying in neighbouring cells, each pair once.
+         * Only cells in the columns [x_begin, x_end) are visited, their pairs reach one column to each side
+         */
+        template <typename Func>
+        void forEachGridPair(Func&& func, uint32_t x_begin = 0, uint32_t x_end = UINT32_MAX) const;
+
+        void collectOverlaps(std::vector<ObjectPair>& pairs, bool use_grid);
+
         void applyConstraint();
 
+        void rebuildLinkBatches();
+
+        void solveLinks();
+
+        static void solveLinkRange(const Link* links, size_t begin, size_t end, float* pos_x, float* pos_y, float* rest_time);
+
+        void applyPins();
+
         void updateObjects(float dt);
 
+        void updateObjectsSleeping(float dt);
+
     private:
-        std::vector<VerletObject> _objects;
+        // objects as structure of arrays, the kernels only stream the fields they need
+        std::vector<float>       _pos_x;
+        std::vector<float>       _pos_y;
+        std::vector<float>       _last_x;
+        std::vector<float>       _last_y;
+        std::vector<float>       _accel_x;
+        std::vector<float>       _accel_y;
+        std::vector<float>       _radius;
+        std::vector<glm::u8vec4> _color;
+        std::vector<float>       _rest_time;    // seconds spent close to the rest position, capped at SLEEP_DELAY
+        std::vector<float>       _rest_x;
+        std::vector<float>       _rest_y;
+        std::vector<uint8_t>     _link_count;   // links the object is an end of
 
         uint32_t    _sub_steps = 1;
         glm::vec2   _gravity = { 0.0f, 1000.0f };
@@ -100,5 +314,114 @@ namespace nhahn
         float       _constraint_radius = 100.0f;
         double      _time = 0.0f;
         double      _frame_dt = 0.0f;
+        Broadphase  _broadphase = Broadphase::UNIFORM_GRID;
+        bool        _multithreaded = true;
+        bool        _sleeping = false;
+        float       _sleep_velocity = 20.0f;
+        float       _wake_step2 = 0.0f;
+        uint32_t    _sleeping_count = 0;
+        uint32_t    _active_cells_count = 0;
+
+        // uniform grid over the constraint, objects are counting sorted by cell each sub step
+        static constexpr uint32_t MAX_GRID_DIM = 2048;
+        glm::vec2               _grid_origin = { 0.0f, 0.0f };
+        float                   _grid_cell_size = 1.0f;
+        uint32_t                _grid_width = 0;
+        uint32_t                _grid_height = 0;
+        std::vector<uint32_t>   _cell_start;    // first entry of each cell in _cell_objects, cells + 1 entries
+        std::vector<uint32_t>   _cell_objects;  // object ids ordered by cell
+        std::vector<uint32_t>   _object_cell;
+        std::vector<uint8_t>    _cell_awake;    // cell holds an awake object
+        std::vector<uint8_t>    _cell_active;   // cell or one of its neighbours holds an awake object
+
+        // distance links, batched by color and sorted by object within a color so the solve walks memory forward
+        std::vector<LinkDesc>   _links;             // creation order
+        std::vector<Link>       _link_batches;
+        std::vector<uint32_t>   _link_batch_start;  // first link of each color, colors + 1 entries
+        bool                    _links_dirty = false;
+        uint32_t                _link_iterations = 1;
+        std::vector<Pin>        _pins;
     };
+
+    template <typename Func>
+    void Solver::forEachGridPair(Func&& func, uint32_t x_begin, uint32_t x_end) const
+    {
+        // half of the neighbourhood is enough when every cell looks forward
+        const int32_t offsets[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+
+        for (uint32_t y{ 0 }; y < _grid_height; ++y) {
+            for (uint32_t x{ x_begin }; x < std::min(x_end, _grid_width); ++x) {
+                const uint32_t cell = y * _grid_width + x;
+                const uint32_t begin = _cell_start[cell];
+                const uint32_t end = _cell_start[cell + 1];
+                if (begin == end)
+                    continue;
+
+                // pairs inside of the cell
+                for (uint32_t a{ begin }; a < end; ++a)
+                    for (uint32_t b{ a + 1 }; b < end; ++b)
+                        func(_cell_objects[a], _cell_objects[b]);
+
+                // pairs with the forward neighbours
+                for (const auto& offset : offsets) {
+                    const int32_t nx = static_cast<int32_t>(x) + offset[0];
+                    const int32_t ny = static_cast<int32_t>(y) + offset[1];
+                    if (nx < 0 || nx >= static_cast<int32_t>(_grid_width) || ny >= static_cast<int32_t>(_grid_height))
+                        continue;
+
+                    const uint32_t neighbour = static_cast<uint32_t>(ny) * _grid_width + static_cast<uint32_t>(nx);
+                    const uint32_t n_begin = _cell_start[neighbour];
+                    const uint32_t n_end = _cell_start[neighbour + 1];
+                    for (uint32_t a{ begin }; a < end; ++a)
+                        for (uint32_t b{ n_begin }; b < n_end; ++b)
+                            func(_cell_objects[a], _cell_objects[b]);
+                }
+            }
+        }
+    }
+
+    // everything changing an object from the outside wakes it up
+    inline void VerletObject::accelerate(glm::vec2 a)
+    {
+        _solver->_rest_time[_index] = 0.0f;
+        _solver->_accel_x[_index] += a.x;
+        _solver->_accel_y[_index] += a.y;
+    }
+
+    inline void VerletObject::setVelocity(glm::vec2 v, float dt)
+    {
+        _solver->_rest_time[_index] = 0.0f;
+        _solver->_last_x[_index] = _solver->_pos_x[_index] - v.x * dt;
+        _solver->_last_y[_index] = _solver->_pos_y[_index] - v.y * dt;
+    }
+
+    inline void VerletObject::addVelocity(glm::vec2 v, float dt)
+    {
+        _solver->_rest_time[_index] = 0.0f;
+        _solver->_last_x[_index] -= v.x * dt;
+        _solver->_last_y[_index] -= v.y * dt;
+    }
+
+    inline void VerletObject::setPosition(glm::vec2 pos)
+    {
+        _solver->_rest_time[_index] = 0.0f;
+        _solver->_pos_x[_index] = pos.x;
+        _solver->_pos_y[_index] = pos.y;
+        _solver->_last_x[_index] = pos.x;
+        _solver->_last_y[_index] = pos.y;
+    }
+
+    inline void VerletObject::setColor(glm::u8vec4 color) { _solver->_color[_index] = color; }
+
+    inline glm::vec2 VerletObject::getVelocity(float dt) const
+    {
+        return { (_solver->_pos_x[_index] - _solver->_last_x[_index]) / dt,
+                 (_solver->_pos_y[_index] - _solver->_last_y[_index]) / dt };
+    }
+
+    inline glm::vec2 VerletObject::getPosition() const { return { _solver->_pos_x[_index], _solver->_pos_y[_index] }; }
+
+    inline float VerletObject::getRadius() const { return _solver->_radius[_index]; }
+
+    inline glm::u8vec4 VerletObject::getColor() const { return _solver->_color[_index]; }
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include <string>
 #include "imgui.h"
+#include "EffectUI.h"
 #include "utility/Debug.h"
 #include "ui/CustomWidgets.h"
 
@@ -58,6 +59,12 @@ namespace nhahn
 		//colorUpdater->m_maxPos = glm::vec4{ 1.0f };
 		m_system->addUpdater(colorUpdater);
 
+		m_turbulenceUpdater = std::make_shared<CurlNoiseUpdater>();
+		m_turbulenceUpdater->m_strength = 0.75f;
+		m_turbulenceUpdater->m_frequency = 4.0f;
+		m_turbulenceUpdater->setOctaves(2);
+		m_system->addUpdater(m_turbulenceUpdater);
+
 		auto eulerUpdater = std::make_shared<EulerUpdater>();
 		eulerUpdater->m_globalAcceleration = glm::vec4{ 0.0, 0.0, 0.0, 0.0 };
 		m_system->addUpdater(eulerUpdater);
@@ -73,7 +80,7 @@ namespace nhahn
 		if (!m_renderer)
 			return false;
 
-		m_renderer->generate(m_system.get(), false);
+		m_renderer->generate(m_system.get(), m_useQuads);
 
 		return true;
 	}
@@ -81,6 +88,114 @@ namespace nhahn
 	void TunnelEffect::clean()
 	{
 		if (m_renderer) m_renderer->destroy();
+		if (m_ageSeedRenderer) m_ageSeedRenderer->destroy();
+		if (m_quantizedRenderer) m_quantizedRenderer->destroy();
+		if (m_gpuSystem) m_gpuSystem->destroy();
+		if (m_analyticSystem) m_analyticSystem->destroy();
+	}
+
+	void TunnelEffect::reset()
+	{
+		m_system->reset();
+		if (m_gpuSystem) m_gpuSystem->reset();
+		if (m_analyticSystem) m_analyticSystem->reset();
+	}
+
+	int TunnelEffect::numAliveParticles()
+	{
+		if (m_useAnalytic)
+			return (int)m_analyticSystem->numAliveParticles();
+		return (int)(m_useGpu ? m_gpuSystem->numAliveParticles() : m_system->numAliveParticles());
+	}
+
+	double TunnelEffect::aliveToAllRatio()
+	{
+		if (m_useAnalytic)
+			return m_analyticSystem->getAliveToAllRatio();
+		return m_useGpu ? m_gpuSystem->getAliveToAllRatio() : m_system->getAliveToAllRatio();
+	}
+
+	void TunnelEffect::setGpuBackend(bool enabled)
+	{
+		if (enabled && !m_gpuSystem)
+		{
+			m_gpuSystem = GpuParticleBackend::create(m_system.get());
+			if (!m_gpuSystem)
+				enabled = false;
+		}
+
+		// the particles are not carried over, the backend that takes over starts empty
+		m_useGpu = enabled;
+		if (m_useGpu)
+		{
+			m_useAnalytic = false;
+			m_gpuSystem->reset();
+		}
+		else
+			m_system->reset();
+	}
+
+	void TunnelEffect::setAnalytic(bool enabled)
+	{
+		if (enabled && !m_analyticSystem)
+		{
+			m_analyticSystem = std::make_unique<AnalyticParticleSystem>();
+			if (!m_analyticSystem->generate(m_system.get()))
+			{
+				m_analyticSystem.reset();
+				enabled = false;
+			}
+		}
+
+		m_useAnalytic = enabled;
+		if (m_useAnalytic)
+		{
+			m_useGpu = false;
+			m_analyticSystem->reset();
+		}
+		else
+			m_system->reset();
+	}
+
+	void TunnelEffect::setAgeSeed(bool enabled)
+	{
+		if (enabled && !m_ageSeedRenderer)
+		{
+			m_ageSeedRenderer = std::make_shared<GLParticleRendererAgeSeed>();
+			m_ageSeedRenderer->generate(m_system.get(), false);
+		}
+		else if (!enabled)
+			m_ageSeedRenderer.reset();
+
+		// the upload formats are for the full color stream, gpu color replaces them
+		if (enabled)
+			m_vertexFormat = 0;
+
+		m_useAgeSeed = enabled;
+	}
+
+	void TunnelEffect::setVertexFormat(int format)
+	{
+		// format 0 is the float upload of the factory renderers, which keep drawing it
+		if (format > 0 && !m_quantizedRenderer)
+		{
+			m_quantizedRenderer = std::make_shared<GLParticleRendererQuantized>();
+			m_quantizedRenderer->generate(m_system.get(), false);
+		}
+		if (m_quantizedRenderer)
+			m_quantizedRenderer->setFormat(format);
+		if (format > 0)
+			setAgeSeed(false);
+
+		m_vertexFormat = format;
+	}
+
+	void TunnelEffect::setQuads(bool enabled)
+	{
+		// generated again with the other buffer layout, the particles are kept
+		m_renderer->destroy();
+		m_renderer->generate(m_system.get(), enabled);
+		m_useQuads = enabled;
 	}
 
 	void TunnelEffect::update(double dt)
@@ -96,17 +211,46 @@ namespace nhahn
 
 	void TunnelEffect::cpuUpdate(double dt)
 	{
-		m_system->update(dt);
+		if (!m_useGpu && !m_useAnalytic)
+			m_system->update(dt);
 	}
 
 	void TunnelEffect::gpuUpdate(double dt)
 	{
-		m_renderer->update();
+		// the analytic particles only upload their new spawns
+		if (m_useAnalytic)
+			m_analyticSystem->update(dt);
+		else if (m_useGpu)
+			m_gpuSystem->update(dt);
+		else
+			activeRenderer()->update();
+	}
+
+	void TunnelEffect::setView(const ScenePass& pass)
+	{
+		if (m_analyticSystem)
+			m_analyticSystem->setView(pass);
+		m_renderer->setView(pass);
+		if (activeRenderer() != m_renderer.get())
+			activeRenderer()->setView(pass);
+	}
+
+	bool TunnelEffect::bounds(glm::vec4& boundsMin, glm::vec4& boundsMax)
+	{
+		// the analytic and gpu particles are never read back
+		if (!m_useGpu && !m_useAnalytic)
+			return systemBounds(m_system.get(), activeRenderer(), boundsMin, boundsMax);
+		return false;
 	}
 
 	void TunnelEffect::render()
 	{
-		m_renderer->render();
+		if (m_useAnalytic)
+			m_analyticSystem->render();
+		else if (m_useGpu)
+			m_gpuSystem->render();
+		else
+			activeRenderer()->render();
 	}
 
 	void TunnelEffect::renderUI()
@@ -118,6 +262,44 @@ namespace nhahn
 		ImGui::Spacing();
 		ImGui::NewLine();
 
+		ImGui::SeparatorText("Settings:");
+
+		bool useGpu = m_useGpu;
+		if (ImGui::Checkbox("gpu backend", &useGpu))
+			setGpuBackend(useGpu);
+		ImGui::SameLine(); ImGui::HelpMarker("Keeps the particles in gpu buffers, nothing is uploaded per frame. Uses compute shaders, or transform feedback with the generators on the cpu on drivers without them.\nThe turbulence has no gpu version and is skipped, switching restarts the effect.");
+
+		bool useAnalytic = m_useAnalytic;
+		if (ImGui::Checkbox("analytic", &useAnalytic))
+			setAnalytic(useAnalytic);
+		ImGui::SameLine(); ImGui::HelpMarker("Stateless particles, position and color are evaluated from the spawn time in the vertex shader and the cpu only writes the new spawns.\nThe turbulence has no closed form and is skipped, the particles fly straight.");
+
+		bool useAgeSeed = m_useAgeSeed;
+		int vertexFormat = m_vertexFormat;
+		uploadFormatUI(m_system.get(), useAgeSeed, vertexFormat, m_formatErrors);
+		if (useAgeSeed != m_useAgeSeed)
+			setAgeSeed(useAgeSeed);
+		if (vertexFormat != m_vertexFormat)
+			setVertexFormat(vertexFormat);
+
+		bool useQuads = m_useQuads;
+		if (quadsUI(*m_renderer, useQuads))
+			setQuads(useQuads);
+
+		rendererUI(*m_renderer, m_system->numAliveParticles());
+
+		ImGui::SeparatorText("Turbulence:");
+
+		ImGui::Checkbox("enabled", &m_turbulenceUpdater->m_enabled);
+		ImGui::SameLine(); ImGui::HelpMarker("Curl noise sampled from cached volumes, one volume per octave.");
+		ImGui::SliderFloat("strength", &m_turbulenceUpdater->m_strength, 0.0f, 10.0f, "%.2f");
+		ImGui::SliderFloat("frequency", &m_turbulenceUpdater->m_frequency, 0.1f, 16.0f, "%.2f");
+		int octaves = (int)m_turbulenceUpdater->numOctaves();
+		if (ImGui::SliderInt("octaves", &octaves, 1, (int)CurlNoiseUpdater::MAX_OCTAVES))
+			m_turbulenceUpdater->setOctaves((uint32_t)octaves);
+		ImGui::SliderFloat("persistence", &m_turbulenceUpdater->m_persistence, 0.0f, 1.0f, "%.2f");
+		ImGui::DragFloat3("scroll speed", &m_turbulenceUpdater->m_scrollSpeed.x, 0.01f, -4.0f, 4.0f, "%.2f");
+
 		ImGui::SeparatorText("Colors:");
 
 		ImGui::ColorEdit4("start color min", &m_colGenerator->m_minStartCol.x);
@@ -0,0 +1,343 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "VerletEffect.h"
+
+#include <math.h>
+#include <algorithm>
+#include <GL/glew.h>
+#include "imgui.h"
+#include "utility/Debug.h"
+#include "utility/Timer.h"
+#include "ui/CustomWidgets.h"
+
+
+namespace nhahn
+{
+	// solver units, the container is drawn with a radius of SCENE_RADIUS in the scene
+	static const float CONTAINER_RADIUS = 450.0f;
+	static const float SCENE_RADIUS = 0.2f;
+	// fraction of the container the objects of a scene cover once it is full
+	static const float FILL_RATIO = 0.6f;
+	// frames in a row over the 60 fps budget that end the stress mode
+	static const int STRESS_FRAMES_OVER_BUDGET = 30;
+	static const double FRAME_BUDGET_MS = 1000.0 / 60.0;
+	static const int STRESS_STREAMS = 256;
+
+	bool VerletEffect::initialize(size_t numParticles)
+	{
+		m_maxObjects = numParticles == 0 ? DEFAULT_OBJECT_COUNT : numParticles;
+		m_sceneObjects = m_maxObjects;
+
+		createSolver();
+
+		DBG("VerletEffect", DebugLevel::DEBUG, "up to %d objects with radius %.2f\n", (int)m_maxObjects, m_objectRadius);
+		return true;
+	}
+
+	bool VerletEffect::initializeRenderer(const char* name)
+	{
+		// the solver has its own layout, the circles are always drawn instanced
+		m_renderer = std::make_unique<VerletRenderer>();
+		attachRenderer();
+
+		return true;
+	}
+
+	void VerletEffect::reset()
+	{
+		m_stressMode = false;
+		m_sceneObjects = m_maxObjects;
+		createSolver();
+		attachRenderer();
+	}
+
+	void VerletEffect::clean()
+	{
+		if (m_renderer) m_renderer->destroy();
+		if (m_gpuSolver) m_gpuSolver->destroy();
+	}
+
+	void VerletEffect::createSolver()
+	{
+		const bool multithreaded = m_solver ? m_solver->isMultithreaded() : true;
+
+		// the radius that lets the expected number of objects fill the container
+		m_objectRadius = std::clamp(sqrtf(FILL_RATIO * CONTAINER_RADIUS * CONTAINER_RADIUS / (float)m_sceneObjects), 0.5f, 20.0f);
+		m_time = 0.0;
+		m_framesOverBudget = 0;
+		m_avgSolverMs = 0.0;
+
+		m_solver = std::make_unique<Solver>();
+		m_solver->setConstraint(glm::vec2(0.0f), CONTAINER_RADIUS);
+		m_solver->setSubStepsCount((uint32_t)m_subSteps);
+		m_solver->setSimulationUpdateRate(1.0 / (double)m_updateRate);
+		m_solver->setMultithreaded(multithreaded);
+		m_solver->setSleeping(m_sleeping, m_sleepVelocity * m_objectRadius);
+		m_solver->setLinkIterations((uint32_t)m_linkIterations);
+
+		// the empty cpu solver passes its settings on
+		if (m_useGpu)
+			m_gpuSolver->upload(*m_solver);
+	}
+
+	void VerletEffect::attachRenderer()
+	{
+		if (!m_renderer)
+			return;
+
+		if (m_useGpu)
+			m_renderer->generate(m_gpuSolver.get());
+		else
+			m_renderer->generate(m_solver.get(), m_maxObjects);
+	}
+
+	void VerletEffect::setGpuSolver(bool enabled)
+	{
+		if (enabled && !m_gpuSolver)
+		{
+			m_gpuSolver = std::make_unique<GpuSolver>();
+			if (!m_gpuSolver->generate(m_maxObjects))
+			{
+				m_gpuSolver.reset();
+				enabled = false;
+			}
+		}
+
+		// the scene moves over to the gpu, there is no way back without reading it back, so it restarts
+		m_useGpu = enabled;
+		if (m_useGpu)
+		{
+			m_gpuSolver->upload(*m_solver);
+			m_avgSolverMs = 0.0;
+			attachRenderer();
+		}
+		else
+		{
+			reset();
+		}
+	}
+
+	void VerletEffect::startStressMode()
+	{
+		m_sceneObjects = STRESS_OBJECT_COUNT;
+		createSolver();
+		attachRenderer();
+
+		m_stressMode = true;
+		m_spawning = true;
+		m_stressResult = 0;
+	}
+
+	void VerletEffect::addCloth()
+	{
+		// square of linked objects hanging from every sixth object of its top row
+		const uint32_t CLOTH_SIDE = 48;
+		const float spacing = 2.2f * m_objectRadius;
+		const glm::vec2 origin{ -0.5f * spacing * (float)(CLOTH_SIDE - 1), -0.7f * CONTAINER_RADIUS };
+
+		for (uint32_t y = 0; y < CLOTH_SIDE; ++y)
+		{
+			for (uint32_t x = 0; x < CLOTH_SIDE; ++x)
+			{
+				VerletObject object = m_solver->addObject(origin + spacing * glm::vec2((float)x, (float)y), m_objectRadius);
+				object.setColor((((x / 4) + (y / 4)) & 1) ? glm::u8vec4(230, 230, 230, 255) : glm::u8vec4(200, 40, 40, 255));
+
+				if (x > 0)
+					m_solver->addLink(m_solver->getObject(object.getIndex() - 1), object);
+				if (y > 0)
+					m_solver->addLink(m_solver->getObject(object.getIndex() - CLOTH_SIDE), object);
+				if (y == 0 && x % 6 == 0)
+					m_solver->setPinned(object, true);
+			}
+		}
+	}
+
+	void VerletEffect::update(double dt)
+	{
+		m_time += dt;
+
+		const size_t limit = m_stressMode ? STRESS_OBJECT_COUNT : m_maxObjects;
+		if (!m_spawning || objectsCount() >= limit)
+			return;
+
+		// a row of streams below the top of the container, one object per stream and frame,
+		// spaced so freshly spawned objects never overlap each other
+		const uint32_t streams = (uint32_t)(m_stressMode ? std::max(m_streams, STRESS_STREAMS) : m_streams);
+		const float spacing = 2.5f * m_objectRadius;
+		const float angle = 0.5f * sinf((float)m_time) + 0.5f * 3.1415926f;
+		const glm::vec2 velocity = m_spawnSpeed * glm::vec2(cosf(angle), sinf(angle));
+
+		// rainbow over the spawn time
+		const float t = (float)m_time;
+		const glm::u8vec4 color{
+			(uint8_t)(255.0f * (0.5f + 0.5f * sinf(t))),
+			(uint8_t)(255.0f * (0.5f + 0.5f * sinf(t + 0.33f * 6.2831853f))),
+			(uint8_t)(255.0f * (0.5f + 0.5f * sinf(t + 0.66f * 6.2831853f))),
+			255 };
+
+		for (uint32_t i = 0; i < streams && objectsCount() < limit; ++i)
+		{
+			const float x = ((float)i - 0.5f * (float)(streams - 1)) * spacing;
+			const float y = -0.6f * CONTAINER_RADIUS - (float)(i & 1) * spacing;
+			if (m_useGpu)
+			{
+				m_gpuSolver->addObject(glm::vec2(x, y), m_objectRadius, color, velocity);
+				continue;
+			}
+
+			VerletObject object = m_solver->addObject(glm::vec2(x, y), m_objectRadius);
+			m_solver->setObjectVelocity(object, velocity);
+			object.setColor(color);
+		}
+	}
+
+	void VerletEffect::cpuUpdate(double dt)
+	{
+		if (m_useGpu)
+			return;
+
+		Timer timer;
+		m_solver->update(dt);
+		recordSolverTime((double)timer.getMicroseconds() / 1000.0);
+	}
+
+	void VerletEffect::gpuUpdate(double dt)
+	{
+		if (m_useGpu)
+		{
+			Timer timer;
+			m_gpuSolver->update(dt);
+
+			// waiting for the gpu only pays off when the time decides the stress run
+			if (m_stressMode)
+				glFinish();
+			recordSolverTime((double)timer.getMicroseconds() / 1000.0);
+		}
+
+		m_renderer->update();
+	}
+
+	void VerletEffect::recordSolverTime(double ms)
+	{
+		m_solverMs = ms;
+		m_avgSolverMs = (m_avgSolverMs == 0.0) ? m_solverMs : 0.95 * m_avgSolverMs + 0.05 * m_solverMs;
+
+		if (!m_stressMode)
+			return;
+
+		// the solver alone has to fit the frame, rendering runs on the gpu
+		m_framesOverBudget = (m_solverMs > FRAME_BUDGET_MS) ? m_framesOverBudget + 1 : 0;
+		if (m_framesOverBudget >= STRESS_FRAMES_OVER_BUDGET || objectsCount() >= STRESS_OBJECT_COUNT)
+		{
+			m_stressMode = false;
+			m_spawning = false;
+			m_stressResult = objectsCount();
+			DBG("VerletEffect", DebugLevel::INFO, "stress mode: %d objects at 60 fps (%d sub steps, %s)\n",
+				(int)m_stressResult, m_subSteps, m_useGpu ? "gpu" : (m_solver->isMultithreaded() ? "multithreaded" : "single threaded"));
+		}
+	}
+
+	void VerletEffect::setView(const ScenePass& pass)
+	{
+		// solver units to the scene, y of the solver points down
+		const float scale = SCENE_RADIUS / CONTAINER_RADIUS;
+		glm::mat4 model{ 1.0f };
+		model[0][0] = scale;
+		model[1][1] = -scale;
+		model[2][2] = scale;
+
+		m_modelViewMat = pass.viewMat * model;
+		m_projMat = pass.projMat;
+	}
+
+	void VerletEffect::render()
+	{
+		m_renderer->render(m_modelViewMat, m_projMat);
+	}
+
+	void VerletEffect::renderUI()
+	{
+		ImGui::NewLine();
+		ImGui::TextWrapped(
+			"Circles poured into a round container, solved with Verlet integration and position based collisions."
+		);
+		ImGui::Spacing();
+		ImGui::NewLine();
+
+		ImGui::SeparatorText("Settings:");
+
+		bool useGpu = m_useGpu;
+		if (ImGui::Checkbox("gpu solver", &useGpu))
+			setGpuSolver(useGpu);
+		ImGui::SameLine(); ImGui::HelpMarker("Solves in compute shaders and draws straight from their buffers.\nSleeping and links are cpu only, switching back restarts the scene.");
+
+		if (ImGui::SliderInt("sub steps", &m_subSteps, 1, 16))
+		{
+			m_solver->setSubStepsCount((uint32_t)m_subSteps);
+			if (m_useGpu) m_gpuSolver->setSubStepsCount((uint32_t)m_subSteps);
+		}
+		ImGui::SameLine(); ImGui::HelpMarker("Collision passes per frame, more sub steps keep dense piles stiff.");
+
+		if (ImGui::SliderInt("update rate", &m_updateRate, 30, 240, "%d hz"))
+		{
+			m_solver->setSimulationUpdateRate(1.0 / (double)m_updateRate);
+			if (m_useGpu) m_gpuSolver->setSimulationUpdateRate(1.0 / (double)m_updateRate);
+		}
+
+		ImGui::BeginDisabled(m_useGpu);
+
+		bool multithreaded = m_solver->isMultithreaded();
+		if (ImGui::Checkbox("multithreaded", &multithreaded))
+			m_solver->setMultithreaded(multithreaded);
+
+		bool gridBroadphase = m_solver->getBroadphase() == Solver::Broadphase::UNIFORM_GRID;
+		if (ImGui::Checkbox("grid broadphase", &gridBroadphase))
+			m_solver->setBroadphase(gridBroadphase ? Solver::Broadphase::UNIFORM_GRID : Solver::Broadphase::BRUTE_FORCE);
+		ImGui::SameLine(); ImGui::HelpMarker("Brute force tests all pairs, only usable with a few thousand objects.");
+
+		bool sleepingChanged = ImGui::Checkbox("sleeping", &m_sleeping);
+		ImGui::SameLine(); ImGui::HelpMarker("Objects resting for a while stop being simulated until something fast hits them.\nNeeds the grid broadphase.");
+		sleepingChanged |= ImGui::SliderFloat("sleep velocity", &m_sleepVelocity, 1.0f, 50.0f, "%.0f radii/s");
+		if (sleepingChanged)
+			m_solver->setSleeping(m_sleeping, m_sleepVelocity * m_objectRadius);
+		if (m_sleeping)
+			ImGui::Text("%d asleep, %d active cells", (int)m_solver->getSleepingCount(), (int)m_solver->getActiveCellsCount());
+
+		if (ImGui::SliderInt("link iterations", &m_linkIterations, 1, 16))
+			m_solver->setLinkIterations((uint32_t)m_linkIterations);
+		ImGui::SameLine(); ImGui::HelpMarker("Passes over the distance links per sub step, large cloths stretch with few passes.");
+		ImGui::EndDisabled();
+
+		ImGui::SeparatorText("Spawning:");
+
+		ImGui::Checkbox("spawning", &m_spawning);
+		ImGui::SliderInt("streams", &m_streams, 1, 64);
+		ImGui::SliderFloat("spawn speed", &m_spawnSpeed, 0.0f, 1000.0f, "%.0f");
+		if (ImGui::Button("reset"))
+			reset();
+		ImGui::SameLine();
+		ImGui::BeginDisabled(m_useGpu);
+		if (ImGui::Button("drop cloth"))
+			addCloth();
+		ImGui::EndDisabled();
+		if (m_solver->getLinksCount() > 0)
+			ImGui::Text("%d links in %d parallel batches", (int)m_solver->getLinksCount(), (int)m_solver->getLinkColorsCount());
+
+		ImGui::SeparatorText("Stress:");
+
+		ImGui::Text("%d objects, solver %.2f ms", (int)objectsCount(), m_avgSolverMs);
+		if (m_stressMode)
+			ImGui::Text("spawning until the solver exceeds %.1f ms ...", FRAME_BUDGET_MS);
+		else if (ImGui::Button("max objects at 60 fps"))
+			startStressMode();
+		ImGui::SameLine(); ImGui::HelpMarker("Spawns smaller objects until the solver no longer fits a 60 fps frame.");
+
+		if (m_stressResult > 0)
+			ImGui::Text("last run: %d objects", (int)m_stressResult);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include "Effect.h"
+#include "GpuSolver.h"
+#include "Solver.h"
+#include "VerletRenderer.h"
+
+
+namespace nhahn
+{
+	/*
+	 * Circles poured into a round container by the Verlet Solver. Serves as the benchmark
+	 * scene for the solver, the stress mode keeps spawning until a frame no longer fits 60 fps.
+	 */
+	class VerletEffect : public IEffect
+	{
+	public:
+		static const size_t DEFAULT_OBJECT_COUNT = 20000;
+		static const size_t STRESS_OBJECT_COUNT = 500000;
+
+		VerletEffect() { }
+		~VerletEffect() { }
+
+		bool initialize(size_t numParticles) override;
+		bool initializeRenderer(const char* name) override;
+		void reset() override;
+		void clean() override;
+
+		void update(double dt) override;
+		void cpuUpdate(double dt) override;
+		void gpuUpdate(double dt) override;
+		void render() override;
+		void renderUI() override;
+		void setView(const ScenePass& pass) override;
+
+		int numAllParticles() override { return (int)std::max(m_maxObjects, objectsCount()); }
+		int numAliveParticles() override { return (int)objectsCount(); }
+		double aliveToAllRatio() override { return (double)numAliveParticles() / (double)numAllParticles(); }
+
+	protected:
+		void createSolver();
+		void attachRenderer();
+		void setGpuSolver(bool enabled);
+		void startStressMode();
+		void addCloth();
+		void recordSolverTime(double ms);
+		size_t objectsCount() const { return m_useGpu ? m_gpuSolver->getObjectsCount() : (size_t)m_solver->getObjectsCount(); }
+
+	protected:
+		std::unique_ptr<Solver> m_solver;
+		std::unique_ptr<GpuSolver> m_gpuSolver;
+		bool m_useGpu{ false };		// m_solver only holds the settings then
+		std::unique_ptr<VerletRenderer> m_renderer;
+		glm::mat4 m_modelViewMat{ 1.0f };
+		glm::mat4 m_projMat{ 1.0f };
+
+		size_t m_maxObjects{ DEFAULT_OBJECT_COUNT };
+		size_t m_sceneObjects{ DEFAULT_OBJECT_COUNT };	// the object radius is chosen so this many fill the container
+		float m_objectRadius{ 1.0f };
+		double m_time{ 0.0 };
+
+		// settings
+		int m_subSteps{ 8 };
+		int m_updateRate{ 60 };
+		int m_streams{ 8 };
+		float m_spawnSpeed{ 300.0f };
+		bool m_spawning{ true };
+		int m_linkIterations{ 4 };
+		bool m_sleeping{ false };
+		float m_sleepVelocity{ 10.0f };	// in object radii per second, so it fits every object size
+
+		// stress mode
+		bool m_stressMode{ false };
+		int m_framesOverBudget{ 0 };
+		size_t m_stressResult{ 0 };
+		double m_solverMs{ 0.0 };
+		double m_avgSolverMs{ 0.0 };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,197 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "VerletRenderer.h"
+
+#include <string>
+#include <GL/glew.h>
+#include "GpuSolver.h"
+#include "Solver.h"
+#include "render/Shader.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+
+
+namespace nhahn
+{
+	static void deleteBuffer(GLuint& buf)
+	{
+		if (buf != 0)
+		{
+			glDeleteBuffers(1, &buf);
+			buf = 0;
+		}
+	}
+
+	static void instanceAttrib(GLuint buf, GLuint attribID, GLint elements, GLenum type, GLboolean normalized, GLsizei stride)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buf);
+		glEnableVertexAttribArray(attribID);
+		glVertexAttribPointer(attribID, elements, type, normalized, stride, nullptr);
+		glVertexAttribDivisor(attribID, 1);
+	}
+
+	// out of line, the header only forward declares Shader
+	VerletRenderer::VerletRenderer() { }
+	VerletRenderer::~VerletRenderer() { destroy(); }
+
+	void VerletRenderer::generate(const Solver* solver, size_t capacity)
+	{
+		ASSERT(solver != nullptr, "VerletRenderer: solver is null");
+
+		m_solver = solver;
+		m_gpuSolver = nullptr;
+
+		loadShader();
+		allocateBuffers(capacity);
+	}
+
+	void VerletRenderer::generate(const GpuSolver* solver)
+	{
+		ASSERT(solver != nullptr, "VerletRenderer: solver is null");
+
+		m_solver = nullptr;
+		m_gpuSolver = solver;
+
+		loadShader();
+		deleteBuffers();
+		m_capacity = 0;
+		if (m_vao == 0)
+			glGenVertexArrays(1, &m_vao);
+		bindGpuBuffers();
+	}
+
+	void VerletRenderer::loadShader()
+	{
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_shader = std::make_unique<Shader>(path.c_str(), "common.inc", "verlet.vert", nullptr, "verlet.frag", 1);
+	}
+
+	void VerletRenderer::deleteBuffers()
+	{
+		deleteBuffer(m_bufPosX);
+		deleteBuffer(m_bufPosY);
+		deleteBuffer(m_bufRadius);
+		deleteBuffer(m_bufCol);
+	}
+
+	void VerletRenderer::bindGpuBuffers()
+	{
+		// same layout as the uploaded buffers, the storage buffers hold one array each too
+		glBindVertexArray(m_vao);
+		instanceAttrib(m_gpuSolver->getBuffer(GpuSolver::POS_X), 0, 1, GL_FLOAT, GL_FALSE, sizeof(float));
+		instanceAttrib(m_gpuSolver->getBuffer(GpuSolver::POS_Y), 1, 1, GL_FLOAT, GL_FALSE, sizeof(float));
+		instanceAttrib(m_gpuSolver->getBuffer(GpuSolver::RADIUS), 2, 1, GL_FLOAT, GL_FALSE, sizeof(float));
+		instanceAttrib(m_gpuSolver->getBuffer(GpuSolver::COLOR), 3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(glm::u8vec4));
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_gpuBufferGeneration = m_gpuSolver->getBufferGeneration();
+	}
+
+	void VerletRenderer::allocateBuffers(size_t capacity)
+	{
+		deleteBuffers();
+		if (m_vao == 0)
+			glGenVertexArrays(1, &m_vao);
+
+		m_capacity = capacity;
+
+		GLuint* buffers[] = { &m_bufPosX, &m_bufPosY, &m_bufRadius, &m_bufCol };
+		for (GLuint* buf : buffers)
+		{
+			glGenBuffers(1, buf);
+			glBindBuffer(GL_ARRAY_BUFFER, *buf);
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(float), nullptr, GL_STREAM_DRAW);
+		}
+
+		glBindVertexArray(m_vao);
+		instanceAttrib(m_bufPosX, 0, 1, GL_FLOAT, GL_FALSE, sizeof(float));
+		instanceAttrib(m_bufPosY, 1, 1, GL_FLOAT, GL_FALSE, sizeof(float));
+		instanceAttrib(m_bufRadius, 2, 1, GL_FLOAT, GL_FALSE, sizeof(float));
+		instanceAttrib(m_bufCol, 3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(glm::u8vec4));
+		glBindVertexArray(0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void VerletRenderer::destroy()
+	{
+		deleteBuffers();
+		if (m_vao != 0)
+		{
+			glDeleteVertexArrays(1, &m_vao);
+			m_vao = 0;
+		}
+		m_shader.reset();
+		m_capacity = 0;
+	}
+
+	void VerletRenderer::update()
+	{
+		if (m_gpuSolver)
+		{
+			// the buffers are drawn in place, they only have to be bound again after growing
+			m_count = m_gpuSolver->getObjectsCount();
+			if (m_gpuSolver->getBufferGeneration() != m_gpuBufferGeneration)
+				bindGpuBuffers();
+			return;
+		}
+
+		ASSERT(m_solver != nullptr, "VerletRenderer: m_solver is null");
+
+		m_count = (size_t)m_solver->getObjectsCount();
+		if (m_count == 0)
+			return;
+
+		if (m_count > m_capacity)
+			allocateBuffers(m_count * 2);
+
+		// orphan the old storage, the previous frame may still be drawn from it
+		const struct { GLuint buf; const void* data; } uploads[] = {
+			{ m_bufPosX, m_solver->getPositionsX() },
+			{ m_bufPosY, m_solver->getPositionsY() },
+			{ m_bufRadius, m_solver->getRadii() },
+			{ m_bufCol, m_solver->getColors() }
+		};
+		for (const auto& upload : uploads)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, upload.buf);
+			glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(float), nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, m_count * sizeof(float), upload.data);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void VerletRenderer::render(const glm::mat4& modelViewMat, const glm::mat4& projMat)
+	{
+		if (m_count == 0 || !m_shader)
+			return;
+
+		// opaque circles, overlapping ones resolve by draw order
+		GLboolean blending = glIsEnabled(GL_BLEND);
+		GLboolean depthMask = GL_TRUE;
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+		glDisable(GL_BLEND);
+		glDepthMask(GL_FALSE);
+
+		m_shader->bind();
+		m_shader->setUniformMat("modelViewMat", modelViewMat, false);
+		m_shader->setUniformMat("projectionMat", projMat, false);
+
+		glBindVertexArray(m_vao);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)m_count);
+		glBindVertexArray(0);
+
+		m_shader->unbind();
+
+		glDepthMask(depthMask);
+		if (blending)
+			glEnable(GL_BLEND);
+	}
+}
\ No newline at end of file
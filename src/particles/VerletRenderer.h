@@ -0,0 +1,61 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <memory>
+#include "glm/glm.hpp"
+
+
+namespace nhahn
+{
+	class Solver;
+	class GpuSolver;
+	class Shader;
+
+	/*
+	 * Draws the objects of a Verlet Solver as instanced circles. The solver arrays are
+	 * uploaded as they are, one vertex buffer per array with a divisor of one. The objects of
+	 * a GpuSolver are drawn straight from its storage buffers, nothing is uploaded then.
+	 */
+	class VerletRenderer
+	{
+	public:
+		VerletRenderer();
+		~VerletRenderer();
+
+		VerletRenderer(const VerletRenderer&) = delete;
+		VerletRenderer& operator=(const VerletRenderer&) = delete;
+
+		/* buffers are sized for capacity objects and grow when the solver holds more */
+		void generate(const Solver* solver, size_t capacity);
+		void generate(const GpuSolver* solver);
+		void destroy();
+		void update();
+		void render(const glm::mat4& modelViewMat, const glm::mat4& projMat);
+
+	protected:
+		void loadShader();
+		void allocateBuffers(size_t capacity);
+		void deleteBuffers();
+		void bindGpuBuffers();
+
+	protected:
+		const Solver* m_solver{ nullptr };
+		const GpuSolver* m_gpuSolver{ nullptr };
+		uint32_t m_gpuBufferGeneration{ 0 };
+		std::unique_ptr<Shader> m_shader;
+
+		size_t m_capacity{ 0 };
+		size_t m_count{ 0 };
+		unsigned int m_bufPosX{ 0 };
+		unsigned int m_bufPosY{ 0 };
+		unsigned int m_bufRadius{ 0 };
+		unsigned int m_bufCol{ 0 };
+		unsigned int m_vao{ 0 };
+	};
+}
\ No newline at end of file
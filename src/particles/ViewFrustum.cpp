@@ -0,0 +1,62 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "ViewFrustum.h"
+
+#include <cmath>
+#include <immintrin.h>
+
+
+namespace nhahn
+{
+	void ViewFrustum::set(const glm::mat4& viewProjMat)
+	{
+		// rows of the matrix, a point is inside when -w <= x, y, z <= w in clip space
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; ++r)
+			rows[r] = glm::vec4(viewProjMat[0][r], viewProjMat[1][r], viewProjMat[2][r], viewProjMat[3][r]);
+
+		const glm::vec4 planes[6] = {
+			rows[3] + rows[0], rows[3] - rows[0],	// left, right
+			rows[3] + rows[1], rows[3] - rows[1],	// bottom, top
+			rows[3] + rows[2], rows[3] - rows[2]	// near, far
+		};
+
+		for (int i = 0; i < 8; ++i)
+		{
+			const glm::vec4& plane = planes[i < 6 ? i : 5];
+			const float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+			const float scale = (length > 0.0f) ? 1.0f / length : 0.0f;
+			m_x[i] = plane.x * scale;
+			m_y[i] = plane.y * scale;
+			m_z[i] = plane.z * scale;
+			m_d[i] = plane.w * scale;
+		}
+	}
+
+	bool ViewFrustum::intersects(const glm::vec4& boundsMin, const glm::vec4& boundsMax, float margin) const
+	{
+		const __m128 zero = _mm_setzero_ps();
+
+		// the corner of the box farthest along each plane normal decides
+		int outside = 0;
+		for (int i = 0; i < 8; i += 4)
+		{
+			const __m128 nx = _mm_load_ps(m_x + i);
+			const __m128 ny = _mm_load_ps(m_y + i);
+			const __m128 nz = _mm_load_ps(m_z + i);
+			const __m128 px = _mm_blendv_ps(_mm_set1_ps(boundsMin.x - margin), _mm_set1_ps(boundsMax.x + margin), _mm_cmpge_ps(nx, zero));
+			const __m128 py = _mm_blendv_ps(_mm_set1_ps(boundsMin.y - margin), _mm_set1_ps(boundsMax.y + margin), _mm_cmpge_ps(ny, zero));
+			const __m128 pz = _mm_blendv_ps(_mm_set1_ps(boundsMin.z - margin), _mm_set1_ps(boundsMax.z + margin), _mm_cmpge_ps(nz, zero));
+
+			const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_add_ps(_mm_mul_ps(nz, pz), _mm_load_ps(m_d + i)));
+			outside |= _mm_movemask_ps(_mm_cmplt_ps(dist, zero));
+		}
+
+		return outside == 0;
+	}
+}
\ No newline at end of file
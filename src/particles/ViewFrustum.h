@@ -0,0 +1,43 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include "utility/Types.h"
+
+#ifndef GLM_FORCE_INTRINSICS
+#define GLM_FORCE_INTRINSICS
+#endif // !GLM_FORCE_INTRINSICS
+#include <glm/glm.hpp>
+
+
+namespace nhahn
+{
+	/*
+	 * The six planes of a camera's clip volume in world space, for culling particle bounds on the
+	 * cpu. Boxes are tested against all planes at once, four planes per SSE register.
+	 */
+	class ViewFrustum
+	{
+	public:
+		ViewFrustum() { }
+		explicit ViewFrustum(const glm::mat4& viewProjMat) { set(viewProjMat); }
+
+		/* planes of projection * view, normalized so the margins are in world units */
+		void set(const glm::mat4& viewProjMat);
+
+		/* false only if the box, grown by margin on every side, is completely outside one of the planes */
+		bool intersects(const glm::vec4& boundsMin, const glm::vec4& boundsMax, float margin = 0.0f) const;
+
+	private:
+		// normal x, y, z and distance of the planes, the last two lanes repeat the far plane
+		alignas(16) float m_x[8]{ };
+		alignas(16) float m_y[8]{ };
+		alignas(16) float m_z[8]{ };
+		alignas(16) float m_d[8]{ };
+	};
+}
\ No newline at end of file
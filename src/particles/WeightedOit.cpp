@@ -0,0 +1,79 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "WeightedOit.h"
+
+#include <string>
+#include "render/Shader.h"
+#include "render/Texture.h"
+#include "utility/Debug.h"
+#include "utility/FileSystem.h"
+
+
+namespace nhahn
+{
+	WeightedOit::WeightedOit() { }
+	WeightedOit::~WeightedOit() { destroy(); }
+
+	bool WeightedOit::generate(int width, int height)
+	{
+		ASSERT(width > 0 && height > 0, "WeightedOit: empty target size");
+		destroy();
+
+		// half floats overflow where a few hundred weighted particles overlap
+		m_accum = std::make_unique<Texture>(TEXTURE_2D, width, height);
+		m_accum->setFormat(TEXEL_FLOAT, 4, 4);
+		m_accum->init();
+
+		// one byte float texels are GL_R8, the product of the transparencies needs no more
+		m_revealage = std::make_unique<Texture>(TEXTURE_2D, width, height);
+		m_revealage->setFormat(TEXEL_FLOAT, 1, 1);
+		m_revealage->init();
+
+		std::string path = FileSystem::getModuleDirectory() + "data\\shaders\\";
+		m_compositeShader = std::make_unique<Shader>(path.c_str(), "common.inc", "quad.vert", nullptr, "oit_composite.frag", 1);
+
+		return true;
+	}
+
+	void WeightedOit::destroy()
+	{
+		m_compositeShader.reset();
+		m_revealage.reset();
+		m_accum.reset();
+	}
+
+	void WeightedOit::begin(RenderTarget& rt)
+	{
+		ASSERT(m_accum && m_revealage, "WeightedOit: targets are not generated");
+
+		rt.selectAttachmentList(2, rt.attachTextureAny(*m_accum), rt.attachTextureAny(*m_revealage));
+		const float clearAccum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		const float clearRevealage[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glClearBufferfv(GL_COLOR, 0, clearAccum);
+		glClearBufferfv(GL_COLOR, 1, clearRevealage);
+
+		glEnable(GL_BLEND);
+		glBlendFunci(0, GL_ONE, GL_ONE);
+		glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+	}
+
+	void WeightedOit::composite(RenderTarget& rt, RtAttachment dst)
+	{
+		rt.selectAttachmentList(1, dst);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		m_accum->bindAny();
+		m_revealage->bindAny();
+		m_compositeShader->bind();
+		m_compositeShader->setUniformI("accum", m_accum->boundUnit());
+		m_compositeShader->setUniformI("revealage", m_revealage->boundUnit());
+		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+		m_compositeShader->unbind();
+	}
+}
\ No newline at end of file
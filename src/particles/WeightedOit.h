@@ -0,0 +1,48 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <memory>
+#include "render/RenderTarget.h"
+
+
+namespace nhahn
+{
+	class Shader;
+	class Texture;
+
+	/*
+	 * Weighted blended order independent transparency (McGuire and Bavoil 2013). Every fragment adds
+	 * its premultiplied color, weighted by alpha and view depth, to an accumulation target and
+	 * multiplies its transparency into a revealage target. The composite divides the weights out and
+	 * blends the average color over the destination by the total coverage, so nothing is sorted.
+	 * particles.frag and billboards.frag write both targets while the program's oitPass is set.
+	 */
+	class WeightedOit
+	{
+	public:
+		WeightedOit();
+		~WeightedOit();
+
+		WeightedOit(const WeightedOit&) = delete;
+		WeightedOit& operator=(const WeightedOit&) = delete;
+
+		bool generate(int width, int height);
+		void destroy();
+
+		/* draws of rt go to the cleared accumulation and revealage targets until composite */
+		void begin(RenderTarget& rt);
+		/* blends the transparent layer over dst, an attachment of rt. Leaves blending enabled */
+		void composite(RenderTarget& rt, RtAttachment dst);
+
+	private:
+		std::unique_ptr<Texture> m_accum;		// rgb * alpha * weight, alpha * weight
+		std::unique_ptr<Texture> m_revealage;	// product of 1 - alpha
+		std::unique_ptr<Shader> m_compositeShader;
+	};
+}
\ No newline at end of file
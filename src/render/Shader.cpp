@@ -8,6 +8,7 @@
 #include "Shader.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <glm/gtc/type_ptr.hpp>
 #include "utility/Debug.h"
 #include "utility/FileSystem.h"
@@ -275,6 +276,8 @@ namespace nhahn
 
 		_uniformHash[_uniformCount] = hash;
 		_uniformLocation[_uniformCount] = glGetUniformLocation(_shaderID, name);
+		// uniforms start out as zero after linking, the cache has to agree or the first set may be skipped
+		memset(&_uniformVals[_uniformCount], 0, sizeof(UniformValue));
 		_uniformCount++;
 
 		return _uniformCount - 1;
@@ -0,0 +1,32 @@
+uniform sampler2D tex;
+uniform int oitPass;
+uniform int overdrawPass;
+
+in vec4 outColor;
+in vec2 texCoord;
+layout(location = 0) out vec4 vFragColor;
+layout(location = 1) out vec4 vFragRevealage;
+
+void main() 
+{
+	vec4 mask = texture(tex, texCoord);
+	if (overdrawPass != 0)
+	{
+		// counted by OverdrawCounter, transparent texels cost the same
+		vFragColor = vec4(1.0);
+		return;
+	}
+	if (oitPass != 0)
+	{
+		// accumulation and revealage of WeightedOit, blended like the sorted particles
+		float alpha = outColor.a * mask.r;
+		vFragColor = vec4(outColor.rgb * alpha, alpha) * oitWeight(alpha, 1.0 / gl_FragCoord.w);
+		vFragRevealage = vec4(alpha);
+		return;
+	}
+#ifdef SORTED_PARTICLES
+	vFragColor = vec4(outColor.rgb, outColor.a * mask.r);
+#else
+	vFragColor = vec4(outColor.rgb * mask.r, outColor.a);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+uniform mat4x4 modelViewMat;
+uniform mat4x4 projectionMat;
+uniform float quadSize;		// edge length in world units at a size scale of 1
+uniform float stretch;		// elongation along the velocity on screen per unit of speed
+
+layout(location = 0) in vec4 vVertex;	// per instance, w is the size scale
+layout(location = 1) in vec4 vColor;
+layout(location = 2) in vec4 vMotion;	// velocity in xyz, rotation angle in w
+layout(location = 3) in vec2 vCorner;	// of the shared quad, -0.5 to 0.5
+
+out vec4 outColor;
+out vec2 texCoord;
+
+void main() 
+{
+	vec4 eyePos = modelViewMat * vec4(vVertex.xyz, 1.0f);
+
+	// the quad faces the camera, its x axis is turned by the angle or follows the velocity on screen
+	vec2 axis = vec2(cos(vMotion.w), sin(vMotion.w));
+	float len = 1.0f;
+	vec2 eyeVel = (mat3(modelViewMat) * vMotion.xyz).xy;
+	float speed = length(eyeVel);
+	if (stretch > 0.0f && speed > 1e-5f)
+	{
+		axis = eyeVel / speed;
+		len += stretch * speed;
+	}
+
+	vec2 corner = vCorner * quadSize * vVertex.w;
+	corner.x *= len;
+	eyePos.xy += axis * corner.x + vec2(-axis.y, axis.x) * corner.y;
+	gl_Position = projectionMat * eyePos;
+
+	outColor = vColor;
+	texCoord = vCorner + 0.5f;
+}
\ No newline at end of file
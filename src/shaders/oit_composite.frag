@@ -0,0 +1,17 @@
+uniform sampler2D accum;
+uniform sampler2D revealage;
+
+in vec2 vCoord;
+out vec4 FragColor0;
+
+void main()
+{
+	float reveal = texture(revealage, vCoord).r;
+	if (reveal >= 1.0)
+		discard;
+
+	// the weighted average color, covering by the accumulated opacity
+	vec4 sum = texture(accum, vCoord);
+	vec3 average = sum.rgb / clamp(sum.a, 1e-5, 5e4);
+	FragColor0 = vec4(average, 1.0 - reveal);
+}
\ No newline at end of file
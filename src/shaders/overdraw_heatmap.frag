@@ -0,0 +1,20 @@
+uniform sampler2D counts;
+uniform float maxCount;
+
+in vec2 vCoord;
+out vec4 FragColor0;
+
+void main()
+{
+	float count = texture(counts, vCoord).r;
+	if (count <= 0.0)
+	{
+		FragColor0 = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+
+	// logarithmic from blue for a single layer over red and yellow to white at the busiest pixel
+	float t = log(1.0 + count) / log(1.0 + maxCount);
+	vec3 heat = vec3(clamp(3.0 * t - 0.5, 0.0, 1.0), clamp(3.0 * t - 1.5, 0.0, 1.0), clamp(1.0 - 3.0 * t, 0.0, 1.0) + clamp(3.0 * t - 2.0, 0.0, 1.0));
+	FragColor0 = vec4(max(heat, vec3(0.15, 0.15, 0.4)), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+// runs the updaters of particle_update.inc on one particle of the FeedbackParticleSystem, the
+// attribute locations follow FeedbackParticleSystem::Vertex
+layout(location = 0) in vec4 inPos;
+layout(location = 1) in vec4 inCol;
+layout(location = 2) in vec4 inStartCol;
+layout(location = 3) in vec4 inEndCol;
+layout(location = 4) in vec4 inVel;
+layout(location = 5) in vec4 inTime;
+
+out vec4 vPos;
+out vec4 vCol;
+out vec4 vStartCol;
+out vec4 vEndCol;
+out vec4 vVel;
+out vec4 vTime;
+flat out int vAlive;
+
+void main()
+{
+	vPos = inPos;
+	vCol = inCol;
+	vVel = inVel;
+	vTime = inTime;
+	vStartCol = inStartCol;
+	vEndCol = inEndCol;
+
+	vAlive = updateParticle(vPos, vVel, vCol, vTime, inStartCol, inEndCol) ? 1 : 0;
+}
\ No newline at end of file
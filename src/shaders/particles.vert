@@ -8,12 +8,35 @@ out vec4 outColor;
 
 void main() 
 {
-    vec4 eyePos = modelViewMat * gl_Vertex;
+#ifdef ANALYTIC_PARTICLES
+	// the attribute is the spawn record, see particles_analytic.inc
+	vec4 vertexPos, vertexColor;
+	if (!evaluateParticle(uint(gl_VertexID), vVertex, vertexPos, vertexColor))
+	{
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);	// outside of the clip volume
+		gl_PointSize = 0.0;
+		return;
+	}
+#elif defined(AGE_SEED_PARTICLES)
+	// the color attribute holds age and seed, see particles_age.inc
+	vec4 vertexPos, vertexColor;
+	ageSeedParticle(vVertex, vColor.xy, vertexPos, vertexColor);
+#elif defined(QUANTIZED_PARTICLES)
+	// positions may be half or 16 bit normalized, see particles_quantized.inc
+	vec4 vertexPos = decodePosition(vVertex);
+	vec4 vertexColor = vColor;
+#else
+	vec4 vertexPos = vVertex;
+	vec4 vertexColor = vColor;
+#endif
+
+    // w of the particle position is the size scale
+    vec4 eyePos = modelViewMat * vec4(vertexPos.xyz, 1.0f);
     gl_Position = projectionMat * eyePos;
 
-	outColor = vColor;
+	outColor = vertexColor;
 
 	float dist = length(eyePos.xyz);
 	float att = inversesqrt(0.5f*dist);
-	gl_PointSize = 2.0f * att;
+	gl_PointSize = 2.0f * att * vertexPos.w;
 }
\ No newline at end of file
@@ -0,0 +1,16 @@
+in vec2 outCorner;
+in vec4 outColor;
+layout(location = 0) out vec4 vFragColor;
+layout(location = 1) out vec4 vFragRevealage;
+
+void main() 
+{
+	float dist2 = dot(outCorner, outCorner);
+	if (dist2 > 1.0f)
+		discard;
+
+	// darker rim so touching circles stay distinguishable
+	vFragColor = vec4(outColor.rgb * (1.0f - 0.35f * dist2 * dist2), outColor.a);
+	// drawn without blending, covers everything in the revealage target of WeightedOit
+	vFragRevealage = vec4(0.0f);
+}
\ No newline at end of file
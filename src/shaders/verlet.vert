@@ -0,0 +1,20 @@
+uniform mat4x4 modelViewMat;
+uniform mat4x4 projectionMat;
+
+// one instance per solver object, the quad corners come from gl_VertexID
+layout(location = 0) in float vPosX;
+layout(location = 1) in float vPosY;
+layout(location = 2) in float vRadius;
+layout(location = 3) in vec4 vColor;
+
+out vec2 outCorner;
+out vec4 outColor;
+
+void main() 
+{
+	outCorner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0f - 1.0f;
+	outColor = vColor;
+
+	vec2 pos = vec2(vPosX, vPosY) + outCorner * vRadius;
+	gl_Position = projectionMat * (modelViewMat * vec4(pos, 0.0f, 1.0f));
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+
+namespace nhahn
+{
+    // how the SceneView blends the particles, picked in the PropertyPanel
+    enum class BlendMode { ADDITIVE = 0, WEIGHTED_OIT, COUNT };
+    inline const char* const BLEND_MODE_NAMES[(int)BlendMode::COUNT] = { "additive", "weighted oit" };
+}
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <memory>
 #include "imgui.h"
 #include "ui/IconFontDefines.h"
+#include "ui/CustomWidgets.h"
+#include "particles/Benchmark.h"
 #include "utility/Debug.h"
 
 
@@ -34,6 +36,18 @@ namespace nhahn
         DBG("PropertyPanel", DebugLevel::DEBUG, "changed onEffectSwitch callback\n");
     }
 
+    void PropertyPanel::setBlendModeChangedCallback(std::function<void(BlendMode)> func)
+    {
+        _blendModeChangedCB = func;
+        DBG("PropertyPanel", DebugLevel::DEBUG, "changed onBlendModeChange callback\n");
+    }
+
+    void PropertyPanel::setOverdrawChangedCallback(std::function<void(bool)> func)
+    {
+        _overdrawChangedCB = func;
+        DBG("PropertyPanel", DebugLevel::DEBUG, "changed onOverdrawChange callback\n");
+    }
+
     void PropertyPanel::render()
     {
         ImGui::SetNextWindowPos(ImGui::GetCursorScreenPos(), ImGuiCond_FirstUseEver);
@@ -68,7 +82,71 @@ namespace nhahn
             }
             ImGui::PopItemWidth();
 
+            int blendMode = (int)_blendMode;
+            if (ImGui::Combo("blending", &blendMode, BLEND_MODE_NAMES, (int)BlendMode::COUNT))
+            {
+                _blendMode = (BlendMode)blendMode;
+                if (_blendModeChangedCB)
+                    _blendModeChangedCB(_blendMode);
+            }
+            ImGui::SameLine(); ImGui::HelpMarker("Additive blending suits glowing effects. Weighted blended transparency alpha blends smoke-like ones without sorting: every particle adds its color weighted by opacity and view distance, a composite pass averages them. Approximates the depth sort, exact where the overlapping particles share a color.");
+
+            if (ImGui::Checkbox("overdraw heatmap", &_overdrawView))
+            {
+                if (_overdrawChangedCB)
+                    _overdrawChangedCB(_overdrawView);
+            }
+            ImGui::SameLine(); ImGui::HelpMarker("Counts the fragments the particles shade per pixel and shows them from blue, a single layer, to white at the busiest pixel. The overlay lists the fragments per pixel of the view and of the covered part. Reads the counts back every frame, which costs a stall.");
+
             _effectMap[_currEffKey]->renderUI();
+
+            ImGui::NewLine();
+            if (ImGui::CollapsingHeader(ICON_MDI_SPEEDOMETER " Benchmarks"))
+            {
+                ImGui::TextWrapped("Runs block the application for a few seconds.");
+
+                if (ImGui::Button("integrators"))
+                    Benchmark::runIntegrators();
+                ImGui::SameLine();
+                if (ImGui::Button("solver broadphase"))
+                    Benchmark::runSolverBroadphase();
+                ImGui::SameLine();
+                if (ImGui::Button("solver scaling"))
+                    Benchmark::runSolverScaling();
+                ImGui::SameLine();
+                if (ImGui::Button("solver sleeping"))
+                    Benchmark::runSolverSleeping();
+                ImGui::SameLine();
+                if (ImGui::Button("solver cloth"))
+                    Benchmark::runSolverCloth();
+                ImGui::SameLine();
+                if (ImGui::Button("gpu solver"))
+                    Benchmark::runSolverGpu();
+                ImGui::SameLine();
+                if (ImGui::Button("gpu particles"))
+                    Benchmark::runParticlesGpu();
+                ImGui::SameLine();
+                if (ImGui::Button("renderers"))
+                    Benchmark::runRenderers();
+                ImGui::SameLine();
+                if (ImGui::Button("vertex pack"))
+                    Benchmark::runVertexPack();
+                ImGui::SameLine();
+                if (ImGui::Button("quads"))
+                    Benchmark::runQuads();
+                ImGui::SameLine();
+                if (ImGui::Button("depth sort"))
+                    Benchmark::runDepthSort();
+                ImGui::SameLine();
+                if (ImGui::Button("transparency"))
+                    Benchmark::runTransparency();
+                ImGui::SameLine();
+                if (ImGui::Button("clear"))
+                    Benchmark::clearResults();
+
+                for (const std::string& line : Benchmark::results())
+                    ImGui::TextUnformatted(line.c_str());
+            }
         }
         ImGui::End();
     }
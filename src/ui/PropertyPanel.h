@@ -12,6 +12,7 @@
 #include <functional>
 #include "glm/glm.hpp"
 #include "particles/Effect.h"
+#include "ui/BlendMode.h"
 
 
 namespace nhahn
@@ -29,12 +30,18 @@ namespace nhahn
 
         void addEffect(std::string name, std::shared_ptr<IEffect> eff);
         void setEffectSwitchedCallback(std::function<void(std::shared_ptr<IEffect>)> func);
+        void setBlendModeChangedCallback(std::function<void(BlendMode)> func);
+        void setOverdrawChangedCallback(std::function<void(bool)> func);
 
     protected:
         MapOfEffects _effectMap;
         std::string _currEffKey;
+        BlendMode _blendMode = BlendMode::ADDITIVE;
+        bool _overdrawView = false;
 
     private:
         std::function<void(std::shared_ptr<IEffect>)> _effectSwitchedCB = {};
+        std::function<void(BlendMode)> _blendModeChangedCB = {};
+        std::function<void(bool)> _overdrawChangedCB = {};
     };
 }
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include "render/BufferObject.h"
 #include "particles/ParticleRenderer.h"
 #include "particles/Effect.h"
+#include "particles/ViewFrustum.h"
 #include "utility/FileSystem.h"
 #include "utility/Debug.h"
 #include "utility/Utils.h"
@@ -101,6 +102,12 @@ namespace nhahn
         _particleTex->copy(textureData);
         delete[] textureData;
 
+        // targets of the transparent particles, the size of the screen texture
+        _oit = std::make_unique<WeightedOit>();
+        _oit->generate(_srcSize.x, _srcSize.y);
+        _overdraw = std::make_unique<OverdrawCounter>();
+        _overdraw->generate(_srcSize.x, _srcSize.y);
+
         _currentEffect = nullptr;
 
         DBG("SceneView", DebugLevel::DEBUG, "Texture memory usage: %dmb\n", (int)(Texture::memoryUsage() / (1024 * 1024)));
@@ -112,6 +119,8 @@ namespace nhahn
         _quadProg.reset();
         _particleProg.reset();
         _particleTex.reset();
+        _oit.reset();
+        _overdraw.reset();
 
         _rt.reset();
     }
@@ -141,6 +150,7 @@ namespace nhahn
         // camera
         updateCamera(dt);
         glm::mat4 projMat = glm::perspective(glm::radians(54.0f), (float)_screenSize.x / (float)_screenSize.y, 0.1f, 100.0f);
+        glm::mat4 viewMat = _cam->getViewMatrix();
 
         // render source textures to screen texture
         _rt->bind();
@@ -155,26 +165,58 @@ namespace nhahn
         _quadProg->unbind();
 
         // render particles to screen texture
+        ScenePass pass;
         if (_currentEffect)
         {
             _currentEffect->update(dt);
             _currentEffect->cpuUpdate(dt);
-            _currentEffect->gpuUpdate(dt);
 
+            // before the upload, renderers with chunk culling only upload what this view sees
             _particleTex->bindAny();
-            _rt->selectAttachmentList(1, _rt->attachTextureAny(*_screen));
+            pass.viewMat = viewMat;
+            pass.projMat = projMat;
+            pass.viewportSize = glm::ivec2(_srcSize);
+            pass.texUnit = _particleTex->boundUnit();
+            pass.weightedOit = !_overdrawView && (_blendMode == BlendMode::WEIGHTED_OIT);
+            pass.overdraw = _overdrawView;
+            _currentEffect->setView(pass);
+
+            glm::vec4 boundsMin, boundsMax;
+            _effectCulled = _currentEffect->bounds(boundsMin, boundsMax) && !ViewFrustum(projMat * viewMat).intersects(boundsMin, boundsMax);
+        }
+        if (_currentEffect && !_effectCulled)
+        {
+            _currentEffect->gpuUpdate(dt);
+
+            // the gpu update may have bound other textures, the effect expects the unit of the pass
+            _particleTex->bind(pass.texUnit);
+            if (_overdrawView)
+                _overdraw->begin(*_rt);
+            else if (pass.weightedOit)
+                _oit->begin(*_rt);
+            else
+                _rt->selectAttachmentList(1, _rt->attachTextureAny(*_screen));
             glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_TRUE);
             glPointParameteri(GL_POINT_SPRITE_COORD_ORIGIN, GL_LOWER_LEFT);
             glPointSize(40.0f);
             glEnable(GL_POINT_SPRITE);
             glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
             _particleProg->bind();
-            _particleProg->setUniformI("tex", _particleTex->boundUnit());
-            _particleProg->setUniformMat("modelViewMat", _cam->getViewMatrix(), false);
+            _particleProg->setUniformI("tex", pass.texUnit);
+            _particleProg->setUniformMat("modelViewMat", viewMat, false);
             _particleProg->setUniformMat("projectionMat", projMat, false);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+            _particleProg->setUniformI("oitPass", pass.weightedOit ? 1 : 0);
+            _particleProg->setUniformI("overdrawPass", pass.overdraw ? 1 : 0);
+            if (!pass.ownsBlending())
+            {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+            }
             _currentEffect->render();
+            if (_overdrawView)
+                _overdraw->resolve(*_rt, _rt->attachTextureAny(*_screen));
+            else if (pass.weightedOit)
+                _oit->composite(*_rt, _rt->attachTextureAny(*_screen));
             glDisable(GL_BLEND);
             _particleProg->unbind();
         }  
@@ -189,9 +231,17 @@ namespace nhahn
 
         // add stats info
         {
-            char statsLabel[64];
-            snprintf(statsLabel, sizeof statsLabel, ICON_MDI_POUND ICON_MDI_SHIMMER " : %i | " ICON_MDI_SPEEDOMETER " : %i fps",
-                (_currentEffect) ? _currentEffect->numAllParticles() : 0, _currentFPS);
+            char overdrawLabel[96] = "";
+            if (_overdrawView)
+            {
+                const OverdrawStats& od = _overdraw->stats();
+                snprintf(overdrawLabel, sizeof overdrawLabel, "\n%.2fx overdraw, %.1fx where covered (%.0f%%), max %.0f",
+                    od.overdraw, od.coveredOverdraw, (od.pixels > 0) ? 100.0 * od.coveredPixels / od.pixels : 0.0, od.maxCount);
+            }
+
+            char statsLabel[160];
+            snprintf(statsLabel, sizeof statsLabel, ICON_MDI_POUND ICON_MDI_SHIMMER " : %i%s | " ICON_MDI_SPEEDOMETER " : %i fps%s",
+                (_currentEffect) ? _currentEffect->numAllParticles() : 0, (_currentEffect && _effectCulled) ? " (culled)" : "", _currentFPS, overdrawLabel);
             ImVec2 labelSize = ImGui::CalcTextSize(statsLabel);
 
             ImGuiWindowFlags statsInfo_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoDocking
@@ -217,7 +267,7 @@ namespace nhahn
 
             if (ImGui::BeginChild("StatsInfo", statsInfo_size, true, statsInfo_flags))
             {
-                ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 1), statsLabel);
+                ImGui::TextColored(ImVec4(0.7f, 0.7f, 0.7f, 1), "%s", statsLabel);
             }
             ImGui::PopStyleVar(2);
             ImGui::EndChild();
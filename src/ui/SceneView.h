@@ -12,6 +12,9 @@
 #include "render/Shader.h"
 #include "render/Texture.h"
 #include "render/RenderTarget.h"
+#include "particles/OverdrawCounter.h"
+#include "particles/WeightedOit.h"
+#include "ui/BlendMode.h"
 
 
 namespace nhahn
@@ -56,6 +59,14 @@ namespace nhahn
 
         void setEffect(IEffect* effect) { _currentEffect = effect; }
 
+        // additive suits glowing effects, weighted blended transparency smoke-like ones without a sort
+        void setBlendMode(BlendMode mode) { _blendMode = mode; }
+        BlendMode blendMode() const { return _blendMode; }
+
+        // shows the fragments per pixel of the particles as a heatmap instead of their colors
+        void setOverdrawView(bool enabled) { _overdrawView = enabled; }
+        bool overdrawView() const { return _overdrawView; }
+
     private:
         void updateCamera(double dt);
 
@@ -73,7 +84,12 @@ namespace nhahn
 
         std::unique_ptr<Shader> _particleProg;
         std::unique_ptr<Texture> _particleTex;
+        std::unique_ptr<WeightedOit> _oit;
+        BlendMode _blendMode = BlendMode::ADDITIVE;
+        std::unique_ptr<OverdrawCounter> _overdraw;
+        bool _overdrawView = false;
 
         IEffect* _currentEffect = nullptr;
+        bool _effectCulled = false;     // bounds of the effect were outside the view last frame
     };
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "FileSystem.h"
+#include <algorithm>
 #include <sys/stat.h>
 #include "Debug.h"
 
@@ -198,6 +199,85 @@ namespace nhahn
 		return "";
 	}
 
+	bool FileSystem::mapFile(const char* filepath, MappedFile* file)
+	{
+		HANDLE hFile = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+		if (hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+		{
+			CloseHandle(hFile);
+			return false;
+		}
+
+		HANDLE hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hMap == NULL)
+		{
+			CloseHandle(hFile);
+			return false;
+		}
+
+		const void* data = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+		if (data == nullptr)
+		{
+			CloseHandle(hMap);
+			CloseHandle(hFile);
+			return false;
+		}
+
+		file->data = data;
+		file->size = (size_t)size.QuadPart;
+		file->fileHandle = hFile;
+		file->mapHandle = hMap;
+		return true;
+	}
+
+	void FileSystem::unmapFile(MappedFile* file)
+	{
+		if (file->data)
+			UnmapViewOfFile(file->data);
+		if (file->mapHandle)
+			CloseHandle((HANDLE)file->mapHandle);
+		if (file->fileHandle)
+			CloseHandle((HANDLE)file->fileHandle);
+
+		*file = MappedFile{};
+	}
+
+	void FileSystem::prefetchMappedRange(const MappedFile* file, size_t offset, size_t size)
+	{
+		if (!file->data || offset >= file->size)
+			return;
+
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = (char*)file->data + offset;
+		range.NumberOfBytes = std::min(size, file->size - offset);
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+
+	void FileSystem::evictMappedRange(const MappedFile* file, size_t offset, size_t size)
+	{
+		if (!file->data || offset >= file->size)
+			return;
+
+		// only the pages completely inside the range, the ones at its ends are shared with the neighbours
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		const size_t pageSize = (size_t)info.dwPageSize;
+		const size_t first = (offset + pageSize - 1) & ~(pageSize - 1);
+		const size_t end = std::min(offset + size, file->size);
+		const size_t last = (end == file->size) ? end : end & ~(pageSize - 1);
+		if (last <= first)
+			return;
+
+		// unlocking pages that are not locked removes them from the working set. They move to the standby
+		// list and stay cached until the memory is needed elsewhere, so this only makes them cheap to reclaim
+		VirtualUnlock((char*)file->data + first, last - first);
+	}
+
 	std::string FileSystem::getModuleDirectory()
 	{
 		if (_cachedModulePath.empty())
@@ -226,6 +306,7 @@ namespace nhahn
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <ctime>
 
 
@@ -260,6 +341,82 @@ namespace nhahn
 		return "";
 	}
 
+	bool FileSystem::mapFile(const char* filepath, MappedFile* file)
+	{
+		int fd = open(filepath, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat attr;
+		if (fstat(fd, &attr) != 0 || attr.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		void* data = mmap(nullptr, (size_t)attr.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED)
+			return false;
+
+		file->data = data;
+		file->size = (size_t)attr.st_size;
+		file->fileHandle = nullptr;
+		file->mapHandle = nullptr;
+		return true;
+	}
+
+	void FileSystem::unmapFile(MappedFile* file)
+	{
+		if (file->data)
+			munmap(const_cast<void*>(file->data), file->size);
+
+		*file = MappedFile{};
+	}
+
+	static void pageAlignedRange(const MappedFile* file, size_t offset, size_t size, char** begin, size_t* length)
+	{
+		const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		const size_t first = offset & ~(pageSize - 1);
+		const size_t last = std::min(offset + size, file->size);
+
+		*begin = (char*)file->data + first;
+		*length = last - first;
+	}
+
+	// only the pages that lie completely inside the range, the ones at its ends are shared with the neighbours
+	static void innerPageRange(const MappedFile* file, size_t offset, size_t size, char** begin, size_t* length)
+	{
+		const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		const size_t first = (offset + pageSize - 1) & ~(pageSize - 1);
+		const size_t end = std::min(offset + size, file->size);
+		const size_t last = (end == file->size) ? end : end & ~(pageSize - 1);
+
+		*begin = (char*)file->data + first;
+		*length = (last > first) ? last - first : 0;
+	}
+
+	void FileSystem::prefetchMappedRange(const MappedFile* file, size_t offset, size_t size)
+	{
+		if (!file->data || offset >= file->size)
+			return;
+
+		char* begin; size_t length;
+		pageAlignedRange(file, offset, size, &begin, &length);
+		madvise(begin, length, MADV_WILLNEED);
+	}
+
+	void FileSystem::evictMappedRange(const MappedFile* file, size_t offset, size_t size)
+	{
+		if (!file->data || offset >= file->size)
+			return;
+
+		char* begin; size_t length;
+		innerPageRange(file, offset, size, &begin, &length);
+		if (length > 0)
+			madvise(begin, length, MADV_DONTNEED);
+	}
+
 	std::string FileSystem::getModuleDirectory()
 	{
 		char szDir[MAX_PATH] = { 0 };
@@ -13,6 +13,15 @@
 
 namespace nhahn
 {
+	/** Read-only view of a file mapped into the address space. */
+	struct MappedFile
+	{
+		const void* data = nullptr;
+		size_t size = 0;
+		void* fileHandle = nullptr;
+		void* mapHandle = nullptr;
+	};
+
 	class FileSystem
 	{
 	public:
@@ -21,6 +30,15 @@ namespace nhahn
 		static char* readBinaryFile(const char* filepath);
 		static void writeBinaryFile(const char* filepath, char* data, unsigned long size);
 
+		/** Map a whole file read-only, pages are loaded lazily by the os on first access. */
+		static bool mapFile(const char* filepath, MappedFile* file);
+		static void unmapFile(MappedFile* file);
+		/** Hint the os to start reading a range of a mapped file in, returns immediately. */
+		static void prefetchMappedRange(const MappedFile* file, size_t offset, size_t size);
+		/** Tell the os a range of a mapped file is no longer needed. Advisory: the pages leave the process,
+		 *  but the os keeps them cached until it needs the memory, nothing is freed right away. */
+		static void evictMappedRange(const MappedFile* file, size_t offset, size_t size);
+
 		static void* loadImageFile(const char* filepath, int* w, int* h,
 			int* channels, int desired_channels);
 
@@ -0,0 +1,119 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#include "JobSystem.h"
+
+#include <algorithm>
+#include "Debug.h"
+
+
+namespace nhahn
+{
+	JobSystem& JobSystem::instance()
+	{
+		static JobSystem s_instance(std::max(1u, std::thread::hardware_concurrency()));
+		return s_instance;
+	}
+
+	JobSystem::JobSystem(uint32_t threadCount)
+	{
+		threadCount = std::max(1u, threadCount);
+		m_activeThreads.store(threadCount, std::memory_order_relaxed);
+
+		for (uint32_t i = 0; i + 1 < threadCount; ++i)
+			m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+
+		DBG("JobSystem", DebugLevel::DEBUG, "started %d worker threads\n", (int)m_workers.size());
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wakeUp.notify_all();
+
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	void JobSystem::setActiveThreads(uint32_t count)
+	{
+		std::lock_guard<std::mutex> lock(m_callMutex);
+		m_activeThreads.store(std::clamp(count, 1u, threadCount()), std::memory_order_relaxed);
+	}
+
+	void JobSystem::parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& func)
+	{
+		chunkSize = std::max<size_t>(1, chunkSize);
+
+		std::lock_guard<std::mutex> callLock(m_callMutex);
+
+		const uint32_t activeThreads = m_activeThreads.load(std::memory_order_relaxed);
+		if (activeThreads == 1 || count < 2 * chunkSize)
+		{
+			func(0, count);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_func = &func;
+			m_count = count;
+			m_chunkSize = chunkSize;
+			m_next.store(0, std::memory_order_relaxed);
+			m_jobWorkers = activeThreads - 1;
+			m_working = m_jobWorkers;
+			m_generation++;
+		}
+		m_wakeUp.notify_all();
+
+		runChunks();
+
+		// the workers still reference func, wait for all of them
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_finished.wait(lock, [this] { return m_working == 0; });
+		m_jobWorkers = 0;
+		m_func = nullptr;
+	}
+
+	void JobSystem::runChunks()
+	{
+		size_t begin;
+		while ((begin = m_next.fetch_add(m_chunkSize, std::memory_order_relaxed)) < m_count)
+			(*m_func)(begin, std::min(begin + m_chunkSize, m_count));
+	}
+
+	void JobSystem::workerLoop(uint32_t index)
+	{
+		uint64_t seenGeneration = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				// inactive workers sleep through the jobs. The job's own worker count is used, it drops to 0
+				// once the job is done, so a wakeup after that never joins a finished job or miscounts m_working
+				m_wakeUp.wait(lock, [this, index, seenGeneration] {
+					return m_quit || (m_generation != seenGeneration && index < m_jobWorkers);
+				});
+				if (m_quit)
+					return;
+				seenGeneration = m_generation;
+			}
+
+			runChunks();
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_working--;
+			}
+			m_finished.notify_one();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+/*------------------------------------------------------------------------------------------------*\
+| ogl-particles
+|
+| Copyright (c) 2023 MisterRooster (github.com/MisterRooster). All rights reserved.
+| Licensed under the MIT license. See LICENSE file for full terms.
+| This notice is not to be removed.
+\*------------------------------------------------------------------------------------------------*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace nhahn
+{
+	/** Fixed pool of worker threads, the thread calling parallelFor works on the range as well. */
+	class JobSystem
+	{
+	public:
+		/** Pool shared by the whole application, one thread per hardware thread. */
+		static JobSystem& instance();
+
+		explicit JobSystem(uint32_t threadCount);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		/**
+		 * Calls func(begin, end) for chunks of [0, count) on all active threads and returns once
+		 * every chunk is done. Ranges smaller than two chunks run on the calling thread only.
+		 * Calls from several threads are serialized, calling it from inside func is not supported.
+		 */
+		void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& func);
+
+		/** Threads taking part in parallelFor including the caller, used by the scaling benchmarks. */
+		void setActiveThreads(uint32_t count);
+		uint32_t activeThreads() const { return m_activeThreads.load(std::memory_order_relaxed); }
+		uint32_t threadCount() const { return (uint32_t)m_workers.size() + 1; }
+
+	private:
+		void workerLoop(uint32_t index);
+		void runChunks();
+
+	private:
+		std::vector<std::thread> m_workers;
+		std::mutex m_callMutex;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wakeUp;
+		std::condition_variable m_finished;
+		uint64_t m_generation{ 0 };
+		uint32_t m_jobWorkers{ 0 };	// workers taking part in the running job, 0 between jobs
+		uint32_t m_working{ 0 };
+		bool m_quit{ false };
+
+		const std::function<void(size_t, size_t)>* m_func{ nullptr };
+		std::atomic<size_t> m_next{ 0 };
+		size_t m_count{ 0 };
+		size_t m_chunkSize{ 1 };
+		std::atomic<uint32_t> m_activeThreads{ 1 };	// only changed under m_callMutex, jobs copy it to m_jobWorkers
+	};
+}
\ No newline at end of file